@@ -23,8 +23,47 @@
   6. **Access the Camera Stream**:
      - Open a web browser and type in the IP address you noted earlier. This will open the camera's web interface where you can view the video stream.
 
+  7. **Culture Density**:
+     - http://<IP>/density returns the optical density and color of the culture on a window of the frame, in JSON:
+       mean luminance and channels, green ratio G / (R + G + B), optical density against the blank, and the
+       luminance histogram (see culture_density.h).
+     - Arguments: x, y, w and h set the window, in thousandths of the frame (default the centre quarter:
+       x=250&y=250&w=500&h=500); blank=1 takes the current frame as the blank (the vessel with the medium, no cells).
+     - The sketch also pushes the measurement to the web server every 30 seconds (POST /camera_data), as the
+       culture_density channel.
+     - tools/density_bench.cpp checks and times the kernels on a computer.
+
+  8. **Mixing Verification**:
+     - A low-priority task takes a frame every 500 ms, unlit, decodes it at low resolution and compares a grid of
+       block means of a window (default the centre 70%) with the previous frame (see mixing_monitor.h). The
+       difference of a stirred culture is learnt during the first 30 seconds as a rolling baseline; the camera
+       flags "no_motion" when the frames stay still for 10 seconds (stirrer stopped) and "foam_surge" when they
+       change far more than the baseline for 2 seconds (foam or a burst of bubbles), then "mixing_normal".
+     - The events are posted to the ESP32 bridge (bridgeEventUrl, POST /camera_event), which forwards them to the
+       web server with the events of the Mega.
+     - http://<IP>/mixing returns the state, the last score and the baseline in JSON. Arguments: x, y, w and h set
+       the window, in thousandths of the frame; relearn=1 learns the baseline again, after changing the stirring
+       speed.
+     - tools/mixing_bench.cpp runs the detection on synthetic frames and times it on a computer.
+
+  9. **Adaptive Stream**:
+     - While the stream runs, the camera measures every frame (waiting for the sensor, encoding, size) and every send
+       to each client, and once per second picks the frame size and JPEG quality (from SVGA down to QQVGA) that the
+       slowest client's link and the bandwidth cap can carry at the target frame rate (see stream_controller.h). It
+       steps down within 2 seconds of a weak link and back up a level at a time, and captures no faster than the
+       target, 15 fps by default.
+     - http://<IP>/status includes the level and the metrics of the last second (stream_fps, stream_frame_bytes,
+       stream_encode_ms, stream_send_ms, stream_link_kbps, stream_kbps, ...).
+     - http://<IP>/control?var=stream_fps&val=10 sets the target frame rate, var=stream_kbps the bandwidth cap in
+       kbit/s (0 for none). Setting the resolution, the quality or a window by hand turns the adaptation off;
+       var=stream_auto&val=1 turns it back on.
+     - tools/controller_bench.cpp runs the controller against a simulated camera and link on a computer.
+
   **Important Note**:
-     - The ESP32-CAM supports only a single video stream at a time. This means you can view the stream on only one tab in one browser at any given moment. Opening multiple tabs or browsers will not work and could cause the stream to stop.
+     - Up to 4 clients can view the stream at once (http://<IP>:81/stream). Each frame is captured and encoded once and
+       sent to every client from the same buffer (see frame_pool.h); a client on a slow link gets fewer frames, without
+       slowing down the others. A fifth client is refused until one of them closes its tab.
+     - tools/stream_bench.cpp checks the shared frames with clients of different speeds on a computer.
 
   **Troubleshooting**:
      - If you do not see the IP address in the Serial Monitor, ensure that your Wi-Fi credentials in the code are correct and that your router is functioning properly.
@@ -36,7 +75,10 @@
 
 #include "esp_camera.h"
 #include <WiFi.h>
+#include <HTTPClient.h>
+#include <time.h>
 #include "config.h"
+#include "culture_density.h"
 
 //
 // WARNING!!! PSRAM IC required for UXGA resolution and high JPEG quality
@@ -44,8 +86,7 @@
 //            Partial images will be transmitted if image exceeds buffer size
 //
 //            You must select partition scheme from the board menu that has at least 3MB APP space.
-//            Face Recognition is DISABLED for ESP32 and ESP32-S2, because it takes up from 15
-//            seconds to process single frame. Face Detection is ENABLED if PSRAM is enabled as well
+//            The culture density decodes the JPEG frames at up to 400 pixels wide, in PSRAM as well
 
 // ===================
 // Select camera model
@@ -72,6 +113,19 @@
 
 void startCameraServer();
 void setupLedFlash(int pin);
+bool measure_culture_density(density_result_t *result, density_window_t *window);
+bool sample_mixing(char *event, size_t size);
+
+// Culture density pushed to the web server as a sensor channel
+const char cameraDataUrl[] = "http://192.168.1.25:8000/camera_data";
+const unsigned long densityPushInterval = 30000;  // ms, the sampling interval of the Mega
+const uint16_t httpTimeout = 3000;
+
+// Mixing events posted to the ESP32 bridge (its address is printed on its serial monitor)
+const char bridgeEventUrl[] = "http://192.168.1.30/camera_event";
+const unsigned long mixingFrameInterval = 500;  // ms between two frames compared, as the defaults of mixing_monitor.h
+const unsigned long mixingMinIdle = 100;        // ms the task yields at least after each frame
+const uint32_t mixingTaskStack = 6144;
 
 void setup() {
   Serial.begin(115200);
@@ -100,7 +154,7 @@ void setup() {
   config.xclk_freq_hz = 20000000;
   config.frame_size = FRAMESIZE_UXGA;
   config.pixel_format = PIXFORMAT_JPEG;  // for streaming
-  //config.pixel_format = PIXFORMAT_RGB565; // for face detection/recognition
+  //config.pixel_format = PIXFORMAT_RGB565; // for the culture density without JPEG decoding
   config.grab_mode = CAMERA_GRAB_WHEN_EMPTY;
   config.fb_location = CAMERA_FB_IN_PSRAM;
   config.jpeg_quality = 12;
@@ -119,7 +173,7 @@ void setup() {
       config.fb_location = CAMERA_FB_IN_DRAM;
     }
   } else {
-    // Best option for face detection/recognition
+    // RGB565 frames are read as they are by the culture density
     config.frame_size = FRAMESIZE_240X240;
 #if CONFIG_IDF_TARGET_ESP32S3
     config.fb_count = 2;
@@ -174,14 +228,91 @@ void setup() {
   Serial.println("");
   Serial.println("WiFi connected");
 
+  // UTC time of the measurements, set in the background
+  configTime(0, 0, "pool.ntp.org");
+
   startCameraServer();
 
+  // Mixing verification, below the priority of the web server tasks
+  xTaskCreatePinnedToCore(mixingTask, "mixing", mixingTaskStack, NULL, 1, NULL, 1);
+
   Serial.print("Camera Ready! Use 'http://");
   Serial.print(WiFi.localIP());
   Serial.println("' to connect");
 }
 
+// Posts the culture density to the web server: {"channel":"culture_density","timestamp":"...","values":{...}}
+void pushCultureDensity() {
+  static char payload[768];
+  density_result_t result;
+  density_window_t window;
+  if (!measure_culture_density(&result, &window)) {
+    Serial.println("Culture density measurement failed");
+    return;
+  }
+
+  // Empty timestamp while NTP did not answer: the server stamps the record
+  char timestamp[21] = "";
+  time_t now = time(NULL);
+  if (now > 1600000000) {
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  }
+  int length = snprintf(payload, sizeof(payload), "{\"channel\":\"culture_density\",\"timestamp\":\"%s\",\"values\":", timestamp);
+  size_t values = density_format_json(&result, &window, payload + length, sizeof(payload) - length - 1);
+  if (values == 0) {
+    Serial.println("Culture density too long to send");
+    return;
+  }
+  length += values;
+  payload[length++] = '}';
+  payload[length] = '\0';
+
+  HTTPClient http;
+  http.setTimeout(httpTimeout);
+  http.setConnectTimeout(httpTimeout);
+  http.begin(cameraDataUrl);
+  http.addHeader("Content-Type", "application/json");
+  int code = http.POST((uint8_t *)payload, length);
+  http.end();
+  if (code != 200) {
+    Serial.printf("Pushing the culture density failed: %d\n", code);
+  }
+}
+
+// Posts a mixing event to the bridge; it is not retried (the state is also served on /mixing)
+void postMixingEvent(const char *event) {
+  HTTPClient http;
+  http.setTimeout(httpTimeout);
+  http.setConnectTimeout(httpTimeout);
+  http.begin(bridgeEventUrl);
+  http.addHeader("Content-Type", "application/json");
+  int code = http.POST((uint8_t *)event, strlen(event));
+  http.end();
+  if (code < 200 || code >= 300) {
+    Serial.printf("Posting the mixing event to the bridge failed: %d\n", code);
+  }
+}
+
+// Samples the mixing at a fixed interval, never taking more than the interval less mixingMinIdle
+void mixingTask(void *parameter) {
+  static char event[256];
+  for (;;) {
+    unsigned long start = millis();
+    if (sample_mixing(event, sizeof(event))) {
+      Serial.printf("Mixing event: %s\n", event);
+      if (WiFi.status() == WL_CONNECTED) {
+        postMixingEvent(event);
+      }
+    }
+    unsigned long elapsed = millis() - start;
+    vTaskDelay(pdMS_TO_TICKS(elapsed + mixingMinIdle < mixingFrameInterval ? mixingFrameInterval - elapsed : mixingMinIdle));
+  }
+}
+
 void loop() {
-  // Do nothing. Everything is done in another task by the web server
-  delay(10000);
+  // The web server runs in its own tasks; the loop pushes the culture density
+  if (WiFi.status() == WL_CONNECTED) {
+    pushCultureDensity();
+  }
+  delay(densityPushInterval);
 }
@@ -15,64 +15,21 @@
 #include "esp_timer.h"
 #include "esp_camera.h"
 #include "img_converters.h"
-#include "fb_gfx.h"
 #include "esp32-hal-ledc.h"
 #include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <sys/time.h>
 #include "camera_index.h"
+#include "culture_density.h"
+#include "mixing_monitor.h"
+#include "frame_pool.h"
+#include "stream_controller.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
 #endif
 
-// Face Detection will not work on boards without (or with disabled) PSRAM
-#ifdef BOARD_HAS_PSRAM
-// Face Recognition takes upward from 15 seconds per frame on chips other than ESP32S3
-// Makes no sense to have it enabled for them
-#if CONFIG_IDF_TARGET_ESP32S3
-#define CONFIG_ESP_FACE_RECOGNITION_ENABLED 1
-#define CONFIG_ESP_FACE_DETECT_ENABLED      1
-#else
-#define CONFIG_ESP_FACE_RECOGNITION_ENABLED 0
-#define CONFIG_ESP_FACE_DETECT_ENABLED      0
-#endif
-#else
-#define CONFIG_ESP_FACE_DETECT_ENABLED      0
-#define CONFIG_ESP_FACE_RECOGNITION_ENABLED 0
-#endif
-
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-
-#include <vector>
-#include "human_face_detect_msr01.hpp"
-#include "human_face_detect_mnp01.hpp"
-
-#define TWO_STAGE 1 /*<! 1: detect by two-stage which is more accurate but slower(with keypoints). */
-                    /*<! 0: detect by one-stage which is less accurate but faster(without keypoints). */
-
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-#pragma GCC diagnostic ignored "-Wformat"
-#pragma GCC diagnostic ignored "-Wstrict-aliasing"
-#include "face_recognition_tool.hpp"
-#include "face_recognition_112_v1_s16.hpp"
-#include "face_recognition_112_v1_s8.hpp"
-#pragma GCC diagnostic error "-Wformat"
-#pragma GCC diagnostic warning "-Wstrict-aliasing"
-
-#define QUANT_TYPE 0  //if set to 1 => very large firmware, very slow, reboots when streaming...
-
-#define FACE_ID_SAVE_NUMBER 7
-#endif
-
-#define FACE_COLOR_WHITE  0x00FFFFFF
-#define FACE_COLOR_BLACK  0x00000000
-#define FACE_COLOR_RED    0x000000FF
-#define FACE_COLOR_GREEN  0x0000FF00
-#define FACE_COLOR_BLUE   0x00FF0000
-#define FACE_COLOR_YELLOW (FACE_COLOR_RED | FACE_COLOR_GREEN)
-#define FACE_COLOR_CYAN   (FACE_COLOR_BLUE | FACE_COLOR_GREEN)
-#define FACE_COLOR_PURPLE (FACE_COLOR_BLUE | FACE_COLOR_RED)
-#endif
-
 // Enable LED FLASH setting
 #define CONFIG_LED_ILLUMINATOR_ENABLED 1
 
@@ -100,31 +57,40 @@ static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %
 httpd_handle_t stream_httpd = NULL;
 httpd_handle_t camera_httpd = NULL;
 
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-
-static int8_t detection_enabled = 0;
-
-// #if TWO_STAGE
-// static HumanFaceDetectMSR01 s1(0.1F, 0.5F, 10, 0.2F);
-// static HumanFaceDetectMNP01 s2(0.5F, 0.3F, 5);
-// #else
-// static HumanFaceDetectMSR01 s1(0.3F, 0.5F, 10, 0.2F);
-// #endif
-
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-static int8_t recognition_enabled = 0;
-static int8_t is_enrolling = 0;
-
-#if QUANT_TYPE
-// S16 model
-FaceRecognition112V1S16 recognizer;
-#else
-// S8 model
-FaceRecognition112V1S8 recognizer;
-#endif
-#endif
+// Frames of the MJPEG stream, encoded once and shared by its clients (frame_pool.h)
+#define STREAM_MAX_CLIENTS       FRAME_POOL_MAX_READERS
+#define STREAM_FRAME_TIMEOUT_MS  5000
+#define STREAM_PRODUCER_STACK    4096
+#define STREAM_PRODUCER_PRIORITY (tskIDLE_PRIORITY + 5)  // As the server task that used to capture
+#define STREAM_CLIENT_STACK      4096
+#define STREAM_CLIENT_PRIORITY   (tskIDLE_PRIORITY + 4)  // Below the capture, which never waits on them
+static frame_pool_t stream_pool;
+static SemaphoreHandle_t stream_lock = NULL;
+static uint8_t stream_clients = 0;
+static bool stream_producing = false;
+
+// Frame size and JPEG quality of the stream, from the best to the cheapest, chosen by stream_control
+// (stream_controller.h) from what the frames cost to encode and send. Level 6 is the size set at boot.
+static const stream_level_t stream_levels[] = {
+  {FRAMESIZE_SVGA, 10}, {FRAMESIZE_SVGA, 14}, {FRAMESIZE_VGA, 10}, {FRAMESIZE_VGA, 14},  {FRAMESIZE_HVGA, 12},
+  {FRAMESIZE_CIF, 12},  {FRAMESIZE_QVGA, 10}, {FRAMESIZE_QVGA, 16}, {FRAMESIZE_HQVGA, 20}, {FRAMESIZE_QQVGA, 24},
+};
+#define STREAM_START_LEVEL 6
+static stream_controller_t stream_control;
+
+// Culture density on a window of the frames (culture_density.h), served on /density and pushed by the sketch
+static density_window_t density_window = {250, 250, 500, 500};
+static float density_blank = 0;  // Luminance of the medium without cells, 0 until taken
+static SemaphoreHandle_t density_lock = NULL;
+
+// Mixing verification by frame differences (mixing_monitor.h), sampled by the sketch and served on /mixing
+static mixing_monitor_t mixing_monitor;
+static density_window_t mixing_window = {150, 150, 700, 700};
+static SemaphoreHandle_t mixing_lock = NULL;
+static volatile uint8_t mixing_skip = 0;  // Frames left out after a frame lit by the LED
+static uint8_t *mixing_rgb = NULL;        // Decoded frame, kept between the samples
+static size_t mixing_rgb_size = 0;
 
-#endif
 
 typedef struct {
   size_t size;   //number of values used for filtering
@@ -166,104 +132,6 @@ static int ra_filter_run(ra_filter_t *filter, int value) {
 }
 #endif
 
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-static void rgb_print(fb_data_t *fb, uint32_t color, const char *str) {
-  fb_gfx_print(fb, (fb->width - (strlen(str) * 14)) / 2, 10, color, str);
-}
-
-static int rgb_printf(fb_data_t *fb, uint32_t color, const char *format, ...) {
-  char loc_buf[64];
-  char *temp = loc_buf;
-  int len;
-  va_list arg;
-  va_list copy;
-  va_start(arg, format);
-  va_copy(copy, arg);
-  len = vsnprintf(loc_buf, sizeof(loc_buf), format, arg);
-  va_end(copy);
-  if (len >= sizeof(loc_buf)) {
-    temp = (char *)malloc(len + 1);
-    if (temp == NULL) {
-      return 0;
-    }
-  }
-  vsnprintf(temp, len + 1, format, arg);
-  va_end(arg);
-  rgb_print(fb, color, temp);
-  if (len > 64) {
-    free(temp);
-  }
-  return len;
-}
-#endif
-static void draw_face_boxes(fb_data_t *fb, std::list<dl::detect::result_t> *results, int face_id) {
-  int x, y, w, h;
-  uint32_t color = FACE_COLOR_YELLOW;
-  if (face_id < 0) {
-    color = FACE_COLOR_RED;
-  } else if (face_id > 0) {
-    color = FACE_COLOR_GREEN;
-  }
-  if (fb->bytes_per_pixel == 2) {
-    //color = ((color >> 8) & 0xF800) | ((color >> 3) & 0x07E0) | (color & 0x001F);
-    color = ((color >> 16) & 0x001F) | ((color >> 3) & 0x07E0) | ((color << 8) & 0xF800);
-  }
-  int i = 0;
-  for (std::list<dl::detect::result_t>::iterator prediction = results->begin(); prediction != results->end(); prediction++, i++) {
-    // rectangle box
-    x = (int)prediction->box[0];
-    y = (int)prediction->box[1];
-    w = (int)prediction->box[2] - x + 1;
-    h = (int)prediction->box[3] - y + 1;
-    if ((x + w) > fb->width) {
-      w = fb->width - x;
-    }
-    if ((y + h) > fb->height) {
-      h = fb->height - y;
-    }
-    fb_gfx_drawFastHLine(fb, x, y, w, color);
-    fb_gfx_drawFastHLine(fb, x, y + h - 1, w, color);
-    fb_gfx_drawFastVLine(fb, x, y, h, color);
-    fb_gfx_drawFastVLine(fb, x + w - 1, y, h, color);
-#if TWO_STAGE
-    // landmarks (left eye, mouth left, nose, right eye, mouth right)
-    int x0, y0, j;
-    for (j = 0; j < 10; j += 2) {
-      x0 = (int)prediction->keypoint[j];
-      y0 = (int)prediction->keypoint[j + 1];
-      fb_gfx_fillRect(fb, x0, y0, 3, 3, color);
-    }
-#endif
-  }
-}
-
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-static int run_face_recognition(fb_data_t *fb, std::list<dl::detect::result_t> *results) {
-  std::vector<int> landmarks = results->front().keypoint;
-  int id = -1;
-
-  Tensor<uint8_t> tensor;
-  tensor.set_element((uint8_t *)fb->data).set_shape({fb->height, fb->width, 3}).set_auto_free(false);
-
-  int enrolled_count = recognizer.get_enrolled_id_num();
-
-  if (enrolled_count < FACE_ID_SAVE_NUMBER && is_enrolling) {
-    id = recognizer.enroll_id(tensor, landmarks, "", true);
-    log_i("Enrolled ID: %d", id);
-    rgb_printf(fb, FACE_COLOR_CYAN, "ID[%u]", id);
-  }
-
-  face_info_t recognize = recognizer.recognize(tensor, landmarks);
-  if (recognize.id >= 0) {
-    rgb_printf(fb, FACE_COLOR_GREEN, "ID[%u]: %.2f", recognize.id, recognize.similarity);
-  } else {
-    rgb_print(fb, FACE_COLOR_RED, "Intruder Alert!");
-  }
-  return recognize.id;
-}
-#endif
-#endif
 
 #if CONFIG_LED_ILLUMINATOR_ENABLED
 void enable_led(bool en) {  // Turn LED On or Off
@@ -341,6 +209,7 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   vTaskDelay(150 / portTICK_PERIOD_MS);  // The LED needs to be turned on ~150ms before the call to esp_camera_fb_get()
   fb = esp_camera_fb_get();              // or it won't be visible in the frame. A better way to do this is needed.
   enable_led(false);
+  mixing_skip = 2;
 #else
   fb = esp_camera_fb_get();
 #endif
@@ -359,387 +228,201 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   snprintf(ts, 32, "%lld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
   httpd_resp_set_hdr(req, "X-Timestamp", (const char *)ts);
 
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-  size_t out_len, out_width, out_height;
-  uint8_t *out_buf;
-  bool s;
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-  bool detected = false;
-#endif
-  int face_id = 0;
-  if (!detection_enabled || fb->width > 400) {
-#endif
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-    size_t fb_len = 0;
-#endif
-    if (fb->format == PIXFORMAT_JPEG) {
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-      fb_len = fb->len;
-#endif
-      res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
-    } else {
-      jpg_chunking_t jchunk = {req, 0};
-      res = frame2jpg_cb(fb, 80, jpg_encode_stream, &jchunk) ? ESP_OK : ESP_FAIL;
-      httpd_resp_send_chunk(req, NULL, 0);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-      fb_len = jchunk.len;
+  size_t fb_len = 0;
 #endif
-    }
-    esp_camera_fb_return(fb);
+  if (fb->format == PIXFORMAT_JPEG) {
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-    int64_t fr_end = esp_timer_get_time();
+    fb_len = fb->len;
 #endif
-    log_i("JPG: %uB %ums", (uint32_t)(fb_len), (uint32_t)((fr_end - fr_start) / 1000));
-    return res;
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-  }
-
-  jpg_chunking_t jchunk = {req, 0};
-
-  if (fb->format == PIXFORMAT_RGB565
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-      && !recognition_enabled
-#endif
-  ) {
-#if TWO_STAGE
-    HumanFaceDetectMSR01 s1(0.1F, 0.5F, 10, 0.2F);
-    HumanFaceDetectMNP01 s2(0.5F, 0.3F, 5);
-    std::list<dl::detect::result_t> &candidates = s1.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3});
-    std::list<dl::detect::result_t> &results = s2.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3}, candidates);
-#else
-    HumanFaceDetectMSR01 s1(0.3F, 0.5F, 10, 0.2F);
-    std::list<dl::detect::result_t> &results = s1.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3});
-#endif
-    if (results.size() > 0) {
-      fb_data_t rfb;
-      rfb.width = fb->width;
-      rfb.height = fb->height;
-      rfb.data = fb->buf;
-      rfb.bytes_per_pixel = 2;
-      rfb.format = FB_RGB565;
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-      detected = true;
-#endif
-      draw_face_boxes(&rfb, &results, face_id);
-    }
-    s = fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height, PIXFORMAT_RGB565, 90, jpg_encode_stream, &jchunk);
-    esp_camera_fb_return(fb);
+    res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
   } else {
-    out_len = fb->width * fb->height * 3;
-    out_width = fb->width;
-    out_height = fb->height;
-    out_buf = (uint8_t *)malloc(out_len);
-    if (!out_buf) {
-      log_e("out_buf malloc failed");
-      httpd_resp_send_500(req);
-      return ESP_FAIL;
-    }
-    s = fmt2rgb888(fb->buf, fb->len, fb->format, out_buf);
-    esp_camera_fb_return(fb);
-    if (!s) {
-      free(out_buf);
-      log_e("To rgb888 failed");
-      httpd_resp_send_500(req);
-      return ESP_FAIL;
-    }
-
-    fb_data_t rfb;
-    rfb.width = out_width;
-    rfb.height = out_height;
-    rfb.data = out_buf;
-    rfb.bytes_per_pixel = 3;
-    rfb.format = FB_BGR888;
-
-#if TWO_STAGE
-    HumanFaceDetectMSR01 s1(0.1F, 0.5F, 10, 0.2F);
-    HumanFaceDetectMNP01 s2(0.5F, 0.3F, 5);
-    std::list<dl::detect::result_t> &candidates = s1.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3});
-    std::list<dl::detect::result_t> &results = s2.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3}, candidates);
-#else
-    HumanFaceDetectMSR01 s1(0.3F, 0.5F, 10, 0.2F);
-    std::list<dl::detect::result_t> &results = s1.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3});
-#endif
-
-    if (results.size() > 0) {
+    jpg_chunking_t jchunk = {req, 0};
+    res = frame2jpg_cb(fb, 80, jpg_encode_stream, &jchunk) ? ESP_OK : ESP_FAIL;
+    httpd_resp_send_chunk(req, NULL, 0);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-      detected = true;
+    fb_len = jchunk.len;
 #endif
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-      if (recognition_enabled) {
-        face_id = run_face_recognition(&rfb, &results);
-      }
-#endif
-      draw_face_boxes(&rfb, &results, face_id);
-    }
-
-    s = fmt2jpg_cb(out_buf, out_len, out_width, out_height, PIXFORMAT_RGB888, 90, jpg_encode_stream, &jchunk);
-    free(out_buf);
-  }
-
-  if (!s) {
-    log_e("JPEG compression failed");
-    httpd_resp_send_500(req);
-    return ESP_FAIL;
   }
+  esp_camera_fb_return(fb);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   int64_t fr_end = esp_timer_get_time();
 #endif
-  log_i("FACE: %uB %ums %s%d", (uint32_t)(jchunk.len), (uint32_t)((fr_end - fr_start) / 1000), detected ? "DETECTED " : "", face_id);
+  log_i("JPG: %uB %ums", (uint32_t)(fb_len), (uint32_t)((fr_end - fr_start) / 1000));
   return res;
-#endif
 }
 
-static esp_err_t stream_handler(httpd_req_t *req) {
-  camera_fb_t *fb = NULL;
-  struct timeval _timestamp;
-  esp_err_t res = ESP_OK;
-  size_t _jpg_buf_len = 0;
-  uint8_t *_jpg_buf = NULL;
-  char *part_buf[128];
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-  bool detected = false;
-  int64_t fr_ready = 0;
-  int64_t fr_recognize = 0;
-  int64_t fr_encode = 0;
-  int64_t fr_face = 0;
-  int64_t fr_start = 0;
-#endif
-  int face_id = 0;
-  size_t out_len = 0, out_width = 0, out_height = 0;
-  uint8_t *out_buf = NULL;
-  bool s = false;
-#if TWO_STAGE
-  HumanFaceDetectMSR01 s1(0.1F, 0.5F, 10, 0.2F);
-  HumanFaceDetectMNP01 s2(0.5F, 0.3F, 5);
-#else
-  HumanFaceDetectMSR01 s1(0.3F, 0.5F, 10, 0.2F);
-#endif
-#endif
-
-  static int64_t last_frame = 0;
-  if (!last_frame) {
-    last_frame = esp_timer_get_time();
-  }
-
-  res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-  if (res != ESP_OK) {
-    return res;
-  }
-
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_set_hdr(req, "X-Framerate", "60");
-
-#if CONFIG_LED_ILLUMINATOR_ENABLED
-  isStreaming = true;
-  enable_led(true);
-#endif
+// MJPEG stream: a producer task captures and encodes every frame once into stream_pool, and each client
+// streams the shared frames from a task of its own (an async request of the stream server), skipping to the
+// newest frame when it is slower than the camera. The producer runs while there are clients, at most at the
+// target frame rate of stream_control, and sets the level it chooses on the sensor.
+static void stream_producer_task(void *arg) {
+  int64_t last_frame = esp_timer_get_time();
 
   while (true) {
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-    detected = false;
-#endif
-    face_id = 0;
+    xSemaphoreTake(stream_lock, portMAX_DELAY);
+    if (stream_clients == 0) {
+      // Under the lock, so a new client cannot start another producer before the LED is off
+      stream_producing = false;
+#if CONFIG_LED_ILLUMINATOR_ENABLED
+      isStreaming = false;
+      enable_led(false);
 #endif
+      frame_pool_trim(&stream_pool);
+      xSemaphoreGive(stream_lock);
+      break;
+    }
+    xSemaphoreGive(stream_lock);
 
-    fb = esp_camera_fb_get();
+    int64_t fr_start = esp_timer_get_time();
+    camera_fb_t *fb = esp_camera_fb_get();
+    int64_t fr_ready = esp_timer_get_time();
     if (!fb) {
       log_e("Camera capture failed");
-      res = ESP_FAIL;
-    } else {
-      _timestamp.tv_sec = fb->timestamp.tv_sec;
-      _timestamp.tv_usec = fb->timestamp.tv_usec;
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-      fr_start = esp_timer_get_time();
-      fr_ready = fr_start;
-      fr_encode = fr_start;
-      fr_recognize = fr_start;
-      fr_face = fr_start;
-#endif
-      if (!detection_enabled || fb->width > 400) {
-#endif
-        if (fb->format != PIXFORMAT_JPEG) {
-          bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-          esp_camera_fb_return(fb);
-          fb = NULL;
-          if (!jpeg_converted) {
-            log_e("JPEG compression failed");
-            res = ESP_FAIL;
-          }
-        } else {
-          _jpg_buf_len = fb->len;
-          _jpg_buf = fb->buf;
-        }
-#if CONFIG_ESP_FACE_DETECT_ENABLED
+      vTaskDelay(100 / portTICK_PERIOD_MS);
+      continue;
+    }
+    struct timeval timestamp = fb->timestamp;
+    frame_slot_t *slot = frame_pool_writable(&stream_pool);
+    bool s = slot != NULL;
+    if (s && fb->format == PIXFORMAT_JPEG) {
+      s = frame_pool_copy(&stream_pool, slot, fb->buf, fb->len, &timestamp);
+      esp_camera_fb_return(fb);
+    } else if (s) {
+      uint8_t *_jpg_buf = NULL;
+      size_t _jpg_buf_len = 0;
+      s = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
+      esp_camera_fb_return(fb);
+      if (s) {
+        frame_pool_adopt(slot, _jpg_buf, _jpg_buf_len, &timestamp);
       } else {
-        if (fb->format == PIXFORMAT_RGB565
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-            && !recognition_enabled
-#endif
-        ) {
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-          fr_ready = esp_timer_get_time();
-#endif
-#if TWO_STAGE
-          std::list<dl::detect::result_t> &candidates = s1.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3});
-          std::list<dl::detect::result_t> &results = s2.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3}, candidates);
-#else
-          std::list<dl::detect::result_t> &results = s1.infer((uint16_t *)fb->buf, {(int)fb->height, (int)fb->width, 3});
-#endif
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-          fr_face = esp_timer_get_time();
-          fr_recognize = fr_face;
-#endif
-          if (results.size() > 0) {
-            fb_data_t rfb;
-            rfb.width = fb->width;
-            rfb.height = fb->height;
-            rfb.data = fb->buf;
-            rfb.bytes_per_pixel = 2;
-            rfb.format = FB_RGB565;
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-            detected = true;
-#endif
-            draw_face_boxes(&rfb, &results, face_id);
-          }
-          s = fmt2jpg(fb->buf, fb->len, fb->width, fb->height, PIXFORMAT_RGB565, 80, &_jpg_buf, &_jpg_buf_len);
-          esp_camera_fb_return(fb);
-          fb = NULL;
-          if (!s) {
-            log_e("fmt2jpg failed");
-            res = ESP_FAIL;
-          }
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-          fr_encode = esp_timer_get_time();
-#endif
-        } else {
-          out_len = fb->width * fb->height * 3;
-          out_width = fb->width;
-          out_height = fb->height;
-          out_buf = (uint8_t *)malloc(out_len);
-          if (!out_buf) {
-            log_e("out_buf malloc failed");
-            res = ESP_FAIL;
-          } else {
-            s = fmt2rgb888(fb->buf, fb->len, fb->format, out_buf);
-            esp_camera_fb_return(fb);
-            fb = NULL;
-            if (!s) {
-              free(out_buf);
-              log_e("To rgb888 failed");
-              res = ESP_FAIL;
-            } else {
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-              fr_ready = esp_timer_get_time();
-#endif
-
-              fb_data_t rfb;
-              rfb.width = out_width;
-              rfb.height = out_height;
-              rfb.data = out_buf;
-              rfb.bytes_per_pixel = 3;
-              rfb.format = FB_BGR888;
-
-#if TWO_STAGE
-              std::list<dl::detect::result_t> &candidates = s1.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3});
-              std::list<dl::detect::result_t> &results = s2.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3}, candidates);
-#else
-              std::list<dl::detect::result_t> &results = s1.infer((uint8_t *)out_buf, {(int)out_height, (int)out_width, 3});
-#endif
-
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-              fr_face = esp_timer_get_time();
-              fr_recognize = fr_face;
-#endif
-
-              if (results.size() > 0) {
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-                detected = true;
-#endif
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-                if (recognition_enabled) {
-                  face_id = run_face_recognition(&rfb, &results);
-#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-                  fr_recognize = esp_timer_get_time();
-#endif
-                }
-#endif
-                draw_face_boxes(&rfb, &results, face_id);
-              }
-              s = fmt2jpg(out_buf, out_len, out_width, out_height, PIXFORMAT_RGB888, 90, &_jpg_buf, &_jpg_buf_len);
-              free(out_buf);
-              if (!s) {
-                log_e("fmt2jpg failed");
-                res = ESP_FAIL;
-              }
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-              fr_encode = esp_timer_get_time();
-#endif
-            }
-          }
-        }
+        log_e("JPEG compression failed");
       }
-#endif
-    }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-    }
-    if (res == ESP_OK) {
-      size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
-      res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
-    }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
-    }
-    if (fb) {
+    } else {
       esp_camera_fb_return(fb);
-      fb = NULL;
-      _jpg_buf = NULL;
-    } else if (_jpg_buf) {
-      free(_jpg_buf);
-      _jpg_buf = NULL;
+      log_e("No free stream frame");
     }
-    if (res != ESP_OK) {
-      log_e("Send frame failed");
-      break;
+    if (!s) {
+      if (slot) {
+        frame_pool_discard(&stream_pool, slot);
+      }
+      continue;
     }
-    int64_t fr_end = esp_timer_get_time();
-
-#if CONFIG_ESP_FACE_DETECT_ENABLED && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-    int64_t ready_time = (fr_ready - fr_start) / 1000;
-    int64_t face_time = (fr_face - fr_ready) / 1000;
-    int64_t recognize_time = (fr_recognize - fr_face) / 1000;
-    int64_t encode_time = (fr_encode - fr_recognize) / 1000;
-    int64_t process_time = (fr_encode - fr_start) / 1000;
-#endif
+    frame_pool_publish(&stream_pool, slot);
 
+    int64_t fr_end = esp_timer_get_time();
+    stream_controller_captured(&stream_control, slot->length, (uint32_t)(fr_ready - fr_start), (uint32_t)(fr_end - fr_ready));
+    stream_level_t level;
+    if (stream_controller_poll(&stream_control, fr_end, &level)) {
+      sensor_t *sensor = esp_camera_sensor_get();
+      if (sensor->pixformat == PIXFORMAT_JPEG) {
+        sensor->set_framesize(sensor, (framesize_t)level.frame_size);
+        sensor->set_quality(sensor, level.quality);
+        log_i("Stream level: framesize %d, quality %u", level.frame_size, level.quality);
+      }
+    }
     int64_t frame_time = fr_end - last_frame;
+    last_frame = fr_end;
     frame_time /= 1000;
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
     uint32_t avg_frame_time = ra_filter_run(&ra_filter, frame_time);
 #endif
     log_i(
-      "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps)"
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-      ", %u+%u+%u+%u=%u %s%d"
-#endif
-      ,
-      (uint32_t)(_jpg_buf_len), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time, avg_frame_time, 1000.0 / avg_frame_time
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-      ,
-      (uint32_t)ready_time, (uint32_t)face_time, (uint32_t)recognize_time, (uint32_t)encode_time, (uint32_t)process_time, (detected) ? "DETECTED " : "", face_id
-#endif
+      "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps), %u clients", (uint32_t)(slot->length), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time,
+      avg_frame_time, 1000.0 / avg_frame_time, stream_clients
     );
+
+    int64_t wait_us = fr_start + stream_controller_frame_interval_us(&stream_control) - esp_timer_get_time();
+    if (wait_us >= 1000) {
+      vTaskDelay(pdMS_TO_TICKS(wait_us / 1000));
+    }
   }
+  vTaskDelete(NULL);
+}
 
+// Sends the shared frames to one client until it disconnects, from the frames it holds (no copy)
+static void stream_client_task(void *arg) {
+  httpd_req_t *req = (httpd_req_t *)arg;
+  char part_buf[128];
+  uint32_t last = 0;
+  uint32_t sent = 0;
+  uint32_t dropped = 0;
+  uint8_t reader = stream_controller_join(&stream_control);
+
+  esp_err_t res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
+  if (res == ESP_OK) {
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "X-Framerate", "60");
+  }
+  while (res == ESP_OK) {
+    const frame_slot_t *frame = frame_pool_acquire(&stream_pool, last, STREAM_FRAME_TIMEOUT_MS);
+    if (!frame) {
+      log_e("No frame for %u ms", STREAM_FRAME_TIMEOUT_MS);
+      break;
+    }
+    if (last != 0) {
+      dropped += frame->sequence - last - 1;
+    }
+    last = frame->sequence;
+    int64_t send_start = esp_timer_get_time();
+    res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+    if (res == ESP_OK) {
+      size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART, frame->length, (int)frame->timestamp.tv_sec, (int)frame->timestamp.tv_usec);
+      res = httpd_resp_send_chunk(req, part_buf, hlen);
+    }
+    if (res == ESP_OK) {
+      res = httpd_resp_send_chunk(req, (const char *)frame->data, frame->length);
+    }
+    size_t length = frame->length;
+    frame_pool_release(&stream_pool, frame);
+    if (res == ESP_OK) {
+      stream_controller_sent(&stream_control, reader, length, (uint32_t)(esp_timer_get_time() - send_start));
+      sent++;
+    }
+  }
+  log_i("Stream client left: %u frames sent, %u skipped", sent, dropped);
+  stream_controller_leave(&stream_control, reader);
+
+  httpd_req_async_handler_complete(req);
+  xSemaphoreTake(stream_lock, portMAX_DELAY);
+  stream_clients--;
+  xSemaphoreGive(stream_lock);
+  vTaskDelete(NULL);
+}
+
+// GET /stream: hands the request to a client task, starting the producer for the first client
+static esp_err_t stream_handler(httpd_req_t *req) {
+  httpd_req_t *async_req = NULL;
+  xSemaphoreTake(stream_lock, portMAX_DELAY);
+  if (stream_clients >= STREAM_MAX_CLIENTS) {
+    xSemaphoreGive(stream_lock);
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_sendstr(req, "Too many stream clients");
+  }
+  if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+    xSemaphoreGive(stream_lock);
+    log_e("Stream request could not be detached");
+    return httpd_resp_send_500(req);
+  }
+  if (xTaskCreate(stream_client_task, "stream_client", STREAM_CLIENT_STACK, async_req, STREAM_CLIENT_PRIORITY, NULL) != pdPASS) {
+    xSemaphoreGive(stream_lock);
+    httpd_req_async_handler_complete(async_req);
+    log_e("Stream client task failed");
+    return ESP_FAIL;
+  }
+  stream_clients++;
+  if (!stream_producing) {
 #if CONFIG_LED_ILLUMINATOR_ENABLED
-  isStreaming = false;
-  enable_led(false);
+    isStreaming = true;
+    enable_led(true);
 #endif
-
-  return res;
+    stream_producing = xTaskCreate(stream_producer_task, "stream_producer", STREAM_PRODUCER_STACK, NULL, STREAM_PRODUCER_PRIORITY, NULL) == pdPASS;
+    if (!stream_producing) {
+      log_e("Stream producer task failed");  // The client times out without frames
+    }
+  }
+  xSemaphoreGive(stream_lock);
+  return ESP_OK;
 }
 
 static esp_err_t parse_get(httpd_req_t *req, char **obuf) {
@@ -785,10 +468,24 @@ static esp_err_t cmd_handler(httpd_req_t *req) {
 
   if (!strcmp(variable, "framesize")) {
     if (s->pixformat == PIXFORMAT_JPEG) {
+      stream_controller_set_auto(&stream_control, false);  // Set by hand: the stream keeps it
       res = s->set_framesize(s, (framesize_t)val);
     }
   } else if (!strcmp(variable, "quality")) {
+    stream_controller_set_auto(&stream_control, false);
     res = s->set_quality(s, val);
+  } else if (!strcmp(variable, "stream_auto")) {
+    stream_controller_set_auto(&stream_control, val);
+  } else if (!strcmp(variable, "stream_fps")) {
+    res = val > 0 ? 0 : -1;
+    if (!res) {
+      stream_controller_set_target(&stream_control, val, stream_control.config.max_bandwidth);
+    }
+  } else if (!strcmp(variable, "stream_kbps")) {
+    res = val >= 0 ? 0 : -1;  // 0 for no cap
+    if (!res) {
+      stream_controller_set_target(&stream_control, stream_control.config.target_fps, (uint32_t)val * 1000 / 8);
+    }
   } else if (!strcmp(variable, "contrast")) {
     res = s->set_contrast(s, val);
   } else if (!strcmp(variable, "brightness")) {
@@ -843,27 +540,6 @@ static esp_err_t cmd_handler(httpd_req_t *req) {
   }
 #endif
 
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-  else if (!strcmp(variable, "face_detect")) {
-    detection_enabled = val;
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-    if (!detection_enabled) {
-      recognition_enabled = 0;
-    }
-#endif
-  }
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-  else if (!strcmp(variable, "face_enroll")) {
-    is_enrolling = !is_enrolling;
-    log_i("Enrolling: %s", is_enrolling ? "true" : "false");
-  } else if (!strcmp(variable, "face_recognize")) {
-    recognition_enabled = val;
-    if (recognition_enabled) {
-      detection_enabled = val;
-    }
-  }
-#endif
-#endif
   else {
     log_i("Unknown command: %s", variable);
     res = -1;
@@ -882,7 +558,7 @@ static int print_reg(char *p, sensor_t *s, uint16_t reg, uint32_t mask) {
 }
 
 static esp_err_t status_handler(httpd_req_t *req) {
-  static char json_response[1024];
+  static char json_response[1536];
 
   sensor_t *s = esp_camera_sensor_get();
   char *p = json_response;
@@ -948,13 +624,12 @@ static esp_err_t status_handler(httpd_req_t *req) {
 #else
   p += sprintf(p, ",\"led_intensity\":%d", -1);
 #endif
-#if CONFIG_ESP_FACE_DETECT_ENABLED
-  p += sprintf(p, ",\"face_detect\":%u", detection_enabled);
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-  p += sprintf(p, ",\"face_enroll\":%u,", is_enrolling);
-  p += sprintf(p, "\"face_recognize\":%u", recognition_enabled);
-#endif
-#endif
+  char *stream = p + 1;
+  size_t stream_length = stream_controller_format_json(&stream_control, stream, json_response + sizeof(json_response) - stream - 2);
+  if (stream_length > 0) {
+    *p = ',';
+    p = stream + stream_length;
+  }
   *p++ = '}';
   *p++ = 0;
   httpd_resp_set_type(req, "application/json");
@@ -1113,6 +788,7 @@ static esp_err_t win_handler(httpd_req_t *req) {
     totalX, totalY, outputX, outputY, scale, binning
   );
   sensor_t *s = esp_camera_sensor_get();
+  stream_controller_set_auto(&stream_control, false);  // The window set by hand is kept
   int res = s->set_res_raw(s, startX, startY, endX, endY, offsetX, offsetY, totalX, totalY, outputX, outputY, scale, binning);
   if (res) {
     return httpd_resp_send_500(req);
@@ -1122,6 +798,250 @@ static esp_err_t win_handler(httpd_req_t *req) {
   return httpd_resp_send(req, NULL, 0);
 }
 
+// Sums of a frame on the density window. JPEG frames are decoded to RGB565 first, scaled down to at most
+// 400 pixels wide: the means do not need the full resolution.
+static bool sum_frame(camera_fb_t *fb, const density_window_t *window, density_sums_t *sums) {
+  density_roi_t roi;
+  if (fb->format == PIXFORMAT_RGB565 || fb->format == PIXFORMAT_GRAYSCALE) {
+    if (!density_roi_from_window(window, fb->width, fb->height, &roi)) {
+      return false;
+    }
+    if (fb->format == PIXFORMAT_RGB565) {
+      density_sum_rgb565(fb->buf, fb->width * 2, &roi, sums);
+    } else {
+      density_sum_grayscale(fb->buf, fb->width, &roi, sums);
+    }
+    return true;
+  }
+  if (fb->format != PIXFORMAT_JPEG) {
+    log_e("Density: unsupported pixel format %u", fb->format);
+    return false;
+  }
+
+  jpg_scale_t scale = fb->width > 1600 ? JPG_SCALE_8X : fb->width > 800 ? JPG_SCALE_4X : fb->width > 400 ? JPG_SCALE_2X : JPG_SCALE_NONE;
+  uint16_t width = fb->width >> scale;
+  uint16_t height = fb->height >> scale;
+  uint8_t *rgb_buf = (uint8_t *)malloc((size_t)width * height * 2);
+  if (!rgb_buf) {
+    log_e("rgb_buf malloc failed");
+    return false;
+  }
+  bool s = jpg2rgb565(fb->buf, fb->len, rgb_buf, scale) && density_roi_from_window(window, width, height, &roi);
+  if (s) {
+    density_sum_rgb565(rgb_buf, width * 2, &roi, sums);
+  }
+  free(rgb_buf);
+  return s;
+}
+
+// Takes a frame, lit as for /capture, and measures the culture on the density window
+bool measure_culture_density(density_result_t *result, density_window_t *window) {
+  camera_fb_t *fb = NULL;
+  xSemaphoreTake(density_lock, portMAX_DELAY);
+  *window = density_window;
+
+#if CONFIG_LED_ILLUMINATOR_ENABLED
+  enable_led(true);
+  vTaskDelay(150 / portTICK_PERIOD_MS);  // Same delay as capture_handler(), for the LED to be in the frame
+  fb = esp_camera_fb_get();
+  enable_led(false);
+  mixing_skip = 2;
+#else
+  fb = esp_camera_fb_get();
+#endif
+  if (!fb) {
+    xSemaphoreGive(density_lock);
+    log_e("Camera capture failed");
+    return false;
+  }
+
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
+  int64_t fr_start = esp_timer_get_time();
+#endif
+  density_sums_t sums;
+  bool color = fb->format != PIXFORMAT_GRAYSCALE;
+  bool s = sum_frame(fb, window, &sums);
+  esp_camera_fb_return(fb);
+  if (s) {
+    density_finish(&sums, color, density_blank, result);
+  }
+  xSemaphoreGive(density_lock);
+#if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
+  int64_t fr_end = esp_timer_get_time();
+#endif
+  log_i("Density: %u pixels %ums", s ? sums.pixels : 0, (uint32_t)((fr_end - fr_start) / 1000));
+  return s;
+}
+
+// GET /density: measures the culture. Optional arguments: x, y, w and h (thousandths of the frame) move the
+// window, and blank=1 takes the frame as the blank (medium without cells) of the optical density.
+static esp_err_t density_handler(httpd_req_t *req) {
+  static char json_response[640];
+  char *buf = NULL;
+  bool take_blank = false;
+
+  if (httpd_req_get_url_query_len(req) > 0) {
+    if (parse_get(req, &buf) != ESP_OK) {
+      return ESP_FAIL;
+    }
+    density_window_t window = density_window;
+    window.x = parse_get_var(buf, "x", window.x);
+    window.y = parse_get_var(buf, "y", window.y);
+    window.width = parse_get_var(buf, "w", window.width);
+    window.height = parse_get_var(buf, "h", window.height);
+    take_blank = parse_get_var(buf, "blank", 0) == 1;
+    free(buf);
+    if (window.width == 0 || window.height == 0 || window.x + window.width > 1000 || window.y + window.height > 1000) {
+      return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "The window must lie within 0-1000");
+    }
+    xSemaphoreTake(density_lock, portMAX_DELAY);
+    if (memcmp(&window, &density_window, sizeof(window)) != 0) {
+      density_window = window;
+      density_blank = 0;  // The blank of another window does not apply
+      log_i("Density window: %u %u %u %u", window.x, window.y, window.width, window.height);
+    }
+    xSemaphoreGive(density_lock);
+  }
+
+  density_result_t result;
+  density_window_t window;
+  if (!measure_culture_density(&result, &window)) {
+    return httpd_resp_send_500(req);
+  }
+  if (take_blank) {
+    xSemaphoreTake(density_lock, portMAX_DELAY);
+    density_blank = result.luminance;
+    xSemaphoreGive(density_lock);
+    result.optical_density = 0;
+    log_i("Density blank: %.2f", result.luminance);
+  }
+
+  if (density_format_json(&result, &window, json_response, sizeof(json_response)) == 0) {
+    return httpd_resp_send_500(req);
+  }
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, json_response, strlen(json_response));
+}
+
+// Grid of a frame on the mixing window. JPEG frames are decoded at the largest scale that keeps them at
+// least 160 pixels wide (DC coefficients only at 1/8), into a buffer kept for the next sample.
+static bool grid_frame(camera_fb_t *fb, const density_window_t *window, mixing_grid_t *grid) {
+  density_roi_t roi;
+  if (fb->format == PIXFORMAT_RGB565 || fb->format == PIXFORMAT_GRAYSCALE) {
+    if (!density_roi_from_window(window, fb->width, fb->height, &roi)) {
+      return false;
+    }
+    if (fb->format == PIXFORMAT_RGB565) {
+      mixing_grid_rgb565(fb->buf, fb->width * 2, &roi, grid);
+    } else {
+      mixing_grid_grayscale(fb->buf, fb->width, &roi, grid);
+    }
+    return true;
+  }
+  if (fb->format != PIXFORMAT_JPEG) {
+    log_e("Mixing: unsupported pixel format %u", fb->format);
+    return false;
+  }
+
+  jpg_scale_t scale = fb->width >= 1280 ? JPG_SCALE_8X : fb->width >= 640 ? JPG_SCALE_4X : fb->width >= 320 ? JPG_SCALE_2X : JPG_SCALE_NONE;
+  uint16_t width = fb->width >> scale;
+  uint16_t height = fb->height >> scale;
+  size_t size = (size_t)width * height * 2;
+  if (size > mixing_rgb_size) {
+    free(mixing_rgb);
+    mixing_rgb = (uint8_t *)malloc(size);
+    mixing_rgb_size = mixing_rgb ? size : 0;
+    if (!mixing_rgb) {
+      log_e("mixing_rgb malloc failed");
+      return false;
+    }
+  }
+  if (!jpg2rgb565(fb->buf, fb->len, mixing_rgb, scale) || !density_roi_from_window(window, width, height, &roi)) {
+    return false;
+  }
+  mixing_grid_rgb565(mixing_rgb, width * 2, &roi, grid);
+  return true;
+}
+
+// Takes a frame (unlit) and scores it against the previous one; true if the mixing state changed, with the
+// event line for the bridge in event. Called by the mixing task of the sketch, at its own pace.
+bool sample_mixing(char *event, size_t size) {
+  static mixing_grid_t grid;
+  // No frame while the culture density lights the LED
+  xSemaphoreTake(density_lock, portMAX_DELAY);
+  camera_fb_t *fb = esp_camera_fb_get();
+  xSemaphoreGive(density_lock);
+  if (!fb) {
+    log_e("Camera capture failed");
+    return false;
+  }
+
+  int64_t fr_start = esp_timer_get_time();
+  xSemaphoreTake(mixing_lock, portMAX_DELAY);
+  density_window_t window = mixing_window;
+  bool s = grid_frame(fb, &window, &grid);
+  esp_camera_fb_return(fb);
+  bool changed = false;
+  if (s && mixing_skip > 0) {
+    // A frame lit by the LED may still be in the buffers of the driver
+    mixing_skip--;
+    mixing_monitor_forget_frame(&mixing_monitor);
+  } else if (s) {
+    changed = mixing_monitor_update(&mixing_monitor, &grid);
+    mixing_monitor.cost_us = esp_timer_get_time() - fr_start;
+  }
+  if (changed) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint32_t unix_time = now.tv_sec > 1600000000 ? now.tv_sec : 0;  // Stamped by the bridge until NTP answers
+    changed = mixing_format_event(&mixing_monitor, unix_time, now.tv_usec / 1000, event, size) > 0;
+    log_i("Mixing: %s", event);
+  }
+  xSemaphoreGive(mixing_lock);
+  return changed;
+}
+
+// GET /mixing: state of the mixing monitor. Optional arguments: x, y, w and h (thousandths of the frame) move
+// the window, and relearn=1 learns the baseline again (after a change of the stirring speed).
+static esp_err_t mixing_handler(httpd_req_t *req) {
+  static char json_response[320];
+  char *buf = NULL;
+
+  if (httpd_req_get_url_query_len(req) > 0) {
+    if (parse_get(req, &buf) != ESP_OK) {
+      return ESP_FAIL;
+    }
+    density_window_t window = mixing_window;
+    window.x = parse_get_var(buf, "x", window.x);
+    window.y = parse_get_var(buf, "y", window.y);
+    window.width = parse_get_var(buf, "w", window.width);
+    window.height = parse_get_var(buf, "h", window.height);
+    bool relearn = parse_get_var(buf, "relearn", 0) == 1;
+    free(buf);
+    if (window.width == 0 || window.height == 0 || window.x + window.width > 1000 || window.y + window.height > 1000) {
+      return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "The window must lie within 0-1000");
+    }
+    xSemaphoreTake(mixing_lock, portMAX_DELAY);
+    if (relearn || memcmp(&window, &mixing_window, sizeof(window)) != 0) {
+      mixing_window = window;
+      mixing_monitor_reset(&mixing_monitor);  // The baseline of another window does not apply
+      log_i("Mixing window: %u %u %u %u", window.x, window.y, window.width, window.height);
+    }
+    xSemaphoreGive(mixing_lock);
+  }
+
+  xSemaphoreTake(mixing_lock, portMAX_DELAY);
+  size_t length = mixing_format_json(&mixing_monitor, &mixing_window, json_response, sizeof(json_response));
+  xSemaphoreGive(mixing_lock);
+  if (length == 0) {
+    return httpd_resp_send_500(req);
+  }
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, json_response, length);
+}
+
 static esp_err_t index_handler(httpd_req_t *req) {
   httpd_resp_set_type(req, "text/html");
   httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
@@ -1287,14 +1207,39 @@ void startCameraServer() {
 #endif
   };
 
-  ra_filter_init(&ra_filter, 20);
-
-#if CONFIG_ESP_FACE_RECOGNITION_ENABLED
-  recognizer.set_partition(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "fr");
+  httpd_uri_t density_uri = {
+    .uri = "/density",
+    .method = HTTP_GET,
+    .handler = density_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
 
-  // load ids from flash partition
-  recognizer.set_ids_from_flash();
+  httpd_uri_t mixing_uri = {
+    .uri = "/mixing",
+    .method = HTTP_GET,
+    .handler = mixing_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
 #endif
+  };
+
+  ra_filter_init(&ra_filter, 20);
+  density_lock = xSemaphoreCreateMutex();
+  mixing_lock = xSemaphoreCreateMutex();
+  stream_lock = xSemaphoreCreateMutex();
+  stream_controller_init(&stream_control, stream_levels, sizeof(stream_levels) / sizeof(stream_levels[0]), STREAM_START_LEVEL);
+  mixing_monitor_init(&mixing_monitor);
+
   log_i("Starting web server on port: '%d'", config.server_port);
   if (httpd_start(&camera_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(camera_httpd, &index_uri);
@@ -1308,6 +1253,8 @@ void startCameraServer() {
     httpd_register_uri_handler(camera_httpd, &greg_uri);
     httpd_register_uri_handler(camera_httpd, &pll_uri);
     httpd_register_uri_handler(camera_httpd, &win_uri);
+    httpd_register_uri_handler(camera_httpd, &density_uri);
+    httpd_register_uri_handler(camera_httpd, &mixing_uri);
   }
 
   config.server_port += 1;
@@ -0,0 +1,170 @@
+// culture_density.cpp
+#include "culture_density.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Pixels converted at a time: the luma of a chunk stays on the stack of the HTTP server task
+#define DENSITY_CHUNK 256
+
+// Channels of a chunk of RGB565 pixels, expanded to 8 bits, and their luma. No branch and no lookup,
+// so the compiler can vectorize it; the histogram is filled from the luma in a second loop. The per-pixel
+// values stay in 16 bits (the luma sum is at most 256 * 255), twice the lanes of 32-bit ones.
+static void sum_rgb565_chunk(const uint8_t *__restrict pixels, size_t count, uint8_t *__restrict luma, density_sums_t *sums) {
+  uint32_t luma_sum = 0;
+  uint32_t red_sum = 0;
+  uint32_t green_sum = 0;
+  uint32_t blue_sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint16_t high = pixels[2 * i];
+    uint16_t low = pixels[2 * i + 1];
+    uint16_t red = (high & 0xF8) | (high >> 5);
+    uint16_t green = ((high & 0x07) << 5) | ((low & 0xE0) >> 3) | ((high & 0x06) >> 1);
+    uint16_t blue = ((low & 0x1F) << 3) | ((low & 0x1C) >> 2);
+    uint16_t y = (uint16_t)(77 * red + 150 * green + 29 * blue) >> 8;
+    red_sum += red;
+    green_sum += green;
+    blue_sum += blue;
+    luma_sum += y;
+    luma[i] = (uint8_t)y;
+  }
+  sums->luma += luma_sum;
+  sums->red += red_sum;
+  sums->green += green_sum;
+  sums->blue += blue_sum;
+}
+
+// Four partial histograms, so that consecutive pixels of the same level do not wait on each other's increment
+static void histogram_chunk(const uint8_t *luma, size_t count, uint32_t bins[4][DENSITY_HISTOGRAM_BINS]) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    bins[0][luma[i] >> 3]++;
+    bins[1][luma[i + 1] >> 3]++;
+    bins[2][luma[i + 2] >> 3]++;
+    bins[3][luma[i + 3] >> 3]++;
+  }
+  for (; i < count; i++) {
+    bins[0][luma[i] >> 3]++;
+  }
+}
+
+static void merge_histograms(uint32_t bins[4][DENSITY_HISTOGRAM_BINS], density_sums_t *sums) {
+  for (int bin = 0; bin < DENSITY_HISTOGRAM_BINS; bin++) {
+    sums->histogram[bin] = bins[0][bin] + bins[1][bin] + bins[2][bin] + bins[3][bin];
+  }
+}
+
+bool density_roi_from_window(const density_window_t *window, uint16_t width, uint16_t height, density_roi_t *roi) {
+  uint32_t x = (uint32_t)window->x * width / 1000;
+  uint32_t y = (uint32_t)window->y * height / 1000;
+  uint32_t right = (uint32_t)(window->x + window->width) * width / 1000;
+  uint32_t bottom = (uint32_t)(window->y + window->height) * height / 1000;
+  if (right > width) {
+    right = width;
+  }
+  if (bottom > height) {
+    bottom = height;
+  }
+  if (x >= right || y >= bottom) {
+    return false;
+  }
+  roi->x = x;
+  roi->y = y;
+  roi->width = right - x;
+  roi->height = bottom - y;
+  return true;
+}
+
+void density_sum_rgb565(const uint8_t *frame, size_t stride, const density_roi_t *roi, density_sums_t *sums) {
+  uint8_t luma[DENSITY_CHUNK];
+  uint32_t bins[4][DENSITY_HISTOGRAM_BINS];
+  memset(sums, 0, sizeof(*sums));
+  memset(bins, 0, sizeof(bins));
+
+  for (uint16_t row = 0; row < roi->height; row++) {
+    const uint8_t *pixels = frame + (size_t)(roi->y + row) * stride + (size_t)roi->x * 2;
+    for (size_t done = 0; done < roi->width; done += DENSITY_CHUNK) {
+      size_t count = roi->width - done < DENSITY_CHUNK ? roi->width - done : DENSITY_CHUNK;
+      sum_rgb565_chunk(pixels + done * 2, count, luma, sums);
+      histogram_chunk(luma, count, bins);
+    }
+  }
+  merge_histograms(bins, sums);
+  sums->pixels = (uint32_t)roi->width * roi->height;
+}
+
+void density_sum_grayscale(const uint8_t *frame, size_t stride, const density_roi_t *roi, density_sums_t *sums) {
+  uint32_t bins[4][DENSITY_HISTOGRAM_BINS];
+  memset(sums, 0, sizeof(*sums));
+  memset(bins, 0, sizeof(bins));
+
+  for (uint16_t row = 0; row < roi->height; row++) {
+    const uint8_t *pixels = frame + (size_t)(roi->y + row) * stride + roi->x;
+    uint32_t row_sum = 0;
+    for (size_t i = 0; i < roi->width; i++) {
+      row_sum += pixels[i];
+    }
+    sums->luma += row_sum;
+    histogram_chunk(pixels, roi->width, bins);
+  }
+  merge_histograms(bins, sums);
+  sums->red = sums->green = sums->blue = sums->luma;
+  sums->pixels = (uint32_t)roi->width * roi->height;
+}
+
+void density_finish(const density_sums_t *sums, bool color, float blank_luminance, density_result_t *result) {
+  result->pixels = sums->pixels;
+  memcpy(result->histogram, sums->histogram, sizeof(result->histogram));
+  if (sums->pixels == 0) {
+    result->luminance = result->red = result->green = result->blue = NAN;
+    result->green_ratio = result->optical_density = NAN;
+    return;
+  }
+  float pixels = (float)sums->pixels;
+  result->luminance = sums->luma / pixels;
+  result->red = sums->red / pixels;
+  result->green = sums->green / pixels;
+  result->blue = sums->blue / pixels;
+
+  uint32_t total = sums->red + sums->green + sums->blue;
+  result->green_ratio = color && total > 0 ? (float)sums->green / total : NAN;
+  // A black ROI has no defined density; the luminance is floored at half a level
+  float luminance = result->luminance > 0.5f ? result->luminance : 0.5f;
+  result->optical_density = blank_luminance > 0 ? -log10f(luminance / blank_luminance) : NAN;
+}
+
+// Appends to the JSON text; false once it does not fit
+static bool append(char *output, size_t size, size_t *length, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(output + *length, size - *length, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= size - *length) {
+    return false;
+  }
+  *length += written;
+  return true;
+}
+
+// Number or null, as JSON has no NaN
+static bool append_number(char *output, size_t size, size_t *length, const char *key, float value, int decimals) {
+  if (isnan(value)) {
+    return append(output, size, length, "\"%s\":null,", key);
+  }
+  return append(output, size, length, "\"%s\":%.*f,", key, decimals, value);
+}
+
+size_t density_format_json(const density_result_t *result, const density_window_t *window, char *output, size_t size) {
+  size_t length = 0;
+  bool fits = append(output, size, &length, "{\"roi\":{\"x\":%u,\"y\":%u,\"w\":%u,\"h\":%u},\"pixels\":%u,", window->x, window->y, window->width,
+                     window->height, (unsigned)result->pixels)
+              && append_number(output, size, &length, "luminance", result->luminance, 2) && append_number(output, size, &length, "red", result->red, 2)
+              && append_number(output, size, &length, "green", result->green, 2) && append_number(output, size, &length, "blue", result->blue, 2)
+              && append_number(output, size, &length, "greenRatio", result->green_ratio, 4)
+              && append_number(output, size, &length, "opticalDensity", result->optical_density, 4) && append(output, size, &length, "\"histogram\":[");
+  for (int bin = 0; fits && bin < DENSITY_HISTOGRAM_BINS; bin++) {
+    fits = append(output, size, &length, bin == 0 ? "%u" : ",%u", (unsigned)result->histogram[bin]);
+  }
+  return fits && append(output, size, &length, "]}") ? length : 0;
+}
@@ -0,0 +1,71 @@
+// culture_density.h
+#ifndef CULTURE_DENSITY_H
+#define CULTURE_DENSITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Optical density and color of the culture, measured on a region of interest (ROI) of the camera frames.
+//
+// The kernels only sum integers over the rows of the ROI, so they run the same on the ESP32 and on a
+// computer (tools/density_bench.cpp), and the inner loops have no branch and no table lookup for the
+// compiler to vectorize where the target has SIMD. The values are derived from the sums at the end:
+//   luminance        mean BT.601 luma, (77 R + 150 G + 29 B) / 256, 0-255
+//   green_ratio      green chromaticity G / (R + G + B): rises with the chlorophyll of the culture
+//   optical_density  -log10(luminance / blank), against the luminance of the medium without cells
+//   histogram        luma of the pixels of the ROI, DENSITY_HISTOGRAM_BINS bins of 8 levels
+
+#define DENSITY_HISTOGRAM_BINS 32
+
+typedef struct {
+  uint16_t x;
+  uint16_t y;
+  uint16_t width;
+  uint16_t height;
+} density_roi_t;
+
+// Integer sums over the ROI (channels expanded to 8 bits). They fit in 32 bits up to 16 million pixels.
+typedef struct {
+  uint32_t pixels;
+  uint32_t luma;
+  uint32_t red;
+  uint32_t green;
+  uint32_t blue;
+  uint32_t histogram[DENSITY_HISTOGRAM_BINS];
+} density_sums_t;
+
+typedef struct {
+  uint32_t pixels;
+  float luminance;
+  float red;
+  float green;
+  float blue;
+  float green_ratio;        // NAN for grayscale frames
+  float optical_density;    // NAN without a blank
+  uint32_t histogram[DENSITY_HISTOGRAM_BINS];
+} density_result_t;
+
+// ROI in thousandths of the frame, so it does not depend on the frame size
+typedef struct {
+  uint16_t x;
+  uint16_t y;
+  uint16_t width;
+  uint16_t height;
+} density_window_t;
+
+// Pixels of a window on a frame of width x height; false if it is empty
+bool density_roi_from_window(const density_window_t *window, uint16_t width, uint16_t height, density_roi_t *roi);
+
+// Sums of an RGB565 frame in the byte order of the camera (high byte first); stride in bytes
+void density_sum_rgb565(const uint8_t *frame, size_t stride, const density_roi_t *roi, density_sums_t *sums);
+
+// Sums of an 8-bit grayscale frame; stride in bytes
+void density_sum_grayscale(const uint8_t *frame, size_t stride, const density_roi_t *roi, density_sums_t *sums);
+
+// Means, ratios and optical density of the sums; blank_luminance <= 0 if the blank was not measured
+void density_finish(const density_sums_t *sums, bool color, float blank_luminance, density_result_t *result);
+
+// JSON object of a result and its window; length written, 0 if it does not fit
+size_t density_format_json(const density_result_t *result, const density_window_t *window, char *output, size_t size);
+
+#endif  // CULTURE_DENSITY_H
@@ -0,0 +1,109 @@
+// frame_pool.cpp
+#include "frame_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#if defined(ESP_PLATFORM)
+#include "esp_heap_caps.h"
+#endif
+
+// Frames go to PSRAM when the board has it, leaving the internal RAM to the network stack
+static uint8_t *allocate_frame(size_t size) {
+#if defined(ESP_PLATFORM)
+  uint8_t *data = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (data) {
+    return data;
+  }
+#endif
+  return (uint8_t *)malloc(size);
+}
+
+frame_slot_t *frame_pool_writable(frame_pool_t *pool) {
+  std::lock_guard<std::mutex> guard(pool->lock);
+  frame_slot_t *best = nullptr;
+  for (frame_slot_t &slot : pool->slots) {
+    if (slot.references > 0 || slot.writing || &slot == pool->newest) {
+      continue;
+    }
+    if (best == nullptr || slot.capacity > best->capacity) {
+      best = &slot;
+    }
+  }
+  if (best) {
+    best->writing = true;
+  }
+  return best;
+}
+
+bool frame_pool_copy(frame_pool_t *pool, frame_slot_t *slot, const uint8_t *data, size_t length, const struct timeval *timestamp) {
+  if (length > slot->capacity) {
+    // Some room to spare, so the next frames (of varying JPEG size) fit as well
+    size_t capacity = length + length / 4;
+    free(slot->data);
+    slot->data = allocate_frame(capacity);
+    pool->allocations++;
+    slot->capacity = slot->data ? capacity : 0;
+    if (!slot->data) {
+      slot->length = 0;
+      return false;
+    }
+  }
+  memcpy(slot->data, data, length);
+  slot->length = length;
+  slot->timestamp = *timestamp;
+  return true;
+}
+
+void frame_pool_adopt(frame_slot_t *slot, uint8_t *data, size_t length, const struct timeval *timestamp) {
+  free(slot->data);
+  slot->data = data;
+  slot->length = length;
+  slot->capacity = length;
+  slot->timestamp = *timestamp;
+}
+
+void frame_pool_publish(frame_pool_t *pool, frame_slot_t *slot) {
+  {
+    std::lock_guard<std::mutex> guard(pool->lock);
+    slot->writing = false;
+    slot->sequence = ++pool->sequence;
+    pool->newest = slot;
+  }
+  pool->published.notify_all();
+}
+
+void frame_pool_discard(frame_pool_t *pool, frame_slot_t *slot) {
+  std::lock_guard<std::mutex> guard(pool->lock);
+  slot->writing = false;
+}
+
+const frame_slot_t *frame_pool_acquire(frame_pool_t *pool, uint32_t after, uint32_t timeout_ms) {
+  std::unique_lock<std::mutex> guard(pool->lock);
+  bool ready = pool->published.wait_for(guard, std::chrono::milliseconds(timeout_ms), [pool, after] {
+    return pool->newest != nullptr && pool->newest->sequence != after;
+  });
+  if (!ready) {
+    return nullptr;
+  }
+  pool->newest->references++;
+  return pool->newest;
+}
+
+void frame_pool_release(frame_pool_t *pool, const frame_slot_t *slot) {
+  std::lock_guard<std::mutex> guard(pool->lock);
+  const_cast<frame_slot_t *>(slot)->references--;
+}
+
+void frame_pool_trim(frame_pool_t *pool) {
+  std::lock_guard<std::mutex> guard(pool->lock);
+  pool->newest = nullptr;
+  for (frame_slot_t &slot : pool->slots) {
+    if (slot.references > 0 || slot.writing) {
+      continue;
+    }
+    free(slot.data);
+    slot.data = nullptr;
+    slot.length = slot.capacity = 0;
+  }
+}
@@ -0,0 +1,67 @@
+// frame_pool.h
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <condition_variable>
+#include <mutex>
+
+// Encoded frames shared between one producer and up to FRAME_POOL_MAX_READERS readers (the MJPEG clients).
+//
+// The producer captures and encodes each frame once into a free slot and publishes it; every reader takes
+// a reference on the newest published frame, sends it from the slot as it is and releases it. The producer
+// never waits on the readers: a slot is free when no reader holds it and it is not the newest frame, and
+// with FRAME_POOL_SLOTS = readers + 2 there is always one (each reader holds at most one slot, one holds the
+// newest frame). A reader slower than the camera skips to the newest frame each time, so its frames are
+// dropped rather than the capture stalled. The buffers are kept from frame to frame (in PSRAM on the
+// ESP32), the producer picking the free slot with the largest buffer, until frame_pool_trim().
+//
+// The slots are handed out under a mutex, for a few instructions per frame; the frames are read without it.
+// It runs the same on a computer (tools/stream_bench.cpp).
+
+#define FRAME_POOL_MAX_READERS 4
+#define FRAME_POOL_SLOTS (FRAME_POOL_MAX_READERS + 2)
+
+typedef struct {
+  uint8_t *data;
+  size_t length;
+  size_t capacity;
+  struct timeval timestamp;
+  uint32_t sequence;      // 1 for the first frame published
+  uint8_t references;     // Readers holding the slot
+  bool writing;           // Taken by the producer
+} frame_slot_t;
+
+typedef struct {
+  std::mutex lock;
+  std::condition_variable published;
+  frame_slot_t slots[FRAME_POOL_SLOTS];
+  frame_slot_t *newest;
+  uint32_t sequence;
+  uint32_t allocations;   // Buffers (re)allocated, for the statistics
+} frame_pool_t;
+
+// Producer: free slot to fill, nullptr only if more than FRAME_POOL_MAX_READERS readers hold frames
+frame_slot_t *frame_pool_writable(frame_pool_t *pool);
+
+// Producer: copies a frame into the slot, growing its buffer if needed; false if it cannot be allocated
+bool frame_pool_copy(frame_pool_t *pool, frame_slot_t *slot, const uint8_t *data, size_t length, const struct timeval *timestamp);
+
+// Producer: gives the slot a buffer from malloc() (a frame encoded elsewhere), freed by the pool
+void frame_pool_adopt(frame_slot_t *slot, uint8_t *data, size_t length, const struct timeval *timestamp);
+
+// Producer: makes the slot the newest frame and wakes the readers, or gives it back unpublished
+void frame_pool_publish(frame_pool_t *pool, frame_slot_t *slot);
+void frame_pool_discard(frame_pool_t *pool, frame_slot_t *slot);
+
+// Reader: newest frame published after the sequence after, waiting up to timeout_ms for it; nullptr on
+// timeout. The frame stays valid until frame_pool_release().
+const frame_slot_t *frame_pool_acquire(frame_pool_t *pool, uint32_t after, uint32_t timeout_ms);
+void frame_pool_release(frame_pool_t *pool, const frame_slot_t *slot);
+
+// Frees the buffers of the slots nobody holds (the stream stopped); the newest frame is forgotten
+void frame_pool_trim(frame_pool_t *pool);
+
+#endif  // FRAME_POOL_H
@@ -0,0 +1,234 @@
+// mixing_monitor.cpp
+#include "mixing_monitor.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// Cell boundaries of a grid over a span of pixels: cell i covers [bounds[i], bounds[i + 1])
+static void grid_bounds(uint16_t span, uint8_t cells, uint16_t *bounds) {
+  for (uint8_t i = 0; i <= cells; i++) {
+    bounds[i] = (uint32_t)i * span / cells;
+  }
+}
+
+static uint8_t grid_size(uint16_t span, uint8_t max_cells) {
+  return span < max_cells ? (uint8_t)span : max_cells;
+}
+
+// Luma sum of a run of RGB565 pixels, as culture_density (bit replication, BT.601 weights); no branch
+static uint32_t sum_rgb565_luma(const uint8_t *pixels, size_t count) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint16_t high = pixels[2 * i];
+    uint16_t low = pixels[2 * i + 1];
+    uint16_t red = (high & 0xF8) | (high >> 5);
+    uint16_t green = ((high & 0x07) << 5) | ((low & 0xE0) >> 3) | ((high & 0x06) >> 1);
+    uint16_t blue = ((low & 0x1F) << 3) | ((low & 0x1C) >> 2);
+    sum += (uint16_t)(77 * red + 150 * green + 29 * blue) >> 8;
+  }
+  return sum;
+}
+
+static uint32_t sum_gray(const uint8_t *pixels, size_t count) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    sum += pixels[i];
+  }
+  return sum;
+}
+
+// Rows of the ROI are summed into the cells of their grid row, which are closed when the grid row ends
+static void make_grid(const uint8_t *frame, size_t stride, const density_roi_t *roi, bool rgb565, mixing_grid_t *grid) {
+  uint16_t columns[MIXING_GRID_COLUMNS + 1];
+  uint16_t rows[MIXING_GRID_ROWS + 1];
+  uint32_t sums[MIXING_GRID_COLUMNS];
+  grid->columns = grid_size(roi->width, MIXING_GRID_COLUMNS);
+  grid->rows = grid_size(roi->height, MIXING_GRID_ROWS);
+  grid_bounds(roi->width, grid->columns, columns);
+  grid_bounds(roi->height, grid->rows, rows);
+  size_t pixel_size = rgb565 ? 2 : 1;
+
+  uint16_t *cell = grid->cells;
+  for (uint8_t row = 0; row < grid->rows; row++) {
+    memset(sums, 0, sizeof(sums));
+    for (uint16_t y = rows[row]; y < rows[row + 1]; y++) {
+      const uint8_t *pixels = frame + (size_t)(roi->y + y) * stride + (size_t)roi->x * pixel_size;
+      for (uint8_t column = 0; column < grid->columns; column++) {
+        const uint8_t *start = pixels + (size_t)columns[column] * pixel_size;
+        size_t count = columns[column + 1] - columns[column];
+        sums[column] += rgb565 ? sum_rgb565_luma(start, count) : sum_gray(start, count);
+      }
+    }
+    uint32_t height = rows[row + 1] - rows[row];
+    for (uint8_t column = 0; column < grid->columns; column++) {
+      uint32_t pixels = (columns[column + 1] - columns[column]) * height;
+      *cell++ = (uint16_t)((sums[column] * 16 + pixels / 2) / pixels);
+    }
+  }
+}
+
+void mixing_grid_rgb565(const uint8_t *frame, size_t stride, const density_roi_t *roi, mixing_grid_t *grid) {
+  make_grid(frame, stride, roi, true, grid);
+}
+
+void mixing_grid_grayscale(const uint8_t *frame, size_t stride, const density_roi_t *roi, mixing_grid_t *grid) {
+  make_grid(frame, stride, roi, false, grid);
+}
+
+void mixing_monitor_init(mixing_monitor_t *monitor) {
+  mixing_config_t *config = &monitor->config;
+  config->learning_frames = 60;
+  config->baseline_weight = 0.02f;
+  config->still_ratio = 0.25f;
+  config->still_floor = 0.15f;
+  config->surge_sigma = 4.0f;
+  config->surge_ratio = 2.0f;
+  config->hold_still = 20;
+  config->hold_surge = 4;
+  config->clear_frames = 10;
+  monitor->events = 0;
+  mixing_monitor_reset(monitor);
+}
+
+void mixing_monitor_reset(mixing_monitor_t *monitor) {
+  monitor->state = MIXING_LEARNING;
+  monitor->pending = MIXING_LEARNING;
+  monitor->has_previous = false;
+  monitor->frames = 0;
+  monitor->baseline = 0;
+  monitor->deviation = 0;
+  monitor->score = monitor->active = monitor->offset = 0;
+  monitor->run = 0;
+  monitor->cost_us = 0;
+}
+
+void mixing_monitor_forget_frame(mixing_monitor_t *monitor) {
+  monitor->has_previous = false;
+}
+
+// Offset, score and active cells of the difference of two grids of the same size
+static void score_difference(const mixing_grid_t *previous, const mixing_grid_t *current, mixing_monitor_t *monitor) {
+  size_t cells = (size_t)current->columns * current->rows;
+  int32_t total = 0;
+  for (size_t i = 0; i < cells; i++) {
+    total += (int32_t)current->cells[i] - previous->cells[i];
+  }
+  int32_t offset = total / (int32_t)cells;
+
+  uint32_t absolute = 0;
+  uint32_t active = 0;
+  for (size_t i = 0; i < cells; i++) {
+    int32_t difference = (int32_t)current->cells[i] - previous->cells[i] - offset;
+    uint32_t magnitude = difference < 0 ? -difference : difference;
+    absolute += magnitude;
+    active += magnitude > MIXING_ACTIVE_LEVELS * 16;
+  }
+  monitor->offset = offset / 16.0f;
+  monitor->score = absolute / (16.0f * cells);
+  monitor->active = (float)active / cells;
+}
+
+// State the score of a frame points to, against the baseline
+static mixing_state_t classify(const mixing_monitor_t *monitor) {
+  const mixing_config_t *config = &monitor->config;
+  float still = config->still_ratio * monitor->baseline;
+  if (monitor->score < still || monitor->score < config->still_floor) {
+    return MIXING_NO_MOTION;
+  }
+  float surge = monitor->baseline + config->surge_sigma * monitor->deviation;
+  if (monitor->score > surge && monitor->score > config->surge_ratio * monitor->baseline) {
+    return MIXING_FOAM_SURGE;
+  }
+  return MIXING_NORMAL;
+}
+
+static void update_baseline(mixing_monitor_t *monitor, float weight) {
+  float error = monitor->score - monitor->baseline;
+  monitor->baseline += weight * error;
+  monitor->deviation += weight * (fabsf(error) - monitor->deviation);
+}
+
+bool mixing_monitor_update(mixing_monitor_t *monitor, const mixing_grid_t *grid) {
+  bool comparable = monitor->has_previous && grid->columns == monitor->previous.columns && grid->rows == monitor->previous.rows;
+  if (comparable) {
+    score_difference(&monitor->previous, grid, monitor);
+  }
+  monitor->previous = *grid;
+  monitor->has_previous = true;
+  if (!comparable) {
+    return false;
+  }
+  monitor->frames++;
+
+  // Plain mean of the first frames, then the rolling baseline
+  const mixing_config_t *config = &monitor->config;
+  if (monitor->state == MIXING_LEARNING) {
+    update_baseline(monitor, 1.0f / monitor->frames);
+    if (monitor->frames < config->learning_frames) {
+      return false;
+    }
+    monitor->state = MIXING_NORMAL;
+    monitor->run = 0;
+    return false;
+  }
+
+  mixing_state_t observed = classify(monitor);
+  if (observed == MIXING_NORMAL && monitor->state == MIXING_NORMAL) {
+    update_baseline(monitor, config->baseline_weight);
+  }
+
+  // The state changes after a run of frames pointing the same way
+  if (observed == monitor->state) {
+    monitor->run = 0;
+    return false;
+  }
+  if (observed != monitor->pending) {
+    monitor->pending = observed;
+    monitor->run = 0;
+  }
+  monitor->run++;
+  uint16_t hold = observed == MIXING_NO_MOTION ? config->hold_still : observed == MIXING_FOAM_SURGE ? config->hold_surge : config->clear_frames;
+  if (monitor->run < hold) {
+    return false;
+  }
+  monitor->state = observed;
+  monitor->run = 0;
+  monitor->events++;
+  return true;
+}
+
+const char *mixing_state_name(mixing_state_t state) {
+  switch (state) {
+    case MIXING_LEARNING:   return "learning";
+    case MIXING_NORMAL:     return "normal";
+    case MIXING_NO_MOTION:  return "no_motion";
+    case MIXING_FOAM_SURGE: return "foam_surge";
+    default:                return "unknown";
+  }
+}
+
+size_t mixing_format_json(const mixing_monitor_t *monitor, const density_window_t *window, char *output, size_t size) {
+  int length = snprintf(output, size,
+                        "{\"roi\":{\"x\":%u,\"y\":%u,\"w\":%u,\"h\":%u},\"state\":\"%s\",\"frames\":%u,\"score\":%.3f,\"baseline\":%.3f,"
+                        "\"deviation\":%.3f,\"active\":%.3f,\"offset\":%.2f,\"events\":%u,\"costMs\":%.1f}",
+                        window->x, window->y, window->width, window->height, mixing_state_name(monitor->state), (unsigned)monitor->frames,
+                        monitor->score, monitor->baseline, monitor->deviation, monitor->active, monitor->offset, (unsigned)monitor->events,
+                        monitor->cost_us / 1000.0f);
+  return length > 0 && (size_t)length < size ? length : 0;
+}
+
+size_t mixing_format_event(const mixing_monitor_t *monitor, uint32_t unix_time, uint16_t milliseconds, char *output, size_t size) {
+  // Back to normal is reported as its own event name, the other states by theirs
+  const char *name = monitor->state == MIXING_NORMAL ? "mixing_normal" : mixing_state_name(monitor->state);
+  int length = snprintf(output, size, "{\"ev\":\"%s\",\"comm\":\"score %.2f baseline %.2f active %.2f\",\"score\":%.3f,\"baseline\":%.3f,\"active\":%.3f",
+                        name, monitor->score, monitor->baseline, monitor->active, monitor->score, monitor->baseline, monitor->active);
+  if (length > 0 && (size_t)length < size && unix_time != 0) {
+    length += snprintf(output + length, size - length, ",\"t\":%u,\"ms\":%u", (unsigned)unix_time, (unsigned)milliseconds);
+  }
+  if (length <= 0 || (size_t)length + 1 >= size) {
+    return 0;
+  }
+  output[length++] = '}';
+  output[length] = '\0';
+  return length;
+}
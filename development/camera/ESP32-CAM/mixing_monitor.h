@@ -0,0 +1,102 @@
+// mixing_monitor.h
+#ifndef MIXING_MONITOR_H
+#define MIXING_MONITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "culture_density.h"
+
+// Verification of the mixing from the camera stream, by frame differences on a region of interest (ROI).
+//
+// Each frame is reduced to a grid of block means of its luma (at most MIXING_GRID_COLUMNS x MIXING_GRID_ROWS
+// cells over the ROI), which averages the sensor noise away and leaves a few hundred values to compare. The
+// motion score of a frame is the mean absolute difference of its cells with the previous frame, once their
+// common offset is taken out (a change of the room lighting moves all the cells together):
+//   score      mean |d - offset| of the cells, in luma levels
+//   active     fraction of the cells whose |d - offset| exceeds MIXING_ACTIVE_LEVELS
+// The score of a stirred culture (moving bubbles and turbulence) is learnt as a rolling baseline, an
+// exponential mean of the score and of its deviation, updated by the normal frames only. Against it:
+//   no_motion   score below still_ratio x baseline (or below still_floor) for hold_still frames: the
+//               stirring stopped or the culture sedimented
+//   foam_surge  score above baseline + surge_sigma x deviation and surge_ratio x baseline, for hold_surge
+//               frames: foam or a burst of bubbles over the ROI
+// and the state returns to normal after clear_frames normal frames. The counts are in frames, so they
+// follow the sampling interval of the caller. Like culture_density, it runs the same on a computer
+// (tools/mixing_bench.cpp).
+
+#define MIXING_GRID_COLUMNS 32
+#define MIXING_GRID_ROWS 24
+#define MIXING_GRID_CELLS (MIXING_GRID_COLUMNS * MIXING_GRID_ROWS)
+#define MIXING_ACTIVE_LEVELS 4
+
+// Block means of the luma, in 1/16 of a level
+typedef struct {
+  uint8_t columns;
+  uint8_t rows;
+  uint16_t cells[MIXING_GRID_CELLS];
+} mixing_grid_t;
+
+typedef enum {
+  MIXING_LEARNING,
+  MIXING_NORMAL,
+  MIXING_NO_MOTION,
+  MIXING_FOAM_SURGE,
+} mixing_state_t;
+
+typedef struct {
+  uint16_t learning_frames;  // Frames averaged into the first baseline
+  float baseline_weight;     // Weight of a normal frame in the rolling baseline
+  float still_ratio;
+  float still_floor;         // Levels: below it a frame is still, whatever the baseline
+  float surge_sigma;
+  float surge_ratio;
+  uint16_t hold_still;
+  uint16_t hold_surge;
+  uint16_t clear_frames;
+} mixing_config_t;
+
+typedef struct {
+  mixing_config_t config;
+  mixing_state_t state;
+  mixing_grid_t previous;
+  bool has_previous;
+  uint32_t frames;           // Frames scored since the last reset
+  float baseline;
+  float deviation;
+  float score;               // Last frame
+  float active;
+  float offset;
+  uint16_t run;              // Consecutive frames pointing to another state
+  mixing_state_t pending;
+  uint32_t events;
+  uint32_t cost_us;          // Processing time of the last frame, set by the caller
+} mixing_monitor_t;
+
+// Defaults for a frame every 500 ms: 30 s of learning, no motion after 10 s, surge after 2 s
+void mixing_monitor_init(mixing_monitor_t *monitor);
+
+// Learns the baseline again (another stirring speed or ROI), keeping the configuration
+void mixing_monitor_reset(mixing_monitor_t *monitor);
+
+// The next frame is not compared with the previous one (frames skipped, lit differently)
+void mixing_monitor_forget_frame(mixing_monitor_t *monitor);
+
+// Grid of an RGB565 frame in the byte order of the camera (high byte first), or of an 8-bit grayscale
+// frame; stride in bytes
+void mixing_grid_rgb565(const uint8_t *frame, size_t stride, const density_roi_t *roi, mixing_grid_t *grid);
+void mixing_grid_grayscale(const uint8_t *frame, size_t stride, const density_roi_t *roi, mixing_grid_t *grid);
+
+// Scores the grid of a new frame; true if the state changed (an event to publish)
+bool mixing_monitor_update(mixing_monitor_t *monitor, const mixing_grid_t *grid);
+
+const char *mixing_state_name(mixing_state_t state);
+
+// JSON status of the monitor and its window; length written, 0 if it does not fit
+size_t mixing_format_json(const mixing_monitor_t *monitor, const density_window_t *window, char *output, size_t size);
+
+// Event line of the current state for the bridge, in the format of the events of the Mega:
+//   {"ev":"no_motion","comm":"score 0.21 baseline 3.40 active 0.00","score":0.21,...,"t":<unix>,"ms":<ms>}
+// The time is left out while unix_time is 0. Length written, 0 if it does not fit.
+size_t mixing_format_event(const mixing_monitor_t *monitor, uint32_t unix_time, uint16_t milliseconds, char *output, size_t size);
+
+#endif  // MIXING_MONITOR_H
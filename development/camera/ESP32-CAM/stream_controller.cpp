@@ -0,0 +1,268 @@
+// stream_controller.cpp
+#include "stream_controller.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DEMAND_HIGH  0.9f   // Of the capacity, to go down
+#define DEMAND_LOW   0.8f   // Of the capacity, for the level above to go up
+#define FPS_MISSED   0.85f  // Of the frames produced, below which a client misses frames
+#define FPS_KEPT     0.95f
+#define MAX_STEPS    3
+#define RETRY_GROWTH 1.5f  // Of the capacity at which a level failed, to try it again at once
+
+void stream_controller_init(stream_controller_t *controller, const stream_level_t *levels, uint8_t level_count, uint8_t start_level) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  stream_controller_config_t *config = &controller->config;
+  config->target_fps = 15;
+  config->max_bandwidth = 0;
+  config->period_us = 1000000;
+  config->down_periods = 2;
+  config->up_periods = 3;
+  config->hold_periods = 2;
+  config->retry_periods = 30;
+  config->up_growth = 1.6f;
+
+  controller->levels = levels;
+  controller->level_count = level_count < STREAM_MAX_LEVELS ? level_count : STREAM_MAX_LEVELS;
+  controller->level = start_level < controller->level_count ? start_level : controller->level_count - 1;
+  controller->automatic = true;
+  controller->apply = false;
+  memset(&controller->metrics, 0, sizeof(controller->metrics));
+  memset(controller->step_ratio, 0, sizeof(controller->step_ratio));
+  controller->from_level = controller->level;
+  controller->from_bytes = 0;
+  controller->period_start = 0;
+  controller->frames = 0;
+  controller->bytes = controller->capture_us = controller->encode_us = 0;
+  memset(controller->readers, 0, sizeof(controller->readers));
+  controller->over = controller->under = controller->hold = 0;
+  controller->failed_level = 0;
+  controller->failed_wait = 0;
+  controller->failed_capacity = 0;
+  controller->changes = 0;
+}
+
+void stream_controller_set_auto(stream_controller_t *controller, bool automatic) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  if (automatic && !controller->automatic) {
+    controller->apply = true;
+    controller->over = controller->under = 0;
+  }
+  controller->automatic = automatic;
+}
+
+void stream_controller_set_target(stream_controller_t *controller, float target_fps, uint32_t max_bandwidth) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  controller->config.target_fps = target_fps;
+  controller->config.max_bandwidth = max_bandwidth;
+  controller->failed_wait = 0;  // A level left under the old target may fit the new one
+}
+
+uint32_t stream_controller_frame_interval_us(stream_controller_t *controller) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  return controller->config.target_fps > 0 ? (uint32_t)(1e6f / controller->config.target_fps) : 0;
+}
+
+uint8_t stream_controller_join(stream_controller_t *controller) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  for (uint8_t reader = 0; reader < FRAME_POOL_MAX_READERS; reader++) {
+    if (!controller->readers[reader].active) {
+      memset(&controller->readers[reader], 0, sizeof(controller->readers[reader]));
+      controller->readers[reader].active = true;
+      return reader;
+    }
+  }
+  return FRAME_POOL_MAX_READERS;
+}
+
+void stream_controller_leave(stream_controller_t *controller, uint8_t reader) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  if (reader < FRAME_POOL_MAX_READERS) {
+    controller->readers[reader].active = false;
+  }
+}
+
+void stream_controller_captured(stream_controller_t *controller, size_t bytes, uint32_t capture_us, uint32_t encode_us) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  controller->frames++;
+  controller->bytes += bytes;
+  controller->capture_us += capture_us;
+  controller->encode_us += encode_us;
+}
+
+void stream_controller_sent(stream_controller_t *controller, uint8_t reader, size_t bytes, uint32_t send_us) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  if (reader < FRAME_POOL_MAX_READERS && controller->readers[reader].active) {
+    controller->readers[reader].frames++;
+    controller->readers[reader].bytes += bytes;
+    controller->readers[reader].send_us += send_us;
+  }
+}
+
+// First frame bytes after a change, settled: the ratio to those before, shared out between the levels
+// of the change
+static void measure_steps(stream_controller_t *controller, float bytes) {
+  uint8_t from = controller->from_level;
+  uint8_t to = controller->level;
+  if (from == to || controller->from_bytes <= 0 || bytes <= 0) {
+    return;
+  }
+  uint8_t best = from < to ? from : to;
+  uint8_t steps = from < to ? to - from : from - to;
+  float ratio = from < to ? controller->from_bytes / bytes : bytes / controller->from_bytes;
+  ratio = ratio < 1 ? 1 : ratio > 4 ? 4 : ratio;
+  float step = powf(ratio, 1.0f / steps);
+  for (uint8_t level = best; level < best + steps; level++) {
+    controller->step_ratio[level] = step;
+  }
+  controller->from_level = to;
+}
+
+// Metrics of the period that ends, for the client that received the fewest frames; starts the next one
+static void close_period(stream_controller_t *controller, int64_t now_us) {
+  stream_metrics_t *metrics = &controller->metrics;
+  float seconds = (now_us - controller->period_start) / 1e6f;
+  uint32_t frames = controller->frames;
+  metrics->capture_fps = frames / seconds;
+  metrics->frame_bytes = frames ? (float)controller->bytes / frames : 0;
+  metrics->capture_ms = frames ? controller->capture_us / 1000.0f / frames : 0;
+  metrics->encode_ms = frames ? controller->encode_us / 1000.0f / frames : 0;
+  if (frames > 0 && controller->hold == 0) {
+    measure_steps(controller, metrics->frame_bytes);
+  }
+
+  const stream_reader_stats_t *slowest = NULL;
+  metrics->clients = 0;
+  for (stream_reader_stats_t &reader : controller->readers) {
+    if (!reader.active) {
+      continue;
+    }
+    metrics->clients++;
+    if (slowest == NULL || reader.frames < slowest->frames || (reader.frames == slowest->frames && reader.send_us > slowest->send_us)) {
+      slowest = &reader;
+    }
+  }
+  if (slowest) {
+    metrics->fps = slowest->frames / seconds;
+    metrics->send_ms = slowest->frames ? slowest->send_us / 1000.0f / slowest->frames : 0;
+    metrics->link_rate = slowest->send_us ? slowest->bytes * 1e6f / slowest->send_us : 0;
+    metrics->bandwidth = slowest->bytes / seconds;
+  } else {
+    metrics->fps = metrics->capture_fps;
+    metrics->send_ms = metrics->link_rate = metrics->bandwidth = 0;
+  }
+
+  controller->period_start = now_us;
+  controller->frames = 0;
+  controller->bytes = controller->capture_us = controller->encode_us = 0;
+  for (stream_reader_stats_t &reader : controller->readers) {
+    reader.frames = 0;
+    reader.bytes = reader.send_us = 0;
+  }
+}
+
+static bool change_level(stream_controller_t *controller, uint8_t level) {
+  controller->from_level = controller->level;
+  controller->from_bytes = controller->metrics.frame_bytes;
+  controller->level = level;
+  controller->hold = controller->config.hold_periods;
+  controller->over = controller->under = 0;
+  controller->changes++;
+  return true;
+}
+
+// Level for the next period, from the metrics of the last one; true if it changed
+static bool decide(stream_controller_t *controller) {
+  const stream_controller_config_t *config = &controller->config;
+  const stream_metrics_t *metrics = &controller->metrics;
+  if (controller->failed_wait > 0) {
+    controller->failed_wait--;
+  }
+  if (metrics->clients == 0 || metrics->link_rate == 0) {
+    controller->over = controller->under = 0;
+    return false;
+  }
+  if (controller->hold > 0) {
+    controller->hold--;
+    return false;
+  }
+
+  // The sensor may not reach the target (long exposures): the frames it produces are what is wanted
+  float wanted_fps = metrics->capture_fps < config->target_fps ? metrics->capture_fps : config->target_fps;
+  float capacity = metrics->link_rate;
+  if (config->max_bandwidth > 0 && config->max_bandwidth < capacity) {
+    capacity = config->max_bandwidth;
+  }
+  float demand = metrics->frame_bytes * wanted_fps;
+
+  if (demand > DEMAND_HIGH * capacity || metrics->fps < FPS_MISSED * wanted_fps) {
+    controller->under = 0;
+    if (++controller->over < config->down_periods || controller->level + 1 >= controller->level_count) {
+      return false;
+    }
+    // One level per up_growth of excess, so a link that collapsed is followed at once
+    uint8_t steps = 1;
+    for (float excess = demand / (DEMAND_HIGH * capacity); excess > config->up_growth && steps < MAX_STEPS; excess /= config->up_growth) {
+      steps++;
+    }
+    uint8_t level = controller->level + steps < controller->level_count ? controller->level + steps : controller->level_count - 1;
+    controller->failed_level = controller->level;
+    controller->failed_wait = config->retry_periods;
+    controller->failed_capacity = capacity;
+    return change_level(controller, level);
+  }
+
+  uint8_t above = controller->level - 1;
+  bool blocked = above == controller->failed_level && controller->failed_wait > 0 && capacity < RETRY_GROWTH * controller->failed_capacity;
+  bool retry = controller->level > 0 && !blocked;
+  if (retry) {
+    float ratio = controller->step_ratio[above] > 0 ? controller->step_ratio[above] : config->up_growth;
+    float above_bytes = metrics->frame_bytes * ratio;
+    if (above_bytes * wanted_fps < DEMAND_LOW * capacity && metrics->fps >= FPS_KEPT * wanted_fps) {
+      controller->over = 0;
+      if (++controller->under >= config->up_periods) {
+        return change_level(controller, above);
+      }
+      return false;
+    }
+  }
+  controller->over = controller->under = 0;
+  return false;
+}
+
+bool stream_controller_poll(stream_controller_t *controller, int64_t now_us, stream_level_t *level) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  if (controller->period_start == 0) {
+    controller->period_start = now_us;
+  }
+  bool changed = false;
+  if (now_us - controller->period_start >= (int64_t)controller->config.period_us) {
+    close_period(controller, now_us);
+    changed = controller->automatic && decide(controller);
+  }
+  if (controller->automatic && controller->apply) {
+    controller->apply = false;
+    changed = true;
+  }
+  if (changed) {
+    *level = controller->levels[controller->level];
+  }
+  return changed;
+}
+
+size_t stream_controller_format_json(stream_controller_t *controller, char *output, size_t size) {
+  std::lock_guard<std::mutex> guard(controller->lock);
+  const stream_metrics_t *metrics = &controller->metrics;
+  const stream_level_t *level = &controller->levels[controller->level];
+  int length = snprintf(output, size,
+                        "\"stream_auto\":%u,\"stream_level\":%u,\"stream_framesize\":%d,\"stream_quality\":%u,\"stream_target_fps\":%.1f,"
+                        "\"stream_max_kbps\":%u,\"stream_clients\":%u,\"stream_capture_fps\":%.1f,\"stream_fps\":%.1f,\"stream_frame_bytes\":%.0f,"
+                        "\"stream_capture_ms\":%.1f,\"stream_encode_ms\":%.1f,\"stream_send_ms\":%.1f,\"stream_link_kbps\":%.0f,\"stream_kbps\":%.0f,"
+                        "\"stream_changes\":%u",
+                        controller->automatic, controller->level, level->frame_size, level->quality, controller->config.target_fps,
+                        (unsigned)(controller->config.max_bandwidth * 8 / 1000), metrics->clients, metrics->capture_fps, metrics->fps,
+                        metrics->frame_bytes, metrics->capture_ms, metrics->encode_ms, metrics->send_ms, metrics->link_rate * 8 / 1000,
+                        metrics->bandwidth * 8 / 1000, (unsigned)controller->changes);
+  return length > 0 && (size_t)length < size ? length : 0;
+}
@@ -0,0 +1,121 @@
+// stream_controller.h
+#ifndef STREAM_CONTROLLER_H
+#define STREAM_CONTROLLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include "frame_pool.h"
+
+// Closed-loop choice of the frame size and JPEG quality of the MJPEG stream, from what the frames cost.
+//
+// The producer reports every frame (its size, the time waiting for the sensor and encoding it), the
+// clients every frame they sent (its size and the time the send took). Once per period the controller
+// computes the metrics of the period, for the slowest client:
+//   capture_fps   frames published          fps          frames that client received
+//   frame_bytes   mean JPEG size           link_rate    bytes per second while sending (what its link takes)
+//   bandwidth     bytes per second sent to it
+// and compares the demand, frame_bytes x min(target_fps, capture_fps), with the capacity, the link rate
+// capped by max_bandwidth. The levels run from the best (0) to the cheapest; the controller goes down
+// when the demand exceeds 90% of the capacity or the client misses frames the camera produced, for
+// down_periods periods (several levels at once when the demand is far above), and up one level when the
+// bytes of the level above fit in 80% of the capacity for up_periods periods. Those are the current bytes
+// times the ratio between the two levels measured at the last change between them (the scene changes
+// the bytes, hardly the ratio), up_growth until then. A level it had to leave is not tried again for retry_periods,
+// unless the capacity grew by half since.
+// It waits hold_periods after a change, for the sensor to settle. A sensor that is slower than the
+// target (long exposures in low light) is not chased: only the bytes of its frames count then.
+
+#define STREAM_MAX_LEVELS 12
+
+typedef struct {
+  int frame_size;    // framesize_t of the sensor
+  uint8_t quality;   // JPEG quality of the sensor, 0-63, lower is better
+} stream_level_t;
+
+typedef struct {
+  float target_fps;
+  uint32_t max_bandwidth;   // Bytes per second, 0 for the link rate alone
+  uint32_t period_us;
+  uint8_t down_periods;
+  uint8_t up_periods;
+  uint8_t hold_periods;
+  uint16_t retry_periods;
+  float up_growth;
+} stream_controller_config_t;
+
+typedef struct {
+  float capture_fps;
+  float fps;
+  float frame_bytes;
+  float capture_ms;   // Waiting for the sensor, per frame
+  float encode_ms;    // Encoding (or copying) into the shared frame, per frame
+  float send_ms;      // Sending to the slowest client, per frame
+  float link_rate;    // Bytes per second, 0 without clients
+  float bandwidth;    // Bytes per second
+  uint8_t clients;
+} stream_metrics_t;
+
+typedef struct {
+  bool active;
+  uint32_t frames;
+  uint64_t bytes;
+  uint64_t send_us;
+} stream_reader_stats_t;
+
+typedef struct {
+  std::mutex lock;
+  stream_controller_config_t config;
+  const stream_level_t *levels;
+  uint8_t level_count;
+  uint8_t level;
+  bool automatic;
+  bool apply;                      // Level to set on the sensor at the next poll
+  stream_metrics_t metrics;        // Last period
+  float step_ratio[STREAM_MAX_LEVELS];   // Frame bytes of each level over those of the next, 0 if not measured
+  uint8_t from_level;              // Level before the last change, and its frame bytes
+  float from_bytes;
+
+  // Current period
+  int64_t period_start;
+  uint32_t frames;
+  uint64_t bytes;
+  uint64_t capture_us;
+  uint64_t encode_us;
+  stream_reader_stats_t readers[FRAME_POOL_MAX_READERS];
+
+  uint8_t over;                    // Consecutive periods calling for a lower level
+  uint8_t under;                   // ... for a higher one
+  uint8_t hold;
+  uint8_t failed_level;            // Last level left for a lower one
+  uint16_t failed_wait;            // Periods before trying it again
+  float failed_capacity;           // Capacity when it was left
+  uint32_t changes;
+} stream_controller_t;
+
+// Defaults: 15 fps, no bandwidth cap, periods of 1 s; starts automatic at start_level
+void stream_controller_init(stream_controller_t *controller, const stream_level_t *levels, uint8_t level_count, uint8_t start_level);
+
+// Automatic mode on or off (the frame size or quality set by hand); switched on, the level is set again
+void stream_controller_set_auto(stream_controller_t *controller, bool automatic);
+void stream_controller_set_target(stream_controller_t *controller, float target_fps, uint32_t max_bandwidth);
+
+// Interval between the frames of the target frame rate, for the producer to pace the capture
+uint32_t stream_controller_frame_interval_us(stream_controller_t *controller);
+
+// Clients: reader index for stream_controller_sent(), FRAME_POOL_MAX_READERS if all are taken
+uint8_t stream_controller_join(stream_controller_t *controller);
+void stream_controller_leave(stream_controller_t *controller, uint8_t reader);
+
+// Measurements of the producer and of the clients, from their own tasks
+void stream_controller_captured(stream_controller_t *controller, size_t bytes, uint32_t capture_us, uint32_t encode_us);
+void stream_controller_sent(stream_controller_t *controller, uint8_t reader, size_t bytes, uint32_t send_us);
+
+// Called by the producer after each frame: closes the period when it is over, and true with the level
+// to set on the sensor if it changed
+bool stream_controller_poll(stream_controller_t *controller, int64_t now_us, stream_level_t *level);
+
+// JSON members (no braces) of the state and metrics, for the status of the camera; length, 0 if too long
+size_t stream_controller_format_json(stream_controller_t *controller, char *output, size_t size);
+
+#endif  // STREAM_CONTROLLER_H
@@ -0,0 +1,145 @@
+/*
+ * Host check of the stream controller (stream_controller.h), on a simulated camera and WiFi link.
+ *
+ * The camera produces frames at the rate of its frame size (slower in low light, where the exposure is
+ * long), of a JPEG size following the pixels and the quality (larger in low light, where the sensor
+ * noise does not compress); one client sends the newest frame each time it is done with the last one,
+ * at the rate of the link. The capture is paced at the target frame rate, as in app_httpd.cpp. The
+ * scenario runs a good link, a weak one, low light and a good link again, under a bandwidth cap, with the
+ * levels of app_httpd.cpp, and prints the level and the metrics of the controller. It fails unless the client gets nearly all the frames with the weak link, the frames shrink
+ * in low light and the level comes back up once the link is good:
+ *
+ *   g++ -O2 -std=gnu++17 -I.. controller_bench.cpp ../stream_controller.cpp -o controller_bench
+ *   ./controller_bench
+ */
+
+#include "stream_controller.h"
+#include <cmath>
+#include <cstdio>
+
+struct Size {
+  const char *name;
+  uint32_t pixels;
+};
+
+// Levels of app_httpd.cpp, with the frame sizes as indexes into SIZES
+enum { QQVGA, HQVGA, QVGA, CIF, HVGA, VGA, SVGA };
+static const Size SIZES[] = {{"QQVGA", 160 * 120}, {"HQVGA", 240 * 176}, {"QVGA", 320 * 240}, {"CIF", 400 * 296},
+                             {"HVGA", 480 * 320}, {"VGA", 640 * 480}, {"SVGA", 800 * 600}};
+static const stream_level_t LEVELS[] = {{SVGA, 10}, {SVGA, 14}, {VGA, 10}, {VGA, 14}, {HVGA, 12},
+                                        {CIF, 12}, {QVGA, 10}, {QVGA, 16}, {HQVGA, 20}, {QQVGA, 24}};
+static const uint8_t START_LEVEL = 6;
+
+struct Phase {
+  const char *name;
+  double seconds;
+  double link;       // Bytes per second
+  bool lowLight;
+};
+
+// Frames per second of the sensor
+static double sensorFps(int size, bool lowLight) {
+  double fps = SIZES[size].pixels <= 400 * 296 ? 25 : SIZES[size].pixels <= 640 * 480 ? 20 : 12;
+  return lowLight && fps > 10 ? 10 : fps;
+}
+
+// About 1 bit per pixel at quality 10, more in low light
+static double frameBytes(const stream_level_t &level, bool lowLight, uint32_t sequence) {
+  double bytes = SIZES[level.frame_size].pixels * (10.0 / level.quality) / 8;
+  return bytes * (lowLight ? 3.0 : 1.0) * (1 + 0.05 * sin(sequence * 0.7));
+}
+
+int main() {
+  const Phase phases[] = {
+    {"good link", 30, 700000, false},
+    {"weak link", 30, 40000, false},
+    {"good, low light", 30, 700000, true},
+    {"good link", 40, 700000, false},
+  };
+  const uint32_t maxBandwidth = 400000;   // 3.2 Mbit/s, shared with the other devices
+
+  static stream_controller_t controller;
+  stream_controller_init(&controller, LEVELS, sizeof(LEVELS) / sizeof(LEVELS[0]), START_LEVEL);
+  stream_controller_set_target(&controller, 15, maxBandwidth);
+  uint8_t reader = stream_controller_join(&controller);
+  stream_level_t level = LEVELS[START_LEVEL];
+
+  int64_t now = 1;
+  int64_t phaseStart = now;
+  int64_t readerFree = 0;      // When the client is done with its frame
+  uint32_t sequence = 0;
+  bool passed = true;
+  uint8_t finalLevels[4];
+  int phaseIndex = 0;
+
+  printf("Time  phase             level  size   q   capture fps  fps   frame B  link kbps  kbps\n");
+  for (const Phase &phase : phases) {
+    int64_t end = phaseStart + (int64_t)(phase.seconds * 1e6);
+    uint32_t sentInLastThird = 0;
+    uint32_t producedInLastThird = 0;
+    double bytesInLastThird = 0;
+    int64_t lastThird = end - (int64_t)(phase.seconds * 1e6 / 3);
+    int64_t nextPrint = phaseStart + 5000000;
+    while (now < end) {
+      // A frame of the sensor, captured and published
+      double bytes = frameBytes(level, phase.lowLight, ++sequence);
+      stream_controller_captured(&controller, (size_t)bytes, 2000, 500);
+      if (now >= lastThird) {
+        producedInLastThird++;
+        bytesInLastThird += bytes;
+      }
+      // The client sends it if it is free, or the newest one once it is
+      if (readerFree <= now) {
+        uint32_t sendUs = (uint32_t)(bytes / phase.link * 1e6) + 2000;
+        stream_controller_sent(&controller, reader, (size_t)bytes, sendUs);
+        readerFree = now + sendUs;
+        if (now >= lastThird) {
+          sentInLastThird++;
+        }
+      }
+
+      // The next frames come at the new size and quality
+      stream_controller_poll(&controller, now, &level);
+      if (now >= nextPrint) {
+        nextPrint += 5000000;
+        const stream_metrics_t &m = controller.metrics;
+        printf("%4.0f  %-16s  %5u  %-5s  %2u  %11.1f  %4.1f  %7.0f  %9.0f  %4.0f\n", now / 1e6, phase.name, controller.level,
+               SIZES[level.frame_size].name, level.quality, m.capture_fps, m.fps, m.frame_bytes, m.link_rate * 8 / 1000, m.bandwidth * 8 / 1000);
+      }
+      int64_t interval = (int64_t)(1e6 / sensorFps(level.frame_size, phase.lowLight));
+      int64_t paced = stream_controller_frame_interval_us(&controller);
+      now += interval > paced ? interval : paced;
+    }
+    phaseStart = now;
+
+    // Settled by the last third of the phase
+    double sentRatio = (double)sentInLastThird / producedInLastThird;
+    double meanBytes = bytesInLastThird / producedInLastThird;
+    printf("      -> %s: %.0f%% of the frames sent, %.0f bytes per frame, level %u\n", phase.name, sentRatio * 100, meanBytes, controller.level);
+    if (sentRatio < 0.8) {
+      printf("      the client misses frames\n");
+      passed = false;
+    }
+    finalLevels[phaseIndex++] = controller.level;
+    if (meanBytes * fmin(15, sensorFps(level.frame_size, phase.lowLight)) > maxBandwidth * 1.05) {
+      printf("      over the bandwidth cap\n");
+      passed = false;
+    }
+  }
+  if (finalLevels[2] <= finalLevels[0]) {
+    printf("The level did not go down in low light\n");
+    passed = false;
+  }
+  if (controller.level > 5) {
+    printf("Level %u did not come back up with the good link\n", controller.level);
+    passed = false;
+  }
+
+  char json[512];
+  if (stream_controller_format_json(&controller, json, sizeof(json)) == 0) {
+    printf("JSON status does not fit\n");
+    return 1;
+  }
+  printf("{%s}\n%s\n", json, passed ? "OK" : "FAILED");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,172 @@
+/*
+ * Host check and benchmark of the culture density kernels (culture_density.h).
+ *
+ * Synthesizes camera frames of a culture vessel: a medium lit from behind whose channels are absorbed
+ * by the cells (Beer-Lambert, chlorophyll absorbing red and blue more than green), with sensor noise
+ * and vignetting, in the RGB565 byte order of the camera and in grayscale. Checks the integer sums
+ * against a plain per-pixel reference, prints the estimated optical density and green ratio for a
+ * range of cell densities, then times the kernels for the frame sizes of the camera:
+ *
+ *   g++ -O2 -ftree-vectorize -std=gnu++17 -I.. density_bench.cpp ../culture_density.cpp -o density_bench
+ *   ./density_bench [repetitions]
+ *
+ * Build with -fno-tree-vectorize instead to compare with the scalar loops.
+ */
+
+#include "culture_density.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct Frame {
+  uint16_t width;
+  uint16_t height;
+  std::vector<uint8_t> rgb565;   // High byte first, as the camera
+  std::vector<uint8_t> gray;
+};
+
+static const float BLANK[3] = {232.0f, 238.0f, 226.0f};
+static const float EXTINCTION[3] = {1.0f, 0.55f, 1.15f};   // Relative absorbance of the channels
+
+static uint32_t noiseState = 12345;
+static int noise(int amplitude) {
+  noiseState = noiseState * 1664525 + 1013904223;
+  return (int)((noiseState >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+static int clampLevel(float value) {
+  return value < 0 ? 0 : value > 255 ? 255 : (int)lroundf(value);
+}
+
+// Culture of optical density od (of the red channel) filling the frame, darker towards the corners
+static Frame makeFrame(uint16_t width, uint16_t height, float od) {
+  Frame frame = {width, height, std::vector<uint8_t>((size_t)width * height * 2), std::vector<uint8_t>((size_t)width * height)};
+  for (uint16_t y = 0; y < height; y++) {
+    for (uint16_t x = 0; x < width; x++) {
+      float dx = (x - width / 2.0f) / width;
+      float dy = (y - height / 2.0f) / height;
+      float vignetting = 1.0f - 0.6f * (dx * dx + dy * dy);
+      int channel[3];
+      for (int c = 0; c < 3; c++) {
+        channel[c] = clampLevel(BLANK[c] * vignetting * powf(10.0f, -od * EXTINCTION[c]) + noise(3));
+      }
+      uint16_t pixel = (uint16_t)(((channel[0] >> 3) << 11) | ((channel[1] >> 2) << 5) | (channel[2] >> 3));
+      size_t index = (size_t)y * width + x;
+      frame.rgb565[index * 2] = pixel >> 8;
+      frame.rgb565[index * 2 + 1] = pixel & 0xFF;
+      frame.gray[index] = (uint8_t)((77 * channel[0] + 150 * channel[1] + 29 * channel[2]) >> 8);
+    }
+  }
+  return frame;
+}
+
+// Plain per-pixel sums, from the 16-bit pixel value
+static density_sums_t referenceSums(const Frame& frame, const density_roi_t& roi) {
+  density_sums_t sums;
+  memset(&sums, 0, sizeof(sums));
+  for (uint16_t y = roi.y; y < roi.y + roi.height; y++) {
+    for (uint16_t x = roi.x; x < roi.x + roi.width; x++) {
+      size_t index = (size_t)y * frame.width + x;
+      uint16_t pixel = (uint16_t)(frame.rgb565[index * 2] << 8 | frame.rgb565[index * 2 + 1]);
+      uint32_t r5 = pixel >> 11;
+      uint32_t g6 = (pixel >> 5) & 0x3F;
+      uint32_t b5 = pixel & 0x1F;
+      uint32_t red = r5 << 3 | r5 >> 2;   // Bit replication: 0 -> 0, 31 -> 255
+      uint32_t green = g6 << 2 | g6 >> 4;
+      uint32_t blue = b5 << 3 | b5 >> 2;
+      uint32_t luma = (77 * red + 150 * green + 29 * blue) >> 8;
+      sums.red += red;
+      sums.green += green;
+      sums.blue += blue;
+      sums.luma += luma;
+      sums.histogram[luma >> 3]++;
+      sums.pixels++;
+    }
+  }
+  return sums;
+}
+
+static bool sameSums(const density_sums_t& a, const density_sums_t& b) {
+  return a.pixels == b.pixels && a.luma == b.luma && a.red == b.red && a.green == b.green && a.blue == b.blue
+         && memcmp(a.histogram, b.histogram, sizeof(a.histogram)) == 0;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  int repetitions = argc > 1 ? atoi(argv[1]) : 50;
+  const density_window_t centre = {250, 250, 500, 500};
+
+  // Exact sums, on a ROI with a ragged edge (not a multiple of the chunk of the kernel)
+  Frame check = makeFrame(800, 600, 0.4f);
+  density_roi_t ragged = {13, 7, 611, 333};
+  density_sums_t sums;
+  density_sum_rgb565(check.rgb565.data(), check.width * 2, &ragged, &sums);
+  if (!sameSums(sums, referenceSums(check, ragged))) {
+    printf("RGB565 sums differ from the per-pixel reference\n");
+    return 1;
+  }
+
+  // Density series: the blank is the medium without cells
+  printf("Culture OD  luminance  OD (luma)  green ratio  OD (gray)\n");
+  float blank = 0;
+  float blankGray = 0;
+  density_result_t color;
+  for (float od : {0.0f, 0.05f, 0.1f, 0.25f, 0.5f, 0.75f, 1.0f, 1.5f}) {
+    Frame frame = makeFrame(320, 240, od);
+    density_roi_t roi;
+    density_roi_from_window(&centre, frame.width, frame.height, &roi);
+    density_result_t gray;
+    density_sum_rgb565(frame.rgb565.data(), frame.width * 2, &roi, &sums);
+    density_finish(&sums, true, blank, &color);
+    density_sum_grayscale(frame.gray.data(), frame.width, &roi, &sums);
+    density_finish(&sums, false, blankGray, &gray);
+    if (od == 0) {
+      blank = color.luminance;
+      blankGray = gray.luminance;
+      color.optical_density = gray.optical_density = 0;
+    }
+    printf("%10.2f  %9.2f  %9.4f  %11.4f  %9.4f\n", od, color.luminance, color.optical_density, color.green_ratio, gray.optical_density);
+  }
+
+  char json[512];
+  if (density_format_json(&color, &centre, json, sizeof(json)) == 0) {
+    printf("JSON result does not fit\n");
+    return 1;
+  }
+  printf("%s\n", json);
+
+  // Throughput on the frame sizes of the camera, whole frame and centre ROI
+  const struct {
+    const char* name;
+    uint16_t width;
+    uint16_t height;
+  } sizes[] = {{"QVGA", 320, 240}, {"VGA", 640, 480}, {"SVGA", 800, 600}, {"UXGA", 1600, 1200}};
+  printf("\nFrame         RGB565 frame   RGB565 ROI   gray frame   (ms, on this computer)\n");
+  for (const auto& size : sizes) {
+    Frame frame = makeFrame(size.width, size.height, 0.5f);
+    density_roi_t whole = {0, 0, size.width, size.height};
+    density_roi_t roi;
+    density_roi_from_window(&centre, size.width, size.height, &roi);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) density_sum_rgb565(frame.rgb565.data(), size.width * 2, &whole, &sums);
+    double rgbFrame = secondsSince(start) * 1e3 / repetitions;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) density_sum_rgb565(frame.rgb565.data(), size.width * 2, &roi, &sums);
+    double rgbRoi = secondsSince(start) * 1e3 / repetitions;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) density_sum_grayscale(frame.gray.data(), size.width, &whole, &sums);
+    double grayFrame = secondsSince(start) * 1e3 / repetitions;
+
+    double megapixels = size.width * size.height / 1e6;
+    printf("%-5s %4ux%-4u %7.3f (%4.0f Mpx/s) %7.3f %7.3f (%4.0f Mpx/s)\n", size.name, size.width, size.height, rgbFrame,
+           megapixels / rgbFrame * 1e3, rgbRoi, grayFrame, megapixels / grayFrame * 1e3);
+  }
+  return 0;
+}
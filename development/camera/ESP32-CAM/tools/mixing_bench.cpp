@@ -0,0 +1,207 @@
+/*
+ * Host check and benchmark of the mixing monitor (mixing_monitor.h).
+ *
+ * Synthesizes the frames of a stirred culture at the low resolution the camera decodes them to: a vessel
+ * with a fixed texture (glass, labels) and bubbles carried around by the vortex of the stirrer, with sensor
+ * noise. The scenario runs the stirring, a step of the room lighting, a stop of the stirrer (the bubbles
+ * stay where they are), the stirring again and a burst of foam, and prints the events of the monitor with
+ * the frame they came at; it fails if an event is missing or unexpected. Then it times the grid and the
+ * scoring on the frame sizes the camera decodes to:
+ *
+ *   g++ -O2 -ftree-vectorize -std=gnu++17 -I.. mixing_bench.cpp ../mixing_monitor.cpp ../culture_density.cpp -o mixing_bench
+ *   ./mixing_bench [repetitions]
+ */
+
+#include "mixing_monitor.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Bubble {
+  float radius;     // Orbit around the stirrer, in thousandths of the frame height
+  float angle;
+  float speed;      // Radians per frame
+  float size;
+};
+
+struct Scene {
+  uint16_t width;
+  uint16_t height;
+  std::vector<float> texture;
+  std::vector<Bubble> bubbles;
+  std::vector<Bubble> foam;
+  float light;
+};
+
+static uint32_t randomState = 12345;
+static float uniform() {
+  randomState = randomState * 1664525 + 1013904223;
+  return (randomState >> 8) / 16777216.0f;
+}
+
+static Scene makeScene(uint16_t width, uint16_t height) {
+  Scene scene = {width, height, std::vector<float>((size_t)width * height), {}, {}, 1.0f};
+  for (uint16_t y = 0; y < height; y++) {
+    for (uint16_t x = 0; x < width; x++) {
+      // Greenish culture, darker at the edges of the vessel, with a fixed pattern
+      float dx = (x - width / 2.0f) / width;
+      float dy = (y - height / 2.0f) / height;
+      scene.texture[(size_t)y * width + x] = 110.0f - 80.0f * (dx * dx + dy * dy) + 12.0f * sinf(x * 0.31f) * cosf(y * 0.23f);
+    }
+  }
+  for (int i = 0; i < 40; i++) {
+    scene.bubbles.push_back({60 + 380 * uniform(), 6.2832f * uniform(), 0.08f + 0.1f * uniform(), 1.0f + 1.5f * uniform()});
+  }
+  return scene;
+}
+
+static void drawBubble(const Scene& scene, const Bubble& bubble, float amplitude, std::vector<float>& luma) {
+  float cx = scene.width / 2.0f + cosf(bubble.angle) * bubble.radius * scene.height / 1000.0f;
+  float cy = scene.height / 2.0f + sinf(bubble.angle) * bubble.radius * scene.height / 1000.0f;
+  float size = bubble.size * scene.width / 160.0f;
+  int reach = (int)ceilf(size * 2);
+  for (int y = (int)cy - reach; y <= (int)cy + reach; y++) {
+    for (int x = (int)cx - reach; x <= (int)cx + reach; x++) {
+      if (x < 0 || y < 0 || x >= scene.width || y >= scene.height) continue;
+      float distance = ((x - cx) * (x - cx) + (y - cy) * (y - cy)) / (size * size);
+      luma[(size_t)y * scene.width + x] += amplitude * expf(-distance);
+    }
+  }
+}
+
+// Next frame in RGB565 (high byte first), moving the bubbles when stirred
+static void renderFrame(Scene& scene, bool stirred, std::vector<uint8_t>& rgb565) {
+  std::vector<float> luma(scene.texture);
+  for (Bubble& bubble : scene.bubbles) {
+    if (stirred) bubble.angle += bubble.speed;
+    drawBubble(scene, bubble, 90.0f, luma);
+  }
+  for (Bubble& bubble : scene.foam) {
+    bubble.angle += bubble.speed;
+    drawBubble(scene, bubble, 120.0f, luma);
+  }
+  rgb565.resize((size_t)scene.width * scene.height * 2);
+  for (size_t i = 0; i < luma.size(); i++) {
+    float level = luma[i] * scene.light + (uniform() - 0.5f) * 8.0f;
+    int value = level < 0 ? 0 : level > 255 ? 255 : (int)level;
+    // Green tint: the green channel carries most of the luma
+    int red = value * 3 / 4;
+    int green = value;
+    int blue = value / 2;
+    uint16_t pixel = (uint16_t)(((red >> 3) << 11) | ((green >> 2) << 5) | (blue >> 3));
+    rgb565[i * 2] = pixel >> 8;
+    rgb565[i * 2 + 1] = pixel & 0xFF;
+  }
+}
+
+struct Phase {
+  const char* name;
+  int frames;
+  bool stirred;
+  bool foam;
+  float light;
+  const char* expected;   // Event expected during the phase, nullptr for none
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  int repetitions = argc > 1 ? atoi(argv[1]) : 200;
+  const density_window_t window = {150, 150, 700, 700};
+
+  // Scenario, at the 2 frames per second of the camera
+  const Phase phases[] = {
+    {"stirring (learning)", 100, true, false, 1.0f, nullptr},
+    {"room light +10%", 60, true, false, 1.1f, nullptr},
+    {"stirrer stopped", 60, false, false, 1.1f, "no_motion"},
+    {"stirring again", 60, true, false, 1.1f, "mixing_normal"},
+    {"foam burst", 12, true, true, 1.1f, "foam_surge"},
+    {"foam gone", 60, true, false, 1.1f, "mixing_normal"},
+  };
+  Scene scene = makeScene(160, 120);
+  density_roi_t roi;
+  density_roi_from_window(&window, scene.width, scene.height, &roi);
+  mixing_monitor_t monitor;
+  mixing_monitor_init(&monitor);
+  mixing_grid_t grid;
+  std::vector<uint8_t> frame;
+  char text[256];
+  int frameNumber = 0;
+  bool passed = true;
+
+  printf("Frame  phase                 state       score  baseline  active  event\n");
+  for (const Phase& phase : phases) {
+    scene.light = phase.light;
+    if (phase.foam) {
+      for (int i = 0; i < 300; i++) {
+        scene.foam.push_back({500 * uniform(), 6.2832f * uniform(), 0.3f + 0.3f * uniform(), 1.0f + 2.0f * uniform()});
+      }
+    } else {
+      scene.foam.clear();
+    }
+    std::string events;
+    for (int i = 0; i < phase.frames; i++, frameNumber++) {
+      renderFrame(scene, phase.stirred, frame);
+      mixing_grid_rgb565(frame.data(), scene.width * 2, &roi, &grid);
+      bool event = mixing_monitor_update(&monitor, &grid);
+      if (event) {
+        mixing_format_event(&monitor, 1700000000 + frameNumber / 2, (frameNumber % 2) * 500, text, sizeof(text));
+        events += events.empty() ? "" : " ";
+        events += monitor.state == MIXING_NORMAL ? "mixing_normal" : mixing_state_name(monitor.state);
+      }
+      if (event || i == phase.frames - 1) {
+        printf("%5d  %-20s  %-10s  %5.2f  %8.2f  %6.3f  %s\n", frameNumber, phase.name, mixing_state_name(monitor.state), monitor.score,
+               monitor.baseline, monitor.active, event ? text : "");
+      }
+    }
+    std::string expected = phase.expected ? phase.expected : "";
+    if (events != expected) {
+      printf("  expected \"%s\", got \"%s\"\n", expected.c_str(), events.c_str());
+      passed = false;
+    }
+  }
+  if (mixing_format_json(&monitor, &window, text, sizeof(text)) == 0) {
+    printf("JSON status does not fit\n");
+    return 1;
+  }
+  printf("%s\n", text);
+  if (!passed) {
+    return 1;
+  }
+
+  // Cost of a frame: the grid of the ROI and the scoring, for the sizes of the decoded frames
+  const struct {
+    const char* name;
+    uint16_t width;
+    uint16_t height;
+  } sizes[] = {{"QVGA/2", 160, 120}, {"UXGA/8", 200, 150}, {"QVGA", 320, 240}, {"VGA", 640, 480}};
+  printf("\nFrame           grid (us)  update (us)   (on this computer)\n");
+  for (const auto& size : sizes) {
+    Scene timed = makeScene(size.width, size.height);
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> second;
+    renderFrame(timed, true, first);
+    renderFrame(timed, true, second);
+    density_roi_from_window(&window, size.width, size.height, &roi);
+    mixing_monitor_t bench;
+    mixing_monitor_init(&bench);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) mixing_grid_rgb565((i & 1 ? second : first).data(), size.width * 2, &roi, &grid);
+    double gridTime = secondsSince(start) * 1e6 / repetitions;
+    mixing_grid_t grids[2];
+    mixing_grid_rgb565(first.data(), size.width * 2, &roi, &grids[0]);
+    mixing_grid_rgb565(second.data(), size.width * 2, &roi, &grids[1]);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) mixing_monitor_update(&bench, &grids[i & 1]);
+    double updateTime = secondsSince(start) * 1e6 / repetitions;
+    printf("%-7s %4ux%-4u %9.1f  %11.2f\n", size.name, size.width, size.height, gridTime, updateTime);
+  }
+  return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Host check of the shared frame pool of the MJPEG stream (frame_pool.h).
+ *
+ * A producer thread publishes frames at the rate of the camera, of varying JPEG sizes, whose bytes are
+ * derived from their sequence. Readers of different speeds stream them at the same time, as the clients
+ * of the stream server: one as fast as the frames come, one over a slow link, one that stalls for two
+ * seconds (a client whose TCP window is full). Every reader checks that the frames it holds are not
+ * overwritten while it sends them and that they come in order; the producer must never find the pool
+ * without a free slot nor wait on the readers. Prints the frames sent and dropped per reader and the time
+ * the producer spent in the pool:
+ *
+ *   g++ -O2 -std=gnu++17 -pthread -I.. stream_bench.cpp ../frame_pool.cpp -o stream_bench
+ *   ./stream_bench [seconds]
+ */
+
+#include "frame_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static frame_pool_t pool;
+static std::atomic<bool> running(true);
+
+static uint8_t frameByte(uint32_t sequence, size_t index) {
+  return (uint8_t)(sequence * 31 + index * 7);
+}
+
+static bool checkFrame(const frame_slot_t *slot) {
+  for (size_t i = 0; i < slot->length; i += 61) {
+    if (slot->data[i] != frameByte(slot->sequence, i)) {
+      return false;
+    }
+  }
+  return slot->length == 0 || slot->data[slot->length - 1] == frameByte(slot->sequence, slot->length - 1);
+}
+
+struct Reader {
+  const char *name;
+  int sendMs;         // Time to send a frame
+  int stallAtMs;      // Stalls once, for stallMs, after this time (-1 for never)
+  int stallMs;
+  uint32_t sent;
+  uint32_t dropped;
+  uint32_t corrupted;
+  uint32_t outOfOrder;
+};
+
+static void readFrames(Reader *reader) {
+  uint32_t last = 0;
+  Clock::time_point start = Clock::now();
+  bool stalled = false;
+  while (running) {
+    const frame_slot_t *slot = frame_pool_acquire(&pool, last, 1000);
+    if (slot == nullptr) {
+      continue;
+    }
+    if (last != 0 && slot->sequence <= last) {
+      reader->outOfOrder++;
+    } else if (last != 0) {
+      reader->dropped += slot->sequence - last - 1;
+    }
+    last = slot->sequence;
+    bool intact = checkFrame(slot);
+    int stall = 0;
+    if (!stalled && reader->stallAtMs >= 0 && Clock::now() - start > std::chrono::milliseconds(reader->stallAtMs)) {
+      stalled = true;
+      stall = reader->stallMs;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(reader->sendMs + stall));
+    // Still the same bytes once sent: the producer did not reuse the slot
+    intact = intact && checkFrame(slot);
+    frame_pool_release(&pool, slot);
+    reader->sent++;
+    reader->corrupted += !intact;
+  }
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 4;
+  const int frameIntervalMs = 40;   // 25 fps, QVGA/VGA on the OV2640
+
+  std::vector<Reader> readers = {
+    {"fast", 0, -1, 0, 0, 0, 0, 0},
+    {"wifi", 25, -1, 0, 0, 0, 0, 0},
+    {"slow", 150, -1, 0, 0, 0, 0, 0},
+    {"stalls", 5, 1000, 2000, 0, 0, 0, 0},
+  };
+  std::vector<std::thread> threads;
+  for (Reader &reader : readers) {
+    threads.emplace_back(readFrames, &reader);
+  }
+
+  std::vector<uint8_t> encoded(64 * 1024);
+  uint32_t published = 0;
+  uint32_t noSlot = 0;
+  double poolTime = 0;
+  double maxPoolTime = 0;
+  Clock::time_point end = Clock::now() + std::chrono::milliseconds((int)(seconds * 1000));
+  Clock::time_point next = Clock::now();
+  uint32_t seed = 1;
+  while (Clock::now() < end) {
+    // The camera hands a frame every interval: produced here, then taken into the pool
+    std::this_thread::sleep_until(next);
+    next += std::chrono::milliseconds(frameIntervalMs);
+    seed = seed * 1664525 + 1013904223;
+    size_t length = 12000 + (seed >> 8) % 20000;
+    uint32_t sequence = pool.sequence + 1;
+    for (size_t i = 0; i < length; i++) {
+      encoded[i] = frameByte(sequence, i);
+    }
+    struct timeval timestamp;
+    gettimeofday(&timestamp, nullptr);
+
+    Clock::time_point start = Clock::now();
+    frame_slot_t *slot = frame_pool_writable(&pool);
+    if (slot == nullptr) {
+      noSlot++;
+      continue;
+    }
+    if (frame_pool_copy(&pool, slot, encoded.data(), length, &timestamp)) {
+      frame_pool_publish(&pool, slot);
+      published++;
+    } else {
+      frame_pool_discard(&pool, slot);
+    }
+    double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    poolTime += elapsed;
+    if (elapsed > maxPoolTime) {
+      maxPoolTime = elapsed;
+    }
+  }
+  running = false;
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  bool passed = noSlot == 0;
+  printf("Producer: %u frames published, %u without a free slot, %u buffers allocated, pool %.1f us/frame (max %.1f)\n", published, noSlot,
+         pool.allocations, poolTime / published, maxPoolTime);
+  printf("Reader   sent  dropped  corrupted  out of order\n");
+  for (const Reader &reader : readers) {
+    printf("%-7s %5u  %7u  %9u  %12u\n", reader.name, reader.sent, reader.dropped, reader.corrupted, reader.outOfOrder);
+    passed = passed && reader.corrupted == 0 && reader.outOfOrder == 0 && reader.sent > 0;
+  }
+  frame_pool_trim(&pool);
+  printf("%s\n", passed ? "OK" : "FAILED");
+  return passed ? 0 : 1;
+}
@@ -15,18 +15,56 @@
  * - ArduinoJson: To handle JSON parsing and serialization
  * - WiFi: To handle WiFi connections
  * - HTTPClient: To handle HTTP requests
- * - NTPClient: To get the current time
  * - WebSocketsClient: To handle WebSocket communication
+ * - ESPAsyncWebServer and AsyncTCP: To serve the recent samples on the local network
  * - Crypto: To handle encryption and decryption
  * - AES: To use AES encryption
  * - config.h: Contains the WiFi and WebSocket server credentials, and the shared secret key
  * 
  * How it works:
+ * - The work is split into three FreeRTOS tasks, connected by lock-free single-producer single-consumer queues
+ *   (SpscQueue), so the serial link with the Mega is read even while the network blocks:
+ *   - ingestTask (core 1, highest priority) waits on the events of the UART driver, assembles the lines of the Mega
+ *     and timestamps them into the ingest queue. It never waits on the other tasks: a line is dropped (and counted)
+ *     only if the ingest queue is full.
+ *   - transformTask (core 1) maps the lines to the records of the web server (outbound queue) with RecordTranscoder,
+ *     which translates the keys of the Mega in one pass without building a JSON document.
+ *   - networkTask (core 0, with the WiFi stack) maintains the WiFi and WebSocket connections, stores the records in
+ *     the persistent queue and sends them.
+ *   The depth and high-water mark of both queues are printed with the status every 10 seconds.
  * - The ESP32 connects to the WiFi network.
  * - It connects to a WebSocket server to receive commands.
  * - When a command is received, it authenticates the command using the shared secret key.
- * - If the command is authenticated, it sends the corresponding command to the Arduino Mega via Serial2.
- * - When data is received from the Arduino Mega, it encrypts the data using the shared secret key and sends it to the web server using an HTTP POST request.
+ * - If the command is authenticated, it sends the corresponding command to the Arduino Mega via UART2.
+ * - When data is received from the Arduino Mega, it is stored in a persistent queue on the LittleFS flash partition
+ *   (TelemetryQueue). The queue is sent to the web server in batches whenever the WiFi and the server are available,
+ *   so the data received during an outage is sent once the connection is back.
+ *   The WiFi is reconnected in the background: the serial link with the Mega is never left unread.
+ * - The batches go over the WebSocket already open for the commands, as {"type":"telemetry","id":n,"records":[...]}
+ *   messages. Up to maxInFlight batches are sent before the first acknowledgement ({"type":"ack","id":n}) comes back;
+ *   a batch leaves the queue only once acknowledged, and the unacknowledged ones are sent again after a disconnection,
+ *   a refusal ("nack") or a timeout. While the WebSocket is down, the batches are posted to /sensor_data/batch.
+ * - tools/standin_server.py is a local stand-in for the web server, which can simulate outages to exercise the queue,
+ *   and tools/telemetry_bench.py measures the round-trip latency and throughput of the uplinks against it.
+ * - Over the WebSocket the records of a batch are sent as one compressed block ({"type":"telemetry","id":n,"block":
+ *   "<base64>"}, see TelemetryBlock.h): timestamps as deltas of deltas and values XORed with the previous ones, which
+ *   takes the slowly varying sensor values to a few bytes per record. tools/block_bench.cpp measures it on data.csv.
+ * - tools/transcoder_bench.cpp measures the conversion of the records on a computer (records/s, heap allocations).
+ * - The data lines are also kept in RAM, as the last 1024 samples (SampleRing, 8.5 hours at the 30 s interval of the
+ *   Mega), and served on port 80 by an async HTTP server (LocalDataServer), so the reactor can be followed from the
+ *   local network while the Raspberry Pi is down: GET / shows the live values, GET /data?from=&to=&last= returns the
+ *   samples of a time range as JSON, and GET /events streams the new samples as Server-Sent Events. The responses are
+ *   written sample by sample into the TCP buffers, from a fixed pool of cursors, without allocating per request.
+ *   tools/sample_ring_bench.cpp checks the ring under a concurrent writer and reader on a computer.
+ * - The clock of the ESP32 is set by SNTP (the time service of ESP-IDF, in the background once the WiFi is up), and the
+ *   transform task synchronizes the clock of the Mega with it every 5 minutes (MegaClockSync): it measures the round
+ *   trip of clock_probe commands over the serial link and sends the Unix time, to the millisecond, at which the Mega
+ *   received the best one (clock_set). The Mega then stamps every sample when it takes it ("t" and "ms" keys), and
+ *   those timestamps, with their milliseconds, replace the time at which the line reached the ESP32.
+ * - The ESP32-CAM posts its mixing events (no_motion, foam_surge, mixing_normal) to POST /camera_event of the local
+ *   server. They are event lines like those of the Mega ({"ev":...}): the async TCP task hands them to the transform
+ *   task through their own queue (cameraQueue, as the ingest queue has the ingest task for only producer), and they
+ *   reach the web server as records with their "event".
  * 
  * Software Setup:
  * - Install the ESP32 Board in Arduino IDE:
@@ -39,10 +77,14 @@
  * 
  * - Install Necessary Libraries:
  *   - Go to Sketch > Include Library > Manage Libraries.
- *   - Search for and install ArduinoJson, WiFi, HTTPClient, NTPClient, WebSocketsClient, Crypto, and AES.
+ *   - Search for and install ArduinoJson, WiFi, HTTPClient, WebSocketsClient, Crypto, and AES.
+ *   - ESPAsyncWebServer and AsyncTCP are installed from their GitHub repositories (Sketch > Include Library >
+ *     Add .ZIP Library): https://github.com/me-no-dev/ESPAsyncWebServer and https://github.com/me-no-dev/AsyncTCP
  *
  * - Partition Scheme
  *   - If you have space problems uploading the code, do the following: "Select Minimal SPIFFS (3.8MB APP with 256KB SPIFFS) in Tools > Partition Scheme".
+ *   - The telemetry queue uses the SPIFFS partition with LittleFS (at most 160 KB, see TelemetryQueue.h), which fits
+ *     in the 256 KB of the Minimal SPIFFS scheme.
  */
 
  /*
@@ -87,18 +129,72 @@ const char webSocketPath[] = "/ws";
 #include <ArduinoJson.h>
 #include <WiFi.h>
 #include <HTTPClient.h>
-#include <NTPClient.h>
-#include <WiFiUdp.h>
 #include <WebSocketsClient.h>
+#include <atomic>
+#include <sys/time.h>
+#include <driver/uart.h>
 #include "config.h"
+#include "SpscQueue.h"
+#include "RecordTranscoder.h"
+#include "TelemetryBlock.h"
+#include <mbedtls/base64.h>
+#include "TelemetryQueue.h"
+#include "LittleFsQueueStorage.h"
+#include "SampleRing.h"
+#include "LocalDataServer.h"
+#include "MegaClockSync.h"
 
-// Define the pins for Serial2 communication with the Arduino Mega
+// Define the pins for the UART2 communication with the Arduino Mega
 const int rxPin = 18;
 const int txPin = 19;
+const uart_port_t megaUart = UART_NUM_2;
+const int megaBaudRate = 9600;
+const int uartRxBufferSize = 2048;     // Driver ring buffer, 2 s of data at 9600 baud
+const int uartEventQueueLength = 20;
+QueueHandle_t uartEvents;
+
+// Lines of the Mega, timestamped by the ingest task
+const size_t maxMegaLineLength = 767;
+struct MegaLine {
+  uint32_t time;                       // Unix time at reception, 0 if the clock was not set
+  uint16_t millisecond;
+  uint16_t length;
+  char text[maxMegaLineLength + 1];
+};
+
+// Records in the format of the web server, produced by the transform task
+struct ServerRecord {
+  uint32_t time;
+  uint16_t length;
+  char text[TelemetryQueue::MAX_LINE_LENGTH + 1];
+};
+
+// Pipeline queues: ingest -> transform -> network (12 KB each)
+SpscQueue<MegaLine, 16> ingestQueue;
+SpscQueue<ServerRecord, 8> outboundQueue;
+SpscQueue<MegaLine, 4> cameraQueue;    // Events of the ESP32-CAM, from the async TCP task of the local server
+
+// Tasks: the WiFi stack runs on core 0, the Arduino loop on core 1
+TaskHandle_t ingestTaskHandle;
+TaskHandle_t transformTaskHandle;
+TaskHandle_t networkTaskHandle;
+const uint32_t ingestTaskStack = 4096;
+const uint32_t transformTaskStack = 8192;
+const uint32_t networkTaskStack = 12288;
 
-// Create an NTP client to get the current time
-WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP, "pool.ntp.org", 0, 60000); // Update the time every 60 seconds
+// Pipeline statistics, printed with the status
+std::atomic<uint32_t> uartOverflows(0);   // Bytes lost in the UART driver (FIFO or ring buffer full)
+std::atomic<uint32_t> linesDropped(0);    // Lines lost because too long or the ingest queue was full
+std::atomic<uint32_t> linesInvalid(0);    // Lines that are not JSON
+std::atomic<uint32_t> cameraEvents(0);
+std::atomic<uint32_t> cameraEventsDropped(0);
+
+// The system clock is set by SNTP; before the first answer it counts from 1970
+const char ntpServer[] = "pool.ntp.org";
+const time_t minValidTime = 1600000000;
+
+// Synchronization of the clock of the Mega, run by the transform task
+MegaClockSync megaClock(megaBaudRate);
 
 // Create a WebSocket client to communicate with the WebSocket server
 WebSocketsClient webSocket;
@@ -110,19 +206,72 @@ unsigned long lastMessageTime = 0;
 unsigned long lastWebSocketReconnectAttempt = 0;
 const unsigned long webSocketReconnectInterval = 5000; // Attempt to reconnect every 5 seconds
 
+// WiFi reconnection in the background
+const unsigned long wifiReconnectInterval = 10000;   // Attempt to reconnect every 10 seconds
+unsigned long lastWiFiReconnectAttempt = 0;
+bool wifiConnected = false;
+
+// Persistent queue of the telemetry waiting to be sent to the web server
+LittleFsQueueStorage queueStorage;
+TelemetryQueue telemetryQueue(queueStorage);
+bool queueAvailable = false;
+const char sensorDataBatchUrl[] = "http://192.168.1.25:8000/sensor_data/batch";
+const uint16_t httpTimeout = 3000;                 // ms, bounds the time the loop can block on the server
+const unsigned long minSendRetryDelay = 1000;
+const unsigned long maxSendRetryDelay = 60000;
+unsigned long sendRetryDelay = minSendRetryDelay;  // Doubled after each failed batch
+unsigned long lastSendAttempt = 0;
+
+// Telemetry batches sent over the WebSocket and not acknowledged yet (acknowledged in order)
+struct InFlightBatch {
+  uint32_t id;
+  QueuePosition end;       // Queue position after the batch
+  uint8_t count;
+  unsigned long sentAt;
+};
+const uint8_t maxInFlight = 4;
+const unsigned long ackTimeout = 10000;  // ms without acknowledgement before the batches are sent again
+const uint8_t maxBatchRefusals = 5;      // Consecutive refusals of the oldest batch before it is dropped
+uint8_t batchRefusals = 0;
+InFlightBatch inFlight[maxInFlight];
+uint8_t inFlightCount = 0;
+uint32_t nextBatchId = 1;
+
+// Compressed telemetry blocks (TelemetryBlock.h) over the WebSocket; the HTTP fallback posts JSON records
+const bool compressTelemetry = true;
+uint8_t blockBuffer[8192];
+char blockBase64[(sizeof(blockBuffer) + 2) / 3 * 4 + 1];
+TelemetryBlockEncoder blockEncoder(blockBuffer, sizeof(blockBuffer));
+uint32_t blockBytesSent = 0;
+uint32_t blockJsonBytes = 0;      // Size of the same records in JSON
+
+// Recent samples, served on the local network by the async HTTP server (written by the transform task)
+SampleRing recentSamples;
+LocalDataServer localServer(recentSamples);
+
+// Uplink statistics, printed with the loop status
+unsigned long ackRoundTripLast = 0;
+unsigned long ackRoundTripMax = 0;
+float ackRoundTripAverage = 0;
+uint32_t recordsAcknowledged = 0;
+uint32_t batchesResent = 0;
+uint32_t recordsRefused = 0;
+
 // Function to handle WebSocket events
 void webSocketEvent(WStype_t type, uint8_t * payload, size_t length) {
   Serial.println("WebSocket event received");
   switch(type) {
     case WStype_DISCONNECTED:
       Serial.println("WebSocket disconnected");
+      resendInFlightBatches();
       break;
     case WStype_CONNECTED:
       Serial.println("WebSocket connected");
       break;
     case WStype_TEXT:
-      Serial.printf("WebSocket received text: %s\n", payload);
       lastMessageTime = millis();
+      if (handleTelemetryAck((char*)payload)) break;
+      Serial.printf("WebSocket received text: %s\n", payload);
       handleCommand((char*)payload);
       break;
     case WStype_BIN:
@@ -179,39 +328,396 @@ void handleCommand(const char* payload) {
     return;
   }
 
-  Serial2.println(command);
+  sendToMega(command);
   Serial.println("Sent to Arduino: " + command);
 }
 
-void setup() {
-  // Initialize the serial communication with the Arduino Mega
-  Serial.begin(115200);
-  delay(3000);
-  Serial.println("ESP32 Ready");
-  Serial2.begin(9600, SERIAL_8N1, rxPin, txPin);
-  Serial2.setRxBufferSize(256);
-  Serial2.setTimeout(500);
+// Sends a command line to the Mega (the UART driver serializes the writes of the tasks)
+void sendToMega(const String& command) {
+  uart_write_bytes(megaUart, command.c_str(), command.length());
+  uart_write_bytes(megaUart, "\r\n", 2);
+}
 
-  // Connect to the local WiFi network
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+// Posts a JSON array of server records; true if the server accepted it
+bool postTelemetry(const String& payload) {
+  HTTPClient http;
+  http.setTimeout(httpTimeout);
+  http.setConnectTimeout(httpTimeout);
+  http.begin(sensorDataBatchUrl);
+  http.addHeader("Content-Type", "application/json");
+  int httpResponseCode = http.POST(payload);
+  if (httpResponseCode <= 0) {
+    Serial.print("Error on sending POST: ");
+    Serial.println(httpResponseCode);
+  } else if (httpResponseCode >= 300) {
+    Serial.println("Server response: " + String(httpResponseCode) + " " + http.getString());
   }
-  Serial.println("\nWiFi connected");
-  Serial.println("IP address: " + WiFi.localIP().toString());
+  http.end();
+  return httpResponseCode >= 200 && httpResponseCode < 300;
+}
 
-  // Initialize the NTP client to get the current time
-  timeClient.begin();
+// Server record of a queued record, nullptr if it is invalid
+const char* serverRecord(const QueuedRecord& queued) {
+  if (strncmp(queued.line, "{\"sensor_value\"", 15) == 0) return queued.line;
 
-  // Initialize the WebSocket connection
-  webSocket.setExtraHeaders("X-Client-Type: ESP32");
-  webSocket.begin("192.168.1.25", 8000, "/ws");
-  webSocket.onEvent(webSocketEvent);
-  webSocket.setReconnectInterval(5000);
+  // Line of the Mega queued by an older firmware, converted when sent
+  static char converted[TelemetryQueue::MAX_LINE_LENGTH + 1];
+  if (RecordTranscoder::transcode(queued.line, strlen(queued.line), queued.time, converted, sizeof(converted)) == 0) {
+    Serial.println("Dropping invalid queued record: " + String(queued.line));
+    return nullptr;
+  }
+  return converted;
 }
 
-void loop() {
+// Reads the next queued records and appends them to a JSON array of server records; returns the record count
+uint8_t readQueuedBatch(String& payload, QueuePosition& end) {
+  QueuedRecord records[TelemetryQueue::MAX_BATCH];
+  uint8_t count = telemetryQueue.read(records, TelemetryQueue::MAX_BATCH, end);
+
+  payload += "[";
+  bool first = true;
+  for (uint8_t i = 0; i < count; i++) {
+    const char* record = serverRecord(records[i]);
+    if (record == nullptr) continue;
+    if (!first) payload += ",";
+    payload += record;
+    first = false;
+  }
+  payload += "]";
+  return count;
+}
+
+// Reads the next queued records into a compressed block and appends it in base64; returns the record count.
+// Reads go on while the block is sure to hold them (a record never takes more room than its JSON text).
+uint8_t readQueuedBlock(String& payload, QueuePosition& end) {
+  uint8_t count = 0;
+  blockEncoder.reset();
+  while (blockEncoder.remaining() >= TelemetryQueue::READ_BUFFER_SIZE &&
+         count + TelemetryQueue::MAX_BATCH <= TelemetryBlockEncoder::MAX_RECORDS) {
+    QueuedRecord records[TelemetryQueue::MAX_BATCH];
+    uint8_t read = telemetryQueue.read(records, TelemetryQueue::MAX_BATCH, end);
+    if (read == 0) break;
+    count += read;
+    for (uint8_t i = 0; i < read; i++) {
+      const char* record = serverRecord(records[i]);
+      if (record == nullptr) continue;
+      size_t length = strlen(record);
+      if (blockEncoder.add(record, length)) {
+        blockJsonBytes += length + 1;
+      } else {
+        Serial.println("Dropping queued record not fitting in a block: " + String(record));
+      }
+    }
+  }
+  if (count == 0) return 0;
+
+  size_t length = 0;
+  mbedtls_base64_encode((unsigned char*)blockBase64, sizeof(blockBase64), &length, blockEncoder.data(),
+                        blockEncoder.size());
+  blockBase64[length] = '\0';
+  payload += "\"";
+  payload += blockBase64;
+  payload += "\"";
+  blockBytesSent += blockEncoder.size();
+  return count;
+}
+
+// Posts the oldest queued records in one request (used while the WebSocket is down)
+bool sendQueuedBatch() {
+  String payload;
+  QueuePosition end;
+  uint8_t count = readQueuedBatch(payload, end);
+  if (count == 0) return true;
+
+  if (payload.length() > 2 && !postTelemetry(payload)) {
+    telemetryQueue.rewind();
+    return false;
+  }
+  telemetryQueue.commit(end);
+  Serial.printf("Sent %u queued records\n", count);
+  return true;
+}
+
+// Pipelines queued batches over the WebSocket, up to maxInFlight without acknowledgement
+void sendQueuedBatchesOverWebSocket() {
+  if (inFlightCount > 0 && millis() - inFlight[0].sentAt > ackTimeout) {
+    Serial.println("Telemetry acknowledgement timed out");
+    retryInFlightBatches();
+  }
+  if (millis() - lastSendAttempt < sendRetryDelay) return;
+  while (inFlightCount < maxInFlight && telemetryQueue.hasUnsent()) {
+    InFlightBatch& batch = inFlight[inFlightCount];
+    String payload = "{\"type\":\"telemetry\",\"id\":" + String(nextBatchId);
+    if (compressTelemetry) {
+      payload += ",\"block\":";
+      batch.count = readQueuedBlock(payload, batch.end);
+    } else {
+      payload += ",\"records\":";
+      batch.count = readQueuedBatch(payload, batch.end);
+    }
+    if (batch.count == 0) break;
+    payload += "}";
+    if (!webSocket.sendTXT(payload)) {
+      retryInFlightBatches();
+      break;
+    }
+    batch.id = nextBatchId++;
+    batch.sentAt = millis();
+    inFlightCount++;
+  }
+}
+
+// Handles {"type":"ack"|"nack","id":n} messages; returns false for any other message (commands)
+bool handleTelemetryAck(const char* payload) {
+  if (strstr(payload, "\"type\"") == nullptr || strstr(payload, "ack\"") == nullptr) return false;
+  JsonDocument doc;
+  if (deserializeJson(doc, payload)) return false;
+  const char* type = doc["type"] | "";
+  bool ack = strcmp(type, "ack") == 0;
+  if (!ack && strcmp(type, "nack") != 0) return false;
+
+  uint32_t id = doc["id"] | 0;
+  if (inFlightCount == 0 || inFlight[0].id != id) return true;   // Batch already sent again
+  if (!ack) {
+    Serial.println("Telemetry batch refused by the server: " + String((const char*)(doc["error"] | "")));
+    // The same batch is sent again until it is acknowledged: one the server keeps refusing would block the queue
+    if (++batchRefusals >= maxBatchRefusals) {
+      Serial.printf("Dropping a telemetry batch of %u records refused %u times\n", inFlight[0].count, batchRefusals);
+      telemetryQueue.commit(inFlight[0].end);
+      recordsRefused += inFlight[0].count;
+      batchRefusals = 0;
+    }
+    retryInFlightBatches();
+    return true;
+  }
+
+  InFlightBatch& batch = inFlight[0];
+  telemetryQueue.commit(batch.end);
+  batchRefusals = 0;
+  sendRetryDelay = 0;   // Keep draining at the loop rate
+  ackRoundTripLast = millis() - batch.sentAt;
+  ackRoundTripMax = max(ackRoundTripMax, ackRoundTripLast);
+  ackRoundTripAverage = recordsAcknowledged == 0 ? ackRoundTripLast : 0.9 * ackRoundTripAverage + 0.1 * ackRoundTripLast;
+  recordsAcknowledged += batch.count;
+  for (uint8_t i = 1; i < inFlightCount; i++) {
+    inFlight[i - 1] = inFlight[i];
+  }
+  inFlightCount--;
+  return true;
+}
+
+// The unacknowledged batches are sent again from the oldest one (the server may receive some twice)
+void resendInFlightBatches() {
+  if (inFlightCount > 0) batchesResent += inFlightCount;
+  inFlightCount = 0;
+  telemetryQueue.rewind();
+}
+
+// After a refusal, a timeout or a failed send: the batches are sent again once the retry delay is over,
+// doubled on each consecutive failure as for the posted batches
+void retryInFlightBatches() {
+  resendInFlightBatches();
+  lastSendAttempt = millis();
+  sendRetryDelay = constrain(sendRetryDelay * 2, minSendRetryDelay, maxSendRetryDelay);
+  Serial.printf("Sending telemetry again in %lu ms (%u bytes queued)\n", sendRetryDelay,
+                telemetryQueue.getPendingBytes());
+}
+
+// Fallback when the queue is unavailable: the record is lost if it cannot be sent immediately
+void sendRecordNow(const char* record) {
+  if (!wifiConnected) return;
+  postTelemetry("[" + String(record) + "]");
+}
+
+// Current Unix time in ms, 0 if SNTP did not answer yet (the system clock is safe to read from any task)
+uint64_t currentTimeMs() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  if (now.tv_sec < minValidTime) return 0;
+  return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+// Current Unix time, 0 if SNTP did not answer yet
+uint32_t currentTime() {
+  return currentTimeMs() / 1000;
+}
+
+// Publishes a complete line of the Mega to the transform task, or drops it if the queue is full
+void publishMegaLine(const char* text, size_t length) {
+  MegaLine* line = ingestQueue.producerSlot();
+  if (line == nullptr) {
+    linesDropped++;
+    return;
+  }
+  uint64_t now = currentTimeMs();
+  line->time = now / 1000;
+  line->millisecond = now % 1000;
+  line->length = length;
+  memcpy(line->text, text, length);
+  line->text[length] = '\0';
+  ingestQueue.push();
+  xTaskNotifyGive(transformTaskHandle);
+}
+
+// Publishes an event of the ESP32-CAM to the transform task (called by the local server); false if the queue is full
+bool publishCameraEvent(const char* text, size_t length) {
+  MegaLine* line = length <= maxMegaLineLength ? cameraQueue.producerSlot() : nullptr;
+  if (line == nullptr) {
+    cameraEventsDropped++;
+    return false;
+  }
+  uint64_t now = currentTimeMs();
+  line->time = now / 1000;
+  line->millisecond = now % 1000;
+  line->length = length;
+  memcpy(line->text, text, length);
+  line->text[length] = '\0';
+  cameraQueue.push();
+  cameraEvents++;
+  xTaskNotifyGive(transformTaskHandle);
+  return true;
+}
+
+// Reads the UART as the driver signals data, and splits it into lines
+void ingestTask(void* parameter) {
+  static char line[maxMegaLineLength + 1];
+  size_t length = 0;
+  bool overlong = false;
+  uint8_t chunk[128];
+
+  for (;;) {
+    uart_event_t event;
+    if (!xQueueReceive(uartEvents, &event, portMAX_DELAY)) continue;
+
+    if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL) {
+      // Data was lost: restart on the next line
+      size_t buffered = 0;
+      uart_get_buffered_data_len(megaUart, &buffered);
+      uartOverflows += buffered;
+      uart_flush_input(megaUart);
+      xQueueReset(uartEvents);
+      length = 0;
+      overlong = true;
+      continue;
+    }
+    if (event.type != UART_DATA) continue;
+
+    size_t available = 0;
+    uart_get_buffered_data_len(megaUart, &available);
+    while (available > 0) {
+      int count = uart_read_bytes(megaUart, chunk, min(available, sizeof(chunk)), 0);
+      if (count <= 0) break;
+      available -= count;
+      for (int i = 0; i < count; i++) {
+        char c = chunk[i];
+        if (c == '\r') continue;
+        if (c != '\n') {
+          if (length < maxMegaLineLength) {
+            line[length++] = c;
+          } else {
+            overlong = true;
+          }
+          continue;
+        }
+        if (overlong) {
+          linesDropped++;
+        } else if (length > 0) {
+          publishMegaLine(line, length);
+        }
+        length = 0;
+        overlong = false;
+      }
+    }
+  }
+}
+
+// Converts one line of the Mega or of the camera into an outbound record; false if the outbound queue is full
+// (retried later)
+bool transformLine(const MegaLine& line, const char* source) {
+  // Answers to the clock probes stay on the ESP32
+  uint64_t receivedMs = line.time == 0 ? 0 : (uint64_t)line.time * 1000 + line.millisecond;
+  if (megaClock.handleReply(line.text, line.length, receivedMs)) return true;
+
+  Serial.printf("Received from %s: %s\n", source, line.text);
+  if (line.text[0] != '{' || line.text[line.length - 1] != '}') {
+    Serial.println("Invalid JSON format received: " + String(line.text));
+    linesInvalid++;
+    return true;
+  }
+
+  ServerRecord* record = outboundQueue.producerSlot();
+  if (record == nullptr) return false;
+
+  // Written straight into the slot of the outbound queue
+  record->length = RecordTranscoder::transcode(line.text, line.length, line.time, record->text, sizeof(record->text));
+  if (record->length == 0) {
+    Serial.println("Invalid or too long JSON received: " + String(line.text));
+    linesInvalid++;
+    return true;
+  }
+  record->time = line.time;
+  outboundQueue.push();
+  xTaskNotifyGive(networkTaskHandle);
+
+  // The data lines also go to the ring of the local HTTP server
+  TelemetrySample sample;
+  if (SampleRing::parseLine(line.text, line.length, line.time, sample)) recentSamples.push(sample);
+  return true;
+}
+
+// Sends the clock probe or setting that is due; a probe is timed from when its last byte left the UART
+void synchronizeMegaClock() {
+  char command[MegaClockSync::COMMAND_LENGTH];
+  if (!megaClock.poll(currentTimeMs(), command)) return;
+  uart_write_bytes(megaUart, command, strlen(command));
+  uart_write_bytes(megaUart, "\r\n", 2);
+  if (strncmp(command, "clock_probe", 11) == 0 && uart_wait_tx_done(megaUart, pdMS_TO_TICKS(100)) == ESP_OK) {
+    megaClock.probeSent(currentTimeMs());
+  }
+}
+
+// Parses and maps the lines of the Mega; waits (leaving the lines in the ingest queue) while the outbound queue is full
+void transformTask(void* parameter) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
+    synchronizeMegaClock();
+    MegaLine* line;
+    while ((line = ingestQueue.consumerSlot()) != nullptr) {
+      if (!transformLine(*line, "Arduino Mega")) break;
+      ingestQueue.pop();
+    }
+    while ((line = cameraQueue.consumerSlot()) != nullptr) {
+      if (!transformLine(*line, "ESP32-CAM")) break;
+      cameraQueue.pop();
+    }
+  }
+}
+
+// Maintains the connections, stores the outbound records in the persistent queue and sends them
+void networkTask(void* parameter) {
+  for (;;) {
+    maintainConnections();
+
+    // Every record is queued first
+    ServerRecord* record;
+    while ((record = outboundQueue.consumerSlot()) != nullptr) {
+      if (!queueAvailable || !telemetryQueue.push(record->time, record->text, record->length)) {
+        // Without the queue the record can only be sent now
+        sendRecordNow(record->text);
+      }
+      outboundQueue.pop();
+    }
+
+    sendTelemetry();
+    logStatus();
+
+    // Woken early by the transform task when a record is ready
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+  }
+}
+
+// Keeps the WebSocket and WiFi connections up, without blocking on the WiFi
+void maintainConnections() {
   static unsigned long lastCheck = 0;
   
   // Maintain the WebSocket connection
@@ -234,118 +740,130 @@ void loop() {
     }
   }
 
-  // Handle WiFi reconnection if the connection is lost
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi connection lost. Reconnecting...");
-    WiFi.disconnect();
-    WiFi.begin(ssid, password);
-    while (WiFi.status() != WL_CONNECTED) {
-      delay(500);
-      Serial.print(".");
+  // Handle WiFi reconnection if the connection is lost, without blocking the loop
+  if (WiFi.status() == WL_CONNECTED) {
+    if (!wifiConnected) {
+      wifiConnected = true;
+      Serial.println("WiFi connected");
+      Serial.println("IP address: " + WiFi.localIP().toString());
+    }
+  } else {
+    if (wifiConnected) {
+      wifiConnected = false;
+      Serial.println("WiFi connection lost. Reconnecting...");
+    }
+    if (millis() - lastWiFiReconnectAttempt > wifiReconnectInterval) {
+      lastWiFiReconnectAttempt = millis();
+      WiFi.disconnect();
+      WiFi.begin(ssid, password);
     }
-    Serial.println("\nWiFi reconnected");
-    Serial.println("IP address: " + WiFi.localIP().toString());
   }
+}
 
-  // Process the data received from the Arduino Mega
-  static String receivedData = "";
-  while (Serial2.available()) {
-    char incomingChar = Serial2.read();
-    receivedData += incomingChar;
-
-    if (incomingChar == '\n') {
-      Serial.print("Received from Arduino Mega: ");
-      Serial.println(receivedData);
-
-      // Parse the received data and send it to the web server
-      JsonDocument doc;
-      DeserializationError error = deserializeJson(doc, receivedData);
-      if (!error) {
-        Serial.println("Valid JSON received");
-        Serial.println(receivedData);
-
-        if (WiFi.status() == WL_CONNECTED) {
-          HTTPClient http;
-          http.begin("http://192.168.1.25:8000/sensor_data");
-          http.addHeader("Content-Type", "application/json");
-
-          // Prepare the JSON data to be sent to the web server
-          if (doc.containsKey("ev") && doc["ev"] == "startup") {
-            // Handle startup data
-            doc["event"] = doc["ev"];
-            doc["programType"] = doc["pt"];
-            doc["rateOrSpeed"] = doc["rate"];
-            doc["duration"] = doc["dur"];
-            doc["tempSetpoint"] = doc["tSet"];
-            doc["phSetpoint"] = doc["phSet"];
-            doc["doSetpoint"] = doc["doSet"];
-            doc["nutrientConc"] = doc["nutC"];
-            doc["baseConc"] = doc["baseC"];
-            doc["experimentName"] = doc["expN"];
-            doc["comment"] = doc["comm"];
-          } else {
-            // Handle regular data
-            doc["event"] = "data";
-            doc["programType"] = doc["prog"];
-            doc["rateOrSpeed"] = 0;
-            doc["duration"] = 0;
-            doc["tempSetpoint"] = 0.0;
-            doc["phSetpoint"] = 0.0;
-            doc["doSetpoint"] = 0.0;
-            doc["nutrientConc"] = 0.0;
-            doc["baseConc"] = 0.0;
-            doc["experimentName"] = "";
-            doc["comment"] = "";
-          }
-
-          // Add additional sensor data to the JSON document
-          doc["currentProgram"] = doc["prog"];
-          doc["programStatus"] = doc["stat"];
-          doc["airPumpStatus"] = doc["ap"];
-          doc["drainPumpStatus"] = doc["dp"];
-          doc["nutrientPumpStatus"] = doc["np"];
-          doc["basePumpStatus"] = doc["bp"];
-          doc["stirringMotorStatus"] = doc["sm"];
-          doc["heatingPlateStatus"] = doc["hp"];
-          doc["ledGrowLightStatus"] = doc["lg"];
-          doc["waterTemp"] = doc["wT"];
-          doc["airTemp"] = doc["aT"];
-          doc["ph"] = doc["pH"];
-          doc["turbidity"] = doc["tb"];
-          doc["oxygen"] = doc["ox"];
-          doc["airFlow"] = doc["af"];
-
-          // Convert the JSON document to a string and add the timestamp
-          String jsonData;
-          serializeJson(doc, jsonData);
-          jsonData = "{\"sensor_value\": " + jsonData + ", \"timestamp\": \"" + timeClient.getFormattedTime() + "\"}";
-          Serial.print("Sending JSON to server: ");
-          Serial.println(jsonData);
-
-          // Send the JSON data to the web server using an HTTP POST request
-          int httpResponseCode = http.POST(jsonData);
-          if (httpResponseCode > 0) {
-            String response = http.getString();
-            Serial.println("Server response: " + response);
-          } else {
-            Serial.print("Error on sending POST: ");
-            Serial.println(httpResponseCode);
-          }
-          http.end();
-        }
-      } else {
-        Serial.println("Invalid JSON format received: " + receivedData);
-      }
-      receivedData = "";
+// Sends the queued telemetry in batches: pipelined over the WebSocket, or posted while it is down
+// (on both, backing off while the server is unreachable or refuses the batches)
+void sendTelemetry() {
+  if (queueAvailable && webSocket.isConnected()) {
+    sendQueuedBatchesOverWebSocket();
+  } else if (queueAvailable && wifiConnected && !telemetryQueue.isEmpty() && millis() - lastSendAttempt >= sendRetryDelay) {
+    lastSendAttempt = millis();
+    if (sendQueuedBatch()) {
+      sendRetryDelay = 0;   // Keep draining at the loop rate
+    } else {
+      sendRetryDelay = constrain(sendRetryDelay * 2, minSendRetryDelay, maxSendRetryDelay);
+      Serial.printf("Sending telemetry failed, retrying in %lu ms (%u bytes queued)\n", sendRetryDelay,
+                    telemetryQueue.getPendingBytes());
     }
   }
-  
-  delay(10); // Small delay to avoid overloading the CPU
+}
 
-  // Periodically log the status of the ESP32 loop
+// Periodically logs the status of the pipeline and of the uplink
+void logStatus() {
   static unsigned long lastLog = 0;
-  if (millis() - lastLog > 10000) {
-    lastLog = millis();
-    Serial.println("ESP32 loop is running");
+  if (millis() - lastLog <= 10000) return;
+  lastLog = millis();
+  Serial.println("ESP32 network task is running");
+  Serial.printf("Pipeline: ingest queue %u/%u (max %u), outbound queue %u/%u (max %u, full %u times), "
+                "%u lines dropped, %u invalid, %u bytes lost in the UART\n", ingestQueue.depth(),
+                ingestQueue.capacity(), ingestQueue.highWater(), outboundQueue.depth(), outboundQueue.capacity(),
+                outboundQueue.highWater(), outboundQueue.fullCount(), linesDropped.load(), linesInvalid.load(),
+                uartOverflows.load());
+  Serial.printf("Clock: %s, %u synchronization rounds of the Mega, last %u/%u answers, delay %u ms (+- %u ms)\n",
+                currentTime() == 0 ? "not set" : "set by SNTP", megaClock.rounds(), megaClock.lastReplies(),
+                MegaClockSync::PROBES_PER_ROUND, megaClock.lastDelay(), megaClock.lastUncertainty());
+  Serial.printf("Local server: %u samples kept (%u received), %u clients, %u refused, %u camera events "
+                "(%u dropped)\n", recentSamples.end() - recentSamples.begin(), recentSamples.end(),
+                localServer.activeClients(), localServer.refusedClients(), cameraEvents.load(),
+                cameraEventsDropped.load());
+  if (queueAvailable) {
+    Serial.printf("Telemetry queue: %u bytes in %u segments, %u bytes dropped\n", telemetryQueue.getPendingBytes(),
+                  telemetryQueue.getSegmentCount(), telemetryQueue.getDroppedBytes());
+    Serial.printf("WebSocket uplink: %u records acknowledged, round trip %lu ms (average %.0f, max %lu), "
+                  "%u batches in flight, %u sent again, %u records dropped after refusals\n", recordsAcknowledged,
+                  ackRoundTripLast, ackRoundTripAverage, ackRoundTripMax, inFlightCount, batchesResent,
+                  recordsRefused);
+    if (blockBytesSent > 0) {
+      Serial.printf("Telemetry blocks: %u bytes for %u bytes of JSON records (%.1fx)\n", blockBytesSent,
+                    blockJsonBytes, (float)blockJsonBytes / blockBytesSent);
+    }
   }
-}
\ No newline at end of file
+}
+
+// UART2 through the ESP-IDF driver, which signals the received data through an event queue
+void beginMegaUart() {
+  uart_config_t config = {};
+  config.baud_rate = megaBaudRate;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  config.source_clk = UART_SCLK_APB;
+  uart_driver_install(megaUart, uartRxBufferSize, 0, uartEventQueueLength, &uartEvents, 0);
+  uart_param_config(megaUart, &config);
+  uart_set_pin(megaUart, txPin, rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+}
+
+void setup() {
+  // Initialize the serial communication with the Arduino Mega
+  Serial.begin(115200);
+  delay(3000);
+  Serial.println("ESP32 Ready");
+  beginMegaUart();
+
+  // Open the telemetry queue (records left from before a reset are sent first)
+  queueAvailable = telemetryQueue.begin();
+  if (queueAvailable) {
+    Serial.printf("Telemetry queue ready: %u bytes pending\n", telemetryQueue.getPendingBytes());
+  } else {
+    Serial.println("LittleFS not available, telemetry is sent without queueing");
+  }
+
+  // Connect to the local WiFi network (the connection completes in the background)
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(ssid, password);
+  lastWiFiReconnectAttempt = millis();
+
+  // Serve the recent samples on the local network (listens on every interface once the WiFi is up), and take the
+  // events of the camera
+  localServer.onCameraEvent(publishCameraEvent);
+  localServer.begin();
+
+  // Set the clock from NTP, in the background (SNTP of ESP-IDF, updated every hour)
+  configTime(0, 0, ntpServer);
+
+  // Initialize the WebSocket connection
+  webSocket.setExtraHeaders("X-Client-Type: ESP32");
+  webSocket.begin("192.168.1.25", 8000, "/ws");
+  webSocket.onEvent(webSocketEvent);
+  webSocket.setReconnectInterval(5000);
+
+  // Start the pipeline: the consumers first, so the notifications of the producers have a target
+  xTaskCreatePinnedToCore(networkTask, "network", networkTaskStack, NULL, 1, &networkTaskHandle, 0);
+  xTaskCreatePinnedToCore(transformTask, "transform", transformTaskStack, NULL, 2, &transformTaskHandle, 1);
+  xTaskCreatePinnedToCore(ingestTask, "ingest", ingestTaskStack, NULL, 3, &ingestTaskHandle, 1);
+}
+
+void loop() {
+  // All the work is done by the tasks started in setup()
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,66 @@
+// HostQueueStorage.cpp
+#ifndef ARDUINO
+
+#include "HostQueueStorage.h"
+#include <stdio.h>
+
+HostQueueStorage::HostQueueStorage(const char* directory) : _directory(directory) {}
+
+bool HostQueueStorage::begin() {
+  char path[FULL_PATH_LENGTH];
+  fullPath("/.", path);
+  FILE* dir = fopen(path, "r");
+  if (!dir) return false;
+  fclose(dir);
+  return true;
+}
+
+uint32_t HostQueueStorage::size(const char* path) {
+  char buffer[FULL_PATH_LENGTH];
+  fullPath(path, buffer);
+  FILE* file = fopen(buffer, "rb");
+  if (!file) return 0;
+  fseek(file, 0, SEEK_END);
+  long fileSize = ftell(file);
+  fclose(file);
+  return fileSize < 0 ? 0 : (uint32_t)fileSize;
+}
+
+size_t HostQueueStorage::read(const char* path, uint32_t offset, uint8_t* data, size_t length) {
+  char buffer[FULL_PATH_LENGTH];
+  fullPath(path, buffer);
+  FILE* file = fopen(buffer, "rb");
+  if (!file) return 0;
+  size_t count = fseek(file, offset, SEEK_SET) == 0 ? fread(data, 1, length, file) : 0;
+  fclose(file);
+  return count;
+}
+
+bool HostQueueStorage::append(const char* path, const uint8_t* data, size_t length) {
+  return writeFile(path, "ab", data, length);
+}
+
+bool HostQueueStorage::write(const char* path, const uint8_t* data, size_t length) {
+  return writeFile(path, "wb", data, length);
+}
+
+bool HostQueueStorage::remove(const char* path) {
+  char buffer[FULL_PATH_LENGTH];
+  fullPath(path, buffer);
+  return ::remove(buffer) == 0;
+}
+
+bool HostQueueStorage::writeFile(const char* path, const char* mode, const uint8_t* data, size_t length) {
+  char buffer[FULL_PATH_LENGTH];
+  fullPath(path, buffer);
+  FILE* file = fopen(buffer, mode);
+  if (!file) return false;
+  bool ok = fwrite(data, 1, length, file) == length;
+  return fclose(file) == 0 && ok;
+}
+
+void HostQueueStorage::fullPath(const char* path, char* buffer) {
+  snprintf(buffer, FULL_PATH_LENGTH, "%s%s", _directory, path);
+}
+
+#endif // ARDUINO
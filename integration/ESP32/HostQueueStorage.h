@@ -0,0 +1,33 @@
+// HostQueueStorage.h
+#ifndef HOST_QUEUE_STORAGE_H
+#define HOST_QUEUE_STORAGE_H
+
+#ifndef ARDUINO
+
+#include "QueueStorage.h"
+
+// QueueStorage in a directory of a computer (stdio), to run the TelemetryQueue without the ESP32
+class HostQueueStorage : public QueueStorage {
+public:
+  // The directory must exist; paths are appended to it ("/q00000001.txt")
+  explicit HostQueueStorage(const char* directory);
+
+  bool begin() override;
+  uint32_t size(const char* path) override;
+  size_t read(const char* path, uint32_t offset, uint8_t* data, size_t length) override;
+  bool append(const char* path, const uint8_t* data, size_t length) override;
+  bool write(const char* path, const uint8_t* data, size_t length) override;
+  bool remove(const char* path) override;
+
+private:
+  static const size_t FULL_PATH_LENGTH = 256;
+
+  const char* _directory;
+
+  bool writeFile(const char* path, const char* mode, const uint8_t* data, size_t length);
+  void fullPath(const char* path, char* buffer);
+};
+
+#endif // ARDUINO
+
+#endif // HOST_QUEUE_STORAGE_H
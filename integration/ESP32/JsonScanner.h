@@ -0,0 +1,103 @@
+// JsonScanner.h
+#ifndef JSON_SCANNER_H
+#define JSON_SCANNER_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Part of a JSON text (no copy)
+struct JsonSlice {
+  const char* start;
+  size_t length;
+};
+
+// Cursor over a JSON text, splitting objects into raw keys and values without building a document.
+// Used by RecordTranscoder, TelemetryBlock and SampleRing, which copy or convert the values themselves.
+struct JsonReader {
+  const char* position;
+  const char* end;
+
+  void skipWhitespace() {
+    while (position < end && (*position == ' ' || *position == '\t' || *position == '\r' || *position == '\n')) {
+      position++;
+    }
+  }
+  bool consume(char c) {
+    skipWhitespace();
+    if (position == end || *position != c) return false;
+    position++;
+    return true;
+  }
+
+  // String with its quotes (escapes are kept as they are)
+  bool readString(JsonSlice& slice) {
+    const char* start = position;
+    if (position == end || *position++ != '"') return false;
+    while (position < end && *position != '"') {
+      if (*position == '\\') position++;
+      position++;
+    }
+    if (position >= end) return false;
+    position++;
+    slice.start = start;
+    slice.length = position - start;
+    return true;
+  }
+
+  // Any JSON value, nested objects and arrays included
+  bool readValue(JsonSlice& slice) {
+    skipWhitespace();
+    if (position == end) return false;
+    if (*position == '"') return readString(slice);
+
+    const char* start = position;
+    int depth = 0;
+    while (position < end) {
+      char c = *position;
+      if (c == '"') {
+        JsonSlice nested;
+        if (!readString(nested)) return false;
+        continue;
+      }
+      if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        if (depth == 0) break;
+        depth--;
+      } else if (c == ',' && depth == 0) {
+        break;
+      }
+      position++;
+    }
+    if (depth != 0) return false;
+    while (position > start && (position[-1] == ' ' || position[-1] == '\t')) {
+      position--;   // Trailing whitespace is not part of the value
+    }
+    slice.start = start;
+    slice.length = position - start;
+    return slice.length > 0;
+  }
+
+  // "key": value of an object, the key with its quotes
+  bool readMember(JsonSlice& key, JsonSlice& value) {
+    skipWhitespace();
+    return readString(key) && consume(':') && readValue(value);
+  }
+};
+
+// Float value of a raw JSON number (true and false are 1 and 0), NaN for null and anything else
+inline float parseJsonNumber(const JsonSlice& value) {
+  char text[32];
+  if (value.length == 4 && memcmp(value.start, "true", 4) == 0) return 1;
+  if (value.length == 5 && memcmp(value.start, "false", 5) == 0) return 0;
+  if (value.length == 0 || value.length >= sizeof(text)) return NAN;
+  memcpy(text, value.start, value.length);
+  text[value.length] = '\0';
+  char* end;
+  float parsed = strtof(text, &end);
+  return end == text + value.length ? parsed : NAN;
+}
+
+#endif // JSON_SCANNER_H
@@ -0,0 +1,47 @@
+// LittleFsQueueStorage.cpp
+#ifdef ARDUINO
+
+#include "LittleFsQueueStorage.h"
+
+bool LittleFsQueueStorage::begin() {
+  return LittleFS.begin(true);  // Format the partition if it cannot be mounted
+}
+
+uint32_t LittleFsQueueStorage::size(const char* path) {
+  if (!LittleFS.exists(path)) return 0;
+  File file = LittleFS.open(path, "r");
+  if (!file) return 0;
+  uint32_t fileSize = file.size();
+  file.close();
+  return fileSize;
+}
+
+size_t LittleFsQueueStorage::read(const char* path, uint32_t offset, uint8_t* data, size_t length) {
+  File file = LittleFS.open(path, "r");
+  if (!file) return 0;
+  size_t count = file.seek(offset) ? file.read(data, length) : 0;
+  file.close();
+  return count;
+}
+
+bool LittleFsQueueStorage::append(const char* path, const uint8_t* data, size_t length) {
+  return writeFile(path, "a", data, length);
+}
+
+bool LittleFsQueueStorage::write(const char* path, const uint8_t* data, size_t length) {
+  return writeFile(path, "w", data, length);
+}
+
+bool LittleFsQueueStorage::remove(const char* path) {
+  return LittleFS.remove(path);
+}
+
+bool LittleFsQueueStorage::writeFile(const char* path, const char* mode, const uint8_t* data, size_t length) {
+  File file = LittleFS.open(path, mode);
+  if (!file) return false;
+  bool ok = file.write(data, length) == length;
+  file.close();
+  return ok;
+}
+
+#endif // ARDUINO
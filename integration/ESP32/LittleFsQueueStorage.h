@@ -0,0 +1,27 @@
+// LittleFsQueueStorage.h
+#ifndef LITTLEFS_QUEUE_STORAGE_H
+#define LITTLEFS_QUEUE_STORAGE_H
+
+#ifdef ARDUINO
+
+#include <LittleFS.h>
+#include "QueueStorage.h"
+
+// QueueStorage on the LittleFS partition of the ESP32 flash. LittleFS commits a file atomically
+// when it is closed, so a power cut leaves either the old or the new content of a file.
+class LittleFsQueueStorage : public QueueStorage {
+public:
+  bool begin() override;
+  uint32_t size(const char* path) override;
+  size_t read(const char* path, uint32_t offset, uint8_t* data, size_t length) override;
+  bool append(const char* path, const uint8_t* data, size_t length) override;
+  bool write(const char* path, const uint8_t* data, size_t length) override;
+  bool remove(const char* path) override;
+
+private:
+  bool writeFile(const char* path, const char* mode, const uint8_t* data, size_t length);
+};
+
+#endif // ARDUINO
+
+#endif // LITTLEFS_QUEUE_STORAGE_H
@@ -0,0 +1,248 @@
+// LocalDataServer.cpp
+#ifdef ARDUINO
+
+#include "LocalDataServer.h"
+
+namespace {
+
+// Live values of the latest sample, from /events
+const char PAGE[] PROGMEM = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><meta name="viewport" content="width=device-width">
+<title>Bioreactor</title>
+<style>body{font-family:sans-serif;margin:1em}td{padding:2px 12px}td+td{text-align:right}</style>
+</head><body><h3>Bioreactor (ESP32 bridge)</h3><p id="state">Connecting...</p><table id="values"></table>
+<p><a href="/data?last=120">Last samples (JSON)</a></p>
+<script>
+const table = document.getElementById("values");
+const events = new EventSource("/events?last=1");
+events.onmessage = (event) => {
+  const sample = JSON.parse(event.data);
+  document.getElementById("state").textContent =
+    "Sample " + sample.seq + (sample.t ? " at " + new Date(sample.t * 1000).toLocaleString() : "");
+  table.innerHTML = "";
+  for (const [key, value] of Object.entries(sample)) {
+    if (key == "seq" || key == "t") continue;
+    table.insertRow().innerHTML = "<td>" + key + "</td><td>" + (value === null ? "-" : value) + "</td>";
+  }
+};
+events.onerror = () => { document.getElementById("state").textContent = "Disconnected, retrying..."; };
+</script></body></html>
+)";
+
+const char EVENTS_PREAMBLE[] = "retry: 5000\n\n";
+const char KEEPALIVE[] = ": keepalive\n\n";
+
+// Unsigned integer parameter of the query string
+bool queryValue(AsyncWebServerRequest* request, const char* name, uint32_t& value) {
+  if (!request->hasParam(name)) return false;
+  value = strtoul(request->getParam(name)->value().c_str(), nullptr, 10);
+  return true;
+}
+
+}  // namespace
+
+LocalDataServer::LocalDataServer(SampleRing& ring)
+    : _server(PORT), _ring(ring), _cursors(), _refused(0), _eventSink(nullptr) {}
+
+void LocalDataServer::begin() {
+  _server.on("/", HTTP_GET, [](AsyncWebServerRequest* request) { request->send_P(200, "text/html", PAGE); });
+  _server.on("/data", HTTP_GET, [this](AsyncWebServerRequest* request) { handleData(request); });
+  _server.on("/events", HTTP_GET, [this](AsyncWebServerRequest* request) { handleEvents(request); });
+  // Answered once the body is complete; a request without body gets no answer from the body handler
+  _server.on(
+      "/camera_event", HTTP_POST,
+      [](AsyncWebServerRequest* request) {
+        if (request->contentLength() == 0) request->send(400, "text/plain", "Empty event\n");
+      },
+      nullptr,
+      [this](AsyncWebServerRequest* request, uint8_t* data, size_t length, size_t index, size_t total) {
+        handleCameraEvent(request, data, length, index, total);
+      });
+  _server.onNotFound([](AsyncWebServerRequest* request) { request->send(404, "text/plain", "Not found\n"); });
+  _server.begin();
+}
+
+uint8_t LocalDataServer::activeClients() const {
+  uint8_t count = 0;
+  for (const Cursor& cursor : _cursors) {
+    if (cursor.inUse) count++;
+  }
+  return count;
+}
+
+// Cursor of a new response, released when its client disconnects; nullptr (and 503) if all are taken
+LocalDataServer::Cursor* LocalDataServer::acquireCursor(AsyncWebServerRequest* request) {
+  for (Cursor& cursor : _cursors) {
+    if (cursor.inUse) continue;
+    cursor = Cursor();
+    cursor.inUse = true;
+    cursor.lastWrite = millis();
+    Cursor* acquired = &cursor;
+    request->onDisconnect([acquired]() { acquired->inUse = false; });
+    return acquired;
+  }
+  _refused++;
+  request->send(503, "text/plain", "Too many clients\n");
+  return nullptr;
+}
+
+void LocalDataServer::handleData(AsyncWebServerRequest* request) {
+  Cursor* cursor = acquireCursor(request);
+  if (cursor == nullptr) return;
+
+  // The range is fixed now, so the response ends even while samples keep coming
+  cursor->next = _ring.begin();
+  cursor->end = _ring.end();
+  cursor->to = 0xFFFFFFFF;
+  uint32_t value;
+  if (queryValue(request, "from", value)) cursor->next = _ring.find(value);
+  if (queryValue(request, "to", value)) cursor->to = value;
+  if (queryValue(request, "last", value) && cursor->end - cursor->next > value) cursor->next = cursor->end - value;
+
+  // Two pointers: kept inside the std::function, without allocation
+  AwsResponseFiller filler = [this, cursor](uint8_t* buffer, size_t capacity, size_t) {
+    return fillData(*cursor, buffer, capacity);
+  };
+  request->send(request->beginChunkedResponse("application/json", filler));
+}
+
+void LocalDataServer::handleEvents(AsyncWebServerRequest* request) {
+  Cursor* cursor = acquireCursor(request);
+  if (cursor == nullptr) return;
+
+  // New samples only, unless the client asks for the last ones or resumes after a reconnection
+  uint32_t begin = _ring.begin();
+  uint32_t end = _ring.end();
+  cursor->next = end;
+  uint32_t value;
+  if (request->hasHeader("Last-Event-ID")) {
+    value = strtoul(request->getHeader("Last-Event-ID")->value().c_str(), nullptr, 10);
+    // An identifier beyond the ring comes from before a restart of the bridge: everything is new
+    cursor->next = value < end ? value + 1 : begin;
+    if (cursor->next < begin) cursor->next = begin;
+  } else if (queryValue(request, "last", value)) {
+    cursor->next = end - begin > value ? end - value : begin;
+  }
+
+  AwsResponseFiller filler = [this, cursor](uint8_t* buffer, size_t capacity, size_t) {
+    return fillEvents(*cursor, buffer, capacity);
+  };
+  AsyncWebServerResponse* response = request->beginChunkedResponse("text/event-stream", filler);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+// Body of a camera event, in one or more parts; the parts are gathered in the _tempObject of the request
+// (freed with it) unless the body came whole
+void LocalDataServer::handleCameraEvent(AsyncWebServerRequest* request, uint8_t* data, size_t length, size_t index,
+                                        size_t total) {
+  if (total > MAX_EVENT_LENGTH) {
+    if (index == 0) request->send(413, "text/plain", "Event too long\n");
+    return;
+  }
+  const char* line = (const char*)data;
+  if (length < total) {
+    if (index == 0) request->_tempObject = malloc(total);
+    if (request->_tempObject == nullptr) {
+      if (index == 0) request->send(500, "text/plain", "Out of memory\n");
+      return;
+    }
+    memcpy((uint8_t*)request->_tempObject + index, data, length);
+    if (index + length < total) return;
+    line = (const char*)request->_tempObject;
+  }
+
+  if (line[0] != '{' || line[total - 1] != '}') {
+    request->send(400, "text/plain", "Not a JSON object\n");
+  } else if (_eventSink == nullptr || !_eventSink(line, total)) {
+    request->send(503, "text/plain", "Event queue full\n");
+  } else {
+    request->send(202, "text/plain", "Accepted\n");
+  }
+}
+
+// Next part of a JSON array of samples: as many whole samples as fit, 0 once the array is closed
+size_t LocalDataServer::fillData(Cursor& cursor, uint8_t* buffer, size_t capacity) {
+  char text[SampleRing::MAX_JSON_LENGTH + 1];
+  size_t written = 0;
+  if (!cursor.started && capacity > 0) {
+    buffer[written++] = '[';
+    cursor.started = true;
+  }
+  while (cursor.started && !cursor.finished) {
+    if (cursor.next >= cursor.end) {
+      if (written + 2 > capacity) break;
+      memcpy(buffer + written, "]\n", 2);
+      written += 2;
+      cursor.finished = true;
+      break;
+    }
+    TelemetrySample sample;
+    if (!_ring.read(cursor.next, sample)) {
+      // Overwritten since the request: continue with the oldest sample kept
+      uint32_t begin = _ring.begin();
+      cursor.next = cursor.next + 1 > begin ? cursor.next + 1 : begin;
+      continue;
+    }
+    if (sample.time > cursor.to) {
+      cursor.end = cursor.next;
+      continue;
+    }
+    size_t length = SampleRing::formatSample(cursor.next, sample, text, sizeof(text));
+    size_t separator = cursor.count > 0 ? 1 : 0;
+    if (written + separator + length > capacity) break;
+    if (separator) buffer[written++] = ',';
+    memcpy(buffer + written, text, length);
+    written += length;
+    cursor.next++;
+    cursor.count++;
+  }
+  if (written > 0) return written;
+  return cursor.finished ? 0 : RESPONSE_TRY_AGAIN;
+}
+
+// Next events of a stream: the samples written since the last call, a keepalive comment now and
+// then, or RESPONSE_TRY_AGAIN (polled again later); never ends
+size_t LocalDataServer::fillEvents(Cursor& cursor, uint8_t* buffer, size_t capacity) {
+  char text[SampleRing::MAX_JSON_LENGTH + 1];
+  size_t written = 0;
+  if (!cursor.started) {
+    // Sent at once, so the client gets the headers before the first sample
+    if (capacity < sizeof(EVENTS_PREAMBLE) - 1) return RESPONSE_TRY_AGAIN;
+    memcpy(buffer, EVENTS_PREAMBLE, sizeof(EVENTS_PREAMBLE) - 1);
+    written = sizeof(EVENTS_PREAMBLE) - 1;
+    cursor.started = true;
+  }
+
+  // A client that fell behind by more than the ring loses the overwritten samples
+  uint32_t begin = _ring.begin();
+  if (cursor.next < begin) cursor.next = begin;
+  uint32_t end = _ring.end();
+  while (cursor.next < end) {
+    TelemetrySample sample;
+    if (!_ring.read(cursor.next, sample)) {
+      cursor.next++;
+      continue;
+    }
+    char id[16];
+    size_t idLength = snprintf(id, sizeof(id), "id: %u\n", (unsigned)cursor.next);
+    size_t length = SampleRing::formatSample(cursor.next, sample, text, sizeof(text));
+    if (written + idLength + 6 + length + 2 > capacity) break;
+    memcpy(buffer + written, id, idLength);
+    memcpy(buffer + written + idLength, "data: ", 6);
+    memcpy(buffer + written + idLength + 6, text, length);
+    memcpy(buffer + written + idLength + 6 + length, "\n\n", 2);
+    written += idLength + 6 + length + 2;
+    cursor.next++;
+  }
+
+  if (written == 0 && millis() - cursor.lastWrite >= KEEPALIVE_INTERVAL && capacity >= sizeof(KEEPALIVE) - 1) {
+    memcpy(buffer, KEEPALIVE, sizeof(KEEPALIVE) - 1);
+    written = sizeof(KEEPALIVE) - 1;
+  }
+  if (written == 0) return RESPONSE_TRY_AGAIN;
+  cursor.lastWrite = millis();
+  return written;
+}
+
+#endif // ARDUINO
@@ -0,0 +1,75 @@
+// LocalDataServer.h
+#ifndef LOCAL_DATA_SERVER_H
+#define LOCAL_DATA_SERVER_H
+
+#ifdef ARDUINO
+
+#include <ESPAsyncWebServer.h>
+#include "SampleRing.h"
+
+// HTTP server of the bridge on the local network, serving the recent samples of the SampleRing, so
+// the reactor can be followed without the web server of the Raspberry Pi:
+//
+//   GET /                           page following the live values
+//   GET /data?from=&to=&last=       JSON array of the samples, from and to in Unix seconds (inclusive),
+//                                   last to keep only the most recent ones
+//   GET /events?last=               Server-Sent Events stream, one "id: <seq>" / "data: <sample>" event
+//                                   per new sample; resumes after the Last-Event-ID of a reconnection
+//   POST /camera_event              event line of the ESP32-CAM ({"ev":...}), handed to the event sink
+//                                   (202, or 503 if the sink is full)
+//
+// The samples are written by the response fillers straight into the send buffers of the async TCP
+// task, one at a time; the position of every response is a cursor from a fixed pool, released when
+// the client disconnects, so the server allocates nothing of its own per request or per sample (the
+// request and response objects of ESPAsyncWebServer excepted). The SSE streams are chunked
+// responses that never end: their filler is polled by AsyncTCP (every 500 ms) until there is a new
+// sample, and sends a comment as keepalive when nothing was sent for 15 s.
+class LocalDataServer {
+public:
+  static const uint16_t PORT = 80;
+  static const uint8_t MAX_CLIENTS = 6;   // Range queries and event streams together
+  static const size_t MAX_EVENT_LENGTH = 512;
+
+  // Takes an event line (not NUL-terminated); called from the async TCP task, false if it was dropped
+  typedef bool (*EventSink)(const char* line, size_t length);
+
+  explicit LocalDataServer(SampleRing& ring);
+
+  void begin();
+  void onCameraEvent(EventSink sink) { _eventSink = sink; }
+
+  // Statistics for the status log
+  uint8_t activeClients() const;
+  uint32_t refusedClients() const { return _refused; }
+
+private:
+  static const unsigned long KEEPALIVE_INTERVAL = 15000;
+
+  struct Cursor {
+    bool inUse;
+    bool started;
+    bool finished;
+    uint32_t next;              // Sequence of the next sample to send
+    uint32_t end;               // Range queries: sequence after the last sample
+    uint32_t to;                // Range queries: last Unix time
+    uint32_t count;
+    unsigned long lastWrite;
+  };
+
+  AsyncWebServer _server;
+  SampleRing& _ring;
+  Cursor _cursors[MAX_CLIENTS];
+  uint32_t _refused;
+  EventSink _eventSink;
+
+  Cursor* acquireCursor(AsyncWebServerRequest* request);
+  void handleData(AsyncWebServerRequest* request);
+  void handleEvents(AsyncWebServerRequest* request);
+  void handleCameraEvent(AsyncWebServerRequest* request, uint8_t* data, size_t length, size_t index, size_t total);
+  size_t fillData(Cursor& cursor, uint8_t* buffer, size_t capacity);
+  size_t fillEvents(Cursor& cursor, uint8_t* buffer, size_t capacity);
+};
+
+#endif // ARDUINO
+
+#endif // LOCAL_DATA_SERVER_H
@@ -0,0 +1,106 @@
+// MegaClockSync.cpp
+#include "MegaClockSync.h"
+#include "JsonScanner.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+const char REPLY_PREFIX[] = "{\"ev\":\"clock\"";
+
+// The UART driver of the bridge signals the received data after 10 idle symbols
+const uint32_t RX_TIMEOUT_SYMBOLS = 10;
+
+bool parseUnsigned(const JsonSlice& slice, uint32_t& value) {
+  value = 0;
+  if (slice.length == 0 || slice.length > 10) return false;
+  for (size_t i = 0; i < slice.length; i++) {
+    if (slice.start[i] < '0' || slice.start[i] > '9') return false;
+    value = value * 10 + (slice.start[i] - '0');
+  }
+  return true;
+}
+
+}  // namespace
+
+MegaClockSync::MegaClockSync(uint32_t baudRate)
+    : _baudRate(baudRate), _nextRound(0), _lastProbe(0), _roundId(0), _probesSent(0), _inRound(false), _replies(0),
+      _bestDelay(0), _bestTime(0), _bestMillis(0), _rounds(0), _lastDelay(0), _lastUncertainty(0), _lastReplies(0) {}
+
+bool MegaClockSync::poll(uint64_t nowMs, char* command) {
+  if (nowMs == 0) return false;
+  if (!_inRound) {
+    if (nowMs < _nextRound) return false;
+    _inRound = true;
+    _roundId += PROBES_PER_ROUND;   // Answers to the probes of an earlier round are ignored
+    _probesSent = 0;
+    _replies = 0;
+    _bestDelay = 0xFFFFFFFF;
+  }
+
+  if (_probesSent < PROBES_PER_ROUND) {
+    if (_probesSent > 0 && nowMs - _lastProbe < PROBE_SPACING) return false;
+    snprintf(command, COMMAND_LENGTH, "clock_probe %u", (unsigned)(_roundId + _probesSent));
+    _sentAt[_probesSent++] = nowMs;   // Until probeSent() gives the time it left
+    _lastProbe = nowMs;
+    return true;
+  }
+  if (_replies < _probesSent && nowMs - _lastProbe < REPLY_TIMEOUT) return false;
+  return finishRound(nowMs, command);
+}
+
+void MegaClockSync::probeSent(uint64_t sentMs) {
+  if (_inRound && _probesSent > 0) _sentAt[_probesSent - 1] = sentMs;
+}
+
+bool MegaClockSync::handleReply(const char* line, size_t length, uint64_t receivedMs) {
+  if (length < sizeof(REPLY_PREFIX) - 1 || memcmp(line, REPLY_PREFIX, sizeof(REPLY_PREFIX) - 1) != 0) return false;
+
+  uint32_t id = 0;
+  uint32_t received = 0;
+  uint32_t sent = 0;
+  uint8_t found = 0;
+  JsonReader reader = {line, line + length};
+  if (!reader.consume('{')) return true;
+  do {
+    JsonSlice key;
+    JsonSlice value;
+    if (!reader.readMember(key, value)) return true;
+    if (key.length == 4 && memcmp(key.start, "\"id\"", 4) == 0 && parseUnsigned(value, id)) found |= 1;
+    if (key.length == 4 && memcmp(key.start, "\"rx\"", 4) == 0 && parseUnsigned(value, received)) found |= 2;
+    if (key.length == 4 && memcmp(key.start, "\"tx\"", 4) == 0 && parseUnsigned(value, sent)) found |= 4;
+  } while (reader.consume(','));
+  if (found != 7 || !_inRound || id < _roundId || id >= _roundId + _probesSent || receivedMs == 0) return true;
+
+  // Round trip without the time the Mega held the probe and the transmission of the answer (10 bits per byte)
+  uint64_t transmission = (uint64_t)(length + 2 + RX_TIMEOUT_SYMBOLS) * 10 * 1000 / _baudRate;
+  uint64_t probeSentAt = _sentAt[id - _roundId];
+  int64_t roundTrip = (int64_t)(receivedMs - probeSentAt) - (int64_t)transmission;
+  int64_t delay = roundTrip - (int64_t)(uint32_t)(sent - received);
+  if (delay < 0) delay = 0;   // Within the resolution of the two clocks
+
+  _replies++;
+  if ((uint64_t)delay < _bestDelay) {
+    _bestDelay = (uint32_t)delay;
+    _bestTime = probeSentAt + delay / 2;
+    _bestMillis = received;
+  }
+  return true;
+}
+
+bool MegaClockSync::finishRound(uint64_t nowMs, char* command) {
+  _inRound = false;
+  _rounds++;
+  _lastReplies = _replies;
+  if (_replies == 0) {
+    _nextRound = nowMs + RETRY_INTERVAL;
+    return false;
+  }
+  _nextRound = nowMs + ROUND_INTERVAL;
+  _lastDelay = _bestDelay;
+  _lastUncertainty = _bestDelay / 2 + 1;
+  if (_lastUncertainty > 65535) _lastUncertainty = 65535;
+  snprintf(command, COMMAND_LENGTH, "clock_set %u %u %u %u", (unsigned)(_bestTime / 1000),
+           (unsigned)(_bestTime % 1000), (unsigned)_bestMillis, (unsigned)_lastUncertainty);
+  return true;
+}
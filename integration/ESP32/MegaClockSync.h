@@ -0,0 +1,69 @@
+// MegaClockSync.h
+#ifndef MEGA_CLOCK_SYNC_H
+#define MEGA_CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Synchronizes the clock of the Mega (SystemClock) with the clock of the bridge (SNTP), so the Mega
+// stamps its samples when it takes them rather than the bridge when it forwards them.
+//
+// Every ROUND_INTERVAL the bridge sends PROBES_PER_ROUND probes over the serial link:
+//   bridge -> Mega   clock_probe <id>                                  (t1: when its last byte left)
+//   Mega -> bridge   {"ev":"clock","id":<id>,"rx":<millis>,"tx":<millis>}   (t4: when it was received)
+// The link delay is the round trip t4 - t1, less the time the Mega held the probe (tx - rx) and the
+// transmission of the answer; the Mega read the probe at t1 + delay / 2, within delay / 2. The probe
+// with the shortest delay of the round (the one least held up by the loop of the Mega) is sent back:
+//   bridge -> Mega   clock_set <unix_time> <milliseconds> <rx> <uncertainty_ms>
+// The Mega estimates the drift of its resonator from the successive corrections.
+class MegaClockSync {
+public:
+  static const uint8_t PROBES_PER_ROUND = 4;
+  static const uint32_t PROBE_SPACING = 300;        // ms
+  static const uint32_t REPLY_TIMEOUT = 2000;       // ms after the last probe
+  static const uint32_t ROUND_INTERVAL = 300000;    // ms
+  static const uint32_t RETRY_INTERVAL = 30000;     // ms, after a round without answer
+  static const size_t COMMAND_LENGTH = 64;
+
+  // Baud rate of the link, to take the transmission of the answers out of the round trip
+  explicit MegaClockSync(uint32_t baudRate);
+
+  // Next command to send to the Mega (NUL-terminated, at most COMMAND_LENGTH), if one is due.
+  // nowMs is the Unix time in ms, 0 while the clock of the bridge is not set (nothing is sent).
+  // After writing a probe, the caller calls probeSent() once it left the UART.
+  bool poll(uint64_t nowMs, char* command);
+  void probeSent(uint64_t sentMs);
+
+  // Takes an answer of the Mega ({"ev":"clock",...}), received at receivedMs; false for other lines
+  bool handleReply(const char* line, size_t length, uint64_t receivedMs);
+
+  // Statistics of the last round, for the status log
+  uint32_t rounds() const { return _rounds; }
+  uint32_t lastDelay() const { return _lastDelay; }
+  uint32_t lastUncertainty() const { return _lastUncertainty; }
+  uint8_t lastReplies() const { return _lastReplies; }
+
+private:
+  uint32_t _baudRate;
+  uint64_t _nextRound;       // Unix ms of the next round, 0 for at once
+  uint64_t _lastProbe;
+  uint32_t _roundId;         // Identifier of the first probe of the current round
+  uint8_t _probesSent;
+  bool _inRound;
+  uint64_t _sentAt[PROBES_PER_ROUND];
+
+  // Best answer of the round
+  uint8_t _replies;
+  uint32_t _bestDelay;
+  uint64_t _bestTime;        // Unix ms at which the Mega read the probe
+  uint32_t _bestMillis;      // millis() of the Mega at that time
+
+  uint32_t _rounds;
+  uint32_t _lastDelay;
+  uint32_t _lastUncertainty;
+  uint8_t _lastReplies;
+
+  bool finishRound(uint64_t nowMs, char* command);
+};
+
+#endif // MEGA_CLOCK_SYNC_H
@@ -0,0 +1,31 @@
+// QueueStorage.h
+#ifndef QUEUE_STORAGE_H
+#define QUEUE_STORAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// File storage used by the TelemetryQueue: a few named files, appended to or rewritten whole.
+// LittleFsQueueStorage runs on the ESP32 flash, HostQueueStorage on a computer (not compiled for the ESP32).
+class QueueStorage {
+public:
+  virtual bool begin() = 0;
+
+  // Size of a file in bytes, 0 if it does not exist
+  virtual uint32_t size(const char* path) = 0;
+
+  // Reads up to length bytes from offset, returns the number of bytes read
+  virtual size_t read(const char* path, uint32_t offset, uint8_t* data, size_t length) = 0;
+
+  // Appends bytes at the end of a file (created if needed)
+  virtual bool append(const char* path, const uint8_t* data, size_t length) = 0;
+
+  // Replaces the content of a file
+  virtual bool write(const char* path, const uint8_t* data, size_t length) = 0;
+
+  virtual bool remove(const char* path) = 0;
+
+  virtual ~QueueStorage() {}
+};
+
+#endif // QUEUE_STORAGE_H
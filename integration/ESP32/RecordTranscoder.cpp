@@ -0,0 +1,209 @@
+// RecordTranscoder.cpp
+#include "RecordTranscoder.h"
+#include "JsonScanner.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+// Fields of a server record (REQUIRED_SENSOR_FIELDS of the backend), in the order they are written
+enum ServerField : uint8_t {
+  EVENT, PROGRAM_TYPE, RATE_OR_SPEED, DURATION, TEMP_SETPOINT, PH_SETPOINT, DO_SETPOINT, NUTRIENT_CONC, BASE_CONC,
+  EXPERIMENT_NAME, COMMENT, CURRENT_PROGRAM, PROGRAM_STATUS, AIR_PUMP, DRAIN_PUMP, NUTRIENT_PUMP, BASE_PUMP,
+  STIRRING_MOTOR, HEATING_PLATE, LED_GROW_LIGHT, WATER_TEMP, AIR_TEMP, PH, TURBIDITY, OXYGEN, AIR_FLOW, FIELD_COUNT
+};
+
+// Server key (with its quotes and colon, ready to copy) and raw JSON default value
+struct ServerFieldInfo {
+  const char* key;
+  const char* defaultValue;
+};
+
+const ServerFieldInfo SERVER_FIELDS[FIELD_COUNT] = {
+  {"\"event\":", "\"data\""}, {"\"programType\":", "\"\""}, {"\"rateOrSpeed\":", "0"}, {"\"duration\":", "0"},
+  {"\"tempSetpoint\":", "0"}, {"\"phSetpoint\":", "0"}, {"\"doSetpoint\":", "0"}, {"\"nutrientConc\":", "0"},
+  {"\"baseConc\":", "0"}, {"\"experimentName\":", "\"\""}, {"\"comment\":", "\"\""}, {"\"currentProgram\":", "\"\""},
+  {"\"programStatus\":", "\"\""}, {"\"airPumpStatus\":", "0"}, {"\"drainPumpStatus\":", "0"},
+  {"\"nutrientPumpStatus\":", "0"}, {"\"basePumpStatus\":", "0"}, {"\"stirringMotorStatus\":", "0"},
+  {"\"heatingPlateStatus\":", "0"}, {"\"ledGrowLightStatus\":", "0"}, {"\"waterTemp\":", "0"}, {"\"airTemp\":", "0"},
+  {"\"ph\":", "0"}, {"\"turbidity\":", "0"}, {"\"oxygen\":", "0"}, {"\"airFlow\":", "0"},
+};
+
+// Keys of the Mega, sorted in byte order for the binary search
+struct KeyTranslation {
+  const char* megaKey;
+  uint8_t length;
+  ServerField field;
+};
+
+#define TRANSLATION(key, field) {key, sizeof(key) - 1, field}
+const KeyTranslation TRANSLATIONS[] = {
+  TRANSLATION("airFlow", AIR_FLOW),
+  TRANSLATION("airP", AIR_PUMP),
+  TRANSLATION("airTemp", AIR_TEMP),
+  TRANSLATION("baseC", BASE_CONC),
+  TRANSLATION("baseP", BASE_PUMP),
+  TRANSLATION("comm", COMMENT),
+  TRANSLATION("doSet", DO_SETPOINT),
+  TRANSLATION("drainP", DRAIN_PUMP),
+  TRANSLATION("dur", DURATION),
+  TRANSLATION("ev", EVENT),
+  TRANSLATION("expN", EXPERIMENT_NAME),
+  TRANSLATION("heatingP", HEATING_PLATE),
+  TRANSLATION("led", LED_GROW_LIGHT),
+  TRANSLATION("nutC", NUTRIENT_CONC),
+  TRANSLATION("nutrientP", NUTRIENT_PUMP),
+  TRANSLATION("oxygen", OXYGEN),
+  TRANSLATION("pH", PH),
+  TRANSLATION("phSet", PH_SETPOINT),
+  TRANSLATION("program", CURRENT_PROGRAM),
+  TRANSLATION("pt", PROGRAM_TYPE),
+  TRANSLATION("rate", RATE_OR_SPEED),
+  TRANSLATION("status", PROGRAM_STATUS),
+  TRANSLATION("stirringM", STIRRING_MOTOR),
+  TRANSLATION("tSet", TEMP_SETPOINT),
+  TRANSLATION("turbidity", TURBIDITY),
+  TRANSLATION("waterTemp", WATER_TEMP),
+};
+#undef TRANSLATION
+const uint8_t TRANSLATION_COUNT = sizeof(TRANSLATIONS) / sizeof(TRANSLATIONS[0]);
+
+// Unsigned integer value, 0 if the slice is not one
+uint32_t parseTime(const JsonSlice& slice) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < slice.length; i++) {
+    if (slice.start[i] < '0' || slice.start[i] > '9') return 0;
+    value = value * 10 + (slice.start[i] - '0');
+  }
+  return value;
+}
+
+int compareKey(const char* key, size_t length, const KeyTranslation& translation) {
+  int order = memcmp(key, translation.megaKey, length < translation.length ? length : translation.length);
+  return order != 0 ? order : (int)length - (int)translation.length;
+}
+
+const KeyTranslation* findTranslation(const JsonSlice& key) {
+  int low = 0;
+  int high = TRANSLATION_COUNT - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    int order = compareKey(key.start, key.length, TRANSLATIONS[middle]);
+    if (order == 0) return &TRANSLATIONS[middle];
+    if (order < 0) {
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return nullptr;
+}
+
+// Bounded output; stops writing (and remembers it) when the buffer is full
+struct Writer {
+  char* output;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+
+  void write(const char* data, size_t count) {
+    if (length + count >= capacity) {
+      overflow = true;
+      return;
+    }
+    memcpy(output + length, data, count);
+    length += count;
+  }
+  void write(const char* text) { write(text, strlen(text)); }
+  void write(char c) { write(&c, 1); }
+};
+
+}  // namespace
+
+size_t RecordTranscoder::transcode(const char* line, size_t length, uint32_t receivedTime, char* output,
+                                   size_t capacity) {
+  JsonReader reader = {line, line + length};
+  Writer writer = {output, capacity, 0, false};
+  JsonSlice values[FIELD_COUNT] = {};
+
+  if (!reader.consume('{')) return 0;
+  writer.write("{\"sensor_value\":{");
+
+  // Keys without a translation are copied at once, the translated ones after the loop
+  bool firstKey = true;
+  bool sourceTime = false;
+  int16_t milliseconds = NO_MILLISECONDS;
+  if (!reader.consume('}')) {
+    do {
+      JsonSlice key;
+      JsonSlice value;
+      if (!reader.readMember(key, value)) return 0;
+
+      JsonSlice name = {key.start + 1, key.length - 2};
+      const KeyTranslation* translation = findTranslation(name);
+      if (name.length == 1 && name.start[0] == 't' && parseTime(value) != 0) {
+        receivedTime = parseTime(value);   // Time at which the Mega took or recorded the sample
+        sourceTime = true;
+      } else if (name.length == 2 && memcmp(name.start, "ms", 2) == 0 && value.length <= 3) {
+        milliseconds = parseTime(value);
+      }
+      if (translation != nullptr) {
+        values[translation->field] = value;
+      } else {
+        if (!firstKey) writer.write(',');
+        writer.write(key.start, key.length);
+        writer.write(':');
+        writer.write(value.start, value.length);
+        firstKey = false;
+      }
+    } while (reader.consume(','));
+    if (!reader.consume('}')) return 0;
+  }
+
+  // Regular data has no program type of its own: it is the current program
+  if (values[PROGRAM_TYPE].start == nullptr) values[PROGRAM_TYPE] = values[CURRENT_PROGRAM];
+
+  for (uint8_t field = 0; field < FIELD_COUNT; field++) {
+    if (!firstKey || field > 0) writer.write(',');
+    writer.write(SERVER_FIELDS[field].key);
+    if (values[field].start != nullptr) {
+      writer.write(values[field].start, values[field].length);
+    } else {
+      writer.write(SERVER_FIELDS[field].defaultValue);
+    }
+  }
+
+  // The milliseconds only come with the time of the Mega
+  if (!sourceTime) milliseconds = NO_MILLISECONDS;
+  char timestamp[TIMESTAMP_SIZE];
+  formatTimestamp(receivedTime, milliseconds, timestamp);
+  writer.write("},\"timestamp\":\"");
+  writer.write(timestamp);
+  writer.write("\"}");
+
+  if (writer.overflow) return 0;
+  output[writer.length] = '\0';
+  return writer.length;
+}
+
+void RecordTranscoder::formatTimestamp(uint32_t unixTime, int16_t milliseconds, char* output) {
+  output[0] = '\0';
+  if (unixTime == 0) return;
+  time_t time = unixTime;
+  struct tm parts;
+  gmtime_r(&time, &parts);
+  if (milliseconds < 0 || milliseconds > 999) {
+    strftime(output, TIMESTAMP_SIZE, "%Y-%m-%dT%H:%M:%SZ", &parts);
+    return;
+  }
+  size_t length = strftime(output, TIMESTAMP_SIZE, "%Y-%m-%dT%H:%M:%S", &parts);
+  snprintf(output + length, TIMESTAMP_SIZE - length, ".%03dZ", milliseconds);
+}
+
+bool RecordTranscoder::checkTable() {
+  for (uint8_t i = 1; i < TRANSLATION_COUNT; i++) {
+    if (compareKey(TRANSLATIONS[i].megaKey, TRANSLATIONS[i].length, TRANSLATIONS[i - 1]) <= 0) return false;
+  }
+  return true;
+}
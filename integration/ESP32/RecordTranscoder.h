@@ -0,0 +1,35 @@
+// RecordTranscoder.h
+#ifndef RECORD_TRANSCODER_H
+#define RECORD_TRANSCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Converts the JSON lines of the Mega (Logger::logData, Logger::logStartup, DataRecorder backfill)
+// into the records expected by the web server:
+//
+//   {"sensor_value":{<other keys of the line>,"event":...,"airPumpStatus":...,...},"timestamp":"..."}
+//
+// The line is read once, without building a document: the keys are looked up in a precomputed
+// translation table and the values are copied as they are (raw JSON) into the output buffer of
+// the caller, so no memory is allocated. Keys without a translation are kept, and the fields
+// the server requires but the line does not carry get their default value.
+class RecordTranscoder {
+public:
+  // Writes the record into output (NUL-terminated) and returns its length; 0 if the line is not a
+  // JSON object or the record does not fit. receivedTime is the Unix time, 0 if unknown; the time
+  // at which the Mega took the sample ("t", and its milliseconds "ms" once its clock is synchronized)
+  // or recorded a backfilled one takes precedence.
+  static size_t transcode(const char* line, size_t length, uint32_t receivedTime, char* output, size_t capacity);
+
+  // ISO 8601 UTC time, "YYYY-MM-DDTHH:MM:SSZ" or with milliseconds "YYYY-MM-DDTHH:MM:SS.mmmZ" (if
+  // milliseconds is not NO_MILLISECONDS), into TIMESTAMP_SIZE bytes; empty if the time is 0
+  static const size_t TIMESTAMP_SIZE = 25;
+  static const int16_t NO_MILLISECONDS = -1;
+  static void formatTimestamp(uint32_t unixTime, int16_t milliseconds, char* output);
+
+  // True if the translation table is sorted (checked by tools/transcoder_bench.cpp)
+  static bool checkTable();
+};
+
+#endif // RECORD_TRANSCODER_H
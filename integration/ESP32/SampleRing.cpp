@@ -0,0 +1,151 @@
+// SampleRing.cpp
+#include "SampleRing.h"
+#include "JsonScanner.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const uint8_t ACTUATOR = 0x80;   // Flag of the actuators in the key table
+
+// Keys of the data lines of the Mega with their channel or actuator index
+struct SampleKey {
+  const char* megaKey;
+  uint8_t length;
+  uint8_t index;
+};
+
+#define KEY(key, index) {key, sizeof(key) - 1, index}
+const SampleKey SAMPLE_KEYS[] = {
+  KEY("waterTemp", 0), KEY("airTemp", 1), KEY("elecTemp", 2), KEY("pH", 3), KEY("turbidity", 4), KEY("oxygen", 5),
+  KEY("airFlow", 6), KEY("airP", ACTUATOR | 0), KEY("drainP", ACTUATOR | 1), KEY("nutrientP", ACTUATOR | 2),
+  KEY("baseP", ACTUATOR | 3), KEY("stirringM", ACTUATOR | 4), KEY("heatingP", ACTUATOR | 5),
+  KEY("led", ACTUATOR | 6),
+};
+#undef KEY
+const uint8_t SAMPLE_KEY_COUNT = sizeof(SAMPLE_KEYS) / sizeof(SAMPLE_KEYS[0]);
+
+const SampleKey* findKey(const char* name, size_t length) {
+  for (uint8_t i = 0; i < SAMPLE_KEY_COUNT; i++) {
+    if (SAMPLE_KEYS[i].length == length && memcmp(SAMPLE_KEYS[i].megaKey, name, length) == 0) return &SAMPLE_KEYS[i];
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+const char* const SampleRing::CHANNEL_NAMES[TelemetrySample::CHANNEL_COUNT] = {
+  "waterTemp", "airTemp", "elecTemp", "ph", "turbidity", "oxygen", "airFlow",
+};
+const char* const SampleRing::ACTUATOR_NAMES[TelemetrySample::ACTUATOR_COUNT] = {
+  "airPumpStatus", "drainPumpStatus", "nutrientPumpStatus", "basePumpStatus", "stirringMotorStatus",
+  "heatingPlateStatus", "ledGrowLightStatus",
+};
+
+SampleRing::SampleRing() : _end(0) {
+  for (uint16_t i = 0; i < CAPACITY; i++) _slots[i].sequence.store(EMPTY, std::memory_order_relaxed);
+}
+
+bool SampleRing::parseLine(const char* line, size_t length, uint32_t time, TelemetrySample& sample) {
+  sample.time = time;
+  for (uint8_t i = 0; i < TelemetrySample::CHANNEL_COUNT; i++) sample.values[i] = NAN;
+  sample.actuators = 0;
+
+  JsonReader reader = {line, line + length};
+  if (!reader.consume('{') || reader.consume('}')) return false;
+  bool hasValues = false;
+  do {
+    JsonSlice key;
+    JsonSlice value;
+    if (!reader.readMember(key, value)) return false;
+    const char* name = key.start + 1;
+    size_t nameLength = key.length - 2;
+    if (nameLength == 2 && memcmp(name, "ev", 2) == 0) return false;   // Startup, program event or backfill
+    if (nameLength == 1 && name[0] == 't') {
+      // Stamped by the Mega when it took the sample
+      uint32_t stamp = value.start[0] >= '0' && value.start[0] <= '9' ? strtoul(value.start, nullptr, 10) : 0;
+      if (stamp > 0) sample.time = stamp;
+      continue;
+    }
+
+    const SampleKey* sampleKey = findKey(name, nameLength);
+    if (sampleKey == nullptr) continue;
+    float number = parseJsonNumber(value);
+    if (sampleKey->index & ACTUATOR) {
+      if (!isnan(number) && number != 0) sample.actuators |= 1 << (sampleKey->index & ~ACTUATOR);
+    } else {
+      sample.values[sampleKey->index] = number;
+      hasValues = true;
+    }
+  } while (reader.consume(','));
+  return hasValues;
+}
+
+void SampleRing::push(const TelemetrySample& sample) {
+  uint32_t sequence = _end.load(std::memory_order_relaxed);
+  Slot& slot = _slots[sequence % CAPACITY];
+  // The slot is marked empty while it is written, so a reader copying it at the same time drops its copy
+  slot.sequence.store(EMPTY, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.sample = sample;
+  slot.sequence.store(sequence, std::memory_order_release);
+  _end.store(sequence + 1, std::memory_order_release);
+}
+
+uint32_t SampleRing::begin() const {
+  uint32_t last = end();
+  return last > CAPACITY ? last - CAPACITY : 0;
+}
+
+bool SampleRing::read(uint32_t sequence, TelemetrySample& sample) const {
+  const Slot& slot = _slots[sequence % CAPACITY];
+  if (slot.sequence.load(std::memory_order_acquire) != sequence) return false;
+  sample = slot.sample;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+uint32_t SampleRing::find(uint32_t time) const {
+  uint32_t low = begin();
+  uint32_t high = end();
+  while (low < high) {
+    uint32_t middle = low + (high - low) / 2;
+    TelemetrySample sample;
+    // A sample overwritten during the search is older than any kept one
+    if (!read(middle, sample) || sample.time < time) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+size_t SampleRing::formatSample(uint32_t sequence, const TelemetrySample& sample, char* output, size_t capacity) {
+  size_t length = 0;
+  int count = snprintf(output, capacity, "{\"seq\":%u,\"t\":%u", (unsigned)sequence, (unsigned)sample.time);
+  if (count < 0 || (size_t)count >= capacity) return 0;
+  length += count;
+
+  for (uint8_t i = 0; i < TelemetrySample::CHANNEL_COUNT; i++) {
+    if (!isfinite(sample.values[i])) {
+      count = snprintf(output + length, capacity - length, ",\"%s\":null", CHANNEL_NAMES[i]);
+    } else {
+      count = snprintf(output + length, capacity - length, ",\"%s\":%.6g", CHANNEL_NAMES[i], sample.values[i]);
+    }
+    if (count < 0 || (size_t)count >= capacity - length) return 0;
+    length += count;
+  }
+  for (uint8_t i = 0; i < TelemetrySample::ACTUATOR_COUNT; i++) {
+    count = snprintf(output + length, capacity - length, ",\"%s\":%u", ACTUATOR_NAMES[i],
+                     (unsigned)((sample.actuators >> i) & 1));
+    if (count < 0 || (size_t)count >= capacity - length) return 0;
+    length += count;
+  }
+  if (length + 1 >= capacity) return 0;
+  output[length++] = '}';
+  output[length] = '\0';
+  return length;
+}
@@ -0,0 +1,72 @@
+// SampleRing.h
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Sensor values and actuator states of one data line of the Mega (Logger::logData)
+struct TelemetrySample {
+  static const uint8_t CHANNEL_COUNT = 7;
+  static const uint8_t ACTUATOR_COUNT = 7;
+
+  uint32_t time;                   // Unix time at reception, 0 if the clock was not set
+  float values[CHANNEL_COUNT];     // In the order of SampleRing::CHANNEL_NAMES, NaN if null (written as null)
+  uint8_t actuators;               // Bit i set if actuator i of SampleRing::ACTUATOR_NAMES is on
+};
+
+// Fixed-size time series of the most recent samples, kept in RAM for the local HTTP server of the
+// bridge (LocalDataServer), so the reactor can be followed while the web server is unreachable.
+//
+// One writer (the transform task) and any number of readers (the async TCP task). Every sample
+// gets a sequence number, counted from 0 at boot; sample n is in slot n % CAPACITY, which holds
+// its sequence number as a per-slot seqlock: a reader copies the slot and keeps the copy only if
+// the slot still holds the same sample afterwards. Neither side waits or allocates.
+class SampleRing {
+public:
+  static const uint16_t CAPACITY = 1024;       // 8.5 hours at the 30 s interval of the Mega (40 KB)
+  static const size_t MAX_JSON_LENGTH = 384;   // Longest JSON object written by formatSample
+
+  // Names in the JSON objects, those of the web server where it has the field
+  static const char* const CHANNEL_NAMES[TelemetrySample::CHANNEL_COUNT];
+  static const char* const ACTUATOR_NAMES[TelemetrySample::ACTUATOR_COUNT];
+
+  SampleRing();
+
+  // Fills sample from a data line of the Mega; false for the event and backfilled lines, and for
+  // anything that is not a JSON object carrying at least one sensor value. time is the reception
+  // time, replaced by the "t" of the line when the Mega stamped it
+  static bool parseLine(const char* line, size_t length, uint32_t time, TelemetrySample& sample);
+
+  // Appends a sample, overwriting the oldest once full (writer only)
+  void push(const TelemetrySample& sample);
+
+  // Sequence numbers of the oldest sample kept and of the next one to be written
+  uint32_t begin() const;
+  uint32_t end() const { return _end.load(std::memory_order_acquire); }
+
+  // Copies sample number sequence; false if it was overwritten or not written yet
+  bool read(uint32_t sequence, TelemetrySample& sample) const;
+
+  // First sequence number whose time is at least time (end() if none). The times only go back
+  // when the clock is first set, so the samples from before NTP answered (time 0) sort first.
+  uint32_t find(uint32_t time) const;
+
+  // {"seq":n,"t":...,"waterTemp":...,...,"airPumpStatus":0,...} (NUL-terminated, null for NaN);
+  // returns its length, 0 if it does not fit in capacity
+  static size_t formatSample(uint32_t sequence, const TelemetrySample& sample, char* output, size_t capacity);
+
+private:
+  static const uint32_t EMPTY = 0xFFFFFFFF;   // Sequence of a slot being written, or never written
+
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    TelemetrySample sample;
+  };
+
+  Slot _slots[CAPACITY];
+  std::atomic<uint32_t> _end;
+};
+
+#endif // SAMPLE_RING_H
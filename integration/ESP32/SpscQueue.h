@@ -0,0 +1,68 @@
+// SpscQueue.h
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free ring of CAPACITY slots between exactly one producer task and one consumer task.
+// The slots are filled and read in place (no copy of the large line buffers): the producer gets a
+// free slot with producerSlot(), fills it and publishes it with push(); the consumer reads
+// consumerSlot() and releases it with pop(). Neither side ever blocks or takes a lock, so a slow
+// consumer can only make the producer find the queue full.
+//
+// Each index is written by one side only, with release/acquire ordering so the slot contents are
+// visible before the index that publishes them. Depth statistics can be read from any task.
+template <typename T, uint16_t CAPACITY>
+class SpscQueue {
+public:
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "The capacity must be a power of two");
+
+  SpscQueue() : _head(0), _tail(0), _highWater(0), _full(0) {}
+
+  // Producer: free slot to fill, nullptr if the queue is full (counted)
+  T* producerSlot() {
+    uint16_t tail = _tail.load(std::memory_order_relaxed);
+    if ((uint16_t)(tail - _head.load(std::memory_order_acquire)) == CAPACITY) {
+      _full.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &_slots[tail & (CAPACITY - 1)];
+  }
+
+  // Producer: publishes the slot returned by producerSlot()
+  void push() {
+    uint16_t tail = _tail.load(std::memory_order_relaxed) + 1;
+    _tail.store(tail, std::memory_order_release);
+    uint16_t depth = tail - _head.load(std::memory_order_relaxed);
+    if (depth > _highWater.load(std::memory_order_relaxed)) _highWater.store(depth, std::memory_order_relaxed);
+  }
+
+  // Consumer: oldest published slot, nullptr if the queue is empty
+  T* consumerSlot() {
+    uint16_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) return nullptr;
+    return &_slots[head & (CAPACITY - 1)];
+  }
+
+  // Consumer: releases the slot returned by consumerSlot()
+  void pop() {
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  uint16_t depth() const {
+    return (uint16_t)(_tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire));
+  }
+  uint16_t capacity() const { return CAPACITY; }
+  uint16_t highWater() const { return _highWater.load(std::memory_order_relaxed); }   // Deepest since boot
+  uint32_t fullCount() const { return _full.load(std::memory_order_relaxed); }        // Times found full
+
+private:
+  T _slots[CAPACITY];
+  std::atomic<uint16_t> _head;       // Next slot to read, written by the consumer only
+  std::atomic<uint16_t> _tail;       // Next slot to fill, written by the producer only
+  std::atomic<uint16_t> _highWater;  // Written by the producer only
+  std::atomic<uint32_t> _full;       // Written by the producer only
+};
+
+#endif // SPSC_QUEUE_H
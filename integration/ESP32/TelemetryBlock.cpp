@@ -0,0 +1,297 @@
+// TelemetryBlock.cpp
+#include "TelemetryBlock.h"
+#include "JsonScanner.h"
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const uint8_t TEXT = 0x80;   // Flag of the text fields in the field table
+
+// Server fields sorted in byte order for the binary search, with their text or numeric index:
+// text fields event, programType, experimentName, comment, currentProgram, programStatus; numeric
+// fields rateOrSpeed, duration, tempSetpoint, phSetpoint, doSetpoint, nutrientConc, baseConc,
+// airPumpStatus, drainPumpStatus, nutrientPumpStatus, basePumpStatus, stirringMotorStatus,
+// heatingPlateStatus, ledGrowLightStatus, waterTemp, airTemp, ph, turbidity, oxygen, airFlow
+struct BlockField {
+  const char* name;
+  uint8_t length;
+  uint8_t index;
+};
+
+#define FIELD(name, index) {name, sizeof(name) - 1, index}
+const BlockField FIELDS[] = {
+  FIELD("airFlow", 19),
+  FIELD("airPumpStatus", 7),
+  FIELD("airTemp", 15),
+  FIELD("baseConc", 6),
+  FIELD("basePumpStatus", 10),
+  FIELD("comment", TEXT | 3),
+  FIELD("currentProgram", TEXT | 4),
+  FIELD("doSetpoint", 4),
+  FIELD("drainPumpStatus", 8),
+  FIELD("duration", 1),
+  FIELD("event", TEXT | 0),
+  FIELD("experimentName", TEXT | 2),
+  FIELD("heatingPlateStatus", 12),
+  FIELD("ledGrowLightStatus", 13),
+  FIELD("nutrientConc", 5),
+  FIELD("nutrientPumpStatus", 9),
+  FIELD("oxygen", 18),
+  FIELD("ph", 16),
+  FIELD("phSetpoint", 3),
+  FIELD("programStatus", TEXT | 5),
+  FIELD("programType", TEXT | 1),
+  FIELD("rateOrSpeed", 0),
+  FIELD("stirringMotorStatus", 11),
+  FIELD("tempSetpoint", 2),
+  FIELD("turbidity", 17),
+  FIELD("waterTemp", 14),
+};
+#undef FIELD
+const uint8_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+const uint32_t NAN_BITS = 0x7FC00000;
+const char NULL_TEXT[] = "null";
+
+int compareName(const char* name, size_t length, const BlockField& field) {
+  int order = memcmp(name, field.name, length < field.length ? length : field.length);
+  return order != 0 ? order : (int)length - (int)field.length;
+}
+
+const BlockField* findField(const char* name, size_t length) {
+  int low = 0;
+  int high = FIELD_COUNT - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    int order = compareName(name, length, FIELDS[middle]);
+    if (order == 0) return &FIELDS[middle];
+    if (order < 0) {
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+  }
+  return nullptr;
+}
+
+// Bits of the float32 value of a raw JSON number, NaN for anything else
+uint32_t parseNumber(const JsonSlice& value) {
+  float number = parseJsonNumber(value);
+  if (isnan(number)) return NAN_BITS;
+  uint32_t bits;
+  memcpy(&bits, &number, sizeof(bits));
+  return bits;
+}
+
+// Unix time in ms of "YYYY-MM-DDTHH:MM:SSZ" or "YYYY-MM-DDTHH:MM:SS.mmmZ", 0 if empty or malformed
+uint64_t parseTimestamp(const JsonSlice& value, bool& hasMilliseconds) {
+  const char* text = value.start + 1;
+  hasMilliseconds = value.length == 26 && text[19] == '.';
+  if ((value.length != 22 && !hasMilliseconds) || text[4] != '-' || text[7] != '-' || text[10] != 'T') return 0;
+  int parts[7];
+  const uint8_t offsets[7] = {0, 5, 8, 11, 14, 17, 20};
+  for (uint8_t i = 0; i < (hasMilliseconds ? 7 : 6); i++) {
+    const char* digits = text + offsets[i];
+    parts[i] = 0;
+    for (uint8_t j = 0; j < (i == 0 ? 4 : i == 6 ? 3 : 2); j++) {
+      if (digits[j] < '0' || digits[j] > '9') return 0;
+      parts[i] = parts[i] * 10 + (digits[j] - '0');
+    }
+  }
+  // Days since 1970-01-01 in the proleptic Gregorian calendar
+  int year = parts[0] - (parts[1] <= 2 ? 1 : 0);
+  int era = year / 400;
+  int yearOfEra = year - era * 400;
+  int month = parts[1] > 2 ? parts[1] - 3 : parts[1] + 9;
+  int dayOfYear = (153 * month + 2) / 5 + parts[2] - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  int32_t days = era * 146097 + dayOfEra - 719468;
+  uint32_t seconds = (uint32_t)days * 86400 + parts[3] * 3600 + parts[4] * 60 + parts[5];
+  return (uint64_t)seconds * 1000 + (hasMilliseconds ? parts[6] : 0);
+}
+
+uint8_t countLeadingZeros(uint32_t value) {
+  uint8_t count = 0;
+  for (uint32_t bit = 0x80000000; bit != 0 && (value & bit) == 0; bit >>= 1) count++;
+  return count;
+}
+
+uint8_t countTrailingZeros(uint32_t value) {
+  uint8_t count = 0;
+  for (uint32_t bit = 1; bit != 0 && (value & bit) == 0; bit <<= 1) count++;
+  return count;
+}
+
+}  // namespace
+
+TelemetryBlockEncoder::TelemetryBlockEncoder(uint8_t* buffer, size_t capacity) : _buffer(buffer), _capacity(capacity) {
+  reset();
+}
+
+void TelemetryBlockEncoder::reset() {
+  _buffer[0] = VERSION;
+  _buffer[1] = 0;
+  _bitLength = 16;
+  _count = 0;
+  _previousTime = 0;
+  _previousDelta = 0;
+  _previousHasMilliseconds = false;
+  for (uint8_t i = 0; i < NUMERIC_FIELD_COUNT; i++) {
+    _previousBits[i] = 0;
+    _previousLeading[i] = 0xFF;
+    _previousTrailing[i] = 0;
+  }
+}
+
+bool TelemetryBlockEncoder::add(const char* record, size_t length) {
+  if (_count >= MAX_RECORDS) return false;
+
+  // Split the record into its fields
+  JsonSlice texts[TEXT_FIELD_COUNT] = {};
+  uint32_t numbers[NUMERIC_FIELD_COUNT];
+  for (uint8_t i = 0; i < NUMERIC_FIELD_COUNT; i++) numbers[i] = NAN_BITS;
+  uint64_t time = 0;
+  bool hasMilliseconds = false;
+  bool hasValues = false;
+
+  JsonReader reader = {record, record + length};
+  if (!reader.consume('{')) return false;
+  do {
+    JsonSlice key;
+    JsonSlice value;
+    if (!reader.readMember(key, value)) return false;
+    if (key.length == 14 && memcmp(key.start, "\"sensor_value\"", 14) == 0) {
+      JsonReader values = {value.start, value.start + value.length};
+      if (!values.consume('{')) return false;
+      hasValues = true;
+      if (values.consume('}')) continue;
+      do {
+        JsonSlice name;
+        JsonSlice field;
+        if (!values.readMember(name, field)) return false;
+        const BlockField* info = findField(name.start + 1, name.length - 2);
+        if (info == nullptr) continue;
+        if (info->index & TEXT) {
+          texts[info->index & ~TEXT] = field;
+        } else {
+          numbers[info->index] = parseNumber(field);
+        }
+      } while (values.consume(','));
+    } else if (key.length == 11 && memcmp(key.start, "\"timestamp\"", 11) == 0 && value.start[0] == '"') {
+      time = parseTimestamp(value, hasMilliseconds);
+    }
+  } while (reader.consume(','));
+  if (!hasValues) return false;
+
+  // Worst case: 47 bits of timestamp, 44 per number, 24 per text field and its bytes
+  size_t worstCase = (47 + NUMERIC_FIELD_COUNT * 44 + TEXT_FIELD_COUNT * 24) / 8 + 1;
+  for (uint8_t i = 0; i < TEXT_FIELD_COUNT; i++) {
+    worstCase += texts[i].start != nullptr ? texts[i].length : sizeof(NULL_TEXT) - 1;
+  }
+  if (remaining() < worstCase) return false;
+
+  writeTimestamp(time, hasMilliseconds);
+  for (uint8_t i = 0; i < TEXT_FIELD_COUNT; i++) {
+    if (texts[i].start != nullptr) {
+      writeText(i, texts[i].start, texts[i].length);
+    } else {
+      writeText(i, NULL_TEXT, sizeof(NULL_TEXT) - 1);
+    }
+  }
+  for (uint8_t i = 0; i < NUMERIC_FIELD_COUNT; i++) {
+    writeNumber(i, numbers[i]);
+  }
+  _buffer[1] = ++_count;
+  return true;
+}
+
+void TelemetryBlockEncoder::writeBits(uint32_t value, uint8_t count) {
+  while (count > 0) {
+    size_t byte = _bitLength / 8;
+    uint8_t free = 8 - (_bitLength % 8);
+    uint8_t taken = count < free ? count : free;
+    uint8_t bits = (value >> (count - taken)) & ((1u << taken) - 1);
+    if (free == 8) _buffer[byte] = 0;
+    _buffer[byte] |= bits << (free - taken);
+    _bitLength += taken;
+    count -= taken;
+  }
+}
+
+void TelemetryBlockEncoder::writeTimestamp(uint64_t time, bool hasMilliseconds) {
+  writeBits(hasMilliseconds ? 1 : 0, 1);
+  // Deltas in ms, or in seconds for the times without milliseconds; a change of unit, a clock set in
+  // the middle of the block or a step back takes the absolute case
+  uint32_t unit = hasMilliseconds ? 1 : 1000;
+  bool absolute = _count == 0 || hasMilliseconds != _previousHasMilliseconds || time < _previousTime ||
+                  time - _previousTime >= 0x80000000ULL;
+  uint32_t delta = absolute ? 0 : (uint32_t)((time - _previousTime) / unit);
+  int32_t deltaOfDelta = (int32_t)(delta - _previousDelta);
+  if (absolute || deltaOfDelta < -65536 || deltaOfDelta > 65535) {
+    if (_count > 0) writeBits(0xF, 4);
+    writeBits((uint32_t)(time / 1000), 32);
+    writeBits((uint32_t)(time % 1000), 10);
+    delta = 0;
+  } else if (deltaOfDelta == 0) {
+    writeBits(0, 1);
+  } else if (deltaOfDelta >= -64 && deltaOfDelta <= 63) {
+    writeBits(0x2, 2);
+    writeBits((uint32_t)deltaOfDelta, 7);
+  } else if (deltaOfDelta >= -2048 && deltaOfDelta <= 2047) {
+    writeBits(0x6, 3);
+    writeBits((uint32_t)deltaOfDelta, 12);
+  } else {
+    writeBits(0xE, 4);
+    writeBits((uint32_t)deltaOfDelta, 17);
+  }
+  _previousDelta = delta;
+  _previousTime = time;
+  _previousHasMilliseconds = hasMilliseconds;
+}
+
+void TelemetryBlockEncoder::writeText(uint8_t field, const char* text, uint16_t length) {
+  if (_count > 0 && _textLength[field] == length && memcmp(_buffer + _textOffset[field], text, length) == 0) {
+    writeBits(0, 1);
+    return;
+  }
+  writeBits(1, 1);
+  _bitLength = (_bitLength + 7) / 8 * 8;
+  writeBits(length, 16);
+  memcpy(_buffer + _bitLength / 8, text, length);
+  _textOffset[field] = _bitLength / 8;
+  _textLength[field] = length;
+  _bitLength += length * 8;
+}
+
+void TelemetryBlockEncoder::writeNumber(uint8_t field, uint32_t bits) {
+  uint32_t xorValue = bits ^ _previousBits[field];
+  _previousBits[field] = bits;
+  if (xorValue == 0) {
+    writeBits(0, 1);
+    return;
+  }
+  uint8_t leading = countLeadingZeros(xorValue);
+  uint8_t trailing = countTrailingZeros(xorValue);
+  if (leading > 31) leading = 31;
+  if (_previousLeading[field] != 0xFF && leading >= _previousLeading[field] && trailing >= _previousTrailing[field]) {
+    // Fits in the window of the previous value
+    writeBits(0x2, 2);
+    writeBits(xorValue >> _previousTrailing[field], 32 - _previousLeading[field] - _previousTrailing[field]);
+    return;
+  }
+  uint8_t meaningful = 32 - leading - trailing;
+  writeBits(0x3, 2);
+  writeBits(leading, 5);
+  writeBits(meaningful - 1, 5);
+  writeBits(xorValue >> trailing, meaningful);
+  _previousLeading[field] = leading;
+  _previousTrailing[field] = trailing;
+}
+
+bool TelemetryBlockEncoder::checkTable() {
+  for (uint8_t i = 1; i < FIELD_COUNT; i++) {
+    if (compareName(FIELDS[i].name, FIELDS[i].length, FIELDS[i - 1]) <= 0) return false;
+  }
+  return true;
+}
@@ -0,0 +1,73 @@
+// TelemetryBlock.h
+#ifndef TELEMETRY_BLOCK_H
+#define TELEMETRY_BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Compressed block of server records (the JSON of RecordTranscoder), in the manner of the Gorilla
+// time-series encoding: the timestamps are stored as deltas of deltas and every numeric field as
+// the XOR of its float value with the previous one, so a value that did not change costs one bit
+// and a slowly varying one only its changing mantissa bits. The text fields (event, program,
+// status...) are stored only when they change.
+//
+// Layout (bits MSB first), decoded by telemetry_block.py on the server:
+//   byte 0: VERSION, byte 1: record count
+//   per record:
+//     timestamp   '1' if it has milliseconds (stamped by the clock of the Mega), else '0'; first
+//                 record 32 bits of Unix seconds + 10 bits of milliseconds; then the delta of delta,
+//                 in ms if the record has milliseconds, else in seconds (two's complement): '0' (0),
+//                 '10' + 7 bits, '110' + 12 bits, '1110' + 17 bits, or '1111' + 32 + 10 bits of
+//                 absolute time (also when the unit changes; the next delta is taken from 0)
+//     text fields '0' if unchanged, else '1', padding to the byte, 16-bit length and the raw JSON value
+//     numbers     XOR of the float32 bits with the previous value (0 before the first record):
+//                 '0' if equal, '10' + the meaningful bits if they fit in the previous window,
+//                 '11' + 5 bits of leading zeros + 5 bits of length - 1 + the meaningful bits
+// Null and non-numeric values of the numeric fields are stored as NaN (null on the server). The
+// keys that the server does not store (seq, sensorFaults...) are not part of the block.
+class TelemetryBlockEncoder {
+public:
+  static const uint8_t VERSION = 2;
+  static const uint8_t MAX_RECORDS = 64;
+  static const uint8_t TEXT_FIELD_COUNT = 6;
+  static const uint8_t NUMERIC_FIELD_COUNT = 20;
+
+  TelemetryBlockEncoder(uint8_t* buffer, size_t capacity);
+
+  // Starts an empty block
+  void reset();
+
+  // Appends a server record; false if it is not one or the block is full (the block is unchanged).
+  // A record carrying all the server fields never takes more bytes in the block than its JSON text.
+  bool add(const char* record, size_t length);
+
+  const uint8_t* data() const { return _buffer; }
+  size_t size() const { return (_bitLength + 7) / 8; }
+  size_t remaining() const { return _capacity - size(); }
+  uint8_t count() const { return _count; }
+
+  // True if the field table is sorted (checked by tools/block_bench.cpp)
+  static bool checkTable();
+
+private:
+  uint8_t* _buffer;
+  size_t _capacity;
+  size_t _bitLength;
+  uint8_t _count;
+
+  uint64_t _previousTime;                          // ms
+  uint32_t _previousDelta;                         // ms, or seconds without milliseconds
+  bool _previousHasMilliseconds;
+  uint32_t _previousBits[NUMERIC_FIELD_COUNT];
+  uint8_t _previousLeading[NUMERIC_FIELD_COUNT];    // XOR window of the last stored value, 0xFF if none
+  uint8_t _previousTrailing[NUMERIC_FIELD_COUNT];
+  uint16_t _textOffset[TEXT_FIELD_COUNT];           // Where the last value of each text field is in the block
+  uint16_t _textLength[TEXT_FIELD_COUNT];
+
+  void writeBits(uint32_t value, uint8_t count);
+  void writeTimestamp(uint64_t time, bool hasMilliseconds);
+  void writeText(uint8_t field, const char* text, uint16_t length);
+  void writeNumber(uint8_t field, uint32_t bits);
+};
+
+#endif // TELEMETRY_BLOCK_H
@@ -0,0 +1,202 @@
+// TelemetryQueue.cpp
+#include "TelemetryQueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char HEAD_PATH[] = "/qhead.bin";
+
+TelemetryQueue::TelemetryQueue(QueueStorage& storage)
+    : _storage(storage), _readSegment(1), _readOffset(0), _nextSegment(2), _sendSegment(1), _sendOffset(0), _writeSegment(1),
+      _writeSize(0), _pendingBytes(0), _droppedBytes(0) {}
+
+bool TelemetryQueue::begin() {
+  if (!_storage.begin()) return false;
+
+  Head head = {};
+  size_t headSize = _storage.read(HEAD_PATH, 0, reinterpret_cast<uint8_t*>(&head), sizeof(head));
+  if (headSize >= OLD_HEAD_SIZE && head.magic == HEAD_MAGIC && head.segment > 0) {
+    _readSegment = head.segment;
+    _readOffset = head.offset;
+  }
+  _nextSegment = headSize == sizeof(head) && head.next > _readSegment ? head.next : _readSegment + 1;
+
+  // The segments are numbered contiguously from the one after the read segment
+  _writeSegment = _readSegment;
+  if (segmentSize(_nextSegment) > 0) {
+    _writeSegment = _nextSegment;
+    while (segmentSize(_writeSegment + 1) > 0) {
+      _writeSegment++;
+    }
+  } else {
+    _nextSegment = _readSegment + 1;
+  }
+  _writeSize = segmentSize(_writeSegment);
+
+  _pendingBytes = segmentSize(_readSegment);
+  _pendingBytes = _pendingBytes > _readOffset ? _pendingBytes - _readOffset : 0;
+  for (uint32_t segment = _nextSegment; segment <= _writeSegment; segment++) {
+    _pendingBytes += segmentSize(segment);
+  }
+  rewind();
+  return true;
+}
+
+bool TelemetryQueue::push(uint32_t time, const char* line, size_t length) {
+  if (length == 0 || length > MAX_LINE_LENGTH) return false;
+  int prefix = snprintf(_writeBuffer, sizeof(_writeBuffer), "%lu ", (unsigned long)time);
+  memcpy(_writeBuffer + prefix, line, length);
+  size_t total = prefix + length;
+  _writeBuffer[total++] = '\n';
+
+  if (_writeSize > 0 && _writeSize + total > SEGMENT_SIZE) {
+    _writeSegment++;
+    _writeSize = 0;
+    while (getSegmentCount() > MAX_SEGMENTS) {
+      dropOldestSegment();
+    }
+  }
+
+  char path[PATH_LENGTH];
+  segmentPath(_writeSegment, path);
+  if (!_storage.append(path, reinterpret_cast<const uint8_t*>(_writeBuffer), total)) return false;
+  _writeSize += total;
+  _pendingBytes += total;
+  return true;
+}
+
+uint8_t TelemetryQueue::read(QueuedRecord* records, uint8_t maxRecords, QueuePosition& end) {
+  uint8_t count = 0;
+  if (maxRecords > MAX_BATCH) maxRecords = MAX_BATCH;
+
+  while (hasUnsent()) {
+    char path[PATH_LENGTH];
+    segmentPath(_sendSegment, path);
+    uint32_t size = segmentSize(_sendSegment);
+    if (_sendOffset >= size) {
+      _sendSegment = _sendSegment == _readSegment ? _nextSegment : _sendSegment + 1;   // Removed once delivered (commit)
+      _sendOffset = 0;
+      continue;
+    }
+
+    size_t length = _storage.read(path, _sendOffset, reinterpret_cast<uint8_t*>(_readBuffer), READ_BUFFER_SIZE - 1);
+    size_t start = 0;
+    for (size_t i = 0; i < length && count < maxRecords; i++) {
+      if (_readBuffer[i] != '\n') continue;
+      _readBuffer[i] = '\0';
+      char* endOfTime;
+      unsigned long time = strtoul(_readBuffer + start, &endOfTime, 10);
+      QueuedRecord& record = records[count++];
+      if (*endOfTime == ' ') {
+        record.time = time;
+        record.line = endOfTime + 1;
+      } else {
+        record.time = 0;
+        record.line = _readBuffer + start;
+      }
+      start = i + 1;
+    }
+    if (count > 0) {
+      _sendOffset += start;
+      end.segment = _sendSegment;
+      end.offset = _sendOffset;
+      return count;
+    }
+
+    // No complete record left in this segment (damaged tail): skip it
+    _sendOffset = size;
+  }
+  return 0;
+}
+
+void TelemetryQueue::commit(const QueuePosition& position) {
+  if (position.segment < _readSegment || (position.segment == _readSegment && position.offset <= _readOffset)) {
+    return;   // Already delivered (segment dropped meanwhile)
+  }
+  // Segments delivered up to the position are removed
+  uint32_t delivered = 0;
+  while (_readSegment < position.segment) {
+    uint32_t size = segmentSize(_readSegment);
+    delivered += size > _readOffset ? size - _readOffset : 0;
+    removeReadSegment();
+  }
+  // Unless the segment of the position was dropped meanwhile
+  if (_readSegment == position.segment) {
+    delivered += position.offset - _readOffset;
+    _readOffset = position.offset;
+    if (_readOffset >= segmentSize(_readSegment) && _readSegment < _writeSegment) {
+      removeReadSegment();
+    }
+  }
+  _pendingBytes = _pendingBytes > delivered ? _pendingBytes - delivered : 0;
+  saveHead();
+}
+
+void TelemetryQueue::rewind() {
+  _sendSegment = _readSegment;
+  _sendOffset = _readOffset;
+}
+
+bool TelemetryQueue::hasUnsent() const {
+  return _sendSegment < _writeSegment || (_sendSegment == _writeSegment && _sendOffset < _writeSize);
+}
+
+uint32_t TelemetryQueue::segmentSize(uint32_t segment) {
+  if (segment == _writeSegment && _writeSize > 0) return _writeSize;
+  char path[PATH_LENGTH];
+  segmentPath(segment, path);
+  return _storage.size(path);
+}
+
+// Disk full: the oldest undelivered records are given up, a whole segment at a time. While the read segment
+// is being drained (partly delivered or in flight), the segment after it is dropped instead, so the records
+// already delivered are not followed by a hole in the middle of a segment and the batches in flight stay valid.
+void TelemetryQueue::dropOldestSegment() {
+  char path[PATH_LENGTH];
+  bool draining = _readOffset > 0 || _sendSegment != _readSegment || _sendOffset > _readOffset;
+  if (draining && _nextSegment < _writeSegment) {
+    segmentPath(_nextSegment, path);
+    uint32_t dropped = _storage.size(path);
+    _droppedBytes += dropped;
+    _pendingBytes = _pendingBytes > dropped ? _pendingBytes - dropped : 0;
+    _storage.remove(path);
+    if (_sendSegment == _nextSegment) {
+      _sendSegment = _nextSegment + 1;
+      _sendOffset = 0;
+    }
+    _nextSegment++;
+    saveHead();
+    return;
+  }
+
+  segmentPath(_readSegment, path);
+  uint32_t size = _storage.size(path);
+  uint32_t dropped = size > _readOffset ? size - _readOffset : 0;
+  _droppedBytes += dropped;
+  _pendingBytes = _pendingBytes > dropped ? _pendingBytes - dropped : 0;
+  removeReadSegment();
+  if (_sendSegment < _readSegment) {
+    _sendSegment = _readSegment;
+    _sendOffset = 0;
+  }
+  saveHead();
+}
+
+void TelemetryQueue::saveHead() {
+  Head head = {HEAD_MAGIC, _readSegment, _readOffset, _nextSegment};
+  _storage.write(HEAD_PATH, reinterpret_cast<const uint8_t*>(&head), sizeof(head));
+}
+
+// The read position moves to the start of the following segment
+void TelemetryQueue::removeReadSegment() {
+  char path[PATH_LENGTH];
+  segmentPath(_readSegment, path);
+  _storage.remove(path);
+  _readSegment = _nextSegment;
+  _nextSegment = _readSegment + 1;
+  _readOffset = 0;
+}
+
+void TelemetryQueue::segmentPath(uint32_t segment, char* path) {
+  snprintf(path, PATH_LENGTH, "/q%08lu.txt", (unsigned long)segment);
+}
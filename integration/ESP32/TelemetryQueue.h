@@ -0,0 +1,95 @@
+// TelemetryQueue.h
+#ifndef TELEMETRY_QUEUE_H
+#define TELEMETRY_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "QueueStorage.h"
+
+// One record of the queue, pointing into the read buffer of the queue until the next read()
+struct QueuedRecord {
+  uint32_t time;      // Unix time at which the record was received (0 if the clock was not set)
+  const char* line;   // JSON record for the web server (a line of the Mega for older queues)
+};
+
+// Position in the queue, just after the records of a read()
+struct QueuePosition {
+  uint32_t segment;
+  uint32_t offset;
+};
+
+// Persistent FIFO of the telemetry received from the Mega, so no record is lost while the WiFi or
+// the server is down. Records are appended as "<time> <line>\n" to numbered segment files
+// (/q00000001.txt, ...); a segment is closed when it reaches SEGMENT_SIZE. The read position
+// (segment and offset) is kept in /qhead.bin and only moves when a batch was delivered (commit).
+// Disk usage is bounded: beyond MAX_SEGMENTS the oldest segment is dropped, or the one after it while the
+// oldest is being drained (the numbering then has a gap after the read segment, also kept in /qhead.bin).
+//
+// Sending is separate from delivering: read() moves a send position, so several batches can be in
+// flight (pipelined) before the first one is acknowledged. commit() then moves the read position to
+// the end of the acknowledged batch, and rewind() sends the unacknowledged records again.
+class TelemetryQueue {
+public:
+  static const uint32_t SEGMENT_SIZE = 16384;
+  static const uint16_t MAX_SEGMENTS = 10;        // 160 KB of the flash partition
+  static const size_t MAX_LINE_LENGTH = 1536;     // A record of the web server
+  static const uint8_t MAX_BATCH = 16;
+  static const size_t READ_BUFFER_SIZE = 4096;    // Bound of the bytes of the records returned by one read()
+
+  explicit TelemetryQueue(QueueStorage& storage);
+
+  // Mounts the storage and restores the read position; false if the storage is unavailable
+  bool begin();
+
+  // Appends a record (line without the trailing newline)
+  bool push(uint32_t time, const char* line, size_t length);
+
+  // Returns up to maxRecords of the records not sent yet, and the position after them
+  uint8_t read(QueuedRecord* records, uint8_t maxRecords, QueuePosition& end);
+
+  // Removes the records up to a position returned by read() (once they were delivered)
+  void commit(const QueuePosition& position);
+
+  // Sends again from the oldest record not delivered
+  void rewind();
+
+  bool isEmpty() const { return _pendingBytes == 0; }
+  bool hasUnsent() const;
+  uint32_t getPendingBytes() const { return _pendingBytes; }
+  uint32_t getDroppedBytes() const { return _droppedBytes; }
+  uint16_t getSegmentCount() const { return _writeSegment > _readSegment ? _writeSegment - _nextSegment + 2 : 1; }
+
+private:
+  static const uint32_t HEAD_MAGIC = 0x51484431;   // "QHD1"
+  static const size_t PATH_LENGTH = 20;
+
+  struct Head {
+    uint32_t magic;
+    uint32_t segment;
+    uint32_t offset;
+    uint32_t next;      // Segment after the read segment (absent from the heads of older versions)
+  };
+  static const size_t OLD_HEAD_SIZE = 12;
+
+  QueueStorage& _storage;
+  uint32_t _readSegment;
+  uint32_t _readOffset;
+  uint32_t _nextSegment;   // Segment after the read segment, _readSegment + 1 unless segments were dropped behind it
+  uint32_t _sendSegment;
+  uint32_t _sendOffset;
+  uint32_t _writeSegment;
+  uint32_t _writeSize;
+  uint32_t _pendingBytes;
+  uint32_t _droppedBytes;
+
+  char _readBuffer[READ_BUFFER_SIZE];
+  char _writeBuffer[MAX_LINE_LENGTH + 16];
+
+  uint32_t segmentSize(uint32_t segment);
+  void dropOldestSegment();
+  void removeReadSegment();
+  void saveHead();
+  static void segmentPath(uint32_t segment, char* path);
+};
+
+#endif // TELEMETRY_QUEUE_H
@@ -0,0 +1,195 @@
+/*
+ * Host benchmark of the compressed telemetry blocks (TelemetryBlock.h) on the data recorded by the servers.
+ *
+ * Every row of a data.csv becomes a server record, as RecordTranscoder writes them; the records are
+ * encoded in blocks of --block records. Reports the size of the JSON records, of the blocks (and of
+ * their base64 text in the WebSocket messages), the compression ratio and the encoding time:
+ *
+ *   g++ -O2 -std=gnu++17 -I.. block_bench.cpp ../TelemetryBlock.cpp -o block_bench
+ *   ./block_bench [--block 64] [--dump blocks.bin] data.csv...
+ *
+ * The columns of the older servers (Temperature, pH, Turbidity_Voltage, O2) are mapped to their
+ * current names. --dump writes the blocks (each after its 16-bit big-endian length), to be checked
+ * with the reference decoder: python telemetry_block.py blocks.bin
+ */
+
+#include "TelemetryBlock.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Server fields in the order of RecordTranscoder, with their kind
+static const char* const TEXT_FIELDS[] = {"event", "programType", "experimentName", "comment", "currentProgram",
+                                          "programStatus"};
+static const char* const FIELD_ORDER[] = {
+  "event", "programType", "rateOrSpeed", "duration", "tempSetpoint", "phSetpoint", "doSetpoint", "nutrientConc",
+  "baseConc", "experimentName", "comment", "currentProgram", "programStatus", "airPumpStatus", "drainPumpStatus",
+  "nutrientPumpStatus", "basePumpStatus", "stirringMotorStatus", "heatingPlateStatus", "ledGrowLightStatus",
+  "waterTemp", "airTemp", "ph", "turbidity", "oxygen", "airFlow",
+};
+static const char* const ALIASES[][2] = {
+  {"Temperature", "waterTemp"}, {"pH", "ph"}, {"Turbidity_Voltage", "turbidity"}, {"O2", "oxygen"},
+};
+
+static std::vector<std::string> splitCsv(const std::string& line) {
+  std::vector<std::string> cells(1);
+  bool quoted = false;
+  for (size_t i = 0; i < line.size(); i++) {
+    char c = line[i];
+    if (c == '"') {
+      if (quoted && i + 1 < line.size() && line[i + 1] == '"') {
+        cells.back() += '"';
+        i++;
+      } else {
+        quoted = !quoted;
+      }
+    } else if (c == ',' && !quoted) {
+      cells.emplace_back();
+    } else if (c != '\r') {
+      cells.back() += c;
+    }
+  }
+  return cells;
+}
+
+static bool isTextField(const std::string& name) {
+  for (const char* field : TEXT_FIELDS) {
+    if (name == field) return true;
+  }
+  return false;
+}
+
+static std::string jsonString(const std::string& text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+// "YYYY-MM-DD HH:MM:SS" to "YYYY-MM-DDTHH:MM:SSZ", empty if it is not a date
+static std::string isoTimestamp(const std::string& time) {
+  if (time.size() != 19 || time[10] != ' ') return "";
+  return time.substr(0, 10) + "T" + time.substr(11) + "Z";
+}
+
+static std::vector<std::string> readRecords(const char* path) {
+  std::vector<std::string> records;
+  std::ifstream file(path);
+  std::string line;
+  if (!std::getline(file, line)) return records;
+  std::vector<std::string> header = splitCsv(line);
+  for (std::string& name : header) {
+    for (const auto& alias : ALIASES) {
+      if (name == alias[0]) name = alias[1];
+    }
+  }
+
+  while (std::getline(file, line)) {
+    if (line.empty()) continue;
+    std::vector<std::string> cells = splitCsv(line);
+    std::string timestamp;
+    std::string values;
+    for (const char* field : FIELD_ORDER) {
+      std::string value = isTextField(field) ? (std::string(field) == "event" ? "\"data\"" : "\"\"") : "0";
+      for (size_t i = 0; i < header.size() && i < cells.size(); i++) {
+        if (header[i] == "Backend_Time" || header[i] == "Time") timestamp = isoTimestamp(cells[i]);
+        if (header[i] != field) continue;
+        if (isTextField(field)) {
+          value = jsonString(cells[i]);
+        } else {
+          char* end;
+          strtod(cells[i].c_str(), &end);
+          value = (!cells[i].empty() && *end == '\0') ? cells[i] : "null";
+        }
+      }
+      values += (values.empty() ? "\"" : ",\"") + std::string(field) + "\":" + value;
+    }
+    records.push_back("{\"sensor_value\":{" + values + "},\"timestamp\":\"" + timestamp + "\"}");
+  }
+  return records;
+}
+
+int main(int argc, char** argv) {
+  size_t blockRecords = 64;
+  const char* dumpPath = nullptr;
+  std::vector<const char*> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--block") == 0 && i + 1 < argc) {
+      blockRecords = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+      dumpPath = argv[++i];
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty() || blockRecords == 0 || blockRecords > TelemetryBlockEncoder::MAX_RECORDS) {
+    printf("Usage: block_bench [--block 1-%u] [--dump blocks.bin] data.csv...\n", TelemetryBlockEncoder::MAX_RECORDS);
+    return 1;
+  }
+  if (!TelemetryBlockEncoder::checkTable()) {
+    printf("The field table of TelemetryBlockEncoder is not sorted\n");
+    return 1;
+  }
+  FILE* dump = dumpPath ? fopen(dumpPath, "wb") : nullptr;
+
+  static uint8_t buffer[8192];
+  TelemetryBlockEncoder encoder(buffer, sizeof(buffer));
+  for (const char* path : paths) {
+    std::vector<std::string> records = readRecords(path);
+    if (records.empty()) {
+      printf("%s: no records\n", path);
+      continue;
+    }
+
+    // Sizes, and the blocks for the reference decoder
+    size_t jsonBytes = 0;
+    size_t blockBytes = 0;
+    size_t base64Bytes = 0;
+    encoder.reset();
+    for (size_t i = 0; i < records.size(); i++) {
+      jsonBytes += records[i].size() + 1;   // Comma of the JSON array
+      if (!encoder.add(records[i].c_str(), records[i].size())) {
+        printf("%s: record %zu not encoded\n", path, i);
+        return 1;
+      }
+      if (encoder.count() == blockRecords || i + 1 == records.size()) {
+        blockBytes += encoder.size();
+        base64Bytes += (encoder.size() + 2) / 3 * 4;
+        if (dump) {
+          uint8_t length[2] = {(uint8_t)(encoder.size() >> 8), (uint8_t)encoder.size()};
+          fwrite(length, 1, 2, dump);
+          fwrite(encoder.data(), 1, encoder.size(), dump);
+        }
+        encoder.reset();
+      }
+    }
+
+    // Encoding time over at least 200000 records
+    size_t passes = (200000 + records.size() - 1) / records.size();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < passes; pass++) {
+      encoder.reset();
+      for (const std::string& record : records) {
+        if (encoder.count() == blockRecords) encoder.reset();
+        encoder.add(record.c_str(), record.size());
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double count = records.size();
+    printf("%s: %zu records, blocks of %zu\n", path, records.size(), blockRecords);
+    printf("  JSON %.1f bytes/record, block %.1f bytes/record (%.1f in base64), ratio %.1fx (%.1fx in base64)\n",
+           jsonBytes / count, blockBytes / count, base64Bytes / count, (double)jsonBytes / blockBytes,
+           (double)jsonBytes / base64Bytes);
+    printf("  encoding %.0f ns/record on this computer\n", seconds * 1e9 / (passes * count));
+  }
+  if (dump) fclose(dump);
+  return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * Host run of the telemetry queue of the bridge (TelemetryQueue on HostQueueStorage) through an outage.
+ *
+ * Queues --records Mega lines (converted by RecordTranscoder, as the bridge does) and sends them in
+ * batches of up to MAX_BATCH records after each one. While the link is down nothing is committed and the
+ * queue grows; once it is back the backlog drains, and then the delivered records are checked: every
+ * record exactly once and in order, except those dropped by the bound of the queue (MAX_SEGMENTS).
+ *
+ *   g++ -O2 -std=gnu++17 -I.. queue_outage.cpp ../TelemetryQueue.cpp ../HostQueueStorage.cpp ../RecordTranscoder.cpp -o queue_outage
+ *   mkdir -p /tmp/queue && ./queue_outage --dir /tmp/queue --records 600 --outage 100:200 --restart
+ *
+ * --outage start:length takes the link down for length records from record start; --restart rebuilds the
+ * queue from its files in the middle of the outage, as after a reset of the ESP32. With --server host:port
+ * the batches are posted to /sensor_data/batch of standin_server.py instead, and its --down/--up or
+ * --fail-rate make the outage (pace the records with --interval so the outage spans some of them):
+ *
+ *   python standin_server.py --port 8000 --quiet --down 10 --up 10
+ *   ./queue_outage --dir /tmp/queue --records 600 --interval 50 --server 127.0.0.1:8000
+ *
+ * The directory must not hold a queue already (delete its /q*.txt and /qhead.bin between runs).
+ */
+
+#include "HostQueueStorage.h"
+#include "RecordTranscoder.h"
+#include "TelemetryQueue.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <netdb.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const uint32_t START_TIME = 1760000000;
+static const uint32_t RECORD_PERIOD = 30;   // Seconds between the lines of the Mega
+static const int DRAIN_ATTEMPTS = 1000;
+
+// Line of Logger::logData with its sequence number
+static std::string megaLine(uint32_t seq) {
+  char line[512];
+  snprintf(line, sizeof(line),
+           "{\"program\":\"Fermentation\",\"status\":\"1\",\"airP\":1,\"drainP\":0,\"sampleP\":0,\"nutrientP\":0,"
+           "\"baseP\":0,\"stirringM\":1,\"heatingP\":%u,\"led\":0,\"waterTemp\":%.2f,\"airTemp\":24.5,"
+           "\"elecTemp\":38.25,\"pH\":%.2f,\"turbidity\":512,\"oxygen\":87.5,\"airFlow\":1.25,\"sensorFaults\":0,"
+           "\"seq\":%u,\"t\":%u,\"ms\":0}",
+           seq % 2, 30.0 + (seq % 50) * 0.01, 7.0 - (seq % 20) * 0.01, seq, START_TIME + seq * RECORD_PERIOD);
+  return line;
+}
+
+// Sequence number of a server record, 0 if it has none
+static uint32_t recordSeq(const char* record) {
+  const char* seq = strstr(record, "\"seq\":");
+  return seq ? strtoul(seq + 6, nullptr, 10) : 0;
+}
+
+// Posts a JSON array of records to the stand-in server; true if it answered 200
+static bool postBatch(const std::string& host, const std::string& port, const std::string& payload) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* address = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0) return false;
+  int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+  bool connected = fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+  freeaddrinfo(address);
+  if (!connected) {
+    if (fd >= 0) close(fd);
+    return false;
+  }
+
+  std::string request = "POST /sensor_data/batch HTTP/1.1\r\nHost: " + host + "\r\nContent-Type: application/json\r\n"
+                        "Content-Length: " + std::to_string(payload.size()) + "\r\nConnection: close\r\n\r\n" + payload;
+  bool sent = true;
+  for (size_t done = 0; sent && done < request.size();) {
+    ssize_t count = send(fd, request.data() + done, request.size() - done, 0);
+    sent = count > 0;
+    done += sent ? count : 0;
+  }
+  // Whole response, read until the server closes the connection
+  std::string response;
+  char buffer[512];
+  for (ssize_t count; sent && (count = recv(fd, buffer, sizeof(buffer), 0)) > 0;) response.append(buffer, count);
+  close(fd);
+  return response.compare(0, 12, "HTTP/1.1 200") == 0 || response.compare(0, 12, "HTTP/1.0 200") == 0;
+}
+
+int main(int argc, char** argv) {
+  const char* directory = nullptr;
+  uint32_t recordCount = 600;
+  uint32_t outageStart = 100;
+  uint32_t outageLength = 200;
+  bool restart = false;
+  unsigned interval = 0;
+  std::string host;
+  std::string port;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+      directory = argv[++i];
+    } else if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+      recordCount = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--outage") == 0 && i + 1 < argc && strchr(argv[i + 1], ':')) {
+      outageStart = strtoul(argv[++i], nullptr, 10);
+      outageLength = strtoul(strchr(argv[i], ':') + 1, nullptr, 10);
+    } else if (strcmp(argv[i], "--restart") == 0) {
+      restart = true;
+    } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+      interval = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc && strchr(argv[i + 1], ':')) {
+      std::string server = argv[++i];
+      host = server.substr(0, server.find(':'));
+      port = server.substr(server.find(':') + 1);
+    } else {
+      directory = nullptr;
+      break;
+    }
+  }
+  if (directory == nullptr || recordCount == 0) {
+    printf("Usage: queue_outage --dir <directory> [--records 600] [--outage start:length] [--restart]\n"
+           "                    [--interval ms] [--server host:port]\n");
+    return 1;
+  }
+  if (!host.empty()) outageLength = 0;   // The server makes the outage
+
+  HostQueueStorage storage(directory);
+  std::unique_ptr<TelemetryQueue> queue(new TelemetryQueue(storage));
+  if (!queue->begin()) {
+    printf("%s: not a directory\n", directory);
+    return 1;
+  }
+  if (!queue->isEmpty()) {
+    printf("%s already holds %u queued bytes, start from an empty directory\n", directory, queue->getPendingBytes());
+    return 1;
+  }
+
+  std::vector<uint32_t> delivered;
+  uint32_t batches = 0;
+  uint32_t failedSends = 0;
+  uint32_t maxPendingBytes = 0;
+  uint16_t maxSegments = 0;
+  uint32_t restartedAt = 0;
+  uint32_t droppedBytes = 0;              // Of the queues before a restart (the counter is not persisted)
+  std::vector<uint32_t> queuedBytes(1);   // Size of each record in the segment files, by sequence number
+
+  // Sends one batch of the oldest records, committed only if delivered
+  auto sendBatch = [&](bool linkUp) {
+    QueuedRecord records[TelemetryQueue::MAX_BATCH];
+    QueuePosition end;
+    uint8_t count = queue->read(records, TelemetryQueue::MAX_BATCH, end);
+    if (count == 0) return true;
+    std::string payload = "[";
+    for (uint8_t i = 0; i < count; i++) {
+      if (i > 0) payload += ",";
+      payload += records[i].line;
+    }
+    payload += "]";
+    std::vector<uint32_t> sequences;
+    for (uint8_t i = 0; i < count; i++) sequences.push_back(recordSeq(records[i].line));
+
+    if (!host.empty()) linkUp = postBatch(host, port, payload);
+    if (!linkUp) {
+      queue->rewind();
+      failedSends++;
+      return false;
+    }
+    queue->commit(end);
+    delivered.insert(delivered.end(), sequences.begin(), sequences.end());
+    batches++;
+    return true;
+  };
+
+  auto started = std::chrono::steady_clock::now();
+  static char record[TelemetryQueue::MAX_LINE_LENGTH + 1];
+  for (uint32_t seq = 1; seq <= recordCount; seq++) {
+    std::string line = megaLine(seq);
+    size_t length = RecordTranscoder::transcode(line.c_str(), line.size(), 0, record, sizeof(record));
+    uint32_t time = START_TIME + seq * RECORD_PERIOD;
+    if (length == 0 || !queue->push(time, record, length)) {
+      printf("Record %u not queued\n", seq);
+      return 1;
+    }
+    queuedBytes.push_back(std::to_string(time).size() + 1 + length + 1);
+    if (queue->getPendingBytes() > maxPendingBytes) maxPendingBytes = queue->getPendingBytes();
+    if (queue->getSegmentCount() > maxSegments) maxSegments = queue->getSegmentCount();
+
+    bool linkUp = seq < outageStart || seq >= outageStart + outageLength;
+    if (restart && restartedAt == 0 && outageLength > 0 && seq == outageStart + outageLength / 2) {
+      // Reset of the bridge: the queue is rebuilt from its files
+      uint32_t pending = queue->getPendingBytes();
+      droppedBytes += queue->getDroppedBytes();
+      queue.reset(new TelemetryQueue(storage));
+      if (!queue->begin() || queue->getPendingBytes() != pending) {
+        printf("Restart at record %u: %u bytes pending instead of %u\n", seq, queue->getPendingBytes(), pending);
+        return 1;
+      }
+      restartedAt = seq;
+    }
+    sendBatch(linkUp);
+    if (interval > 0) std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+  }
+
+  // Drain the backlog, retrying (after a pause with a server) while the link is down
+  for (int attempt = 0; !queue->isEmpty() && attempt < DRAIN_ATTEMPTS;) {
+    if (!sendBatch(true)) {
+      attempt++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(host.empty() ? 0 : 100));
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  // Delivered once and in order; the records missing are exactly those of the segments dropped by the bound
+  droppedBytes += queue->getDroppedBytes();
+  uint32_t duplicates = 0;
+  uint32_t gaps = 0;
+  uint32_t missing = 0;
+  uint32_t missingBytes = 0;
+  uint32_t expected = 1;
+  delivered.push_back(recordCount + 1);
+  for (uint32_t seq : delivered) {
+    if (seq < expected) {
+      duplicates++;
+      continue;
+    }
+    if (seq > expected) {
+      if (seq <= recordCount) gaps++;
+      missing += seq - expected;
+      for (uint32_t lost = expected; lost < seq; lost++) missingBytes += queuedBytes[lost];
+    }
+    expected = seq + 1;
+  }
+  delivered.pop_back();
+
+  if (host.empty()) {
+    printf("%u records, link down for %u from record %u%s\n", recordCount, outageLength, outageStart,
+           restartedAt ? (", restarted at record " + std::to_string(restartedAt)).c_str() : "");
+  } else {
+    printf("%u records posted to %s:%s\n", recordCount, host.c_str(), port.c_str());
+  }
+  printf("Queue: up to %u bytes in %u segments, %u bytes dropped, %u bytes left\n", maxPendingBytes, maxSegments,
+         droppedBytes, queue->getPendingBytes());
+  printf("Sent %u batches (%u failed), %zu records delivered in %.2f s\n", batches, failedSends, delivered.size(),
+         seconds);
+  printf("Missing %u records (%u bytes) in %u gaps, %u duplicates\n", missing, missingBytes, gaps, duplicates);
+
+  bool passed = duplicates == 0 && queue->isEmpty() && missingBytes == droppedBytes;
+  printf("%s\n", passed ? "OK" : "FAILED");
+  return passed ? 0 : 1;
+}
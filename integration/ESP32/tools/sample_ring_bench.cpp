@@ -0,0 +1,120 @@
+/*
+ * Host check and benchmark of the ring of recent samples (SampleRing.h) served by the local HTTP server.
+ *
+ * A writer thread pushes samples (every value derived from the sequence number) while a reader thread
+ * copies recent ones, as the async TCP task does: every copy it keeps must be whole. Then measures the
+ * parsing of the lines of the Mega, the formatting of the samples and the time lookups:
+ *
+ *   g++ -O2 -std=gnu++17 -pthread -I.. sample_ring_bench.cpp ../SampleRing.cpp -o sample_ring_bench
+ *   ./sample_ring_bench [samples]
+ */
+
+#include "SampleRing.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static const char LINE[] =
+  "{\"program\":\"Fermentation\",\"status\":\"running\",\"airP\":1,\"drainP\":0,\"sampleP\":0,\"nutrientP\":0,"
+  "\"baseP\":0,\"stirringM\":1,\"heatingP\":1,\"led\":0,\"waterTemp\":30.12,\"airTemp\":24.5,\"elecTemp\":38.25,"
+  "\"pH\":6.98,\"turbidity\":512,\"oxygen\":87.5,\"airFlow\":1.25,\"sensorFaults\":0,\"seq\":10452}";
+static const char EVENT_LINE[] = "{\"ev\":\"startup\",\"pt\":\"fermentation\",\"tSet\":30,\"phSet\":7}";
+
+static SampleRing ring;
+static volatile uint32_t sink;   // Keeps the timed lookups
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static TelemetrySample sampleOf(uint32_t sequence) {
+  TelemetrySample sample;
+  sample.time = 1760000000 + sequence * 30;
+  for (uint8_t i = 0; i < TelemetrySample::CHANNEL_COUNT; i++) sample.values[i] = (float)(sequence % 100000 + i);
+  sample.actuators = sequence & 0x7F;
+  return sample;
+}
+
+static bool sameSample(const TelemetrySample& a, const TelemetrySample& b) {
+  return a.time == b.time && a.actuators == b.actuators && memcmp(a.values, b.values, sizeof(a.values)) == 0;
+}
+
+int main(int argc, char** argv) {
+  uint32_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000000;
+
+  // Lines of the Mega
+  TelemetrySample sample;
+  if (!SampleRing::parseLine(LINE, strlen(LINE), 1760000000, sample) || sample.values[3] != 6.98f ||
+      sample.actuators != 0x31 || sample.values[6] != 1.25f) {
+    printf("Data line not parsed as expected\n");
+    return 1;
+  }
+  if (SampleRing::parseLine(EVENT_LINE, strlen(EVENT_LINE), 1760000000, sample)) {
+    printf("Event line taken as a sample\n");
+    return 1;
+  }
+
+  // Concurrent writer and reader
+  uint64_t kept = 0;
+  uint64_t dropped = 0;
+  uint64_t torn = 0;
+  std::thread writer([count]() {
+    for (uint32_t i = 0; i < count; i++) {
+      ring.push(sampleOf(i));
+      if (i % 64 == 0) std::this_thread::yield();
+    }
+  });
+  std::thread reader([&]() {
+    while (ring.end() < count) {
+      uint32_t begin = ring.begin();
+      for (uint32_t sequence = begin; sequence < ring.end(); sequence += 7) {
+        TelemetrySample copy;
+        if (!ring.read(sequence, copy)) {
+          dropped++;
+        } else if (!sameSample(copy, sampleOf(sequence))) {
+          torn++;
+        } else {
+          kept++;
+        }
+      }
+    }
+  });
+  writer.join();
+  reader.join();
+  printf("Concurrent reads: %llu kept, %llu dropped (overwritten), %llu torn\n", (unsigned long long)kept,
+         (unsigned long long)dropped, (unsigned long long)torn);
+  if (torn > 0) return 1;
+
+  // Range of the last samples
+  uint32_t from = ring.find(sampleOf(count - 100).time);
+  if (from != count - 100 || ring.find(0) != ring.begin() || ring.find(0xFFFFFFFF) != ring.end()) {
+    printf("find() returned %u instead of %u\n", from, count - 100);
+    return 1;
+  }
+
+  const uint32_t passes = 200000;
+  char text[SampleRing::MAX_JSON_LENGTH + 1];
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < passes; i++) SampleRing::parseLine(LINE, strlen(LINE), 1760000000, sample);
+  double parseTime = secondsSince(start);
+
+  size_t jsonBytes = 0;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < passes; i++) {
+    uint32_t sequence = ring.begin() + i % SampleRing::CAPACITY;
+    ring.read(sequence, sample);
+    jsonBytes += SampleRing::formatSample(sequence, sample, text, sizeof(text));
+  }
+  double formatTime = secondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < passes; i++) sink = ring.find(sampleOf(count - 1 - i % SampleRing::CAPACITY).time);
+  double findTime = secondsSince(start);
+
+  printf("%s\n", text);
+  printf("parseLine %.0f ns, formatSample %.0f ns (%.0f bytes), find %.0f ns, on this computer\n",
+         parseTime * 1e9 / passes, formatTime * 1e9 / passes, (double)jsonBytes / passes, findTime * 1e9 / passes);
+  return 0;
+}
@@ -0,0 +1,250 @@
+"""
+Local stand-in for the bioreactor web server, to exercise the telemetry queue of the ESP32 bridge.
+
+Accepts the telemetry the way the FastAPI backend does (POST /sensor_data with one record,
+POST /sensor_data/batch with a JSON array of records, {"type":"telemetry",...} batches over the
+WebSocket /ws, as records or compressed blocks, acknowledged with {"type":"ack","id":n}) and prints
+what it receives. Outages can be simulated, so the queue can be seen filling up and draining again:
+
+    python standin_server.py --port 8000
+    python standin_server.py --port 8000 --down 120 --up 60     # 2 minutes down, 1 minute up, repeated
+    python standin_server.py --port 8000 --fail-rate 0.3        # 30% of the requests fail (HTTP 503 / nack)
+    python standin_server.py --port 8000 --delay 0.05           # 50 ms of processing per request or batch
+
+Point sensorDataBatchUrl and the WebSocket address in ESP32.ino at the computer running this script,
+or run telemetry_bench.py or queue_outage.cpp against it. Standard library only.
+"""
+
+import argparse
+import base64
+import hashlib
+import json
+import os
+import random
+import struct
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+# Reference decoder of the compressed blocks, from the web server
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "../../raspberry_pi/ServerFastAPI/ServerFastAPI"))
+from telemetry_block import decode_block  # noqa: E402
+
+WEBSOCKET_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+OPCODE_CONTINUATION = 0x0
+OPCODE_TEXT = 0x1
+OPCODE_CLOSE = 0x8
+OPCODE_PING = 0x9
+OPCODE_PONG = 0xA
+
+
+def websocket_accept_key(key):
+    return base64.b64encode(hashlib.sha1((key + WEBSOCKET_GUID).encode()).digest()).decode()
+
+
+def read_exact(stream, length):
+    data = b""
+    while len(data) < length:
+        chunk = stream.read(length - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        data += chunk
+    return data
+
+
+def read_frame(stream):
+    """Read one WebSocket frame, return (fin, opcode, payload)"""
+    first, second = read_exact(stream, 2)
+    length = second & 0x7F
+    if length == 126:
+        length = struct.unpack(">H", read_exact(stream, 2))[0]
+    elif length == 127:
+        length = struct.unpack(">Q", read_exact(stream, 8))[0]
+    mask = read_exact(stream, 4) if second & 0x80 else None
+    payload = read_exact(stream, length)
+    if mask:
+        payload = bytes(byte ^ mask[i % 4] for i, byte in enumerate(payload))
+    return bool(first & 0x80), first & 0x0F, payload
+
+
+def read_message(stream):
+    """Read a complete WebSocket message (reassembling fragments), return (opcode, payload)"""
+    fin, opcode, payload = read_frame(stream)
+    while not fin:
+        fin, _, more = read_frame(stream)
+        payload += more
+    return opcode, payload
+
+
+def write_frame(stream, opcode, payload, masked=False):
+    """Write one WebSocket frame (clients must mask their frames)"""
+    header = bytes([0x80 | opcode])
+    mask_bit = 0x80 if masked else 0
+    if len(payload) < 126:
+        header += bytes([mask_bit | len(payload)])
+    elif len(payload) < 65536:
+        header += bytes([mask_bit | 126]) + struct.pack(">H", len(payload))
+    else:
+        header += bytes([mask_bit | 127]) + struct.pack(">Q", len(payload))
+    if masked:
+        mask = random.getrandbits(32).to_bytes(4, "big")
+        header += mask
+        payload = bytes(byte ^ mask[i % 4] for i, byte in enumerate(payload))
+    stream.write(header + payload)
+    stream.flush()
+
+
+class StandInState:
+    def __init__(self, args):
+        self.args = args
+        self.started = time.monotonic()
+        self.records = 0
+        self.requests = 0
+        self.rejected = 0
+        self.last_timestamp = None
+
+    def accept(self, path, records):
+        """Count the records of a request or batch, None if accepted, or the reason of the refusal"""
+        self.requests += 1
+        if self.args.delay > 0:
+            time.sleep(self.args.delay)
+        if self.is_down() or random.random() < self.args.fail_rate:
+            self.rejected += 1
+            return "simulated outage"
+        for record in records:
+            if "sensor_value" not in record or "timestamp" not in record:
+                return "missing sensor_value or timestamp"
+        self.records += len(records)
+        self.last_timestamp = records[-1]["timestamp"] if records else self.last_timestamp
+        if not self.args.quiet:
+            print(f"{path}: {len(records)} records (total {self.records}, "
+                  f"{self.rejected}/{self.requests} requests rejected), last timestamp {self.last_timestamp}")
+        if self.args.verbose:
+            for record in records:
+                print("  " + json.dumps(record))
+        return None
+
+    def is_down(self):
+        """True during the simulated outage windows"""
+        if self.args.down <= 0:
+            return False
+        period = self.args.down + self.args.up
+        return (time.monotonic() - self.started) % period < self.args.down
+
+
+class StandInHandler(BaseHTTPRequestHandler):
+    state = None
+
+    protocol_version = "HTTP/1.1"   # Keep-alive, so clients can reuse their connection
+    disable_nagle_algorithm = True  # Headers and body are written separately
+
+    def do_POST(self):
+        state = self.state
+        length = int(self.headers.get("Content-Length", 0))
+        body = self.rfile.read(length)
+
+        try:
+            payload = json.loads(body)
+        except ValueError as error:
+            self.reply(400, {"status": "error", "message": str(error)})
+            return
+
+        if self.path == "/sensor_data":
+            records = [payload]
+        elif self.path == "/sensor_data/batch" and isinstance(payload, list):
+            records = payload
+        else:
+            self.reply(404, {"status": "error", "message": "unknown endpoint"})
+            return
+
+        error = state.accept(self.path, records)
+        if error == "simulated outage":
+            self.reply(503, {"status": "error", "message": error})
+        elif error:
+            self.reply(422, {"status": "error", "message": error})
+        else:
+            self.reply(200, {"status": "success", "message": "Data received", "count": len(records)})
+
+    def do_GET(self):
+        if self.path != "/ws" or self.headers.get("Upgrade", "").lower() != "websocket":
+            self.reply(404, {"status": "error", "message": "unknown endpoint"})
+            return
+        self.send_response(101, "Switching Protocols")
+        self.send_header("Upgrade", "websocket")
+        self.send_header("Connection", "Upgrade")
+        self.send_header("Sec-WebSocket-Accept", websocket_accept_key(self.headers["Sec-WebSocket-Key"]))
+        self.end_headers()
+        self.wfile.flush()
+        self.close_connection = True
+        print(f"WebSocket connected ({self.headers.get('X-Client-Type', 'unknown client')})")
+
+        try:
+            while True:
+                opcode, payload = read_message(self.rfile)
+                if opcode == OPCODE_CLOSE:
+                    write_frame(self.wfile, OPCODE_CLOSE, b"")
+                    break
+                if opcode == OPCODE_PING:
+                    write_frame(self.wfile, OPCODE_PONG, payload)
+                    continue
+                if opcode == OPCODE_TEXT:
+                    write_frame(self.wfile, OPCODE_TEXT, self.handle_websocket_text(payload.decode()).encode())
+        except (ConnectionError, OSError):
+            pass
+        print("WebSocket disconnected")
+
+    def handle_websocket_text(self, text):
+        try:
+            message = json.loads(text)
+        except ValueError:
+            message = None
+        if not isinstance(message, dict) or message.get("type") != "telemetry":
+            return f"Message received: {text}"
+        try:
+            if "block" in message:
+                records = decode_block(base64.b64decode(message["block"]))
+            else:
+                records = message.get("records", [])
+        except ValueError as error:
+            return json.dumps({"type": "nack", "id": message.get("id"), "error": str(error)})
+        error = self.state.accept("/ws", records)
+        if error:
+            return json.dumps({"type": "nack", "id": message.get("id"), "error": error})
+        return json.dumps({"type": "ack", "id": message.get("id"), "count": len(records)})
+
+    def reply(self, code, body):
+        data = json.dumps(body).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Stand-in web server for the ESP32 telemetry")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--down", type=float, default=0, help="seconds of simulated outage per cycle")
+    parser.add_argument("--up", type=float, default=60, help="seconds of service per cycle")
+    parser.add_argument("--fail-rate", type=float, default=0, help="fraction of requests rejected at random")
+    parser.add_argument("--delay", type=float, default=0, help="seconds of processing per request or batch")
+    parser.add_argument("--verbose", action="store_true", help="print every record")
+    parser.add_argument("--quiet", action="store_true", help="do not print every request (benchmarks)")
+    args = parser.parse_args()
+
+    StandInHandler.state = StandInState(args)
+    server = ThreadingHTTPServer((args.host, args.port), StandInHandler)
+    print(f"Stand-in server listening on {args.host}:{args.port}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        return 0
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,138 @@
+"""
+Benchmark of the telemetry uplinks of the ESP32 bridge against standin_server.py (or the FastAPI backend).
+
+Sends the same synthetic records the way the bridge does, and reports the throughput and the
+round-trip time of each request (HTTP) or batch acknowledgement (WebSocket):
+
+    python standin_server.py --port 8000 --quiet --delay 0.02
+    python telemetry_bench.py --mode http-single --records 500     # one connection and POST per record
+    python telemetry_bench.py --mode http-batch --batch 12          # POST /sensor_data/batch, one at a time
+    python telemetry_bench.py --mode ws --batch 12 --window 4       # WebSocket, 4 batches in flight
+
+Standard library only.
+"""
+
+import argparse
+import base64
+import http.client
+import json
+import os
+import socket
+import statistics
+import sys
+import time
+from datetime import datetime, timezone
+
+from standin_server import OPCODE_CLOSE, OPCODE_TEXT, read_message, websocket_accept_key, write_frame
+
+
+def make_record(index):
+    return {
+        "timestamp": datetime.fromtimestamp(1760000000 + index, timezone.utc).strftime("%Y-%m-%dT%H:%M:%SZ"),
+        "sensor_value": {"waterTemp": 30.0 + (index % 10) / 10, "pH": 7.0, "oxygen": 85.0},
+        "actuator_status": {"airPump": 1, "heatingPlate": 0},
+        "program": "bench",
+        "status": "running",
+    }
+
+
+def bench_http_single(args, records):
+    rtts = []
+    for record in records:
+        body = json.dumps(record)
+        start = time.perf_counter()
+        connection = http.client.HTTPConnection(args.host, args.port, timeout=5)
+        connection.request("POST", "/sensor_data", body, {"Content-Type": "application/json"})
+        response = connection.getresponse()
+        response.read()
+        connection.close()
+        rtts.append(time.perf_counter() - start)
+        if response.status != 200:
+            raise RuntimeError(f"HTTP {response.status}")
+    return rtts
+
+
+def bench_http_batch(args, records):
+    rtts = []
+    connection = http.client.HTTPConnection(args.host, args.port, timeout=5)
+    for first in range(0, len(records), args.batch):
+        body = json.dumps(records[first:first + args.batch])
+        start = time.perf_counter()
+        connection.request("POST", "/sensor_data/batch", body, {"Content-Type": "application/json"})
+        response = connection.getresponse()
+        response.read()
+        rtts.append(time.perf_counter() - start)
+        if response.status != 200:
+            raise RuntimeError(f"HTTP {response.status}")
+    connection.close()
+    return rtts
+
+
+def open_websocket(args):
+    sock = socket.create_connection((args.host, args.port), timeout=5)
+    key = base64.b64encode(os.urandom(16)).decode()
+    sock.sendall((f"GET /ws HTTP/1.1\r\nHost: {args.host}:{args.port}\r\nUpgrade: websocket\r\n"
+                  f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n"
+                  f"X-Client-Type: ESP32\r\n\r\n").encode())
+    stream = sock.makefile("rwb")
+    status = stream.readline()
+    headers = {}
+    for line in iter(stream.readline, b"\r\n"):
+        name, _, value = line.decode().partition(":")
+        headers[name.strip().lower()] = value.strip()
+    if b" 101 " not in status or headers.get("sec-websocket-accept") != websocket_accept_key(key):
+        raise RuntimeError(f"WebSocket handshake failed: {status.decode().strip()}")
+    return sock, stream
+
+
+def bench_websocket(args, records):
+    """Keeps up to args.window batches in flight, like sendQueuedBatchesOverWebSocket() in ESP32.ino"""
+    sock, stream = open_websocket(args)
+    batches = [records[first:first + args.batch] for first in range(0, len(records), args.batch)]
+    sent_at = {}
+    rtts = []
+    next_batch = 0
+    while next_batch < len(batches) or sent_at:
+        while next_batch < len(batches) and len(sent_at) < args.window:
+            message = json.dumps({"type": "telemetry", "id": next_batch + 1, "records": batches[next_batch]})
+            sent_at[next_batch + 1] = time.perf_counter()
+            write_frame(stream, OPCODE_TEXT, message.encode(), masked=True)
+            next_batch += 1
+        opcode, payload = read_message(stream)
+        if opcode != OPCODE_TEXT:
+            continue
+        reply = json.loads(payload)
+        if reply.get("type") != "ack":
+            raise RuntimeError(f"batch {reply.get('id')} refused: {reply.get('error')}")
+        rtts.append(time.perf_counter() - sent_at.pop(reply["id"]))
+    write_frame(stream, OPCODE_CLOSE, b"", masked=True)
+    sock.close()
+    return rtts
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark of the ESP32 telemetry uplinks")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8000)
+    parser.add_argument("--mode", choices=["http-single", "http-batch", "ws"], default="ws")
+    parser.add_argument("--records", type=int, default=1200)
+    parser.add_argument("--batch", type=int, default=12, help="records per batch (http-batch, ws)")
+    parser.add_argument("--window", type=int, default=4, help="batches in flight (ws)")
+    args = parser.parse_args()
+
+    records = [make_record(i) for i in range(args.records)]
+    bench = {"http-single": bench_http_single, "http-batch": bench_http_batch, "ws": bench_websocket}[args.mode]
+    start = time.perf_counter()
+    rtts = bench(args, records)
+    elapsed = time.perf_counter() - start
+
+    rtts_ms = sorted(rtt * 1000 for rtt in rtts)
+    print(f"{args.mode}: {len(records)} records in {elapsed:.2f} s, {len(records) / elapsed:.0f} records/s")
+    print(f"round trip over {len(rtts_ms)} requests: mean {statistics.mean(rtts_ms):.1f} ms, "
+          f"p50 {rtts_ms[len(rtts_ms) // 2]:.1f} ms, p95 {rtts_ms[int(len(rtts_ms) * 0.95)]:.1f} ms, "
+          f"max {rtts_ms[-1]:.1f} ms")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,161 @@
+/*
+ * Host benchmark of the conversion of the Mega lines into web server records.
+ *
+ * Measures records/s and heap allocations per record of RecordTranscoder (streaming, into a
+ * reusable buffer) and, when ArduinoJson is available, of the former conversion (JsonDocument,
+ * copy of the keys under their server names, serialization and String concatenation; std::string
+ * stands in for the Arduino String):
+ *
+ *   g++ -O2 -std=gnu++17 -I.. transcoder_bench.cpp ../RecordTranscoder.cpp -o transcoder_bench
+ *   g++ -O2 -std=gnu++17 -I.. -I<ArduinoJson>/src -DWITH_ARDUINOJSON transcoder_bench.cpp ../RecordTranscoder.cpp -o transcoder_bench
+ *   ./transcoder_bench [records]
+ *
+ * Allocations are counted by wrapping malloc (glibc only).
+ */
+
+#include "RecordTranscoder.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef WITH_ARDUINOJSON
+#include <ArduinoJson.h>
+#endif
+
+static unsigned long allocations = 0;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+extern "C" void* malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+extern "C" void* calloc(size_t count, size_t size) {
+  allocations++;
+  return __libc_calloc(count, size);
+}
+extern "C" void* realloc(void* pointer, size_t size) {
+  allocations++;
+  return __libc_realloc(pointer, size);
+}
+
+// Lines as printed by Logger::logData, Logger::logStartup and DataRecorder::sendRecord
+static const char* const LINES[] = {
+  "{\"program\":\"Fermentation\",\"status\":\"running\",\"airP\":1,\"drainP\":0,\"sampleP\":0,\"nutrientP\":0,"
+  "\"baseP\":0,\"stirringM\":1,\"heatingP\":1,\"led\":0,\"waterTemp\":30.12,\"airTemp\":24.5,\"elecTemp\":38.25,"
+  "\"pH\":6.98,\"turbidity\":512,\"oxygen\":87.5,\"airFlow\":1.25,\"sensorFaults\":0,\"seq\":10452,\"t\":1760000000,"
+  "\"ms\":137}",
+  "{\"ev\":\"startup\",\"pt\":\"fermentation\",\"rate\":0,\"dur\":86400,\"tSet\":30,\"phSet\":7,\"doSet\":80,"
+  "\"nutC\":2.5,\"baseC\":1,\"expN\":\"Yeast batch 12\",\"comm\":\"Second run with the new sparger\"}",
+  "{\"ev\":\"backfill\",\"seq\":10001,\"t\":1760000000,\"up\":5400,\"program\":\"Fermentation\",\"status\":\"1\","
+  "\"airP\":1,\"drainP\":0,\"sampleP\":1,\"nutrientP\":0,\"baseP\":0,\"stirringM\":0,\"heatingP\":1,\"led\":0,"
+  "\"sensorFaults\":2,\"waterTemp\":30.1,\"airTemp\":null,\"elecTemp\":38.2,\"pH\":7.01,\"oxygen\":88,"
+  "\"airFlow\":1.2,\"turbidity\":505}",
+};
+static const size_t LINE_COUNT = sizeof(LINES) / sizeof(LINES[0]);
+static const uint32_t RECEIVED_TIME = 1760000000;
+
+#ifdef WITH_ARDUINOJSON
+// The conversion of ESP32.ino before RecordTranscoder
+static std::string buildServerRecord(JsonDocument& doc, const char* timestamp) {
+  if (doc.containsKey("ev") && doc["ev"] == "startup") {
+    doc["event"] = doc["ev"];
+    doc["programType"] = doc["pt"];
+    doc["rateOrSpeed"] = doc["rate"];
+    doc["duration"] = doc["dur"];
+    doc["tempSetpoint"] = doc["tSet"];
+    doc["phSetpoint"] = doc["phSet"];
+    doc["doSetpoint"] = doc["doSet"];
+    doc["nutrientConc"] = doc["nutC"];
+    doc["baseConc"] = doc["baseC"];
+    doc["experimentName"] = doc["expN"];
+    doc["comment"] = doc["comm"];
+  } else {
+    doc["event"] = "data";
+    doc["programType"] = doc["prog"];
+    doc["rateOrSpeed"] = 0;
+    doc["duration"] = 0;
+    doc["tempSetpoint"] = 0.0;
+    doc["phSetpoint"] = 0.0;
+    doc["doSetpoint"] = 0.0;
+    doc["nutrientConc"] = 0.0;
+    doc["baseConc"] = 0.0;
+    doc["experimentName"] = "";
+    doc["comment"] = "";
+  }
+  doc["currentProgram"] = doc["prog"];
+  doc["programStatus"] = doc["stat"];
+  doc["airPumpStatus"] = doc["ap"];
+  doc["drainPumpStatus"] = doc["dp"];
+  doc["nutrientPumpStatus"] = doc["np"];
+  doc["basePumpStatus"] = doc["bp"];
+  doc["stirringMotorStatus"] = doc["sm"];
+  doc["heatingPlateStatus"] = doc["hp"];
+  doc["ledGrowLightStatus"] = doc["lg"];
+  doc["waterTemp"] = doc["wT"];
+  doc["airTemp"] = doc["aT"];
+  doc["ph"] = doc["pH"];
+  doc["turbidity"] = doc["tb"];
+  doc["oxygen"] = doc["ox"];
+  doc["airFlow"] = doc["af"];
+
+  std::string jsonData;
+  serializeJson(doc, jsonData);
+  return "{\"sensor_value\": " + jsonData + ", \"timestamp\": \"" + std::string(timestamp) + "\"}";
+}
+
+static size_t convertWithDocument(const char* line) {
+  char timestamp[RecordTranscoder::TIMESTAMP_SIZE];
+  RecordTranscoder::formatTimestamp(RECEIVED_TIME, RecordTranscoder::NO_MILLISECONDS, timestamp);
+  JsonDocument doc;
+  if (deserializeJson(doc, line)) return 0;
+  return buildServerRecord(doc, timestamp).length();
+}
+#endif
+
+static size_t convertWithTranscoder(const char* line) {
+  static char output[1537];
+  return RecordTranscoder::transcode(line, strlen(line), RECEIVED_TIME, output, sizeof(output));
+}
+
+static void bench(const char* name, size_t (*convert)(const char*), unsigned long records) {
+  size_t bytes = 0;
+  unsigned long allocationsBefore = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < records; i++) {
+    bytes += convert(LINES[i % LINE_COUNT]);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  unsigned long allocationCount = allocations - allocationsBefore;
+  printf("%-12s %10.0f records/s  %6.2f allocations/record  %6.1f bytes/record\n", name, records / seconds,
+         (double)allocationCount / records, (double)bytes / records);
+}
+
+int main(int argc, char** argv) {
+  unsigned long records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 300000;
+  if (!RecordTranscoder::checkTable()) {
+    printf("The translation table of RecordTranscoder is not sorted\n");
+    return 1;
+  }
+
+  static char output[1537];
+  for (size_t i = 0; i < LINE_COUNT; i++) {
+    if (RecordTranscoder::transcode(LINES[i], strlen(LINES[i]), RECEIVED_TIME, output, sizeof(output)) == 0) {
+      printf("Line %zu could not be converted\n", i);
+      return 1;
+    }
+    printf("%s\n\n", output);
+  }
+
+#ifdef WITH_ARDUINOJSON
+  bench("JsonDocument", convertWithDocument, records);
+#else
+  printf("Built without ArduinoJson: former conversion not measured (see the build line above)\n");
+#endif
+  bench("Transcoder", convertWithTranscoder, records);
+  return 0;
+}
@@ -1,5 +1,6 @@
 // ActuatorController.cpp
 #include "ActuatorController.h"
+#include "Interlocks.h"
 
 // Static pointers, initialized to nullptr
 DCPump* ActuatorController::airPump = nullptr;
@@ -10,6 +11,13 @@ StirringMotor* ActuatorController::stirringMotor = nullptr;
 HeatingPlate* ActuatorController::heatingPlate = nullptr;
 LEDGrowLight* ActuatorController::ledGrowLight = nullptr;
 DCPump* ActuatorController::samplePump = nullptr;
+ActuatorMask ActuatorController::accessMask = ACTUATOR_MASK_ALL;
+ActuatorMask ActuatorController::runningMask = ACTUATOR_MASK_NONE;
+InterlockConditions ActuatorController::interlockConditions = INTERLOCK_NONE;
+uint16_t ActuatorController::denialCount[ActuatorController::ACTUATOR_COUNT] = {};
+ActuatorDenial ActuatorController::lastDenial[ActuatorController::ACTUATOR_COUNT] = {};
+ActuatorMask ActuatorController::timedMask = ACTUATOR_MASK_NONE;
+unsigned long ActuatorController::stopTime[ActuatorController::ACTUATOR_COUNT] = {};
 
 // Initialize method
 void ActuatorController::initialize(DCPump& airP, DCPump& drainP,
@@ -38,48 +46,128 @@ void ActuatorController::beginAll() {
     ledGrowLight->begin();
 }
 
-void ActuatorController::runActuator(const String& actuatorName, float value, int duration) {
+// The drain and sample pumps account no volume until set_pump_calibration has been run for them
+bool ActuatorController::checkPumpCalibration() {
+    bool calibrated = true;
+    DCPump* liquidPumps[] = {drainPump, samplePump};
+    for (DCPump* pump : liquidPumps) {
+        if (pump && !pump->isCalibrated()) {
+            Logger::log(LogLevel::WARNING, String(pump->getName()) + " has no flow calibration: its volume is not accounted (set_pump_calibration)");
+            calibrated = false;
+        }
+    }
+    return calibrated;
+}
+
+// The name is mapped to its ActuatorId once; callers that know the id skip the lookup
+ActuatorDenial ActuatorController::runActuator(const String& actuatorName, float value, unsigned long duration) {
     //Logger::log(LogLevel::INFO, "Attempting to find actuator: " + actuatorName); ///
-    ActuatorInterface* actuator = findActuatorByName(actuatorName);
-    if (actuator) {
-        //Logger::log(LogLevel::INFO, "Attempting to run actuator: " + actuatorName + " with value: " + String(value));
-        actuator->control(true, value);
-        Logger::log(LogLevel::INFO, "Running actuator: " + actuatorName + " with value: " + String(value));
-        if (duration > 0) {
-            delay(duration);
-            stopActuator(actuatorName);
+    int8_t id = findActuatorId(actuatorName);
+    if (id < 0) {
+        Logger::log(LogLevel::ERROR, "Actuator not found: " + actuatorName);
+        return ActuatorDenial::UNKNOWN_ACTUATOR;
+    }
+    return runActuator(static_cast<ActuatorId>(id), value, duration);
+}
+
+ActuatorDenial ActuatorController::runActuator(ActuatorId actuatorId, float value, unsigned long duration) {
+    uint8_t id = static_cast<uint8_t>(actuatorId);
+    if (id >= ACTUATOR_COUNT) {
+        return ActuatorDenial::UNKNOWN_ACTUATOR;
+    }
+    if (!isAccessAllowed(actuatorId)) {
+        return ActuatorDenial::NOT_LEASED;
+    }
+    ActuatorInterface* actuator = getActuator(actuatorId);
+    const char* actuatorName = actuator->getName();
+    ActuatorDenial denial = checkInterlocks(actuatorId);
+    if (denial != ActuatorDenial::NONE) {
+        recordDenial(actuatorId, denial);
+        if (actuator->isOn()) {
+            actuator->control(false, 0);
+            updateRunning(actuatorId);
         }
+        return denial;
+    }
+    lastDenial[id] = ActuatorDenial::NONE;
+
+    //Logger::log(LogLevel::INFO, "Attempting to run actuator: " + actuatorName + " with value: " + String(value));
+    if ((actuator == drainPump || actuator == samplePump) && !actuator->isOn() && !static_cast<DCPump*>(actuator)->isCalibrated()) {
+        Logger::log(LogLevel::WARNING, String(actuatorName) + " runs without flow calibration: the volume removed is not accounted");
+    }
+    actuator->control(true, value);
+    updateRunning(actuatorId);
+    Logger::log(LogLevel::INFO, "Running actuator: " + String(actuatorName) + " with value: " + String(value));
+    // A timed run must not block the loop (watchdog): update() stops the actuator at its deadline
+    if (duration > 0) {
+        timedMask |= actuatorBit(actuatorId);
+        stopTime[id] = millis() + duration;
     } else {
-        Logger::log(LogLevel::ERROR, "Actuator not found: " + actuatorName);
+        timedMask &= ~actuatorBit(actuatorId);
+    }
+    return ActuatorDenial::NONE;
+}
+
+// The deadline belongs to the command that started the actuator, so the access mask is ignored here
+void ActuatorController::update() {
+    timedMask &= runningMask;   // Stopped in the meantime
+    if (timedMask == ACTUATOR_MASK_NONE) return;
+    unsigned long now = millis();
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        ActuatorId actuatorId = static_cast<ActuatorId>(id);
+        if (!(timedMask & actuatorBit(actuatorId)) || (long)(now - stopTime[id]) < 0) continue;
+        timedMask &= ~actuatorBit(actuatorId);
+        getActuator(actuatorId)->control(false, 0);
+        updateRunning(actuatorId);
+        Logger::log(LogLevel::INFO, "Stopped actuator: " + String(getActuatorName(actuatorId)) + " (duration elapsed)");
     }
 }
 
 void ActuatorController::stopActuator(const String& actuatorName) {
-    ActuatorInterface* actuator = findActuatorByName(actuatorName);
-    if (actuator) {
-        actuator->control(false, 0);
+    int8_t id = findActuatorId(actuatorName);
+    if (id >= 0) {
+        stopActuator(static_cast<ActuatorId>(id));
+    }
+}
+
+void ActuatorController::stopActuator(ActuatorId actuatorId) {
+    if (static_cast<uint8_t>(actuatorId) < ACTUATOR_COUNT && isAccessAllowed(actuatorId)) {
+        getActuator(actuatorId)->control(false, 0);
+        updateRunning(actuatorId);
         delay(50);  // Ajoutez un court délai pour la stabilisation
-        Logger::log(LogLevel::INFO, "Stopped actuator: " + actuatorName);
+        Logger::log(LogLevel::INFO, "Stopped actuator: " + String(getActuatorName(actuatorId)));
     }
 }
 
+// Stops all the actuators the caller may drive (see setAccessMask)
 void ActuatorController::stopAllActuators() {
     Logger::log(LogLevel::INFO, "Entering stopAllActuators");
-    const ActuatorInterface* actuators[] = {
-        airPump, drainPump, nutrientPump, basePump, 
-        stirringMotor, heatingPlate, ledGrowLight
-    };
-    for (const auto& actuator : actuators) {
+    for (uint8_t id = 0; id < static_cast<uint8_t>(ActuatorId::COUNT); id++) {
+        ActuatorInterface* actuator = getActuator(static_cast<ActuatorId>(id));
+        if (!(accessMask & actuatorBit(static_cast<ActuatorId>(id)))) continue;
         if (actuator->isOn()) {
             Logger::log(LogLevel::INFO, "Stopping " + String(actuator->getName()));
             //actuator->control(false, 0);
             const_cast<ActuatorInterface*>(actuator)->control(false, 0);
+            updateRunning(static_cast<ActuatorId>(id));
             delay(50); 
         }
     }
     Logger::log(LogLevel::INFO, "All actuators stopped");
 }
 
+// Ignores the access mask and does not log: called from the watchdog interrupt before a reset
+void ActuatorController::forceAllOff() {
+    for (uint8_t id = 0; id < static_cast<uint8_t>(ActuatorId::COUNT); id++) {
+        ActuatorInterface* actuator = getActuator(static_cast<ActuatorId>(id));
+        if (actuator) {
+            actuator->forceOff();
+        }
+    }
+    runningMask = ACTUATOR_MASK_NONE;
+    timedMask = ACTUATOR_MASK_NONE;
+}
+
 bool ActuatorController::isActuatorRunning(const String& actuatorName) {
     ActuatorInterface* actuator = findActuatorByName(actuatorName);
     return actuator ? actuator->isOn() : false;
@@ -97,6 +185,169 @@ ActuatorInterface* ActuatorController::findActuatorByName(const String& name) {
     return nullptr;
 }
 
+ActuatorInterface* ActuatorController::getActuator(ActuatorId id) {
+    switch (id) {
+        case ActuatorId::AIR_PUMP: return airPump;
+        case ActuatorId::DRAIN_PUMP: return drainPump;
+        case ActuatorId::SAMPLE_PUMP: return samplePump;
+        case ActuatorId::NUTRIENT_PUMP: return nutrientPump;
+        case ActuatorId::BASE_PUMP: return basePump;
+        case ActuatorId::STIRRING_MOTOR: return stirringMotor;
+        case ActuatorId::HEATING_PLATE: return heatingPlate;
+        case ActuatorId::LED_GROW_LIGHT: return ledGrowLight;
+        default: return nullptr;
+    }
+}
+
+ActuatorMask ActuatorController::getActuatorMask(const String& actuatorName) {
+    for (uint8_t id = 0; id < static_cast<uint8_t>(ActuatorId::COUNT); id++) {
+        ActuatorInterface* actuator = getActuator(static_cast<ActuatorId>(id));
+        if (actuator && actuatorName == actuator->getName()) {
+            return actuatorBit(static_cast<ActuatorId>(id));
+        }
+    }
+    return ACTUATOR_MASK_NONE;
+}
+
+const char* ActuatorController::getActuatorName(ActuatorId id) {
+    ActuatorInterface* actuator = getActuator(id);
+    return actuator ? actuator->getName() : "unknown";
+}
+
+int8_t ActuatorController::findActuatorId(const String& actuatorName) {
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        ActuatorInterface* actuator = getActuator(static_cast<ActuatorId>(id));
+        if (actuator && actuatorName == actuator->getName()) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+// O(1): the running actuators and the met conditions are bit masks
+ActuatorDenial ActuatorController::checkInterlocks(ActuatorId id) {
+    const Interlock& interlock = INTERLOCKS[static_cast<uint8_t>(id)];
+    if (interlock.excludes & runningMask) {
+        return ActuatorDenial::EXCLUDED;
+    }
+    InterlockConditions missing = interlock.requiredConditions & ~getInterlockConditions();
+    if (missing & INTERLOCK_VOLUME_ABOVE_MIN) {
+        return ActuatorDenial::VOLUME_LOW;
+    }
+    if (missing & INTERLOCK_STIRRING_ON) {
+        return ActuatorDenial::NOT_STIRRED;
+    }
+    return ActuatorDenial::NONE;
+}
+
+InterlockConditions ActuatorController::getInterlockConditions() {
+    InterlockConditions conditions = interlockConditions;
+    if (runningMask & actuatorBit(ActuatorId::STIRRING_MOTOR)) {
+        conditions |= INTERLOCK_STIRRING_ON;
+    }
+    return conditions;
+}
+
+ActuatorMask ActuatorController::getOutputMask() {
+    ActuatorMask mask = runningMask & ~actuatorBit(ActuatorId::HEATING_PLATE);
+    if (heatingPlate && heatingPlate->isRelayOn()) {
+        mask |= actuatorBit(ActuatorId::HEATING_PLATE);
+    }
+    return mask;
+}
+
+void ActuatorController::setInterlockCondition(InterlockConditions condition, bool met) {
+    InterlockConditions previous = interlockConditions;
+    if (met) {
+        interlockConditions |= condition;
+    } else {
+        interlockConditions &= ~condition;
+    }
+    if (interlockConditions != previous && !met) {
+        enforceInterlocks();
+    }
+}
+
+void ActuatorController::updateRunning(ActuatorId id) {
+    ActuatorMask bit = actuatorBit(id);
+    ActuatorMask previous = runningMask;
+    if (getActuator(id)->isOn()) {
+        runningMask |= bit;
+    } else {
+        runningMask &= ~bit;
+    }
+    if (previous & ~runningMask) {
+        enforceInterlocks();    // A stopped actuator may be a condition of others (stirring)
+    }
+}
+
+// Stops the running actuators whose required conditions are no longer met. Safety first: the access mask is ignored.
+void ActuatorController::enforceInterlocks() {
+    InterlockConditions conditions = getInterlockConditions();
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        if (!(runningMask & actuatorBit(static_cast<ActuatorId>(id)))) continue;
+        InterlockConditions missing = INTERLOCKS[id].requiredConditions & ~conditions;
+        if (missing == INTERLOCK_NONE) continue;
+        ActuatorInterface* actuator = getActuator(static_cast<ActuatorId>(id));
+        actuator->control(false, 0);
+        runningMask &= ~actuatorBit(static_cast<ActuatorId>(id));
+        denialCount[id]++;
+        lastDenial[id] = (missing & INTERLOCK_VOLUME_ABOVE_MIN) ? ActuatorDenial::VOLUME_LOW : ActuatorDenial::NOT_STIRRED;
+        Logger::log(LogLevel::WARNING, String(actuator->getName()) + " stopped by interlock: " + getDenialName(lastDenial[id]));
+    }
+}
+
+// Counts every refused command, but only logs when the reason changes (PID loops retry on every update)
+void ActuatorController::recordDenial(ActuatorId id, ActuatorDenial denial) {
+    uint8_t index = static_cast<uint8_t>(id);
+    if (denialCount[index] < UINT16_MAX) denialCount[index]++;
+    if (lastDenial[index] != denial) {
+        lastDenial[index] = denial;
+        String reason = getDenialName(denial);
+        if (denial == ActuatorDenial::EXCLUDED) {
+            ActuatorMask conflicts = INTERLOCKS[index].excludes & runningMask;
+            for (uint8_t other = 0; other < ACTUATOR_COUNT; other++) {
+                if (conflicts & actuatorBit(static_cast<ActuatorId>(other))) {
+                    reason += String(" (") + getActuatorName(static_cast<ActuatorId>(other)) + ")";
+                    break;
+                }
+            }
+        }
+        Logger::log(LogLevel::WARNING, String(getActuatorName(id)) + " refused by interlock: " + reason);
+    }
+}
+
+void ActuatorController::logInterlockStats() {
+    Logger::log(LogLevel::INFO, "Interlocks - volume above minimum: " +
+                String((interlockConditions & INTERLOCK_VOLUME_ABOVE_MIN) ? "yes" : "no") +
+                ", stirring: " + String((getInterlockConditions() & INTERLOCK_STIRRING_ON) ? "on" : "off"));
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        if (denialCount[id] == 0) continue;
+        Logger::log(LogLevel::INFO, String("  ") + getActuatorName(static_cast<ActuatorId>(id)) + ": " +
+                    String(denialCount[id]) + " refused, last: " + getDenialName(lastDenial[id]));
+    }
+}
+
+const char* ActuatorController::getDenialName(ActuatorDenial denial) {
+    switch (denial) {
+        case ActuatorDenial::NONE: return "none";
+        case ActuatorDenial::UNKNOWN_ACTUATOR: return "unknown actuator";
+        case ActuatorDenial::NOT_LEASED: return "owned by another program";
+        case ActuatorDenial::EXCLUDED: return "excluded by a running actuator";
+        case ActuatorDenial::VOLUME_LOW: return "volume below minimum";
+        case ActuatorDenial::NOT_STIRRED: return "stirring off";
+        default: return "unknown";
+    }
+}
+
+bool ActuatorController::isAccessAllowed(ActuatorId id) {
+    if (accessMask & actuatorBit(id)) {
+        return true;
+    }
+    Logger::log(LogLevel::WARNING, "Actuator " + String(getActuatorName(id)) + " is owned by another program, command refused");
+    return false;
+}
+
 float ActuatorController::getVolumeAdded(const String& actuatorName) {
     if (actuatorName == "nutrientPump" && nutrientPump) {
         return nutrientPump->getVolumeAdded();
@@ -109,6 +360,8 @@ float ActuatorController::getVolumeAdded(const String& actuatorName) {
 float ActuatorController::getVolumeRemoved(const String& actuatorName) {
     if (actuatorName == "drainPump" && drainPump) {
         return drainPump->getVolumeRemoved();
+    } else if (actuatorName == "samplePump" && samplePump) {
+        return samplePump->getVolumeRemoved();
     }
     return 0.0f;
 }
@@ -124,14 +377,38 @@ void ActuatorController::resetVolumeAdded(const String& actuatorName) {
 void ActuatorController::resetVolumeRemoved(const String& actuatorName) {
     if (actuatorName == "drainPump" && drainPump) {
         drainPump->resetVolumeRemoved();
+    } else if (actuatorName == "samplePump" && samplePump) {
+        samplePump->resetVolumeRemoved();
     }
 }
 
+float ActuatorController::consumeVolumeAdded(const String& actuatorName) {
+    if (actuatorName == "nutrientPump" && nutrientPump) {
+        return nutrientPump->consumeVolumeAdded();
+    } else if (actuatorName == "basePump" && basePump) {
+        return basePump->consumeVolumeAdded();
+    }
+    return 0.0f;
+}
+
+float ActuatorController::consumeVolumeRemoved(const String& actuatorName) {
+    if (actuatorName == "drainPump" && drainPump) {
+        return drainPump->consumeVolumeRemoved();
+    } else if (actuatorName == "samplePump" && samplePump) {
+        return samplePump->consumeVolumeRemoved();
+    }
+    return 0.0f;
+}
+
 float ActuatorController::getPumpMaxFlowRate(const String& actuatorName) {
     if (actuatorName == "nutrientPump" && nutrientPump) {
         return nutrientPump->getMaxFlowRate();
     } else if (actuatorName == "basePump" && basePump) {
         return basePump->getMaxFlowRate();
+    } else if (actuatorName == "drainPump" && drainPump) {
+        return drainPump->getFlowAtMaxSpeed();
+    } else if (actuatorName == "samplePump" && samplePump) {
+        return samplePump->getFlowAtMaxSpeed();
     }
     return 0.0f;
 }
@@ -141,10 +418,29 @@ float ActuatorController::getPumpMinFlowRate(const String& actuatorName) {
         return nutrientPump->getMinFlowRate();
     } else if (actuatorName == "basePump" && basePump) {
         return basePump->getMinFlowRate();
+    } else if (actuatorName == "drainPump" && drainPump) {
+        return drainPump->getFlowAtMinSpeed();
+    } else if (actuatorName == "samplePump" && samplePump) {
+        return samplePump->getFlowAtMinSpeed();
     }
     return 0.0f;
 }
 
+// For the DC pumps, the range is the calibrated flow at minimum speed and at 100% speed
+void ActuatorController::setPumpFlowRange(const String& actuatorName, float minFlowRate, float maxFlowRate) {
+    if (actuatorName == "nutrientPump" && nutrientPump) {
+        nutrientPump->setFlowRange(minFlowRate, maxFlowRate);
+    } else if (actuatorName == "basePump" && basePump) {
+        basePump->setFlowRange(minFlowRate, maxFlowRate);
+    } else if (actuatorName == "drainPump" && drainPump) {
+        drainPump->setFlowCalibration(minFlowRate, maxFlowRate);
+    } else if (actuatorName == "samplePump" && samplePump) {
+        samplePump->setFlowCalibration(minFlowRate, maxFlowRate);
+    } else {
+        Logger::log(LogLevel::WARNING, "No flow calibration for actuator: " + actuatorName);
+    }
+}
+
 int ActuatorController::getStirringMotorMinRPM() {
     return stirringMotor ? stirringMotor->getMinRPM() : 0;
 }
@@ -153,12 +449,16 @@ int ActuatorController::getStirringMotorMaxRPM() {
     return stirringMotor ? stirringMotor->getMaxRPM() : 0;
 }
 
+float ActuatorController::getHeatingPlateEnergy() {
+    return heatingPlate ? heatingPlate->getDeliveredEnergy() : 0.0f;
+}
+
 float ActuatorController::getTotalVolumeAdded() {
     return getVolumeAdded("nutrientPump") + getVolumeAdded("basePump");
 }
 
 float ActuatorController::getTotalVolumeRemoved() {
-    return getVolumeRemoved("drainPump");
+    return getVolumeRemoved("drainPump") + getVolumeRemoved("samplePump");
 }
 
 void ActuatorController::logActuatorData() {
@@ -168,6 +468,8 @@ void ActuatorController::logActuatorData() {
     Logger::log(LogLevel::INFO, "Nutrient Pump: " + String(ActuatorController::isActuatorRunning("nutrientPump") ? "ON" : "OFF"));
     Logger::log(LogLevel::INFO, "Base Pump: " + String(ActuatorController::isActuatorRunning("basePump") ? "ON" : "OFF"));
     Logger::log(LogLevel::INFO, "Stirring Motor: " + String(ActuatorController::isActuatorRunning("stirringMotor") ? "ON" : "OFF"));
-    Logger::log(LogLevel::INFO, "Heating Plate: " + String(ActuatorController::isActuatorRunning("heatingPlate") ? "ON" : "OFF"));
+    Logger::log(LogLevel::INFO, "Heating Plate: " + String(ActuatorController::isActuatorRunning("heatingPlate") ? "ON" : "OFF") +
+                ", relay " + String(heatingPlate && heatingPlate->isRelayOn() ? "ON" : "OFF"));
+    Logger::log(LogLevel::INFO, "Heating Plate energy: " + String(getHeatingPlateEnergy()) + " Wh");
     Logger::log(LogLevel::INFO, "LED Grow Light: " + String(ActuatorController::isActuatorRunning("ledGrowLight") ? "ON" : "OFF"));
 }
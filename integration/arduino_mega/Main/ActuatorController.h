@@ -11,6 +11,42 @@ enum class ControlMode {
     Relay
 };
 
+// Actuator identifiers, used as bit positions in actuator masks (ownership/lease tables)
+enum class ActuatorId : uint8_t {
+    AIR_PUMP,
+    DRAIN_PUMP,
+    SAMPLE_PUMP,
+    NUTRIENT_PUMP,
+    BASE_PUMP,
+    STIRRING_MOTOR,
+    HEATING_PLATE,
+    LED_GROW_LIGHT,
+    COUNT
+};
+
+typedef uint16_t ActuatorMask;
+const ActuatorMask ACTUATOR_MASK_NONE = 0;
+const ActuatorMask ACTUATOR_MASK_ALL = (1 << static_cast<uint8_t>(ActuatorId::COUNT)) - 1;
+
+constexpr ActuatorMask actuatorBit(ActuatorId id) { return 1 << static_cast<uint8_t>(id); }
+
+// Conditions an actuator may require to run (see Interlocks.h)
+typedef uint8_t InterlockConditions;
+const InterlockConditions INTERLOCK_NONE = 0;
+const InterlockConditions INTERLOCK_VOLUME_ABOVE_MIN = 0x01;  // Culture volume above the minimum (set by VolumeManager)
+const InterlockConditions INTERLOCK_STIRRING_ON = 0x02;       // Stirring motor running (tracked by ActuatorController)
+
+// Reason why runActuator() refused a command
+enum class ActuatorDenial : uint8_t {
+    NONE,
+    UNKNOWN_ACTUATOR,
+    NOT_LEASED,       // Owned by another program
+    EXCLUDED,         // An actuator it may not run with is running
+    VOLUME_LOW,       // Requires the volume above the minimum
+    NOT_STIRRED,      // Requires the stirring motor running
+    COUNT
+};
+
 class ActuatorController {
 public:
     public:
@@ -19,10 +55,16 @@ public:
                            StirringMotor& stirringMotor, HeatingPlate& heatingPlate,
                            LEDGrowLight& ledGrowLight, DCPump& samplePump);
     static void beginAll();
+    static bool checkPumpCalibration();  // Warns about liquid pumps without flow calibration; true if all are calibrated
     
-    static void runActuator(const String& actuatorName, float value, int duration);
+    // duration (ms) > 0 does not block: the actuator is stopped by update() once it has elapsed
+    static ActuatorDenial runActuator(const String& actuatorName, float value, unsigned long duration);
+    static ActuatorDenial runActuator(ActuatorId id, float value, unsigned long duration);  // No name lookup
+    static void update();  // Stops the actuators whose run duration has elapsed, called from loop()
     static void stopActuator(const String& actuatorName);
+    static void stopActuator(ActuatorId id);
     static void stopAllActuators();
+    static void forceAllOff();   // Cuts all actuators at once, safe from an interrupt (watchdog safe state)
     static bool isActuatorRunning(const String& actuatorName);
 
     template<typename T>
@@ -32,15 +74,39 @@ public:
     static float getVolumeRemoved(const String& actuatorName);
     static void resetVolumeAdded(const String& actuatorName);
     static void resetVolumeRemoved(const String& actuatorName);
+    static float consumeVolumeAdded(const String& actuatorName);
+    static float consumeVolumeRemoved(const String& actuatorName);
     static float getTotalVolumeAdded();
     static float getTotalVolumeRemoved();
 
     static float getPumpMaxFlowRate(const String& actuatorName);
     static float getPumpMinFlowRate(const String& actuatorName);
+    static void setPumpFlowRange(const String& actuatorName, float minFlowRate, float maxFlowRate);
     static int getStirringMotorMinRPM();
     static int getStirringMotorMaxRPM();
+    static float getHeatingPlateEnergy();
 
     static ActuatorInterface* findActuatorByName(const String& name);
+    static ActuatorMask getActuatorMask(const String& actuatorName);  // 0 if unknown
+    static const char* getActuatorName(ActuatorId id);
+
+    // Actuators the running caller may drive (set by the StateMachine around program calls).
+    // Commands on actuators outside the mask are refused; all actuators are allowed by default.
+    static void setAccessMask(ActuatorMask mask) { accessMask = mask; }
+    static ActuatorMask getAccessMask() { return accessMask; }
+
+    // Interlocks: runActuator() refuses to start an actuator whose interlock (Interlocks.h) is violated,
+    // and running actuators are stopped when a condition they require is lost
+    static ActuatorDenial checkInterlocks(ActuatorId id);
+    static void setInterlockCondition(InterlockConditions condition, bool met);
+    static InterlockConditions getInterlockConditions();
+    static ActuatorMask getRunningMask() { return runningMask; }
+    // As getRunningMask(), with the heating plate bit following its relay (off in the OFF part of its windows):
+    // the actuators drawing power now, as reported in the telemetry
+    static ActuatorMask getOutputMask();
+    static uint16_t getDenialCount(ActuatorId id) { return denialCount[static_cast<uint8_t>(id)]; }
+    static void logInterlockStats();
+    static const char* getDenialName(ActuatorDenial denial);
     static void runHeatingPlatePID(double pidOutput);
 
     static void logActuatorData();
@@ -55,6 +121,22 @@ private:
     static LEDGrowLight* ledGrowLight;
     static ControlMode heatingControlMode;
     static DCPump* samplePump;
+    static ActuatorMask accessMask;
+
+    static const uint8_t ACTUATOR_COUNT = static_cast<uint8_t>(ActuatorId::COUNT);
+    static ActuatorMask runningMask;                 // Actuators currently on
+    static InterlockConditions interlockConditions;  // Conditions set from outside (volume)
+    static uint16_t denialCount[ACTUATOR_COUNT];     // Refused commands and interlock stops, per actuator
+    static ActuatorDenial lastDenial[ACTUATOR_COUNT];
+    static ActuatorMask timedMask;                   // Running actuators started with a duration
+    static unsigned long stopTime[ACTUATOR_COUNT];   // millis() at which update() stops them
+
+    static ActuatorInterface* getActuator(ActuatorId id);
+    static int8_t findActuatorId(const String& actuatorName);
+    static bool isAccessAllowed(ActuatorId id);
+    static void updateRunning(ActuatorId id);
+    static void enforceInterlocks();
+    static void recordDenial(ActuatorId id, ActuatorDenial denial);
 };
 
 #endif // ACTUATOR_CONTROLLER_H
@@ -8,28 +8,83 @@ CommandHandler::CommandHandler(StateMachine& stateMachine, SafetySystem& safetyS
       volumeManager(volumeManager), logger(logger),
       pidManager(pidManager) {}
 
+// Returns the space-separated token starting at pos and moves pos past it
+String CommandHandler::nextToken(const String& command, int& pos) {
+    while (pos < (int)command.length() && command.charAt(pos) == ' ') pos++;
+    int end = command.indexOf(' ', pos);
+    if (end == -1) end = command.length();
+    String token = command.substring(pos, end);
+    pos = end;
+    return token;
+}
+
 void CommandHandler::executeCommand(const String& command) {
     logger.log(LogLevel::INFO, "Executing command: " + command);
 
     if (command == "help") {
         printHelp();
     } else if (command.startsWith("test") || command == "tests") {
-        stateMachine.startProgram("Tests", command);
+        stateMachine.postEvent(ProgramEvent::START, "Tests", command);
     } else if (command.startsWith("drain")) {
-        stateMachine.startProgram("Drain", command);
+        stateMachine.postEvent(ProgramEvent::START, "Drain", command);
     } else if (command.startsWith("mix")) {
-        stateMachine.startProgram("Mix", command);
+        stateMachine.postEvent(ProgramEvent::START, "Mix", command);
     } else if (command.startsWith("fermentation")) {
-        stateMachine.startProgram("Fermentation", command);
-    } else if (command == "stop") {
-        stateMachine.stopAllPrograms();
-        //stateMachine.stopProgram();
+        stateMachine.postEvent(ProgramEvent::START, "Fermentation", command);
+    } else if (command == "stop" || command.startsWith("stop ")) {
+        int pos = 4;
+        stateMachine.postEvent(ProgramEvent::STOP, nextToken(command, pos));
+    } else if (command == "pause" || command.startsWith("pause ")) {
+        int pos = 5;
+        stateMachine.postEvent(ProgramEvent::PAUSE, nextToken(command, pos));
+    } else if (command == "resume" || command.startsWith("resume ")) {
+        int pos = 6;
+        stateMachine.postEvent(ProgramEvent::RESUME, nextToken(command, pos));
+    } else if (command == "events") {
+        stateMachine.logEventStats();
+    } else if (command == "watchdog") {
+        Watchdog::logStatus();
+    } else if (command == "interlocks") {
+        ActuatorController::logInterlockStats();
+    } else if (command == "sensors") {
+        ErrorHandler::logSensorHealth();
+    } else if (command == "clock") {
+        SystemClock::logStatus();
+    } else if (command == "recorder") {
+        DataRecorder::logStatus();
+    } else if (command.startsWith("backfill ")) {
+        int pos = 8;
+        uint32_t from = nextToken(command, pos).toInt();
+        uint32_t to = nextToken(command, pos).toInt();
+        if (!DataRecorder::requestBackfill(from, to)) {
+            logger.log(LogLevel::WARNING, "Invalid backfill command. Usage: backfill <from_seq> [to_seq] (last record " +
+                       String(DataRecorder::getLastSeq()) + ")");
+        }
+    } else if (command.startsWith("clock_set ")) {
+        // clock_set <unix_time_seconds> <milliseconds> <at_millis> <uncertainty_ms>, sent by the ESP32
+        int pos = 9;
+        String unixTime = nextToken(command, pos);
+        String milliseconds = nextToken(command, pos);
+        String atMillis = nextToken(command, pos);
+        String uncertainty = nextToken(command, pos);
+        if (uncertainty.length() > 0 && milliseconds.toInt() < 1000) {
+            SystemClock::synchronize(strtoul(unixTime.c_str(), nullptr, 10), milliseconds.toInt(),
+                                     strtoul(atMillis.c_str(), nullptr, 10), uncertainty.toInt());
+        } else {
+            logger.log(LogLevel::WARNING, "Invalid clock_set command. Usage: clock_set <unix_time_seconds> <milliseconds> <at_millis> <uncertainty_ms>");
+        }
     } else if (command.startsWith("adjust_volume")) {
         handleAdjustVolume(command);
     } else if (command.startsWith("set_") || command.startsWith("alarms ") || command.startsWith("warnings ")) {
         handleSetCommand(command);
     } else if (command.startsWith("ph ")) {
         handlePHCalibrationCommand(command);
+    } else if (command.startsWith("recipe_")) {
+        handleRecipeCommand(command);
+    } else if (command == "recipe") {
+        stateMachine.postEvent(ProgramEvent::START, "Recipe", command);
+    } else if (command == "save_params" || command == "load_params" || command == "erase_params") {
+        handleParametersCommand(command);
     } else {
         logger.log(LogLevel::WARNING, "Unknown command: " + command);
     }
@@ -55,6 +110,58 @@ void CommandHandler::handleSetCommand(const String& command) {
         int interval = command.substring(19).toInt();
         safetySystem.setCheckInterval(interval * 1000); // Convert to milliseconds
         logger.log(LogLevel::INFO, "Safety check interval set to " + String(interval) + " seconds");
+    } else if (command.startsWith("set_pid ")) {
+        int pos = 8;
+        String type = nextToken(command, pos);
+        String kp = nextToken(command, pos);
+        String ki = nextToken(command, pos);
+        String kd = nextToken(command, pos);
+        if (kd.length() > 0) {
+            pidManager.adjustPIDParameters(type, kp.toFloat(), ki.toFloat(), kd.toFloat());
+            logger.log(LogLevel::INFO, "PID " + type + " gains set to " + kp + " " + ki + " " + kd);
+        } else {
+            logger.log(LogLevel::WARNING, "Invalid set_pid command. Usage: set_pid <temperature|pH|DO> <Kp> <Ki> <Kd>");
+        }
+    } else if (command.startsWith("set_ramp ")) {
+        int pos = 9;
+        String type = nextToken(command, pos);
+        String profile = nextToken(command, pos);
+        String rate = nextToken(command, pos);
+        TrajectoryProfile trajectoryProfile;
+        if (profile == "step") {
+            trajectoryProfile = TrajectoryProfile::STEP;
+        } else if (profile == "linear") {
+            trajectoryProfile = TrajectoryProfile::LINEAR;
+        } else if (profile == "scurve") {
+            trajectoryProfile = TrajectoryProfile::S_CURVE;
+        } else {
+            logger.log(LogLevel::WARNING, "Invalid set_ramp command. Usage: set_ramp <temperature|pH|DO> <step|linear|scurve> <rate_per_min>");
+            return;
+        }
+        if (pidManager.setTrajectory(type, trajectoryProfile, rate.toFloat())) {
+            logger.log(LogLevel::INFO, "PID " + type + " setpoint trajectory: " + profile + " at " + rate + " /min");
+        }
+    } else if (command.startsWith("set_setpoint_ramp ")) {
+        int pos = 18;
+        String type = nextToken(command, pos);
+        String target = nextToken(command, pos);
+        String soak = nextToken(command, pos);
+        if (target.length() > 0) {
+            pidManager.rampSetpoint(type, target.toFloat(), (unsigned long)(soak.toFloat() * 60000.0));
+        } else {
+            logger.log(LogLevel::WARNING, "Invalid set_setpoint_ramp command. Usage: set_setpoint_ramp <temperature|pH|DO> <target> [soak_minutes]");
+        }
+    } else if (command.startsWith("set_pump_calibration ")) {
+        int pos = 21;
+        String pump = nextToken(command, pos);
+        String minFlow = nextToken(command, pos);
+        String maxFlow = nextToken(command, pos);
+        if (maxFlow.length() > 0) {
+            ActuatorController::setPumpFlowRange(pump, minFlow.toFloat(), maxFlow.toFloat());
+            logger.log(LogLevel::INFO, pump + " flow range set to " + minFlow + " - " + maxFlow + " ml/min");
+        } else {
+            logger.log(LogLevel::WARNING, "Invalid set_pump_calibration command. Usage: set_pump_calibration <pump> <min_ml_per_min> <max_ml_per_min>");
+        }
     } else if (command.startsWith("set_initial_volume")) {
         int spaceIndex = command.indexOf(' ');
         if (spaceIndex != -1) {
@@ -64,6 +171,15 @@ void CommandHandler::handleSetCommand(const String& command) {
         } else {
             logger.log(LogLevel::WARNING, "Invalid set_initial_volume command. Usage: set_initial_volume <volume_in_liters>");
         }
+    } else if (command.startsWith("set_time ")) {
+        int pos = 9;
+        String unixTime = nextToken(command, pos);
+        if (unixTime.length() > 0) {
+            SystemClock::setUnixTime(strtoul(unixTime.c_str(), nullptr, 10));
+            logger.log(LogLevel::INFO, "Clock set to " + unixTime);
+        } else {
+            logger.log(LogLevel::WARNING, "Invalid set_time command. Usage: set_time <unix_time_seconds>");
+        }
     } else {
         logger.log(LogLevel::WARNING, "Unknown set command: " + command);
     }
@@ -85,6 +201,54 @@ void CommandHandler::handlePHCalibrationCommand(const String& command) {
     }
 }
 
+void CommandHandler::handleParametersCommand(const String& command) {
+    if (command == "save_params") {
+        pidManager.saveParameters();
+    } else if (command == "load_params") {
+        if (!pidManager.loadParameters()) {
+            logger.log(LogLevel::WARNING, "No saved parameters, keeping current ones");
+        }
+    } else {
+        ParameterStore::erase();
+    }
+}
+
+// Recipe upload: recipe_begin, then recipe_write <offset> <hex bytes> chunks, then recipe_commit <length> <crc16 hex>
+void CommandHandler::handleRecipeCommand(const String& command) {
+    int pos = command.indexOf(' ');
+    if (pos == -1) pos = command.length();
+    String action = command.substring(0, pos);
+    if (action == "recipe_begin") {
+        RecipeStore::begin();
+    } else if (action == "recipe_write") {
+        String offset = nextToken(command, pos);
+        String hex = nextToken(command, pos);
+        uint8_t data[MAX_RECIPE_CHUNK];
+        uint8_t length = hex.length() / 2;
+        if (offset.length() == 0 || hex.length() % 2 != 0 || length == 0 || length > MAX_RECIPE_CHUNK) {
+            logger.log(LogLevel::WARNING, "Invalid recipe_write command. Usage: recipe_write <offset> <hex_bytes> (max " +
+                       String(MAX_RECIPE_CHUNK) + " bytes)");
+            return;
+        }
+        for (uint8_t i = 0; i < length; i++) {
+            data[i] = strtoul(hex.substring(2 * i, 2 * i + 2).c_str(), nullptr, 16);
+        }
+        if (RecipeStore::write(offset.toInt(), data, length)) {
+            logger.log(LogLevel::DEBUG, "Recipe chunk written at " + offset);
+        }
+    } else if (action == "recipe_commit") {
+        String length = nextToken(command, pos);
+        String crc = nextToken(command, pos);
+        if (crc.length() > 0) {
+            RecipeStore::commit(length.toInt(), strtoul(crc.c_str(), nullptr, 16));
+        } else {
+            logger.log(LogLevel::WARNING, "Invalid recipe_commit command. Usage: recipe_commit <length> <crc16_hex>");
+        }
+    } else {
+        logger.log(LogLevel::WARNING, "Unknown recipe command: " + command);
+    }
+}
+
 void CommandHandler::printHelp() {
     Serial.println();
     Serial.println("------------------------------------------------- Available commands: -------------------------------------------------");
@@ -110,9 +274,20 @@ void CommandHandler::printHelp() {
     Serial.println("    ledGrowLight <intensity_0_100%> <duration_seconds>");
     Serial.println("tests - Run all predefined tests");
     Serial.println("drain <rate> <duration> - Start draining");
-    Serial.println("stop - Stop all actuators and PIDs");
+    Serial.println("stop - Stop all running programs, actuators and PIDs");
+    Serial.println("stop <program> - Stop one running program (tests, drain, mix, fermentation, recipe), the others keep running");
+    Serial.println("pause [program] / resume [program] - Pause or resume one running program, or all of them");
+    Serial.println("events - Show the state machine event counters and latencies");
+    Serial.println("watchdog - Show the last reset cause and the heartbeat ages");
+    Serial.println("interlocks - Show the interlock conditions and the refused actuator commands");
+    Serial.println("sensors - Show the health of every sensor channel (ok, suspect, fault)");
+    Serial.println("recorder - Show the state of the SD card data recorder");
+    Serial.println("clock - Show the clock, its estimated rate error and its last synchronization by the ESP32");
+    Serial.println("backfill <from_seq> [to_seq] - Send the recorded telemetry again (missed while the link was down)");
     Serial.println("mix <speed> - Start mixing");
     Serial.println("fermentation <temp> <ph> <do> <nutrient_conc> <base_conc> <duration> <experiment_name> <comment> - Start fermentation");
+    Serial.println("recipe - Start the fermentation recipe stored in EEPROM");
+    Serial.println("recipe_begin / recipe_write <offset> <hex> / recipe_commit <length> <crc16> - Upload a recipe (see tools/recipe_compiler.py)");
     Serial.println("test pid <type> <setpoint> - Start PID control (type: temp, ph, or do)");
     Serial.println("alarm false - Disable safety alarms");
     Serial.println("alarm true - Enable safety alarms");
@@ -124,6 +299,15 @@ void CommandHandler::printHelp() {
     Serial.println("ph ENTERPH - Enter pH calibration mode");
     Serial.println("ph CALPH - Calibrate with buffer solution");
     Serial.println("ph EXITPH - Save and exit pH calibration mode");
+    Serial.println("set_pid <temperature|pH|DO> <Kp> <Ki> <Kd> - Set PID gains");
+    Serial.println("set_ramp <temperature|pH|DO> <step|linear|scurve> <rate_per_min> - Set the setpoint trajectory of a PID loop");
+    Serial.println("set_setpoint_ramp <temperature|pH|DO> <target> [soak_minutes] - Ramp a running PID loop to a new setpoint");
+    Serial.println("set_pump_calibration <nutrientPump|basePump> <min> <max> - Set pump flow range (ml/min)");
+    Serial.println("set_pump_calibration <drainPump|samplePump> <flow_at_min_speed> <flow_at_100%> - Set pump flow calibration (ml/min)");
+    Serial.println("set_time <unix_time_seconds> - Set the clock (used to report the downtime after a reset)");
+    Serial.println("save_params - Save controller parameters to EEPROM");
+    Serial.println("load_params - Reload controller parameters from EEPROM");
+    Serial.println("erase_params - Erase saved controller parameters (defaults at next boot)");
     Serial.println("-----------------------------------------------------------------------------------------------------------------------");
 }
 
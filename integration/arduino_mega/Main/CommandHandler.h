@@ -7,6 +7,11 @@
 #include "VolumeManager.h"
 #include <logger/Logger.h>
 #include "PIDManager.h"
+#include "SystemClock.h"
+#include "RecipeStore.h"
+#include "Watchdog.h"
+#include "ErrorHandler.h"
+#include "DataRecorder.h"
 
 class CommandHandler {
 public:
@@ -30,6 +35,14 @@ private:
     void handleSetCommand(const String& command);
     
     void handlePHCalibrationCommand(const String& command);
+
+    void handleParametersCommand(const String& command);
+
+    void handleRecipeCommand(const String& command);
+
+    static const uint8_t MAX_RECIPE_CHUNK = 32; // Bytes per recipe_write command
+
+    static String nextToken(const String& command, int& pos);
 };
 
 #endif // COMMAND_HANDLER_H
\ No newline at end of file
@@ -3,7 +3,7 @@
 
 extern CommandHandler commandHandler;
 
-Communication::Communication(HardwareSerial& serial) : _serial(serial) {}
+Communication::Communication(HardwareSerial& serial) : _serial(serial), _receivedAt(0) {}
 
 void Communication::begin(unsigned long baud) {
     _serial.begin(baud);
@@ -16,6 +16,7 @@ bool Communication::available() {
 String Communication::readMessage() {
     if (_serial.available() > 0) {
         String receivedData = _serial.readStringUntil('\n');
+        _receivedAt = millis();
         receivedData.trim();
         if (receivedData.length() > 0) {
             return receivedData;
@@ -32,6 +33,10 @@ void Communication::processCommand(const String& command) {
     if (command.length() == 0) {
         return;  // Do not process empty commands
     }
+    if (command.startsWith("clock_probe ")) {
+        answerClockProbe(command);
+        return;
+    }
 
     StaticJsonDocument<200> doc;
     DeserializationError error = deserializeJson(doc, command);
@@ -71,4 +76,17 @@ void Communication::processCommand(const String& command) {
             Logger::log(LogLevel::WARNING, "Unknown program: " + program);
         }
     }
-}
\ No newline at end of file
+}
+
+// Answers "clock_probe <id>" of the ESP32 with the millis() at which the probe was read and at which
+// the answer starts, on the port of the data lines: {"ev":"clock","id":<id>,"rx":<ms>,"tx":<ms>}.
+// The ESP32 takes the round trip out of both, and sends the time back with clock_set.
+void Communication::answerClockProbe(const String& command) {
+    String answer = "{\"ev\":\"clock\",\"id\":" + String(command.substring(12).toInt()) + ",\"rx\":" +
+                    String(_receivedAt) + ",\"tx\":";
+    Serial.flush();             // Nothing queued ahead of the answer, so it leaves at the time it carries
+    unsigned long sentAt = millis();
+    Serial.print(answer);
+    Serial.print(sentAt);
+    Serial.println('}');
+}
@@ -14,8 +14,14 @@ public:
     void sendMessage(const String& message);
     void processCommand(const String& command);
 
+    // millis() when the last message was read, for the clock synchronization
+    unsigned long lastReceiveTime() const { return _receivedAt; }
+
 private:
     HardwareSerial& _serial;
+    unsigned long _receivedAt;
+
+    void answerClockProbe(const String& command);
     static const unsigned int MAX_MESSAGE_LENGTH = 256;
 };
 
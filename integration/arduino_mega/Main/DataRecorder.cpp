@@ -0,0 +1,291 @@
+// DataRecorder.cpp
+#include "DataRecorder.h"
+#include "SystemClock.h"
+#include <util/crc16.h>
+
+static const char INDEX_PATH[] = "INDEX.BIN";
+
+// Scale of the stored sensor values and telemetry key, indexed by SensorId
+static const float VALUE_SCALES[] = {100, 100, 100, 100, 1, 100, 1};
+static const char* const VALUE_KEYS[] = {"waterTemp", "airTemp", "elecTemp", "pH", "oxygen", "airFlow", "turbidity"};
+static_assert(sizeof(VALUE_SCALES) / sizeof(VALUE_SCALES[0]) == RECORDED_SENSOR_COUNT,
+              "One scale per sensor");
+
+// Telemetry key of each actuator state, indexed by ActuatorId (as in Logger::logData)
+static const char* const ACTUATOR_KEYS[] = {"airP", "drainP", "sampleP", "nutrientP", "baseP", "stirringM", "heatingP", "led"};
+static_assert(sizeof(ACTUATOR_KEYS) / sizeof(ACTUATOR_KEYS[0]) == RECORDED_ACTUATOR_COUNT,
+              "One key per actuator");
+
+LogStorage* DataRecorder::storage = nullptr;
+uint8_t DataRecorder::buffer[DataRecorder::SECTOR_SIZE];
+uint16_t DataRecorder::bufferFill = 0;
+uint16_t DataRecorder::bufferWritten = 0;
+bool DataRecorder::segmentOpen = false;
+DataRecorder::SegmentEntry DataRecorder::segment = {};
+uint32_t DataRecorder::segmentRecords = 0;
+uint16_t DataRecorder::indexEntries = 0;
+uint16_t DataRecorder::nextNumber = 1;
+uint32_t DataRecorder::nextSeq = 1;
+unsigned long DataRecorder::lastSync = 0;
+uint16_t DataRecorder::writeErrors = 0;
+uint32_t DataRecorder::backfillNext = 0;
+uint32_t DataRecorder::backfillEnd = 0;
+uint32_t DataRecorder::backfillSent = 0;
+uint32_t DataRecorder::backfillFirst = 0;
+DataRecorder::SegmentEntry DataRecorder::lookup = {};
+uint32_t DataRecorder::lookupRecords = 0;
+
+bool DataRecorder::begin(LogStorage& logStorage) {
+    if (!logStorage.begin()) {
+        Logger::log(LogLevel::WARNING, "SD card not found, data recorder disabled");
+        return false;
+    }
+    storage = &logStorage;
+    segmentOpen = false;
+    bufferFill = 0;
+    bufferWritten = 0;
+    nextNumber = 1;
+    nextSeq = 1;
+    backfillNext = 0;
+    lookup = {};
+
+    // Continue the numbering after the last segment listed in the index
+    indexEntries = storage->size(INDEX_PATH) / sizeof(SegmentEntry);
+    SegmentEntry last;
+    for (uint16_t i = indexEntries; i > 0; i--) {
+        if (readIndexEntry(i - 1, last)) {
+            char path[PATH_LENGTH];
+            segmentPath(last.number, path);
+            nextNumber = last.number + 1;
+            // Records still in the sector buffer at the reset may have been sent live: skip their
+            // numbers so that a sequence number never names two different records
+            nextSeq = last.firstSeq + storage->size(path) / RECORD_SIZE + SECTOR_SIZE / RECORD_SIZE;
+            break;
+        }
+    }
+    Logger::log(LogLevel::INFO, "Data recorder ready: " + String(indexEntries) + " segments, next record " +
+                String(nextSeq));
+    return true;
+}
+
+uint32_t DataRecorder::record(const String& label, uint8_t state, const float* values, uint8_t actuators,
+                              uint8_t sensorFaults) {
+    if (!storage) return 0;
+    String name = label.length() > 0 ? label : String("idle");
+    if (!segmentOpen || segmentRecords >= MAX_SEGMENT_RECORDS ||
+        strncmp(name.c_str(), segment.label, sizeof(segment.label) - 1) != 0) {
+        openSegment(name);
+    }
+
+    DataRecord record = {};
+    record.seq = nextSeq++;
+    record.time = SystemClock::now();
+    record.uptime = millis() / 1000;
+    for (uint8_t i = 0; i < RECORDED_SENSOR_COUNT; i++) {
+        float value = values[i] * VALUE_SCALES[i];
+        record.values[i] = (isnan(value) || value <= NO_VALUE || value > INT16_MAX) ? NO_VALUE : (int16_t)lround(value);
+    }
+    record.actuators = actuators;
+    record.sensorFaults = sensorFaults;
+    record.state = state;
+    record.crc = computeCRC(reinterpret_cast<const uint8_t*>(&record), offsetof(DataRecord, crc));
+
+    memcpy(buffer + bufferFill, &record, RECORD_SIZE);
+    bufferFill += RECORD_SIZE;
+    segmentRecords++;
+    if (bufferFill == SECTOR_SIZE || millis() - lastSync >= SYNC_INTERVAL) {
+        writeBuffer();
+    }
+    return record.seq;
+}
+
+// Appends the unwritten part of the sector buffer; a full sector starts a new buffer. A full sector that
+// could not be written is lost, and the segment file is then short of its records: the recording continues
+// in a new segment, so that record n of a segment stays at offset n * RECORD_SIZE.
+void DataRecorder::writeBuffer() {
+    lastSync = millis();
+    if (bufferFill > bufferWritten) {
+        char path[PATH_LENGTH];
+        segmentPath(segment.number, path);
+        if (storage->append(path, buffer + bufferWritten, bufferFill - bufferWritten)) {
+            bufferWritten = bufferFill;
+        } else if (writeErrors++ == 0) {
+            Logger::log(LogLevel::WARNING, "SD card write failed, records kept in RAM until the next sector");
+        }
+    }
+    if (bufferFill == SECTOR_SIZE) {
+        // The records not written are lost with the sector, the card is probably gone
+        bool lost = bufferWritten < SECTOR_SIZE;
+        bufferFill = 0;
+        bufferWritten = 0;
+        if (lost) {
+            openSegment(String(segment.label));
+        }
+    }
+}
+
+void DataRecorder::openSegment(const String& label) {
+    if (segmentOpen) writeBuffer();
+    bufferFill = 0;
+    bufferWritten = 0;
+
+    segment = {};
+    segment.magic = MAGIC;
+    segment.number = nextNumber++;
+    segment.firstSeq = nextSeq;
+    segment.startTime = SystemClock::now();
+    strncpy(segment.label, label.c_str(), sizeof(segment.label) - 1);
+    segment.crc = computeCRC(reinterpret_cast<const uint8_t*>(&segment), offsetof(SegmentEntry, crc));
+    segmentOpen = true;
+    segmentRecords = 0;
+    lastSync = millis();
+
+    if (storage->append(INDEX_PATH, reinterpret_cast<const uint8_t*>(&segment), sizeof(segment))) {
+        indexEntries++;
+    } else {
+        Logger::log(LogLevel::WARNING, "SD card index write failed");
+    }
+
+    // Rotation: keep the last MAX_SEGMENTS segment files
+    if (segment.number > MAX_SEGMENTS) {
+        char path[PATH_LENGTH];
+        segmentPath(segment.number - MAX_SEGMENTS, path);
+        storage->remove(path);
+    }
+    Logger::log(LogLevel::INFO, "Recording segment " + String(segment.number) + " (" + label + ") from record " +
+                String(segment.firstSeq));
+}
+
+bool DataRecorder::requestBackfill(uint32_t from, uint32_t to) {
+    if (!storage || from == 0 || from >= nextSeq) return false;
+    if (to == 0 || to >= nextSeq) to = nextSeq - 1;
+    if (to < from) return false;
+    backfillNext = from;
+    backfillFirst = from;
+    backfillEnd = to;
+    backfillSent = 0;
+    Logger::log(LogLevel::INFO, "Backfill of records " + String(from) + " to " + String(to));
+    return true;
+}
+
+void DataRecorder::update() {
+    if (!storage || backfillNext == 0) return;
+    DataRecord record;
+    const char* program;
+    for (uint8_t i = 0; i < BACKFILL_PER_UPDATE && backfillNext <= backfillEnd; i++, backfillNext++) {
+        if (readRecord(backfillNext, record, program)) {
+            sendRecord(record, program);
+            backfillSent++;
+        }
+    }
+    if (backfillNext > backfillEnd) {
+        Serial.println("{\"ev\":\"backfill_end\",\"from\":" + String(backfillFirst) + ",\"to\":" + String(backfillEnd) +
+                       ",\"sent\":" + String(backfillSent) + "}");
+        backfillNext = 0;
+    }
+}
+
+// Sends a record with the keys of the live telemetry (Logger::logData), so the bridge and the server
+// handle both the same way. The program is the label of the segment, truncated to its 17 characters.
+// The line is built by hand, like backfill_end, rather than in a 384-byte JSON document on the stack.
+void DataRecorder::sendRecord(const DataRecord& record, const char* program) {
+    String output = "{\"ev\":\"backfill\",\"seq\":" + String(record.seq) + ",\"t\":" + String(record.time) +
+                    ",\"up\":" + String(record.uptime) + ",\"program\":\"";
+    for (const char* c = program; *c; c++) {
+        if (*c == '"' || *c == '\\') output += '\\';
+        output += *c;
+    }
+    output += "\",\"status\":\"" + String(record.state) + "\"";
+    for (uint8_t i = 0; i < RECORDED_ACTUATOR_COUNT; i++) {
+        output += ",\"" + String(ACTUATOR_KEYS[i]) + "\":" + String((record.actuators >> i) & 1);
+    }
+    output += ",\"sensorFaults\":" + String(record.sensorFaults);
+    for (uint8_t i = 0; i < RECORDED_SENSOR_COUNT; i++) {
+        output += ",\"" + String(VALUE_KEYS[i]) + "\":";
+        if (record.values[i] == NO_VALUE) {
+            output += "null";
+        } else {
+            output += String(record.values[i] / VALUE_SCALES[i], VALUE_SCALES[i] >= 100 ? 2 : 0);
+        }
+    }
+    output += "}";
+    Serial.println(output);
+}
+
+bool DataRecorder::readRecord(uint32_t seq, DataRecord& record, const char*& label) {
+    if (segmentOpen && seq >= segment.firstSeq) {
+        label = segment.label;
+        // Current segment: the records of the current sector may still be in the buffer only
+        uint32_t offset = (seq - segment.firstSeq) * RECORD_SIZE;
+        uint32_t sectorStart = (segmentRecords * RECORD_SIZE) - bufferFill;
+        if (offset >= sectorStart) {
+            if (offset - sectorStart >= bufferFill) return false;
+            memcpy(&record, buffer + (offset - sectorStart), RECORD_SIZE);
+        } else {
+            char path[PATH_LENGTH];
+            segmentPath(segment.number, path);
+            if (!storage->read(path, offset, reinterpret_cast<uint8_t*>(&record), RECORD_SIZE)) return false;
+        }
+    } else {
+        if (!findSegment(seq)) return false;
+        label = lookup.label;
+        char path[PATH_LENGTH];
+        segmentPath(lookup.number, path);
+        if (!storage->read(path, (seq - lookup.firstSeq) * RECORD_SIZE, reinterpret_cast<uint8_t*>(&record),
+                           RECORD_SIZE)) {
+            return false;
+        }
+    }
+    return record.seq == seq &&
+           record.crc == computeCRC(reinterpret_cast<const uint8_t*>(&record), offsetof(DataRecord, crc));
+}
+
+// Finds the segment holding a record (searching the index from the end), cached for the next lookups
+bool DataRecorder::findSegment(uint32_t seq) {
+    if (lookup.magic == MAGIC && seq >= lookup.firstSeq && seq < lookup.firstSeq + lookupRecords) return true;
+    SegmentEntry entry;
+    for (uint16_t i = indexEntries; i > 0; i--) {
+        if (readIndexEntry(i - 1, entry) && entry.firstSeq <= seq) {
+            char path[PATH_LENGTH];
+            segmentPath(entry.number, path);
+            lookup = entry;
+            lookupRecords = storage->size(path) / RECORD_SIZE;   // 0 once the segment was rotated out
+            return seq < lookup.firstSeq + lookupRecords;
+        }
+    }
+    return false;
+}
+
+bool DataRecorder::readIndexEntry(uint16_t index, SegmentEntry& entry) {
+    return storage->read(INDEX_PATH, (uint32_t)index * sizeof(SegmentEntry), reinterpret_cast<uint8_t*>(&entry),
+                         sizeof(SegmentEntry)) &&
+           entry.magic == MAGIC &&
+           entry.crc == computeCRC(reinterpret_cast<const uint8_t*>(&entry), offsetof(SegmentEntry, crc));
+}
+
+void DataRecorder::logStatus() {
+    if (!storage) {
+        Logger::log(LogLevel::INFO, "Data recorder disabled (no SD card)");
+        return;
+    }
+    Logger::log(LogLevel::INFO, "Data recorder: segment " + String(segment.number) + " (" + String(segment.label) +
+                "), records " + String(segment.firstSeq) + " to " + String(nextSeq - 1) + ", " +
+                String(bufferFill - bufferWritten) + " bytes not yet written, " + String(writeErrors) +
+                " write errors");
+    if (backfillNext != 0) {
+        Logger::log(LogLevel::INFO, "Backfill in progress: record " + String(backfillNext) + " of " + String(backfillEnd));
+    }
+}
+
+void DataRecorder::segmentPath(uint16_t number, char* path) {
+    snprintf(path, PATH_LENGTH, "LOG%05u.BIN", number);
+}
+
+// CRC-16/MODBUS
+uint16_t DataRecorder::computeCRC(const uint8_t* bytes, uint8_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < length; i++) {
+        crc = _crc16_update(crc, bytes[i]);
+    }
+    return crc;
+}
@@ -0,0 +1,117 @@
+// DataRecorder.h
+#ifndef DATA_RECORDER_H
+#define DATA_RECORDER_H
+
+#include <Arduino.h>
+#include <logger/Logger.h>
+#include <logger/LogStorage.h>
+
+// Values and states of one record, in SensorId and ActuatorId order (checked against them in Main.ino).
+// The recorder does not read the controllers, so it also builds on a host (tools/recorder_check.cpp).
+const uint8_t RECORDED_SENSOR_COUNT = 7;
+const uint8_t RECORDED_ACTUATOR_COUNT = 8;
+
+// One telemetry sample as stored on the card. Records have a fixed size, so record n of a
+// segment file is at offset n * sizeof(DataRecord) and a sector holds a whole number of records.
+struct DataRecord {
+    uint32_t seq;            // Sequence number, increasing across segments and resets (0 = none)
+    uint32_t time;           // Unix time, 0 if the clock was not set
+    uint32_t uptime;         // Seconds since boot
+    int16_t values[RECORDED_SENSOR_COUNT];  // Scaled sensor values, NO_VALUE if masked
+    uint8_t actuators;       // Actuators drawing power (bit per ActuatorId, see getOutputMask)
+    uint8_t sensorFaults;    // Faulted sensors (bit per SensorId)
+    uint8_t state;           // ProgramState
+    uint8_t reserved;
+    uint16_t crc;            // CRC-16/MODBUS of the record, CRC field excluded
+};
+
+// Local binary log of the telemetry on an SD card, so the data sent while the ESP32 or the WiFi
+// is down can be sent again later (backfill).
+//
+// Records are collected in a RAM buffer mirroring the current 512-byte sector of the file: a full
+// sector is appended in one write, and the partial sector is also appended every SYNC_INTERVAL so
+// a power cut loses at most that much data. Appends never cross a sector boundary.
+//
+// Each experiment (set of running programs) gets its own segment file LOGnnnnn.BIN; a segment is
+// also rotated when it reaches MAX_SEGMENT_RECORDS, and the oldest segments are deleted beyond
+// MAX_SEGMENTS. INDEX.BIN lists the segments (number, first sequence number, start time, label)
+// and is only ever appended to. The number of records of a segment follows from its file size.
+class DataRecorder {
+public:
+    // Mounts the storage and reads the index (as after a reset); recording stays off if it fails
+    static bool begin(LogStorage& storage);
+    static bool isEnabled() { return storage != nullptr; }
+
+    // Stores one record of the sensor samples (RECORDED_SENSOR_COUNT values, NaN if masked) and actuator
+    // states; starts a new segment when the label (running programs) changes. Returns the sequence number,
+    // 0 if not recorded.
+    static uint32_t record(const String& label, uint8_t state, const float* values, uint8_t actuators,
+                           uint8_t sensorFaults);
+
+    // Streams the requested records, a few per call (call once per loop)
+    static void update();
+
+    // Queues records [from, to] to be sent again as {"ev":"backfill",...} lines; to = 0 means up to the last one
+    static bool requestBackfill(uint32_t from, uint32_t to);
+
+    static uint32_t getLastSeq() { return nextSeq - 1; }
+    static void logStatus();
+
+    static const int16_t NO_VALUE = INT16_MIN;
+    static const uint32_t MAX_SEGMENT_RECORDS = 32768;          // 1 MiB per segment (11 days at 30 s)
+    static const uint16_t MAX_SEGMENTS = 200;
+    static const unsigned long SYNC_INTERVAL = 300000;          // 5 minutes
+
+private:
+    struct SegmentEntry {
+        uint16_t magic;
+        uint16_t number;         // Segment file LOGnnnnn.BIN
+        uint32_t firstSeq;
+        uint32_t startTime;      // Unix time, 0 if the clock was not set
+        char label[18];
+        uint16_t crc;
+    };
+
+    static const uint16_t MAGIC = 0xDA7A;
+    static const uint16_t SECTOR_SIZE = 512;
+    static const uint8_t RECORD_SIZE = 32;
+    static const uint8_t BACKFILL_PER_UPDATE = 4;
+    static const uint8_t PATH_LENGTH = 13;
+
+    static_assert(sizeof(DataRecord) == RECORD_SIZE, "Data records must be 32 bytes");
+    static_assert(sizeof(SegmentEntry) == 32, "Index entries must be 32 bytes");
+    static_assert(SECTOR_SIZE % RECORD_SIZE == 0, "Records must not straddle sectors");
+    static_assert(RECORDED_ACTUATOR_COUNT <= 8, "Actuator states must fit in a byte");
+
+    static LogStorage* storage;
+    static uint8_t buffer[SECTOR_SIZE];
+    static uint16_t bufferFill;        // Bytes of the current sector held in the buffer
+    static uint16_t bufferWritten;     // Bytes of the buffer already appended to the file
+    static bool segmentOpen;
+    static SegmentEntry segment;       // Current segment
+    static uint32_t segmentRecords;
+    static uint16_t indexEntries;
+    static uint16_t nextNumber;
+    static uint32_t nextSeq;
+    static unsigned long lastSync;
+    static uint16_t writeErrors;
+
+    // Backfill in progress, with the segment of the last lookup cached
+    static uint32_t backfillNext;
+    static uint32_t backfillEnd;
+    static uint32_t backfillSent;
+    static uint32_t backfillFirst;
+    static SegmentEntry lookup;
+    static uint32_t lookupRecords;
+
+    static void openSegment(const String& label);
+    static void writeBuffer();
+    static bool readRecord(uint32_t seq, DataRecord& record, const char*& label);
+    static bool readIndexEntry(uint16_t index, SegmentEntry& entry);
+    static bool findSegment(uint32_t seq);
+    static void sendRecord(const DataRecord& record, const char* program);
+    static void segmentPath(uint16_t number, char* path);
+    static uint16_t computeCRC(const uint8_t* bytes, uint8_t length);
+};
+
+#endif // DATA_RECORDER_H
@@ -18,6 +18,8 @@ public:
     bool isPaused() const override { return _isPaused; }
     String getName() const { return "Drain"; }
     void parseCommand(const String& command) override;
+    ActuatorMask getActuatorMask(const String& command) const override { return actuatorBit(ActuatorId::DRAIN_PUMP); }
+    uint8_t getPriority() const override { return PRIORITY_LOW; }
 
 private:
     int rate;
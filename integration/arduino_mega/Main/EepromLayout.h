@@ -0,0 +1,39 @@
+// EepromLayout.h
+#ifndef EEPROM_LAYOUT_H
+#define EEPROM_LAYOUT_H
+
+#include <Arduino.h>
+
+// Map of the ATmega2560 EEPROM (4096 bytes). Every module persisting data gets its own region here
+// so that regions never overlap. Keep integration/arduino_mega/tools/eeprom_tool.py in sync when changing this file.
+
+// 0x000 - 0x03F: reserved, DFRobot_PH stores its calibration voltages at 0x00 - 0x07
+const uint16_t EEPROM_PH_CALIBRATION_ADDR = 0x000;
+
+// 0x040 - 0x1FF: controller parameters (ParameterStore), rotating slots for wear leveling
+const uint16_t EEPROM_PARAMS_ADDR = 0x040;
+const uint8_t EEPROM_PARAMS_SLOT_COUNT = 4;
+const uint16_t EEPROM_PARAMS_SLOT_SIZE = 96;
+
+// 0x200 - 0x5FF: volume ledger (VolumeLedger), two snapshot slots followed by the journal
+const uint16_t EEPROM_LEDGER_SNAPSHOT_ADDR = 0x200;
+const uint16_t EEPROM_LEDGER_SNAPSHOT_SIZE = 32;
+const uint16_t EEPROM_LEDGER_JOURNAL_ADDR = 0x240;
+const uint8_t EEPROM_LEDGER_JOURNAL_ENTRIES = 120;   // 8-byte entries, up to 0x5FF
+
+// 0x600 - 0x7FF: checkpoint of the running program (ProgramCheckpoint), rotating slots for wear leveling
+const uint16_t EEPROM_CHECKPOINT_ADDR = 0x600;
+const uint8_t EEPROM_CHECKPOINT_SLOT_COUNT = 4;
+const uint16_t EEPROM_CHECKPOINT_SLOT_SIZE = 128;
+
+// 0x800 - 0xBFF: fermentation recipe bytecode (RecipeStore), header followed by the code
+const uint16_t EEPROM_RECIPE_ADDR = 0x800;
+const uint16_t EEPROM_RECIPE_SIZE = 1024;
+
+// 0xC00 - 0xC1F: cause of the last reset (Watchdog), written by the watchdog interrupt before a reset
+const uint16_t EEPROM_RESET_CAUSE_ADDR = 0xC00;
+const uint16_t EEPROM_RESET_CAUSE_SIZE = 32;
+
+const uint16_t EEPROM_SIZE = 4096;
+
+#endif // EEPROM_LAYOUT_H
@@ -1,14 +1,150 @@
 #include "ErrorHandler.h"
 
+// Indexed by SensorId: min, max, sentinel, spike floor, flatline samples, stale seconds.
+// The DS18B20 reads 85 °C after a power glitch and the DS18B20 and SEN0554 readings are coarsely
+// quantized, so they are not checked for flatlines. The analog channels always carry some noise.
+const SensorHealthConfig ErrorHandler::CONFIG[ErrorHandler::SENSOR_COUNT] = {
+    /* WATER_TEMP */      {-10.0, 110.0, -1000.0, 2.0, 600, 10},
+    /* AIR_TEMP */        {-40.0, 84.0, -1000.0, 3.0, 0, 15},
+    /* ELECTRONIC_TEMP */ {-40.0, 84.0, -1000.0, 3.0, 0, 15},
+    /* PH */              {0.0, 14.0, -1000.0, 0.5, 600, 10},
+    /* OXYGEN */          {0.0, 20000.0, -1000.0, 1000.0, 600, 10},   // ug/L
+    /* AIR_FLOW */        {0.0, 30.0, -1.0, 2.0, 0, 30},
+    /* TURBIDITY */       {0.0, 10000.0, -1.0, 50.0, 0, 15},
+};
+
+ErrorHandler::ChannelState ErrorHandler::channels[ErrorHandler::SENSOR_COUNT] = {};
+
 void ErrorHandler::handleError(const String& errorMessage) {
     Logger::log(LogLevel::ERROR, "ERROR: " + errorMessage);
     // Add error handling logic here (e.g. emergency stop)
 }
 
+// Staleness: a channel without a valid sample for too long is faulted
 void ErrorHandler::checkSensorResponses() {
-    // Implement the logic to check that all sensors respond correctly
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        ChannelState& channel = channels[i];
+        if (channel.lastGoodTime == 0) {
+            channel.lastGoodTime = now;     // Start counting from the first check (setup takes a while)
+        } else if (channel.health != SensorHealth::FAULT && now - channel.lastGoodTime > CONFIG[i].staleSeconds * 1000UL) {
+            channel.goodCount = 0;
+            setHealth(static_cast<SensorId>(i), SensorHealth::FAULT, SensorFault::STALE);
+        }
+    }
 }
 
 void ErrorHandler::checkActuatorResponses() {
     // Implement the logic to check that all actuators respond correctly
-}
\ No newline at end of file
+}
+
+bool ErrorHandler::checkSample(SensorId id, float& value, unsigned long now) {
+    uint8_t index = static_cast<uint8_t>(id);
+    if (index >= SENSOR_COUNT) return true;
+    const SensorHealthConfig& config = CONFIG[index];
+    ChannelState& channel = channels[index];
+
+    SensorFault sampleFault = SensorFault::NONE;
+    if (isnan(value) || value == config.sentinel) {
+        sampleFault = SensorFault::SENTINEL;
+    } else if (value < config.minValue || value > config.maxValue) {
+        sampleFault = SensorFault::RANGE;
+    } else {
+        if (channel.seeded && fabs(value - channel.mean) > SPIKE_SIGMA * sqrt(channel.variance) + config.spikeFloor) {
+            if (++channel.spikeCount < SPIKE_CONFIRM) {
+                sampleFault = SensorFault::SPIKE;
+            } else {
+                channel.seeded = false;     // Persistent jump: restart the stats from the new level
+                channel.spikeCount = 0;
+            }
+        } else {
+            channel.spikeCount = 0;
+        }
+        if (config.flatlineSamples > 0 && channel.seeded && value == channel.lastValue) {
+            if (channel.flatCount < UINT16_MAX) channel.flatCount++;
+            if (channel.flatCount >= config.flatlineSamples) {
+                sampleFault = SensorFault::FLATLINE;
+            }
+        } else {
+            channel.flatCount = 0;
+        }
+        channel.lastValue = value;
+    }
+
+    if (sampleFault == SensorFault::NONE) {
+        if (!channel.seeded) {
+            channel.mean = value;
+            channel.variance = 0;
+            channel.seeded = true;
+        } else {
+            float delta = value - channel.mean;
+            channel.mean += STATS_ALPHA * delta;
+            channel.variance = (1 - STATS_ALPHA) * (channel.variance + STATS_ALPHA * delta * delta);
+        }
+        channel.lastGoodTime = now;
+        channel.lastGoodValue = value;
+        channel.hasGoodValue = true;
+        channel.badCount = 0;
+        if (channel.health == SensorHealth::SUSPECT) {
+            setHealth(id, SensorHealth::OK, SensorFault::NONE);
+        } else if (channel.health == SensorHealth::FAULT && ++channel.goodCount >= RECOVER_CONFIRM) {
+            setHealth(id, SensorHealth::OK, SensorFault::NONE);
+        }
+        return channel.health != SensorHealth::FAULT;
+    }
+
+    channel.goodCount = 0;
+    if (channel.badCount < 255) channel.badCount++;
+    if (channel.health != SensorHealth::FAULT) {
+        setHealth(id, channel.badCount >= FAULT_CONFIRM ? SensorHealth::FAULT : SensorHealth::SUSPECT, sampleFault);
+    }
+    if (channel.health == SensorHealth::FAULT) {
+        return false;
+    }
+    // A single bad sample does not stop the controllers: they keep the last good value until a fault
+    value = channel.hasGoodValue ? channel.lastGoodValue : NAN;
+    return true;
+}
+
+void ErrorHandler::setHealth(SensorId id, SensorHealth health, SensorFault fault) {
+    ChannelState& channel = channels[static_cast<uint8_t>(id)];
+    SensorHealth previous = channel.health;
+    channel.health = health;
+    channel.fault = fault;
+    const char* name = SensorController::getSensor(id) ? SensorController::getSensor(id)->getName() : "sensor";
+    if (health == SensorHealth::FAULT && previous != SensorHealth::FAULT) {
+        Logger::log(LogLevel::WARNING, String(name) + " faulted (" + getFaultName(fault) + "), masked from the controllers");
+    } else if (health == SensorHealth::OK && previous == SensorHealth::FAULT) {
+        Logger::log(LogLevel::INFO, String(name) + " recovered");
+    }
+}
+
+uint8_t ErrorHandler::getFaultMask() {
+    uint8_t mask = 0;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        if (channels[i].health == SensorHealth::FAULT) mask |= 1 << i;
+    }
+    return mask;
+}
+
+void ErrorHandler::logSensorHealth() {
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        const ChannelState& channel = channels[i];
+        SensorInterface* sensor = SensorController::getSensor(static_cast<SensorId>(i));
+        const char* state = channel.health == SensorHealth::OK ? "ok" : channel.health == SensorHealth::SUSPECT ? "suspect" : "fault";
+        Logger::log(LogLevel::INFO, String(sensor ? sensor->getName() : "sensor") + ": " + state +
+                    (channel.fault != SensorFault::NONE ? String(" (") + getFaultName(channel.fault) + ")" : String("")) +
+                    ", mean " + String(channel.mean) + ", std " + String(sqrt(channel.variance)));
+    }
+}
+
+const char* ErrorHandler::getFaultName(SensorFault fault) {
+    switch (fault) {
+        case SensorFault::SENTINEL: return "error value";
+        case SensorFault::RANGE: return "out of range";
+        case SensorFault::SPIKE: return "spike";
+        case SensorFault::FLATLINE: return "flatline";
+        case SensorFault::STALE: return "stale";
+        default: return "none";
+    }
+}
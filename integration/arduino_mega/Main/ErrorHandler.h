@@ -3,12 +3,82 @@
 
 #include <Arduino.h>
 #include <logger/Logger.h>
+#include "SensorController.h"
+
+enum class SensorHealth : uint8_t {
+    OK,
+    SUSPECT,    // Last sample rejected, not faulted yet: the last good value is held
+    FAULT       // Masked: SensorController reads NaN until the channel recovers
+};
+
+enum class SensorFault : uint8_t {
+    NONE,
+    SENTINEL,   // Error value returned by the driver (-1000 DS18B20, -1 SEN0554 / air flow)
+    RANGE,      // Outside the physical range of the sensor
+    SPIKE,      // Far from the rolling mean (a persistent jump is accepted as a level change)
+    FLATLINE,   // Exactly the same value for too many samples (stuck ADC or bus)
+    STALE       // No valid sample for too long
+};
+
+// Limits of one sensor channel for the health monitor
+struct SensorHealthConfig {
+    float minValue;
+    float maxValue;
+    float sentinel;
+    float spikeFloor;          // Minimum deviation from the mean counted as a spike (sensor units)
+    uint16_t flatlineSamples;  // Identical samples before a flatline fault, 0 = not checked
+    uint8_t staleSeconds;
+};
 
 class ErrorHandler {
 public:
     static void handleError(const String& errorMessage);
     static void checkSensorResponses();
     static void checkActuatorResponses();
+
+    // Runs one sample through the health state machine of its channel (called by SensorController
+    // for every reading). A rejected sample on a channel that is not faulted yet is replaced by the last
+    // good value (NaN if there is none). Returns false once the channel is faulted: it must be masked.
+    static bool checkSample(SensorId id, float& value, unsigned long now);
+
+    static bool isHealthy(SensorId id) { return channels[static_cast<uint8_t>(id)].health != SensorHealth::FAULT; }
+    static SensorHealth getHealth(SensorId id) { return channels[static_cast<uint8_t>(id)].health; }
+    static SensorFault getFault(SensorId id) { return channels[static_cast<uint8_t>(id)].fault; }
+
+    // Bit per SensorId, set while the channel is faulted (sent with the telemetry)
+    static uint8_t getFaultMask();
+    static void logSensorHealth();
+    static const char* getFaultName(SensorFault fault);
+
+private:
+    // Rolling statistics in constant memory: exponentially weighted mean and variance
+    struct ChannelState {
+        float mean;
+        float variance;
+        float lastValue;
+        float lastGoodValue;   // Held while the channel is SUSPECT
+        bool hasGoodValue;
+        unsigned long lastGoodTime;
+        uint16_t flatCount;
+        uint8_t badCount;      // Consecutive rejected samples
+        uint8_t goodCount;     // Consecutive valid samples while faulted
+        uint8_t spikeCount;
+        bool seeded;
+        SensorHealth health;
+        SensorFault fault;
+    };
+
+    static const uint8_t SENSOR_COUNT = static_cast<uint8_t>(SensorId::COUNT);
+    static constexpr float STATS_ALPHA = 0.1;    // Weight of a new sample in the rolling stats
+    static constexpr float SPIKE_SIGMA = 6.0;    // Spike threshold in standard deviations (plus the floor)
+    static const uint8_t SPIKE_CONFIRM = 3;      // Consecutive spikes accepted as a level change
+    static const uint8_t FAULT_CONFIRM = 3;      // Consecutive rejected samples before a fault
+    static const uint8_t RECOVER_CONFIRM = 5;    // Consecutive valid samples to clear a fault
+
+    static const SensorHealthConfig CONFIG[SENSOR_COUNT];
+    static ChannelState channels[SENSOR_COUNT];
+
+    static void setHealth(SensorId id, SensorHealth health, SensorFault fault);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -14,6 +14,10 @@ FermentationProgram::FermentationProgram(PIDManager& pidManager, VolumeManager&
       duration(0),
       startTime(0),
       pauseStartTime(0),
+      currentStirringSpeed(0),
+      nutrientFixedFlowRate(0),
+      lastNutrientActivationTime(0),
+      isAddingNutrients(false),
       isPIDEnabled(false) //PID activated by default ; false/true
 {
 }
@@ -170,6 +174,95 @@ void FermentationProgram::parseCommand(const String& command) {
     comment = String(comm);
 }
 
+// PID loops (heating plate, base pump, air pump), stirring and nutrient feeding
+ActuatorMask FermentationProgram::getActuatorMask(const String& command) const {
+    return actuatorBit(ActuatorId::HEATING_PLATE) | actuatorBit(ActuatorId::BASE_PUMP) | actuatorBit(ActuatorId::AIR_PUMP) |
+           actuatorBit(ActuatorId::STIRRING_MOTOR) | actuatorBit(ActuatorId::NUTRIENT_PUMP);
+}
+
+// Checkpoint payload: configuration, elapsed run time and the state of the nutrient phase
+bool FermentationProgram::saveCheckpoint(CheckpointWriter& writer) const {
+    if (!_isRunning) return false;
+    unsigned long now = millis();
+    uint32_t elapsed = (_isPaused ? pauseStartTime : now) - startTime - totalPauseTime;
+    uint32_t nutrientPhaseElapsed = now - lastNutrientActivationTime;
+    uint8_t flags = (_isPaused ? 0x01 : 0) | (isPIDEnabled ? 0x02 : 0) | (isAddingNutrients ? 0x04 : 0);
+
+    writer.write(tempSetpoint);
+    writer.write(phSetpoint);
+    writer.write(doSetpoint);
+    writer.write(nutrientConc);
+    writer.write(baseConc);
+    writer.write(nutrientFixedFlowRate);
+    writer.write(static_cast<int32_t>(duration));
+    writer.write(elapsed);
+    writer.write(nutrientPhaseElapsed);
+    writer.write(static_cast<int16_t>(currentStirringSpeed));
+    writer.write(flags);
+    writer.writeString(experimentName, CHECKPOINT_STRING_LENGTH);
+    writer.writeString(comment, CHECKPOINT_STRING_LENGTH);
+    return true;
+}
+
+bool FermentationProgram::restoreCheckpoint(CheckpointReader& reader) {
+    float temp, ph, dissolvedOxygen, nutrient, base, fixedFlowRate;
+    int32_t savedDuration;
+    uint32_t elapsed, nutrientPhaseElapsed;
+    int16_t stirringSpeed;
+    uint8_t flags;
+    String name, savedComment;
+
+    reader.read(temp);
+    reader.read(ph);
+    reader.read(dissolvedOxygen);
+    reader.read(nutrient);
+    reader.read(base);
+    reader.read(fixedFlowRate);
+    reader.read(savedDuration);
+    reader.read(elapsed);
+    reader.read(nutrientPhaseElapsed);
+    reader.read(stirringSpeed);
+    reader.read(flags);
+    reader.readString(name);
+    reader.readString(savedComment);
+    if (!reader.ok()) {
+        Logger::log(LogLevel::ERROR, "Invalid fermentation checkpoint");
+        return false;
+    }
+
+    configure(temp, ph, dissolvedOxygen, nutrient, base, savedDuration, name, savedComment);
+    nutrientFixedFlowRate = fixedFlowRate;
+    isPIDEnabled = flags & 0x02;
+
+    // Continue the run where it was checkpointed; the time the board was off is not counted
+    unsigned long now = millis();
+    _isRunning = true;
+    _isPaused = false;
+    startTime = now - elapsed;
+    totalPauseTime = 0;
+    lastNutrientActivationTime = now - nutrientPhaseElapsed;
+    isAddingNutrients = flags & 0x04;
+
+    currentStirringSpeed = stirringSpeed;
+    pidManager.setMinStirringSpeed(currentStirringSpeed);
+    ActuatorController::runActuator("stirringMotor", currentStirringSpeed, 0);
+    pidManager.startTemperaturePID(tempSetpoint);
+    pidManager.startPHPID(phSetpoint);
+    pidManager.startDOPID(doSetpoint);
+
+    // The nutrient pump runs until update() ends the activation period
+    if (isAddingNutrients) {
+        ActuatorController::runActuator("nutrientPump", nutrientFixedFlowRate, 0);
+    }
+    if (flags & 0x01) {
+        pause();
+    }
+
+    Logger::log(LogLevel::INFO, "Fermentation resumed from checkpoint: " + experimentName + ", elapsed " +
+                String(elapsed / 1000) + " s of " + String(duration) + " s");
+    return true;
+}
+
 void FermentationProgram::addNutrientsContinuously() {
     // Calculate elapsed time in hours
     float elapsedTime = (millis() - startTime) / 3600000.0;
@@ -183,10 +276,8 @@ void FermentationProgram::addNutrientsContinuously() {
         float maxFlowRate = ActuatorController::getPumpMaxFlowRate("nutrientPump");
         // Calculate how long the pump should run to add the desired amount of nutrients
         float pumpDuration = (nutrientToAddNow / maxFlowRate) * 60000; // Convert to milliseconds
-        // Activate the nutrient pump
+        // Activate the nutrient pump (the pump accounts the volume it delivers); ActuatorController::update() stops it
         ActuatorController::runActuator("nutrientPump", maxFlowRate, pumpDuration);
-        // Record the volume change
-        volumeManager.recordVolumeChange(nutrientToAddNow, "Nutrient");
         Logger::log(LogLevel::INFO, "Added nutrients: " + String(nutrientToAddNow) + " ml");
     } else {
         Logger::log(LogLevel::WARNING, "Cannot add nutrients: Volume limit reached");
@@ -222,13 +313,13 @@ void FermentationProgram::addNutrientsContinuouslyFixedRate(float fixedFlowRate)
         Logger::log(LogLevel::INFO, "Fermentation stopped: Volume limit reached or duration exceeded");
         return;
     }
-    // Calculate the amount of nutrient to add
-    float availableVolume = maxAllowedVolume - currentVolume;
+    // Calculate the amount of nutrient to add (ml)
+    float availableVolume = (maxAllowedVolume - currentVolume) * 1000.0;
     float nutrientToAdd = min((fixedFlowRate * NUTRIENT_ACTIVATION_TIME / 60000.0), availableVolume);
-    // Start adding nutrients if there's room
+    // Start adding nutrients if there's room (the pump accounts the volume it delivers)
     if (nutrientToAdd > 0) {
-        ActuatorController::runActuator("nutrientPump", fixedFlowRate, NUTRIENT_ACTIVATION_TIME);
-        volumeManager.recordVolumeChange(nutrientToAdd, "Nutrient");
+        // Stopped above once NUTRIENT_ACTIVATION_TIME has elapsed, without blocking the loop
+        ActuatorController::runActuator("nutrientPump", fixedFlowRate, 0);
         Logger::log(LogLevel::INFO, "Started adding nutrients: " + String(nutrientToAdd) + " ml");
         isAddingNutrients = true;
         lastNutrientActivationTime = currentTime;
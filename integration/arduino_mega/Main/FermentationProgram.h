@@ -24,6 +24,9 @@ public:
     bool isPaused() const override { return _isPaused; }
     String getName() const override { return "Fermentation"; }
     void parseCommand(const String& command) override;
+    ActuatorMask getActuatorMask(const String& command) const override;
+    bool saveCheckpoint(CheckpointWriter& writer) const override;
+    bool restoreCheckpoint(CheckpointReader& reader) override;
     void initializeStirringSpeed();
     void setNutrientFixedFlowRate(float rate) { nutrientFixedFlowRate = rate; }
 
@@ -63,6 +66,11 @@ private:
     bool isPIDEnabled;
 
     static const int MIN_STIRRING_SPEED = 500;
+    static const uint8_t CHECKPOINT_STRING_LENGTH = 12; // Characters of the experiment name/comment kept in checkpoints
+    // Setpoints, concentrations and flow rate, duration, elapsed times, stirring speed and flags
+    static const uint8_t CHECKPOINT_FIELDS_SIZE = 6 * sizeof(float) + sizeof(int32_t) + 2 * sizeof(uint32_t) + sizeof(int16_t) + sizeof(uint8_t);
+    static_assert(CHECKPOINT_FIELDS_SIZE + 2 * (1 + CHECKPOINT_STRING_LENGTH) <= ProgramCheckpoint::MAX_PAYLOAD,
+                  "Fermentation checkpoint with the longest name and comment does not fit in the payload");
 };
 
 #endif // FERMENTATION_PROGRAM_H
\ No newline at end of file
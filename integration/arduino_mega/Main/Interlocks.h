@@ -0,0 +1,42 @@
+// Interlocks.h
+#ifndef INTERLOCKS_H
+#define INTERLOCKS_H
+
+#include "ActuatorController.h"
+
+// Interlock of one actuator: the actuators it may not run with, and the conditions it requires
+struct Interlock {
+    ActuatorMask excludes;
+    InterlockConditions requiredConditions;
+};
+
+// Interlock matrix, indexed by ActuatorId. ActuatorController::runActuator() consults it in O(1):
+// the running actuators and the met conditions are kept as bit masks.
+constexpr Interlock INTERLOCKS[] = {
+    /* AIR_PUMP */       {ACTUATOR_MASK_NONE, INTERLOCK_NONE},
+    /* DRAIN_PUMP */     {actuatorBit(ActuatorId::NUTRIENT_PUMP) | actuatorBit(ActuatorId::BASE_PUMP), INTERLOCK_NONE},
+    /* SAMPLE_PUMP */    {ACTUATOR_MASK_NONE, INTERLOCK_NONE},
+    /* NUTRIENT_PUMP */  {actuatorBit(ActuatorId::DRAIN_PUMP), INTERLOCK_NONE},  // Would fight the drain pump
+    /* BASE_PUMP */      {actuatorBit(ActuatorId::DRAIN_PUMP), INTERLOCK_NONE},
+    /* STIRRING_MOTOR */ {ACTUATOR_MASK_NONE, INTERLOCK_NONE},
+    /* HEATING_PLATE */  {ACTUATOR_MASK_NONE, INTERLOCK_VOLUME_ABOVE_MIN | INTERLOCK_STIRRING_ON},  // No dry or unstirred heating
+    /* LED_GROW_LIGHT */ {ACTUATOR_MASK_NONE, INTERLOCK_NONE},
+};
+
+static_assert(sizeof(INTERLOCKS) / sizeof(INTERLOCKS[0]) == static_cast<uint8_t>(ActuatorId::COUNT),
+              "One interlock per actuator");
+
+// Compile-time checks of the matrix: exclusions are mutual, and no actuator excludes itself
+constexpr bool interlockExcludes(uint8_t a, uint8_t b) {
+    return (INTERLOCKS[a].excludes >> b) & 1;
+}
+
+constexpr bool interlocksConsistent(uint8_t a = 0, uint8_t b = 0) {
+    return a >= static_cast<uint8_t>(ActuatorId::COUNT) ? true
+         : b >= static_cast<uint8_t>(ActuatorId::COUNT) ? interlocksConsistent(a + 1, 0)
+         : interlockExcludes(a, b) == interlockExcludes(b, a) && !interlockExcludes(a, a) && interlocksConsistent(a, b + 1);
+}
+
+static_assert(interlocksConsistent(), "Interlock exclusions must be mutual and may not exclude the actuator itself");
+
+#endif // INTERLOCKS_H
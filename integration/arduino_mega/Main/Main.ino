@@ -30,11 +30,16 @@
 #include "PIDManager.h"
 #include "CommandHandler.h"
 #include "Communication.h"
+#include "Watchdog.h"
+#include "ErrorHandler.h"
+#include "DataRecorder.h"
+#include <logger/SdLogStorage.h>
 
 #include "TestsProgram.h"
 #include "DrainProgram.h"
 #include "MixProgram.h"
 #include "FermentationProgram.h"
+#include "RecipeProgram.h"
 
 // Define serial port for communication with ESP32
 #define SerialESP Serial1
@@ -58,9 +63,19 @@ DCPump samplePump(3, 28, 15, "samplePump");// Sample pump (PWM: 3, Relay: 28, Mi
 PeristalticPump nutrientPump(0x61, 7, 1, 105.0, "nutrientPump"); // Nutrient pump (I2C: 0x61, Relay: 7, Min flow: 1, Max flow: 105.0)
 PeristalticPump basePump(0x60, 8, 1, 105.0, "basePump");         // Base pump (I2C: 0x60, Relay: 8, Min flow: 1, Max flow: 105.0)
 StirringMotor stirringMotor(9, 10, 390, 1000,"stirringMotor");   // Stirring motor (PWM: 9, Relay: 10, Min RPM: 390, Max RPM: 1000)
-HeatingPlate heatingPlate(12, false, "heatingPlate");            // Heating plate (Relay: 12, Not PWM capable)
+HeatingPlate heatingPlate(12, false, 100.0, "heatingPlate");     // Heating plate (Relay: 12, Not PWM capable, Rated power: 100 W)
 LEDGrowLight ledGrowLight(27, "ledGrowLight");                   // LED grow light (Relay: 27)
 
+// SD card data recorder on the SPI bus (MISO 50, MOSI 51, SCK 52, CS 53). Pin 52 is also used by the air
+// temperature sensor: move that sensor to a free pin, then uncomment the line below to enable the recorder.
+// #define SD_CARD_CS_PIN 53
+#ifdef SD_CARD_CS_PIN
+SdLogStorage sdStorage(SD_CARD_CS_PIN);
+#endif
+// The recorder stores the samples and actuator states in SensorId and ActuatorId order
+static_assert(RECORDED_SENSOR_COUNT == static_cast<uint8_t>(SensorId::COUNT), "One recorded value per sensor");
+static_assert(RECORDED_ACTUATOR_COUNT == static_cast<uint8_t>(ActuatorId::COUNT), "One recorded state per actuator");
+
 // System components
 Logger logger;
 PIDManager pidManager;
@@ -73,6 +88,7 @@ TestsProgram testsProgram(pidManager);
 DrainProgram drainProgram;
 MixProgram mixProgram;
 FermentationProgram fermentationProgram(pidManager, volumeManager);
+RecipeProgram recipeProgram(pidManager, volumeManager);
 
 CommandHandler commandHandler(stateMachine, safetySystem, volumeManager, logger, pidManager);
 
@@ -85,6 +101,9 @@ void setup() {
 
     Logger::log(LogLevel::INFO, "Setup started");
 
+    // Report why the board reset (watchdog causes are recorded in EEPROM before the reset)
+    Watchdog::begin();
+
     // Initialize sensors
     SensorController::initialize(waterTempSensor, airTempSensor, electronicTempSensor,
                                  phSensor,
@@ -99,20 +118,40 @@ void setup() {
     ActuatorController::beginAll();
     
     safetySystem.setLogger(&logger); //This allows the SafetySystem to use the same logger
+    safetySystem.setVolumeManager(&volumeManager);
 
     // Add programs to the state machine
     stateMachine.addProgram("Tests", &testsProgram);
     stateMachine.addProgram("Drain", &drainProgram);
     stateMachine.addProgram("Mix", &mixProgram);
     stateMachine.addProgram("Fermentation", &fermentationProgram);
+    stateMachine.addProgram("Recipe", &recipeProgram);
 
     // Initialisation of the PIDManager to define hysteresis values
     pidManager.initialize(2.0, 5.0, 1.0, 2.0, 5.0, 1.0, 2.0, 5.0, 1.0);
     pidManager.setHysteresis(0.5, 0.05, 1.0);
+    // Tuned parameters saved in EEPROM (if any) override the defaults above
+    if (!pidManager.loadParameters()) {
+        Logger::log(LogLevel::INFO, "Using default controller parameters");
+    }
+    ActuatorController::checkPumpCalibration();
     Logger::log(LogLevel::INFO, "PID setup");
 
-    volumeManager.setInitialVolume(0.3);           // set an initial volume of 0.2 L
+    // Restore the volume journaled in EEPROM before a reset, or start from the default initial volume
+    if (!volumeManager.restore()) {
+        volumeManager.setInitialVolume(0.3);       // set an initial volume of 0.3 L
+    }
     //Logger::log(LogLevel::INFO, "Setup an initial volume");
+
+#ifdef SD_CARD_CS_PIN
+    DataRecorder::begin(sdStorage);
+#endif
+
+    // Continue the program that was running before a reset (checkpointed in EEPROM)
+    stateMachine.resumeFromCheckpoint();
+
+    // From now on a hung loop or a late heartbeat cuts the actuators and resets the board
+    Watchdog::enable(ActuatorController::forceAllOff);
     
     Logger::log(LogLevel::INFO, "Setup completed");
 }
@@ -134,41 +173,87 @@ void loop() {
         Logger::log(LogLevel::INFO, "Received from Serial Monitor: " + command);
         commandHandler.executeCommand(command);
     }
+    Watchdog::beat(Heartbeat::LINK);
     
     // Update state machine
     stateMachine.update();
 
+    // Stop the actuators started for a duration once it has elapsed
+    ActuatorController::update();
+
     // Update PID manager
     pidManager.updateAllPIDControllers();
 
-    // Check safety limits
-    //safetySystem.checkLimits();
+    // Account the pump volumes and keep the volume ledger up to date
+    volumeManager.update();
+    Watchdog::beat(Heartbeat::CONTROL);
+
+    // Refresh one cached sensor sample, fault stale channels, then check the safety limits against the cached samples
+    SensorController::sampleNextSensor();
+    ErrorHandler::checkSensorResponses();
+    safetySystem.checkLimits();
+    // A new safety stop is queued as a trip: the state machine applies it before any other pending event
+    static bool safetyTripped = false;
+    if (safetySystem.shouldStop() != safetyTripped) {
+        safetyTripped = safetySystem.shouldStop();
+        if (safetyTripped) {
+            stateMachine.postEvent(ProgramEvent::SAFETY_TRIP, "", "safety limits exceeded");
+        }
+    }
+    Watchdog::beat(Heartbeat::SAFETY);
 
     // Log data every interval
     unsigned long currentMillis = millis();
     if (currentMillis - previousMillis >= interval) {
         previousMillis = currentMillis;
+        // The cached samples, as kept fresh by sampleNextSensor(): no sensor is read here. The line is stamped
+        // with the time of the newest of them, from the clock synchronized by the ESP32 (0 until then).
+        unsigned long acquiredMillis = SensorController::getLatestSampleTime();
+        uint32_t acquiredTime = 0;
+        uint16_t acquiredMilliseconds = 0;
+        SystemClock::timeAt(acquiredMillis != 0 ? acquiredMillis : currentMillis, acquiredTime, acquiredMilliseconds);
+        // Actuators drawing power now: the heating plate relay follows its time-proportioning windows
+        ActuatorMask outputs = ActuatorController::getOutputMask();
+        // The same sample is stored on the SD card first, so it can be sent again if it is lost
+        float samples[RECORDED_SENSOR_COUNT];
+        for (uint8_t i = 0; i < RECORDED_SENSOR_COUNT; i++) {
+            samples[i] = SensorController::getSample(static_cast<SensorId>(i)).value;
+        }
+        uint32_t seq = DataRecorder::record(stateMachine.getCurrentProgram(),
+                                            static_cast<uint8_t>(stateMachine.getCurrentState()),
+                                            samples, static_cast<uint8_t>(outputs), ErrorHandler::getFaultMask());
         logger.logData(
             stateMachine.getCurrentProgram(), 
             String(static_cast<int>(stateMachine.getCurrentState())),
-            SensorController::readSensor("waterTempSensor"),
-            SensorController::readSensor("airTempSensor"),
-            SensorController::readSensor("electronicTempSensor"),
-            SensorController::readSensor("phSensor"),
-            SensorController::readSensor("turbiditySensorSEN0554"),
-            SensorController::readSensor("oxygenSensor"),
-            SensorController::readSensor("airFlowSensor"),
-            ActuatorController::isActuatorRunning("airPump"),
-            ActuatorController::isActuatorRunning("drainPump"),
-            ActuatorController::isActuatorRunning("samplePump"),
-            ActuatorController::isActuatorRunning("nutrientPump"),
-            ActuatorController::isActuatorRunning("basePump"),
-            ActuatorController::isActuatorRunning("stirringMotor"),
-            ActuatorController::isActuatorRunning("heatingPlate"),
-            ActuatorController::isActuatorRunning("ledGrowLight")
+            SensorController::getSample(SensorId::WATER_TEMP).value,
+            SensorController::getSample(SensorId::AIR_TEMP).value,
+            SensorController::getSample(SensorId::ELECTRONIC_TEMP).value,
+            SensorController::getSample(SensorId::PH).value,
+            SensorController::getSample(SensorId::TURBIDITY).value,
+            SensorController::getSample(SensorId::OXYGEN).value,
+            SensorController::getSample(SensorId::AIR_FLOW).value,
+            (outputs & actuatorBit(ActuatorId::AIR_PUMP)) != 0,
+            (outputs & actuatorBit(ActuatorId::DRAIN_PUMP)) != 0,
+            (outputs & actuatorBit(ActuatorId::SAMPLE_PUMP)) != 0,
+            (outputs & actuatorBit(ActuatorId::NUTRIENT_PUMP)) != 0,
+            (outputs & actuatorBit(ActuatorId::BASE_PUMP)) != 0,
+            (outputs & actuatorBit(ActuatorId::STIRRING_MOTOR)) != 0,
+            (outputs & actuatorBit(ActuatorId::HEATING_PLATE)) != 0,
+            (outputs & actuatorBit(ActuatorId::LED_GROW_LIGHT)) != 0,
+            ErrorHandler::getFaultMask(),
+            seq,
+            acquiredTime,
+            acquiredMilliseconds
         );
+        Watchdog::beat(Heartbeat::LOGGING);
     }
 
+    // Send a few of the requested backfill records
+    DataRecorder::update();
+
+    // Feed the watchdog if every subsystem beat in time
+    Watchdog::update();
+
     // Short pause to avoid excessive CPU usage
     delay(10);
 }
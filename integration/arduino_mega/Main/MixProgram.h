@@ -18,6 +18,8 @@ public:
     bool isPaused() const override { return _isPaused; }
     String getName() const { return "Mix"; }
     void parseCommand(const String& command) override;
+    ActuatorMask getActuatorMask(const String& command) const override { return actuatorBit(ActuatorId::STIRRING_MOTOR); }
+    uint8_t getPriority() const override { return PRIORITY_LOW; }
 
 private:
     int speed;
@@ -6,10 +6,18 @@ PIDManager::PIDManager()
       phPID(&phInput, &phOutput, &phSetpoint, 0, 0, 0, DIRECT),
       doPID(&doInput, &doOutput, &doSetpoint, 0, 0, 0, DIRECT),
       tempPIDRunning(false), phPIDRunning(false), doPIDRunning(false),
+      tempLease(ACTUATOR_MASK_NONE), phLease(ACTUATOR_MASK_NONE), doLease(ACTUATOR_MASK_NONE),
       lastTempUpdateTime(0), lastPHUpdateTime(0), lastDOUpdateTime(0),
+      tempTrajectory(TrajectoryProfile::S_CURVE, DEFAULT_TEMP_RAMP_RATE),
+      phTrajectory(TrajectoryProfile::STEP, 0),
+      doTrajectory(TrajectoryProfile::STEP, 0),
       tempHysteresis(0.5), phHysteresis(0.05), doHysteresis(1.0),
-      minStirringSpeed(0),
-      isStartupPhase(true)
+      tempKp(0), tempKi(0), tempKd(0),
+      phKp(0), phKi(0), phKd(0),
+      doKp(0), doKi(0), doKd(0),
+      minStirringSpeed(0), maxStirringSpeed(0),
+      isStartupPhase(true),
+      tempInputMasked(false), phInputMasked(false), doInputMasked(false)
 {
     tempPID.SetOutputLimits(0, 100);
     phPID.SetOutputLimits(0, 100);
@@ -22,6 +30,9 @@ PIDManager::PIDManager()
 void PIDManager::initialize(double tempKp, double tempKi, double tempKd,
                             double phKp, double phKi, double phKd,
                             double doKp, double doKi, double doKd) {
+    this->tempKp = tempKp; this->tempKi = tempKi; this->tempKd = tempKd;
+    this->phKp = phKp; this->phKi = phKi; this->phKd = phKd;
+    this->doKp = doKp; this->doKi = doKi; this->doKd = doKd;
     tempPID.SetTunings(tempKp * 1.5, tempKi * 0.5, tempKd * 2);  // Start-up parameters for temperature
     phPID.SetTunings(phKp * 1.5, phKi * 0.5, phKd * 2);  // Start-up parameters for pH
     doPID.SetTunings(doKp * 1.5, doKi * 0.5, doKd * 2);  // Start-up parameters for  DO
@@ -33,54 +44,84 @@ void PIDManager::setHysteresis(double tempHyst, double phHyst, double doHyst) {
     doHysteresis = doHyst;
 }
 
+// Each loop drives its actuator under the lease of the program that started it (within the caller's own mask),
+// so that the updates from loop() cannot override the actuators leased to another program
 void PIDManager::updateAllPIDControllers() {
     unsigned long currentTime = millis();
     bool anyPIDUpdated  = false;
+    ActuatorMask callerMask = ActuatorController::getAccessMask();
     if (tempPIDRunning && currentTime - lastTempUpdateTime >= UPDATE_INTERVAL_TEMP) {
+        ActuatorController::setAccessMask(tempLease & callerMask);
         updateTemperaturePID();
         lastTempUpdateTime = currentTime;
         anyPIDUpdated  = true;
     }
     if (phPIDRunning && currentTime - lastPHUpdateTime >= UPDATE_INTERVAL_PH) {
+        ActuatorController::setAccessMask(phLease & callerMask);
         updatePHPID();
         lastPHUpdateTime = currentTime;
         anyPIDUpdated  = true;
     }
     if (doPIDRunning && currentTime - lastDOUpdateTime >= UPDATE_INTERVAL_DO) {
+        ActuatorController::setAccessMask(doLease & callerMask);
         updateDOPID();
         lastDOUpdateTime = currentTime;
         anyPIDUpdated  = true;
     }
     if (anyPIDUpdated ) {
+        ActuatorController::setAccessMask((tempLease | phLease | doLease) & callerMask);
         adjustPIDStirringSpeed();
     }
+    ActuatorController::setAccessMask(callerMask);
 }
 
-void PIDManager::setTemperatureSetpoint(double setpoint) { tempSetpoint = setpoint; }
-void PIDManager::setPHSetpoint(double setpoint) { phSetpoint = setpoint; }
-void PIDManager::setDOSetpoint(double setpoint) { doSetpoint = setpoint; }
+// A running loop moves from its current setpoint to the new one along its trajectory
+void PIDManager::setTemperatureSetpoint(double setpoint) {
+    if (tempPIDRunning) tempTrajectory.start(tempSetpoint, setpoint, millis()); else tempTrajectory.hold(setpoint);
+    tempSetpoint = tempTrajectory.getSetpoint();
+}
+
+void PIDManager::setPHSetpoint(double setpoint) {
+    if (phPIDRunning) phTrajectory.start(phSetpoint, setpoint, millis()); else phTrajectory.hold(setpoint);
+    phSetpoint = phTrajectory.getSetpoint();
+}
+
+void PIDManager::setDOSetpoint(double setpoint) {
+    if (doPIDRunning) doTrajectory.start(doSetpoint, setpoint, millis()); else doTrajectory.hold(setpoint);
+    doSetpoint = doTrajectory.getSetpoint();
+}
 
 double PIDManager::getTemperatureOutput() const { return tempOutput; } 
 double PIDManager::getPHOutput() const { return phOutput; }             
 double PIDManager::getDOOutput() const { return doOutput; }
 
+// The trajectory starts from the measured value, so the heater does not saturate on a setpoint step
 void PIDManager::startTemperaturePID(double setpoint) {
-    tempSetpoint = setpoint;
+    tempInput = SensorController::readSensor("waterTempSensor");
+    if (isnan(tempInput)) tempTrajectory.hold(setpoint); else tempTrajectory.start(tempInput, setpoint, millis());
+    tempSetpoint = tempTrajectory.getSetpoint();
     tempPIDRunning = true;
+    tempLease = ActuatorController::getAccessMask();
     isStartupPhase = true;
     Logger::log(LogLevel::INFO, "Temperature PID started with setpoint: " + String(setpoint));
 }
 
 void PIDManager::startPHPID(double setpoint) {
-    phSetpoint = setpoint;
+    phInput = SensorController::readSensor("phSensor");
+    if (isnan(phInput)) phTrajectory.hold(setpoint); else phTrajectory.start(phInput, setpoint, millis());
+    phSetpoint = phTrajectory.getSetpoint();
     phPIDRunning = true;
+    phLease = ActuatorController::getAccessMask();
     isStartupPhase = true;
     Logger::log(LogLevel::INFO, "pH PID started with setpoint: " + String(setpoint));
 }
 
 void PIDManager::startDOPID(double setpoint) {
-    doSetpoint = setpoint;
+    doInput = SensorController::readSensor("oxygenSensor");
+    if (isnan(doInput)) doTrajectory.hold(setpoint); else doTrajectory.start(doInput, setpoint, millis());
+    doSetpoint = doTrajectory.getSetpoint();
     doPIDRunning = true;
+    doLease = ActuatorController::getAccessMask();
     isStartupPhase = true;
     Logger::log(LogLevel::INFO, "DO PID started with setpoint: " + String(setpoint));
 }
@@ -151,15 +192,19 @@ void PIDManager::adjustPIDStirringSpeed() {
     if (!tempPIDRunning && !phPIDRunning && !doPIDRunning) {
         // If no PID is active, use minimum speed
         int minSpeed = getMinStirringSpeed();
-        ActuatorController::runActuator("stirringMotor", minSpeed, 0);
+        ActuatorController::runActuator(ActuatorId::STIRRING_MOTOR, minSpeed, 0);
         return;
     }
 
     double maxOutput = max(max(abs(tempOutput), abs(phOutput)), abs(doOutput));
     int pidSpeed = map(maxOutput, 0, 100, ActuatorController::getStirringMotorMinRPM(), ActuatorController::getStirringMotorMaxRPM());
     int finalSpeed = max(pidSpeed, getMinStirringSpeed());
-    finalSpeed = constrain(finalSpeed, ActuatorController::getStirringMotorMinRPM(), ActuatorController::getStirringMotorMaxRPM());
-    ActuatorController::runActuator("stirringMotor", finalSpeed, 0);
+    int maxSpeed = ActuatorController::getStirringMotorMaxRPM();
+    if (maxStirringSpeed > 0) {
+        maxSpeed = min(maxSpeed, maxStirringSpeed);
+    }
+    finalSpeed = constrain(finalSpeed, ActuatorController::getStirringMotorMinRPM(), maxSpeed);
+    ActuatorController::runActuator(ActuatorId::STIRRING_MOTOR, finalSpeed, 0);
     
     Logger::log(LogLevel::INFO, "Adjusted stirring motor speed: " + String(finalSpeed));
 }
@@ -190,14 +235,18 @@ void PIDManager::updateTemperaturePID() {
     if (!tempPIDRunning) return;
     
     tempInput = SensorController::readSensor("waterTempSensor");
+    tempSetpoint = tempTrajectory.update(millis());
+    if (isInputMasked(tempInput, tempInputMasked, "heatingPlate", "Temperature")) return;
     
-    if (abs(tempInput - tempSetpoint) > tempHysteresis) {
+    // While ramping or soaking, the loop keeps regulating even inside the hysteresis band
+    if (tempTrajectory.isActive() || abs(tempInput - tempSetpoint) > tempHysteresis) {
         tempPID.Compute();
-        if (isStartupPhase && abs(tempInput - tempSetpoint) < 2.0) {
+        if (isStartupPhase && abs(tempInput - tempTrajectory.getTarget()) < 2.0) {
             switchToMaintainMode();
         }
            
-        ActuatorController::runActuator("heatingPlate", tempOutput, 0);  
+        ActuatorController::runActuator(ActuatorId::HEATING_PLATE, tempOutput, 0);  
+        logTrajectory("temperature", tempTrajectory, tempInput, tempOutput);
         Logger::log(LogLevel::INFO, "Temperature PID update - Setpoint: " + String(tempSetpoint) + ", Input: " + String(tempInput) + ", Output: " + String(tempOutput) + "%");
     } else {
         stopTemperaturePID();
@@ -209,11 +258,14 @@ void PIDManager::updatePHPID() {
     if (!phPIDRunning) return;
     
     phInput = SensorController::readSensor("phSensor");
+    phSetpoint = phTrajectory.update(millis());
+    if (isInputMasked(phInput, phInputMasked, "basePump", "pH")) return;
     
-    if (abs(phInput - phSetpoint) > phHysteresis) {
+    if (phTrajectory.isActive() || abs(phInput - phSetpoint) > phHysteresis) {
         phPID.Compute();
         double flowRate = convertPIDOutputToFlowRate(phOutput);
-        ActuatorController::runActuator("basePump", flowRate, 0);  
+        ActuatorController::runActuator(ActuatorId::BASE_PUMP, flowRate, 0);  
+        logTrajectory("pH", phTrajectory, phInput, phOutput);
         Logger::log(LogLevel::INFO, "pH PID update - Setpoint: " + String(phSetpoint) + ", Input: " + String(phInput) + ", Output: " + String(flowRate));
     } else {
         stopPHPID();
@@ -225,10 +277,13 @@ void PIDManager::updateDOPID() {
     if (!doPIDRunning) return;
 
     doInput = SensorController::readSensor("oxygenSensor");
+    doSetpoint = doTrajectory.update(millis());
+    if (isInputMasked(doInput, doInputMasked, "airPump", "DO")) return;
     
-    if (abs(doInput - doSetpoint) > doHysteresis) {
+    if (doTrajectory.isActive() || abs(doInput - doSetpoint) > doHysteresis) {
         doPID.Compute();
-        ActuatorController::runActuator("airPump", doOutput, 0);  // 0 pour une durée continue
+        ActuatorController::runActuator(ActuatorId::AIR_PUMP, doOutput, 0);  // 0 pour une durée continue
+        logTrajectory("DO", doTrajectory, doInput, doOutput);
         Logger::log(LogLevel::INFO, "DO PID update - Setpoint: " + String(doSetpoint) + ", Input: " + String(doInput) + ", Output: " + String(doOutput));
     } else {
         stopDOPID();
@@ -237,24 +292,41 @@ void PIDManager::updateDOPID() {
 }
 
 
+// A faulted sensor reads NaN: the loop keeps running but holds its actuator off until the input recovers
+bool PIDManager::isInputMasked(double input, bool& masked, const char* actuatorName, const char* pidType) {
+    if (isnan(input)) {
+        if (!masked) {
+            masked = true;
+            ActuatorController::stopActuator(actuatorName);
+            Logger::log(LogLevel::WARNING, String(pidType) + " PID input unavailable, " + actuatorName + " held off");
+        }
+        return true;
+    }
+    if (masked) {
+        masked = false;
+        Logger::log(LogLevel::INFO, String(pidType) + " PID input recovered");
+    }
+    return false;
+}
+
 void PIDManager::stopTemperaturePID() {
     tempPIDRunning = false;
     tempOutput = 0;
-    ActuatorController::stopActuator("heatingPlate");
+    ActuatorController::stopActuator(ActuatorId::HEATING_PLATE);
     Logger::log(LogLevel::INFO, "Temperature PID stopped");
 }
 
 void PIDManager::stopPHPID() {
     phPIDRunning = false;
     phOutput = 0;
-    ActuatorController::stopActuator("basePump");
+    ActuatorController::stopActuator(ActuatorId::BASE_PUMP);
     Logger::log(LogLevel::INFO, "pH PID stopped");
 }
 
 void PIDManager::stopDOPID() {
     doPIDRunning = false;
     doOutput = 0;
-    ActuatorController::stopActuator("airPump");
+    ActuatorController::stopActuator(ActuatorId::AIR_PUMP);
     Logger::log(LogLevel::INFO, "DO PID stopped");
 }
 
@@ -281,21 +353,103 @@ void PIDManager::resumeAllPID() {
 void PIDManager::adjustPIDParameters(const String& pidType, double Kp, double Ki, double Kd) {
     if (pidType == "temperature") {
         tempPID.SetTunings(Kp, Ki, Kd);
+        tempKp = Kp; tempKi = Ki; tempKd = Kd;
     } else if (pidType == "pH") {
         phPID.SetTunings(Kp, Ki, Kd);
+        phKp = Kp; phKi = Ki; phKd = Kd;
     } else if (pidType == "DO") {
         doPID.SetTunings(Kp, Ki, Kd);
+        doKp = Kp; doKi = Ki; doKd = Kd;
+    } else {
+        Logger::log(LogLevel::WARNING, "Unknown PID type: " + pidType);
+    }
+}
+
+bool PIDManager::setTrajectory(const String& pidType, TrajectoryProfile profile, float rateLimit) {
+    SetpointTrajectory* trajectory = findTrajectory(pidType);
+    if (!trajectory) {
+        Logger::log(LogLevel::WARNING, "Unknown PID type: " + pidType);
+        return false;
+    }
+    trajectory->setProfile(profile);
+    trajectory->setRateLimit(max(rateLimit, 0.0f));
+    return true;
+}
+
+bool PIDManager::rampSetpoint(const String& pidType, double target, unsigned long soakTime) {
+    SetpointTrajectory* trajectory = findTrajectory(pidType);
+    if (!trajectory) {
+        Logger::log(LogLevel::WARNING, "Unknown PID type: " + pidType);
+        return false;
+    }
+    double* setpoint = (trajectory == &tempTrajectory) ? &tempSetpoint : (trajectory == &phTrajectory) ? &phSetpoint : &doSetpoint;
+    trajectory->start(*setpoint, target, millis(), soakTime);
+    *setpoint = trajectory->getSetpoint();
+    Logger::log(LogLevel::INFO, pidType + " setpoint ramp to " + String(target) + ", soak " + String(soakTime / 60000) + " min");
+    return true;
+}
+
+const SetpointTrajectory* PIDManager::getTrajectory(const String& pidType) const {
+    return const_cast<PIDManager*>(this)->findTrajectory(pidType);
+}
+
+SetpointTrajectory* PIDManager::findTrajectory(const String& pidType) {
+    if (pidType == "temperature") return &tempTrajectory;
+    if (pidType == "pH") return &phTrajectory;
+    if (pidType == "DO") return &doTrajectory;
+    return nullptr;
+}
+
+// Reports the trajectory progress with the loop data while the setpoint is moving or soaking
+void PIDManager::logTrajectory(const String& pidType, const SetpointTrajectory& trajectory, double input, double output) {
+    TrajectoryPhase phase = trajectory.getPhase();
+    if (phase == TrajectoryPhase::RAMP || phase == TrajectoryPhase::SOAK) {
+        Logger::logPIDData(pidType, trajectory.getSetpoint(), input, output, trajectory.getTarget(), trajectory.getProgress());
     }
 }
 
-// A sauvegarder/charger sur le serveur SI BESOIN de plus de data.
-void PIDManager::saveParameters(const char* filename) {
-    // Implement saving PID parameters to EEPROM or SD card
-    Logger::log(LogLevel::INFO, "Saving PID parameters to " + String(filename));
+// Saves gains, hysteresis, stirring limits and pump calibration to EEPROM
+bool PIDManager::saveParameters() {
+    ControllerParameters params;
+    params.tempKp = tempKp; params.tempKi = tempKi; params.tempKd = tempKd;
+    params.phKp = phKp; params.phKi = phKi; params.phKd = phKd;
+    params.doKp = doKp; params.doKi = doKi; params.doKd = doKd;
+    params.tempHysteresis = tempHysteresis;
+    params.phHysteresis = phHysteresis;
+    params.doHysteresis = doHysteresis;
+    params.nutrientPumpMinFlow = ActuatorController::getPumpMinFlowRate("nutrientPump");
+    params.nutrientPumpMaxFlow = ActuatorController::getPumpMaxFlowRate("nutrientPump");
+    params.basePumpMinFlow = ActuatorController::getPumpMinFlowRate("basePump");
+    params.basePumpMaxFlow = ActuatorController::getPumpMaxFlowRate("basePump");
+    params.drainPumpMinFlow = ActuatorController::getPumpMinFlowRate("drainPump");
+    params.drainPumpMaxFlow = ActuatorController::getPumpMaxFlowRate("drainPump");
+    params.samplePumpMinFlow = ActuatorController::getPumpMinFlowRate("samplePump");
+    params.samplePumpMaxFlow = ActuatorController::getPumpMaxFlowRate("samplePump");
+    params.minStirringSpeed = minStirringSpeed;
+    params.maxStirringSpeed = maxStirringSpeed;
+    return ParameterStore::save(params);
 }
-void PIDManager::loadParameters(const char* filename) {
-    // Implement loading PID parameters from EEPROM or SD card
-    Logger::log(LogLevel::INFO, "Loading PID parameters from " + String(filename));
+
+// Restores the parameters saved in EEPROM; keeps the current ones if none are valid
+bool PIDManager::loadParameters() {
+    ControllerParameters params;
+    if (!ParameterStore::load(params)) {
+        return false;
+    }
+    initialize(params.tempKp, params.tempKi, params.tempKd,
+               params.phKp, params.phKi, params.phKd,
+               params.doKp, params.doKi, params.doKd);
+    setHysteresis(params.tempHysteresis, params.phHysteresis, params.doHysteresis);
+    ActuatorController::setPumpFlowRange("nutrientPump", params.nutrientPumpMinFlow, params.nutrientPumpMaxFlow);
+    ActuatorController::setPumpFlowRange("basePump", params.basePumpMinFlow, params.basePumpMaxFlow);
+    ActuatorController::setPumpFlowRange("drainPump", params.drainPumpMinFlow, params.drainPumpMaxFlow);
+    ActuatorController::setPumpFlowRange("samplePump", params.samplePumpMinFlow, params.samplePumpMaxFlow);
+    minStirringSpeed = params.minStirringSpeed;
+    maxStirringSpeed = params.maxStirringSpeed;
+    Logger::log(LogLevel::INFO, "Temperature PID gains - Kp: " + String(tempKp) + ", Ki: " + String(tempKi) + ", Kd: " + String(tempKd));
+    Logger::log(LogLevel::INFO, "pH PID gains - Kp: " + String(phKp) + ", Ki: " + String(phKi) + ", Kd: " + String(phKd));
+    Logger::log(LogLevel::INFO, "DO PID gains - Kp: " + String(doKp) + ", Ki: " + String(doKi) + ", Kd: " + String(doKd));
+    return true;
 }
 
 double PIDManager::convertPIDOutputToFlowRate(double pidOutput) {
@@ -6,6 +6,8 @@
 #include "ActuatorController.h"
 #include "SensorController.h"
 #include "VolumeManager.h"
+#include "ParameterStore.h"
+#include "SetpointTrajectory.h"
 #include <logger/Logger.h>
 
 class PIDManager {
@@ -22,6 +24,7 @@ public:
     void setPHSetpoint(double setpoint);
     void setDOSetpoint(double setpoint);
 
+    // The start/set methods move the setpoint along the loop's trajectory (see setTrajectory)
     void startTemperaturePID(double setpoint);
     void startPHPID(double setpoint);
     void startDOPID(double setpoint);
@@ -38,21 +41,34 @@ public:
     void pauseAllPID();
     void resumeAllPID();
 
+    // A loop stops by itself once its input is within the hysteresis band (outside a setpoint ramp or soak)
+    bool isTemperaturePIDRunning() const { return tempPIDRunning; }
+    bool isPHPIDRunning() const { return phPIDRunning; }
+    bool isDOPIDRunning() const { return doPIDRunning; }
+
     double getTemperatureOutput() const;
     double getPHOutput() const;
     double getDOOutput() const;
 
     void adjustPIDStirringSpeed();
 
-    void saveParameters(const char* filename);
-    void loadParameters(const char* filename);
+    bool saveParameters();
+    bool loadParameters();
 
     void setHysteresis(double tempHyst, double phHyst, double doHyst);
 
     void adjustPIDParameters(const String& pidType, double Kp, double Ki, double Kd);
 
+    // Profile and rate limit (units per minute, 0 = step) of the setpoint trajectory of a loop
+    bool setTrajectory(const String& pidType, TrajectoryProfile profile, float rateLimit);
+    // Ramps the setpoint of a running loop to target, then holds it for soakTime (ms)
+    bool rampSetpoint(const String& pidType, double target, unsigned long soakTime);
+    const SetpointTrajectory* getTrajectory(const String& pidType) const;
+
     void setMinStirringSpeed(int speed) { minStirringSpeed = speed; }
     int getMinStirringSpeed() const { return minStirringSpeed; }
+    void setMaxStirringSpeed(int speed) { maxStirringSpeed = speed; } // 0 = motor maximum
+    int getMaxStirringSpeed() const { return maxStirringSpeed; }
 private:
     PID tempPID;
     PID phPID;
@@ -66,6 +82,11 @@ private:
     bool phPIDRunning;
     bool doPIDRunning;
 
+    // Access mask of the program that started each loop: the updates from loop() drive its leased actuators only
+    ActuatorMask tempLease;
+    ActuatorMask phLease;
+    ActuatorMask doLease;
+
     unsigned long lastTempUpdateTime;
     unsigned long lastPHUpdateTime;
     unsigned long lastDOUpdateTime;
@@ -74,17 +95,37 @@ private:
     static const unsigned long UPDATE_INTERVAL_PH = 30000;   // 45 seconds - (30-60 seconds; usually in the chemical process industry ) ; could be appropriate if the changes are rapid: 5 seconds
     static const unsigned long UPDATE_INTERVAL_DO = 30000;  // 45 seconds - (30-60 seconds; usually in the chemical process industry ) ; could be appropriate if the changes are rapid: 10 seconds
 
+    SetpointTrajectory tempTrajectory;
+    SetpointTrajectory phTrajectory;
+    SetpointTrajectory doTrajectory;
+
+    static constexpr float DEFAULT_TEMP_RAMP_RATE = 0.5;  // °C/min
+
     double tempHysteresis;
     double phHysteresis;
     double doHysteresis;
 
+    // Base gains as given to initialize()/adjustPIDParameters(), before start-up/maintain scaling
+    double tempKp, tempKi, tempKd;
+    double phKp, phKi, phKd;
+    double doKp, doKi, doKd;
+
     int minStirringSpeed;
+    int maxStirringSpeed;
     bool isStartupPhase;
 
+    // Set while the input sensor of the loop is faulted (see ErrorHandler)
+    bool tempInputMasked;
+    bool phInputMasked;
+    bool doInputMasked;
+
     void switchToMaintainMode();
     double convertPIDOutputToHeatingPower(double pidOutput);
     double convertPIDOutputToFlowRate(double pidOutput);
     double convertPIDOutputToPercentage(double pidOutput);
+    SetpointTrajectory* findTrajectory(const String& pidType);
+    void logTrajectory(const String& pidType, const SetpointTrajectory& trajectory, double input, double output);
+    bool isInputMasked(double input, bool& masked, const char* actuatorName, const char* pidType);
 
 };
 
@@ -0,0 +1,101 @@
+// ParameterStore.cpp
+#include "ParameterStore.h"
+#include <util/crc16.h>
+
+int8_t ParameterStore::activeSlot = -1;
+uint32_t ParameterStore::sequence = 0;
+
+bool ParameterStore::load(ControllerParameters& params) {
+    uint32_t latestSequence;
+    int8_t slot = findLatestSlot(latestSequence);
+    if (slot < 0) {
+        Logger::log(LogLevel::WARNING, "No valid parameters in EEPROM");
+        return false;
+    }
+    RecordHeader header;
+    readSlot(slot, header, &params);
+    activeSlot = slot;
+    sequence = latestSequence;
+    Logger::log(LogLevel::INFO, "Parameters loaded from EEPROM slot " + String(slot) + " (seq " + String(sequence) + ")");
+    return true;
+}
+
+bool ParameterStore::save(const ControllerParameters& params) {
+    if (activeSlot < 0) {
+        activeSlot = findLatestSlot(sequence);
+    }
+    uint8_t slot = (activeSlot < 0) ? 0 : (activeSlot + 1) % EEPROM_PARAMS_SLOT_COUNT;
+    uint16_t address = slotAddress(slot);
+
+    RecordHeader header = { MAGIC, VERSION, sizeof(ControllerParameters), sequence + 1 };
+    EEPROM.put(address, header);
+    EEPROM.put(address + sizeof(RecordHeader), params);
+    uint16_t length = sizeof(RecordHeader) + sizeof(ControllerParameters);
+    uint16_t crc = computeCRC(address, length);
+    EEPROM.put(address + length, crc);
+
+    // Read back to make sure the cells took the new values
+    RecordHeader check;
+    if (!readSlot(slot, check, nullptr)) {
+        Logger::log(LogLevel::ERROR, "EEPROM parameter write failed in slot " + String(slot));
+        return false;
+    }
+    activeSlot = slot;
+    sequence = header.sequence;
+    Logger::log(LogLevel::INFO, "Parameters saved to EEPROM slot " + String(slot) + " (seq " + String(sequence) + ")");
+    return true;
+}
+
+void ParameterStore::erase() {
+    for (uint8_t slot = 0; slot < EEPROM_PARAMS_SLOT_COUNT; slot++) {
+        EEPROM.update(slotAddress(slot), 0xFF);
+        EEPROM.update(slotAddress(slot) + 1, 0xFF);
+    }
+    activeSlot = -1;
+    sequence = 0;
+    Logger::log(LogLevel::INFO, "Parameters erased from EEPROM");
+}
+
+uint16_t ParameterStore::slotAddress(uint8_t slot) {
+    return EEPROM_PARAMS_ADDR + slot * EEPROM_PARAMS_SLOT_SIZE;
+}
+
+bool ParameterStore::readSlot(uint8_t slot, RecordHeader& header, ControllerParameters* params) {
+    uint16_t address = slotAddress(slot);
+    EEPROM.get(address, header);
+    if (header.magic != MAGIC || header.version != VERSION || header.size != sizeof(ControllerParameters)) {
+        return false;
+    }
+    uint16_t length = sizeof(RecordHeader) + sizeof(ControllerParameters);
+    uint16_t storedCRC;
+    EEPROM.get(address + length, storedCRC);
+    if (storedCRC != computeCRC(address, length)) {
+        return false;
+    }
+    if (params) {
+        EEPROM.get(address + sizeof(RecordHeader), *params);
+    }
+    return true;
+}
+
+// CRC-16/MODBUS (polynomial 0xA001, initial value 0xFFFF)
+uint16_t ParameterStore::computeCRC(uint16_t address, uint16_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) {
+        crc = _crc16_update(crc, EEPROM.read(address + i));
+    }
+    return crc;
+}
+
+int8_t ParameterStore::findLatestSlot(uint32_t& latestSequence) {
+    int8_t latest = -1;
+    latestSequence = 0;
+    for (uint8_t slot = 0; slot < EEPROM_PARAMS_SLOT_COUNT; slot++) {
+        RecordHeader header;
+        if (readSlot(slot, header, nullptr) && (latest < 0 || header.sequence > latestSequence)) {
+            latest = slot;
+            latestSequence = header.sequence;
+        }
+    }
+    return latest;
+}
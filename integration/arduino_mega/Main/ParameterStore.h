@@ -0,0 +1,59 @@
+// ParameterStore.h
+#ifndef PARAMETER_STORE_H
+#define PARAMETER_STORE_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "EepromLayout.h"
+#include <logger/Logger.h>
+
+// Controller parameters persisted in EEPROM (little-endian, packed, as laid out on the AVR).
+// Bump ParameterStore::VERSION whenever this structure changes.
+struct ControllerParameters {
+    float tempKp, tempKi, tempKd;
+    float phKp, phKi, phKd;
+    float doKp, doKi, doKd;
+    float tempHysteresis, phHysteresis, doHysteresis;
+    float nutrientPumpMinFlow, nutrientPumpMaxFlow;  // ml/min
+    float basePumpMinFlow, basePumpMaxFlow;          // ml/min
+    float drainPumpMinFlow, drainPumpMaxFlow;        // ml/min at minimum and 100% speed
+    float samplePumpMinFlow, samplePumpMaxFlow;      // ml/min at minimum and 100% speed
+    int16_t minStirringSpeed;                        // RPM
+    int16_t maxStirringSpeed;                        // RPM
+};
+
+// Versioned, CRC-protected store for ControllerParameters.
+// Each save goes to the next of EEPROM_PARAMS_SLOT_COUNT slots (wear leveling); the valid record
+// with the highest sequence number is the current one, so an interrupted write never loses the
+// previous parameters.
+class ParameterStore {
+public:
+    static const uint16_t MAGIC = 0xB10C;
+    static const uint8_t VERSION = 2;
+
+    static bool load(ControllerParameters& params);
+    static bool save(const ControllerParameters& params);
+    static void erase();
+    static uint32_t getSequence() { return sequence; }
+
+private:
+    struct RecordHeader {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t size;       // sizeof(ControllerParameters)
+        uint32_t sequence;  // Incremented on every save
+    };
+
+    static_assert(sizeof(RecordHeader) + sizeof(ControllerParameters) + sizeof(uint16_t) <= EEPROM_PARAMS_SLOT_SIZE,
+                  "ControllerParameters record does not fit in an EEPROM slot");
+
+    static int8_t activeSlot;
+    static uint32_t sequence;
+
+    static uint16_t slotAddress(uint8_t slot);
+    static bool readSlot(uint8_t slot, RecordHeader& header, ControllerParameters* params);
+    static uint16_t computeCRC(uint16_t address, uint16_t length);
+    static int8_t findLatestSlot(uint32_t& latestSequence);
+};
+
+#endif // PARAMETER_STORE_H
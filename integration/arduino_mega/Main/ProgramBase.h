@@ -3,6 +3,8 @@
 #define PROGRAM_BASE_H
 
 #include <Arduino.h>
+#include "ProgramCheckpoint.h"
+#include "ActuatorController.h"
 
 class ProgramBase {
 public:
@@ -32,6 +34,25 @@ public:
 
     virtual void parseCommand(const String& command) = 0;
 
+    // Actuators the program drives when started with this command; the StateMachine leases them
+    // to the program and refuses its commands on other actuators
+    virtual ActuatorMask getActuatorMask(const String& command) const { return ACTUATOR_MASK_ALL; }
+
+    // Priority used to arbitrate actuator conflicts: a program preempts running programs of lower
+    // priority that own actuators it needs, and is refused by programs of equal or higher priority
+    virtual uint8_t getPriority() const { return PRIORITY_NORMAL; }
+
+    static const uint8_t PRIORITY_LOW = 1;      // Utility programs (mixing, draining, tests)
+    static const uint8_t PRIORITY_NORMAL = 2;   // Culture programs (fermentation, recipes)
+
+    // Write the state needed to continue the program after a reset (optional).
+    // Returns false if the program does not support checkpoints; a payload too long for the writer
+    // shows as writer.length() == 0.
+    virtual bool saveCheckpoint(CheckpointWriter& writer) const { return false; }
+
+    // Restart the program from a checkpoint, PID loops and actuators included (optional)
+    virtual bool restoreCheckpoint(CheckpointReader& reader) { return false; }
+
     // Virtual destructor
     virtual ~ProgramBase() {}
     
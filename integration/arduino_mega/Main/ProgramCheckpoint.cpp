@@ -0,0 +1,143 @@
+// ProgramCheckpoint.cpp
+#include "ProgramCheckpoint.h"
+#include "SystemClock.h"
+#include <util/crc16.h>
+
+int8_t ProgramCheckpoint::activeSlot = -1;
+uint32_t ProgramCheckpoint::sequence = 0;
+
+void CheckpointWriter::writeString(const String& value, uint8_t maxLength) {
+    uint8_t length = min((unsigned int)maxLength, value.length());
+    write(length);
+    if (_length + length > _capacity) {
+        _overflow = true;
+        return;
+    }
+    memcpy(_buffer + _length, value.c_str(), length);
+    _length += length;
+}
+
+void CheckpointReader::readString(String& value) {
+    uint8_t length = 0;
+    read(length);
+    if (_error || _position + length > _length) {
+        _error = true;
+        return;
+    }
+    value = "";
+    value.reserve(length);
+    for (uint8_t i = 0; i < length; i++) {
+        value += (char)_buffer[_position + i];
+    }
+    _position += length;
+}
+
+bool ProgramCheckpoint::save(const String& programName, const uint8_t* payload, uint8_t length) {
+    if (length == 0 || length > MAX_PAYLOAD) {
+        return false;
+    }
+    if (activeSlot < 0) {
+        activeSlot = findLatestSlot(sequence);
+    }
+    uint8_t slot = (activeSlot < 0) ? 0 : (activeSlot + 1) % EEPROM_CHECKPOINT_SLOT_COUNT;
+    uint16_t address = slotAddress(slot);
+
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.length = length;
+    header.sequence = sequence + 1;
+    strncpy(header.info.program, programName.c_str(), PROGRAM_NAME_SIZE - 1);
+    header.info.wallTime = SystemClock::now();
+    header.info.uptime = millis();
+
+    EEPROM.put(address, header);
+    for (uint8_t i = 0; i < length; i++) {
+        EEPROM.update(address + sizeof(RecordHeader) + i, payload[i]);
+    }
+    uint16_t recordLength = sizeof(RecordHeader) + length;
+    uint16_t crc = computeCRC(address, recordLength);
+    EEPROM.put(address + recordLength, crc);
+
+    RecordHeader check;
+    if (!readSlot(slot, check)) {
+        Logger::log(LogLevel::ERROR, "EEPROM checkpoint write failed in slot " + String(slot));
+        return false;
+    }
+    activeSlot = slot;
+    sequence = header.sequence;
+    return true;
+}
+
+bool ProgramCheckpoint::load(Info& info, uint8_t* payload, uint8_t& length) {
+    uint32_t latestSequence;
+    int8_t slot = findLatestSlot(latestSequence);
+    if (slot < 0) {
+        return false;
+    }
+    RecordHeader header;
+    readSlot(slot, header);
+    uint16_t address = slotAddress(slot) + sizeof(RecordHeader);
+    for (uint8_t i = 0; i < header.length; i++) {
+        payload[i] = EEPROM.read(address + i);
+    }
+    length = header.length;
+    info = header.info;
+    info.program[PROGRAM_NAME_SIZE - 1] = '\0';
+    activeSlot = slot;
+    sequence = latestSequence;
+    return true;
+}
+
+void ProgramCheckpoint::clear() {
+    for (uint8_t slot = 0; slot < EEPROM_CHECKPOINT_SLOT_COUNT; slot++) {
+        EEPROM.update(slotAddress(slot), 0xFF);
+        EEPROM.update(slotAddress(slot) + 1, 0xFF);
+    }
+    activeSlot = -1;
+    sequence = 0;
+}
+
+bool ProgramCheckpoint::exists() {
+    uint32_t latestSequence;
+    return findLatestSlot(latestSequence) >= 0;
+}
+
+uint16_t ProgramCheckpoint::slotAddress(uint8_t slot) {
+    return EEPROM_CHECKPOINT_ADDR + slot * EEPROM_CHECKPOINT_SLOT_SIZE;
+}
+
+bool ProgramCheckpoint::readSlot(uint8_t slot, RecordHeader& header) {
+    uint16_t address = slotAddress(slot);
+    EEPROM.get(address, header);
+    if (header.magic != MAGIC || header.version != VERSION || header.length == 0 || header.length > MAX_PAYLOAD) {
+        return false;
+    }
+    uint16_t recordLength = sizeof(RecordHeader) + header.length;
+    uint16_t storedCRC;
+    EEPROM.get(address + recordLength, storedCRC);
+    return storedCRC == computeCRC(address, recordLength);
+}
+
+// CRC-16/MODBUS (polynomial 0xA001, initial value 0xFFFF)
+uint16_t ProgramCheckpoint::computeCRC(uint16_t address, uint16_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) {
+        crc = _crc16_update(crc, EEPROM.read(address + i));
+    }
+    return crc;
+}
+
+int8_t ProgramCheckpoint::findLatestSlot(uint32_t& latestSequence) {
+    int8_t latest = -1;
+    latestSequence = 0;
+    for (uint8_t slot = 0; slot < EEPROM_CHECKPOINT_SLOT_COUNT; slot++) {
+        RecordHeader header;
+        if (readSlot(slot, header) && (latest < 0 || header.sequence > latestSequence)) {
+            latest = slot;
+            latestSequence = header.sequence;
+        }
+    }
+    return latest;
+}
@@ -0,0 +1,107 @@
+// ProgramCheckpoint.h
+#ifndef PROGRAM_CHECKPOINT_H
+#define PROGRAM_CHECKPOINT_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "EepromLayout.h"
+#include <logger/Logger.h>
+
+// Sequential writer for the checkpoint payload of a program.
+// Values are copied byte-wise (AVR layout); writing past the capacity invalidates the payload.
+class CheckpointWriter {
+public:
+    CheckpointWriter(uint8_t* buffer, uint8_t capacity)
+        : _buffer(buffer), _capacity(capacity), _length(0), _overflow(false) {}
+
+    template<typename T> void write(const T& value) {
+        if (_length + sizeof(T) > _capacity) {
+            _overflow = true;
+            return;
+        }
+        memcpy(_buffer + _length, &value, sizeof(T));
+        _length += sizeof(T);
+    }
+
+    // Length-prefixed string, truncated to maxLength characters
+    void writeString(const String& value, uint8_t maxLength);
+
+    uint8_t length() const { return _overflow ? 0 : _length; }
+
+private:
+    uint8_t* _buffer;
+    uint8_t _capacity;
+    uint8_t _length;
+    bool _overflow;
+};
+
+// Sequential reader matching CheckpointWriter
+class CheckpointReader {
+public:
+    CheckpointReader(const uint8_t* buffer, uint8_t length)
+        : _buffer(buffer), _length(length), _position(0), _error(false) {}
+
+    template<typename T> void read(T& value) {
+        if (_position + sizeof(T) > _length) {
+            _error = true;
+            return;
+        }
+        memcpy(&value, _buffer + _position, sizeof(T));
+        _position += sizeof(T);
+    }
+
+    void readString(String& value);
+
+    bool ok() const { return !_error; }
+
+private:
+    const uint8_t* _buffer;
+    uint8_t _length;
+    uint8_t _position;
+    bool _error;
+};
+
+// CRC-protected EEPROM record holding the checkpoint of the running program.
+// Checkpoints rotate over EEPROM_CHECKPOINT_SLOT_COUNT slots and are written with EEPROM.put,
+// which only rewrites the bytes that changed since the slot was last used; the valid record with
+// the highest sequence number is the current one, and clear() invalidates all of them.
+class ProgramCheckpoint {
+public:
+    static const uint16_t MAGIC = 0xC4EC;
+    static const uint8_t VERSION = 1;
+    static const uint8_t PROGRAM_NAME_SIZE = 16;
+    static const uint8_t MAX_PAYLOAD = 80;  // Fermentation: 39 bytes of fields and two strings of 12 characters
+
+    struct Info {
+        char program[PROGRAM_NAME_SIZE];  // Name of the checkpointed program
+        uint32_t wallTime;                // Unix time of the checkpoint, 0 if the clock was not set
+        uint32_t uptime;                  // millis() at the checkpoint
+    };
+
+    static bool save(const String& programName, const uint8_t* payload, uint8_t length);
+    static bool load(Info& info, uint8_t* payload, uint8_t& length);
+    static void clear();
+    static bool exists();
+
+private:
+    struct RecordHeader {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t length;     // Payload length
+        uint32_t sequence;  // Incremented on every save
+        Info info;
+    };
+
+    static_assert(sizeof(RecordHeader) + MAX_PAYLOAD + sizeof(uint16_t) <= EEPROM_CHECKPOINT_SLOT_SIZE,
+                  "Program checkpoint does not fit in an EEPROM slot");
+
+    static int8_t activeSlot;
+    static uint32_t sequence;
+
+    static uint16_t slotAddress(uint8_t slot);
+    static bool readSlot(uint8_t slot, RecordHeader& header);
+    static uint16_t computeCRC(uint16_t address, uint16_t length);
+    static int8_t findLatestSlot(uint32_t& latestSequence);
+};
+
+#endif // PROGRAM_CHECKPOINT_H
@@ -0,0 +1,63 @@
+// RecipeBytecode.h
+#ifndef RECIPE_BYTECODE_H
+#define RECIPE_BYTECODE_H
+
+#include <Arduino.h>
+
+// Bytecode of fermentation recipes run by RecipeProgram.
+// Each instruction is an opcode byte followed by fixed-size little-endian operands:
+//
+//   END                                     end of the recipe
+//   SET      target:u8 value:f32            set a setpoint/actuator at once
+//   RAMP     target:u8 value:f32 time:u32   ramp linearly from the current value over time (s)
+//   HOLD     time:u32                       wait for time (s)
+//   WAIT     sensor:u8 cmp:u8 value:f32 timeout:u32   wait until sensor <cmp> value, 0 = no timeout (s)
+//   LOOP     count:u8                       repeat the body up to ENDLOOP count times, 0 = forever
+//   ENDLOOP
+//   OFF      target:u8                      stop a PID loop or actuator
+//   MARK     phase:u8                       log the start of a recipe phase
+//
+// Times are measured in millis(), so a duration may not exceed RECIPE_MAX_DURATION (49.7 days).
+//
+// Keep integration/arduino_mega/tools/recipe_compiler.py in sync when changing this file.
+
+const uint32_t RECIPE_MAX_DURATION = 4294967;   // s, UINT32_MAX ms
+
+enum class RecipeOp : uint8_t {
+    END = 0x00,
+    SET = 0x01,
+    RAMP = 0x02,
+    HOLD = 0x03,
+    WAIT = 0x04,
+    LOOP = 0x05,
+    ENDLOOP = 0x06,
+    OFF = 0x07,
+    MARK = 0x08
+};
+
+enum class RecipeTarget : uint8_t {
+    TEMPERATURE,   // Temperature PID setpoint (°C)
+    PH,            // pH PID setpoint
+    DO,            // Dissolved oxygen PID setpoint (%)
+    STIRRING,      // Stirring motor speed (RPM)
+    AIR,           // Air pump speed (%)
+    LIGHT,         // LED grow light intensity (%)
+    NUTRIENT,      // Nutrient pump flow rate (ml/min)
+    COUNT
+};
+
+enum class RecipeSensor : uint8_t {
+    TEMPERATURE,
+    PH,
+    DO,
+    TURBIDITY,
+    VOLUME,        // Culture volume (L)
+    COUNT
+};
+
+enum class RecipeCompare : uint8_t {
+    BELOW,
+    ABOVE
+};
+
+#endif // RECIPE_BYTECODE_H
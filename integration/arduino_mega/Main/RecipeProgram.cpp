@@ -0,0 +1,428 @@
+// RecipeProgram.cpp
+#include "RecipeProgram.h"
+
+RecipeProgram::RecipeProgram(PIDManager& pidManager, VolumeManager& volumeManager)
+    : pidManager(pidManager), volumeManager(volumeManager),
+      pc(0), codeLength(0), phase(0), instructionStart(0), pauseStartTime(0), lastActionTime(0),
+      instructionStarted(false), rampFrom(0), loopDepth(0), activeTargets(0) {
+    memset(setpoints, 0, sizeof(setpoints));
+}
+
+void RecipeProgram::start(const String& command) {
+    if (!RecipeStore::isValid()) {
+        Logger::log(LogLevel::ERROR, "No valid recipe in EEPROM. Upload one with recipe_begin/recipe_write/recipe_commit.");
+        return;
+    }
+    codeLength = RecipeStore::getLength();
+    pc = 0;
+    phase = 0;
+    loopDepth = 0;
+    instructionStarted = false;
+    activeTargets = 0;
+    memset(setpoints, 0, sizeof(setpoints));
+    _isRunning = true;
+    _isPaused = false;
+    Logger::log(LogLevel::INFO, "Recipe started (" + String(codeLength) + " bytes)");
+}
+
+void RecipeProgram::update() {
+    if (!_isRunning || _isPaused) return;
+
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < MAX_INSTRUCTIONS_PER_TICK && _isRunning; i++) {
+        Instruction instruction;
+        if (!decode(pc, codeLength, instruction)) {
+            Logger::log(LogLevel::ERROR, "Invalid recipe instruction at " + String(pc));
+            stop();
+            return;
+        }
+        if (!execute(instruction, now)) {
+            return;  // Blocking instruction still in progress
+        }
+    }
+}
+
+// Executes one instruction; returns false while a timed/conditional instruction is still in progress
+bool RecipeProgram::execute(const Instruction& instruction, unsigned long now) {
+    if (!instructionStarted) {
+        instructionStarted = true;
+        instructionStart = now;
+        lastActionTime = 0;
+        if (instruction.op == RecipeOp::RAMP) {
+            rampFrom = setpoints[instruction.arg];
+        }
+    }
+    unsigned long elapsed = now - instructionStart;
+
+    switch (instruction.op) {
+        case RecipeOp::END:
+            finish();
+            return false;
+        case RecipeOp::SET:
+            applyTarget(instruction.arg, instruction.value);
+            break;
+        case RecipeOp::RAMP: {
+            unsigned long duration = instruction.time * 1000UL;
+            if (elapsed < duration) {
+                if (lastActionTime == 0 || now - lastActionTime >= RAMP_UPDATE_INTERVAL) {
+                    lastActionTime = now;
+                    applyTarget(instruction.arg, rampFrom + (instruction.value - rampFrom) * ((float)elapsed / duration));
+                }
+                return false;
+            }
+            applyTarget(instruction.arg, instruction.value);
+            break;
+        }
+        case RecipeOp::HOLD:
+            if (elapsed < instruction.time * 1000UL) return false;
+            break;
+        case RecipeOp::WAIT: {
+            if (lastActionTime != 0 && now - lastActionTime < CONDITION_CHECK_INTERVAL) return false;
+            lastActionTime = now;
+            float reading = readSensor(instruction.arg);
+            bool reached = (instruction.compare == static_cast<uint8_t>(RecipeCompare::BELOW)) ? reading < instruction.value
+                                                                                                : reading > instruction.value;
+            if (!reached) {
+                if (instruction.time == 0 || elapsed < instruction.time * 1000UL) return false;
+                Logger::log(LogLevel::WARNING, "Recipe wait timed out at " + String(pc) + " (reading " + String(reading) + ")");
+            }
+            break;
+        }
+        case RecipeOp::LOOP:
+            if (loopDepth >= MAX_LOOP_DEPTH) {
+                Logger::log(LogLevel::ERROR, "Recipe loops nested too deep");
+                stop();
+                return false;
+            }
+            loops[loopDepth].bodyStart = pc + instruction.size;
+            loops[loopDepth].remaining = instruction.arg;
+            loopDepth++;
+            break;
+        case RecipeOp::ENDLOOP: {
+            instructionStarted = false;
+            if (loopDepth == 0) break;
+            LoopFrame& loop = loops[loopDepth - 1];
+            if (loop.remaining == 0 || --loop.remaining > 0) {
+                pc = loop.bodyStart;
+                return true;
+            }
+            loopDepth--;
+            break;
+        }
+        case RecipeOp::OFF:
+            turnOffTarget(instruction.arg);
+            break;
+        case RecipeOp::MARK:
+            phase = instruction.arg;
+            Logger::log(LogLevel::INFO, "Recipe phase " + String(phase));
+            break;
+    }
+    instructionStarted = false;
+    pc += instruction.size;
+    return true;
+}
+
+// The PID loops are frozen; nutrient feeding, air and light are stopped and the stirring slowed to its minimum
+// (as FermentationProgram does), then restored from the setpoints on resume
+void RecipeProgram::pause() {
+    if (!_isRunning || _isPaused) return;
+    _isPaused = true;
+    pauseStartTime = millis();
+    pidManager.pauseAllPID();
+    ActuatorController::stopActuator("nutrientPump");
+    ActuatorController::stopActuator("airPump");
+    ActuatorController::stopActuator("ledGrowLight");
+    if (activeTargets & (1 << static_cast<uint8_t>(RecipeTarget::STIRRING))) {
+        ActuatorController::runActuator("stirringMotor", ActuatorController::getStirringMotorMinRPM(), 0);
+    }
+    Logger::log(LogLevel::INFO, "Recipe paused");
+}
+
+void RecipeProgram::resume() {
+    if (!_isRunning || !_isPaused) return;
+    _isPaused = false;
+    instructionStart += millis() - pauseStartTime;  // Timed instructions do not count the pause
+    pidManager.resumeAllPID();
+    for (uint8_t target = 0; target < TARGET_COUNT; target++) {
+        if (!isPIDTarget(target) && (activeTargets & (1 << target))) {
+            applyTarget(target, setpoints[target]);
+        }
+    }
+    Logger::log(LogLevel::INFO, "Recipe resumed");
+}
+
+void RecipeProgram::stop() {
+    if (!_isRunning) return;
+    _isRunning = false;
+    _isPaused = false;
+    ActuatorController::stopAllActuators();
+    pidManager.stop();
+    activeTargets = 0;
+    Logger::log(LogLevel::INFO, "Recipe stopped at " + String(pc));
+}
+
+void RecipeProgram::finish() {
+    stop();
+    Logger::log(LogLevel::INFO, "Recipe completed");
+}
+
+void RecipeProgram::parseCommand(const String& command) {
+    // The recipe is uploaded with the recipe_* commands; "recipe" takes no parameters
+}
+
+// Every recipe target: PID loops (heating plate, base pump, air pump), stirring, light and nutrient feeding
+ActuatorMask RecipeProgram::getActuatorMask(const String& command) const {
+    return actuatorBit(ActuatorId::HEATING_PLATE) | actuatorBit(ActuatorId::BASE_PUMP) | actuatorBit(ActuatorId::AIR_PUMP) |
+           actuatorBit(ActuatorId::STIRRING_MOTOR) | actuatorBit(ActuatorId::NUTRIENT_PUMP) | actuatorBit(ActuatorId::LED_GROW_LIGHT);
+}
+
+bool RecipeProgram::isPIDTarget(uint8_t target) {
+    return target <= static_cast<uint8_t>(RecipeTarget::DO);
+}
+
+// A PID loop that stopped by itself (input within its hysteresis band) is started again for a new setpoint
+void RecipeProgram::applyTarget(uint8_t target, float value) {
+    if (target >= TARGET_COUNT) return;
+    setpoints[target] = value;
+    activeTargets |= (1 << target);
+
+    switch (static_cast<RecipeTarget>(target)) {
+        case RecipeTarget::TEMPERATURE:
+            if (pidManager.isTemperaturePIDRunning()) pidManager.setTemperatureSetpoint(value); else pidManager.startTemperaturePID(value);
+            break;
+        case RecipeTarget::PH:
+            if (pidManager.isPHPIDRunning()) pidManager.setPHSetpoint(value); else pidManager.startPHPID(value);
+            break;
+        case RecipeTarget::DO:
+            if (pidManager.isDOPIDRunning()) pidManager.setDOSetpoint(value); else pidManager.startDOPID(value);
+            break;
+        case RecipeTarget::STIRRING:
+            pidManager.setMinStirringSpeed(value);
+            ActuatorController::runActuator("stirringMotor", value, 0);
+            break;
+        case RecipeTarget::AIR:
+            ActuatorController::runActuator("airPump", value, 0);
+            break;
+        case RecipeTarget::LIGHT:
+            ActuatorController::runActuator("ledGrowLight", value, 0);
+            break;
+        case RecipeTarget::NUTRIENT:
+            if (value > 0) {
+                ActuatorController::runActuator("nutrientPump", value, 0);
+            } else {
+                ActuatorController::stopActuator("nutrientPump");
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void RecipeProgram::turnOffTarget(uint8_t target) {
+    if (target >= TARGET_COUNT) return;
+    activeTargets &= ~(1 << target);
+    setpoints[target] = 0;
+
+    switch (static_cast<RecipeTarget>(target)) {
+        case RecipeTarget::TEMPERATURE: pidManager.stopTemperaturePID(); break;
+        case RecipeTarget::PH: pidManager.stopPHPID(); break;
+        case RecipeTarget::DO: pidManager.stopDOPID(); break;
+        case RecipeTarget::STIRRING: ActuatorController::stopActuator("stirringMotor"); break;
+        case RecipeTarget::AIR: ActuatorController::stopActuator("airPump"); break;
+        case RecipeTarget::LIGHT: ActuatorController::stopActuator("ledGrowLight"); break;
+        case RecipeTarget::NUTRIENT: ActuatorController::stopActuator("nutrientPump"); break;
+        default: break;
+    }
+}
+
+float RecipeProgram::readSensor(uint8_t sensor) {
+    switch (static_cast<RecipeSensor>(sensor)) {
+        case RecipeSensor::TEMPERATURE: return SensorController::readSensor("waterTempSensor");
+        case RecipeSensor::PH: return SensorController::readSensor("phSensor");
+        case RecipeSensor::DO: return SensorController::readSensor("oxygenSensor");
+        case RecipeSensor::TURBIDITY: return SensorController::readSensor("turbiditySensorSEN0554");
+        case RecipeSensor::VOLUME: return volumeManager.getCurrentVolume();
+        default: return NAN;
+    }
+}
+
+// Decodes the instruction at address; returns false if it is unknown or runs past the code
+bool RecipeProgram::decode(uint16_t address, uint16_t length, Instruction& instruction) {
+    if (address >= length) return false;
+    instruction.op = static_cast<RecipeOp>(RecipeStore::readByte(address));
+    instruction.arg = 0;
+    instruction.compare = 0;
+    instruction.value = 0;
+    instruction.time = 0;
+
+    switch (instruction.op) {
+        case RecipeOp::END:
+        case RecipeOp::ENDLOOP:
+            instruction.size = 1;
+            break;
+        case RecipeOp::LOOP:
+        case RecipeOp::MARK:
+            instruction.size = 2;
+            break;
+        case RecipeOp::OFF:
+            instruction.size = 2;
+            break;
+        case RecipeOp::SET:
+            instruction.size = 6;
+            break;
+        case RecipeOp::RAMP:
+            instruction.size = 10;
+            break;
+        case RecipeOp::HOLD:
+            instruction.size = 5;
+            break;
+        case RecipeOp::WAIT:
+            instruction.size = 11;
+            break;
+        default:
+            return false;
+    }
+    if (address + instruction.size > length) return false;
+
+    switch (instruction.op) {
+        case RecipeOp::LOOP:
+        case RecipeOp::MARK:
+        case RecipeOp::OFF:
+            instruction.arg = RecipeStore::readByte(address + 1);
+            break;
+        case RecipeOp::SET:
+            instruction.arg = RecipeStore::readByte(address + 1);
+            RecipeStore::read(address + 2, instruction.value);
+            break;
+        case RecipeOp::RAMP:
+            instruction.arg = RecipeStore::readByte(address + 1);
+            RecipeStore::read(address + 2, instruction.value);
+            RecipeStore::read(address + 6, instruction.time);
+            break;
+        case RecipeOp::HOLD:
+            RecipeStore::read(address + 1, instruction.time);
+            break;
+        case RecipeOp::WAIT:
+            instruction.arg = RecipeStore::readByte(address + 1);
+            instruction.compare = RecipeStore::readByte(address + 2);
+            RecipeStore::read(address + 3, instruction.value);
+            RecipeStore::read(address + 7, instruction.time);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+bool RecipeProgram::validate(uint16_t length) {
+    uint16_t address = 0;
+    uint8_t depth = 0;
+    while (address < length) {
+        Instruction instruction;
+        if (!decode(address, length, instruction)) {
+            Logger::log(LogLevel::ERROR, "Recipe: invalid instruction at " + String(address));
+            return false;
+        }
+        bool targetOp = instruction.op == RecipeOp::SET || instruction.op == RecipeOp::RAMP || instruction.op == RecipeOp::OFF;
+        if (targetOp && instruction.arg >= TARGET_COUNT) {
+            Logger::log(LogLevel::ERROR, "Recipe: invalid target at " + String(address));
+            return false;
+        }
+        if (instruction.op == RecipeOp::WAIT &&
+            (instruction.arg >= static_cast<uint8_t>(RecipeSensor::COUNT) || instruction.compare > static_cast<uint8_t>(RecipeCompare::ABOVE))) {
+            Logger::log(LogLevel::ERROR, "Recipe: invalid condition at " + String(address));
+            return false;
+        }
+        if (instruction.time > RECIPE_MAX_DURATION) {
+            Logger::log(LogLevel::ERROR, "Recipe: duration over " + String(RECIPE_MAX_DURATION) + " s at " + String(address));
+            return false;
+        }
+        if (instruction.op == RecipeOp::LOOP && ++depth > MAX_LOOP_DEPTH) {
+            Logger::log(LogLevel::ERROR, "Recipe: loops nested too deep at " + String(address));
+            return false;
+        }
+        if (instruction.op == RecipeOp::ENDLOOP && depth-- == 0) {
+            Logger::log(LogLevel::ERROR, "Recipe: ENDLOOP without LOOP at " + String(address));
+            return false;
+        }
+        if (instruction.op == RecipeOp::END) {
+            if (depth != 0) {
+                Logger::log(LogLevel::ERROR, "Recipe: unterminated loop");
+                return false;
+            }
+            return true;
+        }
+        address += instruction.size;
+    }
+    Logger::log(LogLevel::ERROR, "Recipe: missing END");
+    return false;
+}
+
+// Checkpoint payload: recipe CRC, program counter, progress of the current instruction, loops and setpoints
+bool RecipeProgram::saveCheckpoint(CheckpointWriter& writer) const {
+    if (!_isRunning) return false;
+    unsigned long now = _isPaused ? pauseStartTime : millis();
+    uint32_t elapsed = instructionStarted ? now - instructionStart : 0;
+
+    writer.write(RecipeStore::getCRC());
+    writer.write(pc);
+    writer.write(phase);
+    writer.write(instructionStarted);
+    writer.write(elapsed);
+    writer.write(rampFrom);
+    writer.write(loopDepth);
+    for (uint8_t i = 0; i < loopDepth; i++) {
+        writer.write(loops[i].bodyStart);
+        writer.write(loops[i].remaining);
+    }
+    writer.write(activeTargets);
+    for (uint8_t i = 0; i < TARGET_COUNT; i++) {
+        if (activeTargets & (1 << i)) writer.write(setpoints[i]);
+    }
+    return true;
+}
+
+bool RecipeProgram::restoreCheckpoint(CheckpointReader& reader) {
+    uint16_t crc;
+    uint32_t elapsed;
+    uint8_t targets;
+    reader.read(crc);
+    if (!reader.ok() || !RecipeStore::isValid() || crc != RecipeStore::getCRC()) {
+        Logger::log(LogLevel::ERROR, "Recipe changed since the checkpoint, not resuming");
+        return false;
+    }
+    reader.read(pc);
+    reader.read(phase);
+    reader.read(instructionStarted);
+    reader.read(elapsed);
+    reader.read(rampFrom);
+    reader.read(loopDepth);
+    if (loopDepth > MAX_LOOP_DEPTH) return false;
+    for (uint8_t i = 0; i < loopDepth; i++) {
+        reader.read(loops[i].bodyStart);
+        reader.read(loops[i].remaining);
+    }
+    reader.read(targets);
+    float values[TARGET_COUNT];
+    for (uint8_t i = 0; i < TARGET_COUNT; i++) {
+        values[i] = 0;
+        if (targets & (1 << i)) reader.read(values[i]);
+    }
+    if (!reader.ok()) {
+        Logger::log(LogLevel::ERROR, "Invalid recipe checkpoint");
+        return false;
+    }
+
+    codeLength = RecipeStore::getLength();
+    instructionStart = millis() - elapsed;
+    lastActionTime = 0;
+    _isRunning = true;
+    _isPaused = false;
+    activeTargets = 0;
+    for (uint8_t i = 0; i < TARGET_COUNT; i++) {
+        setpoints[i] = values[i];
+        if (targets & (1 << i)) applyTarget(i, values[i]);
+    }
+    Logger::log(LogLevel::INFO, "Recipe resumed from checkpoint at " + String(pc) + ", phase " + String(phase));
+    return true;
+}
@@ -0,0 +1,86 @@
+// RecipeProgram.h
+#ifndef RECIPE_PROGRAM_H
+#define RECIPE_PROGRAM_H
+
+#include "ProgramBase.h"
+#include "PIDManager.h"
+#include "VolumeManager.h"
+#include "ActuatorController.h"
+#include "SensorController.h"
+#include "RecipeBytecode.h"
+#include "RecipeStore.h"
+#include <logger/Logger.h>
+
+// Runs the multi-phase fermentation recipe stored in EEPROM (see RecipeBytecode.h).
+// The code is fetched from EEPROM one instruction at a time, so RAM use is constant whatever
+// the recipe length, and at most MAX_INSTRUCTIONS_PER_TICK instructions run per update().
+class RecipeProgram : public ProgramBase {
+public:
+    RecipeProgram(PIDManager& pidManager, VolumeManager& volumeManager);
+
+    void start(const String& command) override;
+    void update() override;
+    void pause() override;
+    void resume() override;
+    void stop() override;
+    bool isRunning() const override { return _isRunning; }
+    bool isPaused() const override { return _isPaused; }
+    String getName() const override { return "Recipe"; }
+    void parseCommand(const String& command) override;
+    ActuatorMask getActuatorMask(const String& command) const override;
+    bool saveCheckpoint(CheckpointWriter& writer) const override;
+    bool restoreCheckpoint(CheckpointReader& reader) override;
+
+    // Checks the opcodes, operands and loop nesting of the stored code
+    static bool validate(uint16_t length);
+
+    uint16_t getProgramCounter() const { return pc; }
+    uint8_t getPhase() const { return phase; }
+
+private:
+    struct Instruction {
+        RecipeOp op;
+        uint8_t arg;        // Target, sensor or loop count
+        uint8_t compare;
+        float value;
+        uint32_t time;      // Duration or timeout (s)
+        uint8_t size;       // Encoded size in bytes
+    };
+
+    struct LoopFrame {
+        uint16_t bodyStart;
+        uint8_t remaining;  // 0 = forever
+    };
+
+    static const uint8_t MAX_LOOP_DEPTH = 4;
+    static const uint8_t MAX_INSTRUCTIONS_PER_TICK = 8;
+    static const uint8_t TARGET_COUNT = static_cast<uint8_t>(RecipeTarget::COUNT);
+    static const unsigned long RAMP_UPDATE_INTERVAL = 5000;       // ms
+    static const unsigned long CONDITION_CHECK_INTERVAL = 1000;   // ms
+
+    PIDManager& pidManager;
+    VolumeManager& volumeManager;
+
+    uint16_t pc;
+    uint16_t codeLength;
+    uint8_t phase;
+    unsigned long instructionStart;   // Start of the current timed instruction
+    unsigned long pauseStartTime;
+    unsigned long lastActionTime;     // Last ramp update or condition check
+    bool instructionStarted;
+    float rampFrom;
+    LoopFrame loops[MAX_LOOP_DEPTH];
+    uint8_t loopDepth;
+    float setpoints[TARGET_COUNT];
+    uint8_t activeTargets;            // Bit per RecipeTarget that was set and not turned off
+
+    static bool decode(uint16_t address, uint16_t length, Instruction& instruction);
+    bool execute(const Instruction& instruction, unsigned long now);
+    void applyTarget(uint8_t target, float value);
+    static bool isPIDTarget(uint8_t target);
+    void turnOffTarget(uint8_t target);
+    float readSensor(uint8_t sensor);
+    void finish();
+};
+
+#endif // RECIPE_PROGRAM_H
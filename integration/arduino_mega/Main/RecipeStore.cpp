@@ -0,0 +1,69 @@
+// RecipeStore.cpp
+#include "RecipeStore.h"
+#include "RecipeProgram.h"
+#include <util/crc16.h>
+
+void RecipeStore::begin() {
+    EEPROM.update(EEPROM_RECIPE_ADDR, 0xFF);
+    EEPROM.update(EEPROM_RECIPE_ADDR + 1, 0xFF);
+    Logger::log(LogLevel::INFO, "Recipe upload started (capacity " + String(getCapacity()) + " bytes)");
+}
+
+bool RecipeStore::write(uint16_t offset, const uint8_t* data, uint8_t length) {
+    if (offset + length > getCapacity()) {
+        Logger::log(LogLevel::ERROR, "Recipe chunk out of range at offset " + String(offset));
+        return false;
+    }
+    for (uint8_t i = 0; i < length; i++) {
+        EEPROM.update(CODE_ADDR + offset + i, data[i]);
+    }
+    return true;
+}
+
+bool RecipeStore::commit(uint16_t length, uint16_t crc) {
+    if (length == 0 || length > getCapacity()) {
+        Logger::log(LogLevel::ERROR, "Invalid recipe length: " + String(length));
+        return false;
+    }
+    uint16_t computed = computeCRC(length);
+    if (computed != crc) {
+        Logger::log(LogLevel::ERROR, "Recipe CRC mismatch: expected " + String(crc, HEX) + ", got " + String(computed, HEX));
+        return false;
+    }
+    if (!RecipeProgram::validate(length)) {
+        return false;
+    }
+    RecordHeader header = { MAGIC, VERSION, 0, length, crc };
+    EEPROM.put(EEPROM_RECIPE_ADDR, header);
+    Logger::log(LogLevel::INFO, "Recipe stored: " + String(length) + " bytes, CRC " + String(crc, HEX));
+    return true;
+}
+
+bool RecipeStore::isValid() {
+    RecordHeader header;
+    return readHeader(header) && computeCRC(header.length) == header.crc;
+}
+
+uint16_t RecipeStore::getLength() {
+    RecordHeader header;
+    return readHeader(header) ? header.length : 0;
+}
+
+uint16_t RecipeStore::getCRC() {
+    RecordHeader header;
+    return readHeader(header) ? header.crc : 0;
+}
+
+bool RecipeStore::readHeader(RecordHeader& header) {
+    EEPROM.get(EEPROM_RECIPE_ADDR, header);
+    return header.magic == MAGIC && header.version == VERSION && header.length > 0 && header.length <= getCapacity();
+}
+
+// CRC-16/MODBUS (polynomial 0xA001, initial value 0xFFFF)
+uint16_t RecipeStore::computeCRC(uint16_t length) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++) {
+        crc = _crc16_update(crc, EEPROM.read(CODE_ADDR + i));
+    }
+    return crc;
+}
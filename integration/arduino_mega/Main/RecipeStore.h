@@ -0,0 +1,45 @@
+// RecipeStore.h
+#ifndef RECIPE_STORE_H
+#define RECIPE_STORE_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "EepromLayout.h"
+#include <logger/Logger.h>
+
+// EEPROM storage of the recipe bytecode, uploaded in chunks over the command interface:
+// begin() invalidates the stored recipe, write() stores chunks, commit() checks the CRC of the
+// whole code and validates it before marking the recipe as valid, so a partial upload never runs.
+class RecipeStore {
+public:
+    static const uint16_t MAGIC = 0x5EC1;
+    static const uint8_t VERSION = 1;
+
+    static void begin();
+    static bool write(uint16_t offset, const uint8_t* data, uint8_t length);
+    static bool commit(uint16_t length, uint16_t crc);
+
+    static bool isValid();
+    static uint16_t getLength();       // Length of the valid recipe, 0 if none
+    static uint16_t getCRC();
+    static uint16_t getCapacity() { return EEPROM_RECIPE_SIZE - sizeof(RecordHeader); }
+
+    static uint8_t readByte(uint16_t offset) { return EEPROM.read(CODE_ADDR + offset); }
+    template<typename T> static void read(uint16_t offset, T& value) { EEPROM.get(CODE_ADDR + offset, value); }
+
+private:
+    struct RecordHeader {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t reserved;
+        uint16_t length;   // Code length
+        uint16_t crc;      // CRC-16/MODBUS of the code
+    };
+
+    static const uint16_t CODE_ADDR = EEPROM_RECIPE_ADDR + sizeof(RecordHeader);
+
+    static bool readHeader(RecordHeader& header);
+    static uint16_t computeCRC(uint16_t length);
+};
+
+#endif // RECIPE_STORE_H
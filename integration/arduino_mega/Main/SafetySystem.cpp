@@ -3,9 +3,49 @@
 
 SafetySystem::SafetySystem(float totalVolume, float maxVolumePercent, float minVolume)
     : totalVolume(totalVolume), maxVolumePercent(maxVolumePercent), minVolume(minVolume), 
-      stopRequired(false), logger(nullptr), alarmEnabled(false), warningEnabled(false),
-      lastCheckTime(0), checkInterval(30000) {} // 30 seconds by default
+      stopRequired(false), logger(nullptr), volumeManager(nullptr), alarmEnabled(false), warningEnabled(false),
+      lastCheckTime(0), checkInterval(0), ruleCount(0), volumeSampleTime(0) { // Checked on every call by default
+    memset(ruleState, 0, sizeof(ruleState));
+    memset(lastSampleTime, 0, sizeof(lastSampleTime));
 
+    // Persistence in samples: the temperatures and pH are sampled every 2 s, the volume every second
+    addRule("Water temperature low", SafetySource::WATER_TEMP, SafetyCompare::BELOW, MIN_WATER_TEMP, 0.5, 3, LogLevel::WARNING, false);
+    addRule("Water temperature high", SafetySource::WATER_TEMP, SafetyCompare::ABOVE, MAX_WATER_TEMP, 0.5, 3, LogLevel::WARNING, false);
+    addRule("Water temperature critical", SafetySource::WATER_TEMP, SafetyCompare::ABOVE, CRITICAL_WATER_TEMP, 1.0, 3, LogLevel::ERROR, true);
+    addRule("Air temperature low", SafetySource::AIR_TEMP, SafetyCompare::BELOW, MIN_AIR_TEMP, 0.5, 3, LogLevel::WARNING, false);
+    addRule("Air temperature high", SafetySource::AIR_TEMP, SafetyCompare::ABOVE, MAX_AIR_TEMP, 0.5, 3, LogLevel::WARNING, false);
+    addRule("Electronic temperature high", SafetySource::ELECTRONIC_TEMP, SafetyCompare::ABOVE, MAX_ELECTRONIC_TEMP - 10, 1.0, 3, LogLevel::WARNING, false);
+    addRule("Electronic temperature critical", SafetySource::ELECTRONIC_TEMP, SafetyCompare::ABOVE, MAX_ELECTRONIC_TEMP, 1.0, 3, LogLevel::ERROR, true);
+    addRule("pH low", SafetySource::PH, SafetyCompare::BELOW, MIN_PH, 0.1, 3, LogLevel::WARNING, false);
+    addRule("pH high", SafetySource::PH, SafetyCompare::ABOVE, MAX_PH, 0.1, 3, LogLevel::WARNING, false);
+    addRule("pH critical", SafetySource::PH, SafetyCompare::ABOVE, CRITICAL_PH, 0.2, 5, LogLevel::ERROR, true);
+    addRule("Dissolved oxygen low", SafetySource::OXYGEN, SafetyCompare::BELOW, MIN_DO, 100.0, 3, LogLevel::WARNING, false);
+    addRule("Turbidity high", SafetySource::TURBIDITY, SafetyCompare::ABOVE, MAX_TURBIDITY, 20.0, 3, LogLevel::WARNING, false);
+    minVolumeRule = ruleCount;
+    addRule("Volume below minimum", SafetySource::VOLUME, SafetyCompare::BELOW, minVolume + VOLUME_MARGIN, 0.01, 2, LogLevel::WARNING, false);
+    maxVolumeRule = ruleCount;
+    addRule("Volume near maximum", SafetySource::VOLUME, SafetyCompare::ABOVE, maxVolumePercent * totalVolume - VOLUME_MARGIN, 0.01, 2, LogLevel::ERROR, true);
+}
+
+// VolumeManager never reports a volume outside [getMinVolume(), getMaxAllowedVolume()]: the rules are
+// set just inside these bounds, or they could never trip
+void SafetySystem::setVolumeManager(VolumeManager* volumeManager) {
+    this->volumeManager = volumeManager;
+    if (!volumeManager) return;
+    rules[minVolumeRule].limit = volumeManager->getMinVolume() + VOLUME_MARGIN;
+    rules[maxVolumeRule].limit = volumeManager->getMaxAllowedVolume() - VOLUME_MARGIN;
+}
+
+void SafetySystem::addRule(const char* message, SafetySource source, SafetyCompare compare, float limit, float hysteresis,
+                           uint8_t persistence, LogLevel level, bool stopsSystem) {
+    if (ruleCount >= MAX_RULES) return;
+    rules[ruleCount] = {message, source, compare, limit, hysteresis, persistence, level, stopsSystem};
+    ruleCount++;
+}
+
+// Evaluates the rules against the latest samples. Only the sources with a new sample since the previous
+// call are evaluated, so calling this on every loop costs a few comparisons. Sensors are not read here:
+// SensorController::sampleNextSensor() keeps the samples fresh.
 void SafetySystem::checkLimits() {
     unsigned long currentTime = millis();
     if (currentTime - lastCheckTime < checkInterval) {
@@ -13,73 +53,77 @@ void SafetySystem::checkLimits() {
     }
     lastCheckTime = currentTime;
 
-    stopRequired = false;
-    checkWaterTemperature();
-    checkAirTemperature();
-    checkElectronicTemperature();
-    checkPH();
-    checkDissolvedOxygen();
-    checkVolume();
-    checkTurbidity();
-}
-
-void SafetySystem::checkWaterTemperature() {
-    float temp = SensorController::readSensor("waterTempSensor");
-    if (temp < MIN_WATER_TEMP) logAlert("Water temperature low", LogLevel::WARNING);
-    if (temp > MAX_WATER_TEMP) logAlert("Water temperature high", LogLevel::WARNING);
-    if (temp > CRITICAL_WATER_TEMP) {
-        logAlert("Water temperature critical", LogLevel::ERROR);
-        stopRequired = true;
+    for (uint8_t source = 0; source < SOURCE_COUNT; source++) {
+        float value;
+        unsigned long time;
+        if (!getSample(static_cast<SafetySource>(source), value, time) || time == lastSampleTime[source]) {
+            continue;
+        }
+        lastSampleTime[source] = time;
+        if (isnan(value)) continue;
+        for (uint8_t i = 0; i < ruleCount; i++) {
+            if (static_cast<uint8_t>(rules[i].source) == source) {
+                evaluateRule(i, value);
+            }
+        }
     }
-}
 
-void SafetySystem::checkAirTemperature() {
-    float temp = SensorController::readSensor("airTempSensor");
-    if (temp < MIN_AIR_TEMP) logAlert("Air temperature low", LogLevel::WARNING);
-    if (temp > MAX_AIR_TEMP) logAlert("Air temperature high", LogLevel::WARNING);
+    stopRequired = false;
+    for (uint8_t i = 0; i < ruleCount; i++) {
+        if (ruleState[i].active && rules[i].stopsSystem) {
+            stopRequired = true;
+        }
+    }
 }
 
-void SafetySystem::checkPH() {
-    float pH = SensorController::readSensor("phSensor");
-    if (pH < MIN_PH) logAlert("pH low", LogLevel::WARNING);
-    if (pH > MAX_PH) logAlert("pH high", LogLevel::WARNING);
-    if (pH > CRITICAL_PH) {
-        logAlert("pH critical", LogLevel::ERROR);
-        stopRequired = true;
+bool SafetySystem::getSample(SafetySource source, float& value, unsigned long& time) {
+    if (source == SafetySource::VOLUME) {
+        if (!volumeManager) return false;
+        // The volume changes slowly: sample it at a fixed rate
+        unsigned long now = millis();
+        if (volumeSampleTime != 0 && now - volumeSampleTime < VOLUME_SAMPLE_INTERVAL) {
+            time = lastSampleTime[static_cast<uint8_t>(source)];
+        } else {
+            volumeSampleTime = now ? now : 1;
+            time = volumeSampleTime;
+        }
+        value = volumeManager->getCurrentVolume();
+        return true;
     }
+    const SensorSample& sample = SensorController::getSample(static_cast<SensorId>(source));
+    if (sample.time == 0) return false;
+    value = sample.value;
+    time = sample.time;
+    return true;
 }
 
-void SafetySystem::checkDissolvedOxygen() {
-    float do_percent = SensorController::readSensor("oxygenSensor");
-    if (do_percent < MIN_DO) logAlert("Dissolved oxygen low", LogLevel::WARNING);
-}
+// Debounced state change of one rule: alerts are only emitted on the transitions
+void SafetySystem::evaluateRule(uint8_t index, float value) {
+    const SafetyRule& rule = rules[index];
+    RuleState& state = ruleState[index];
 
-void SafetySystem::checkVolume() {
-    // Note: You'll need to implement a method to get the current volume
-    float volume = 0; // Replace with actual method to get current volume
-    if (volume <= minVolume) {
-        logAlert("Volume below minimum", LogLevel::WARNING);
-    }
-    if (volume >= maxVolumePercent * totalVolume) {
-        logAlert("Volume near maximum", LogLevel::ERROR);
-        stopRequired = true;
+    bool beyond, inside;
+    if (rule.compare == SafetyCompare::BELOW) {
+        beyond = value < rule.limit;
+        inside = value >= rule.limit + rule.hysteresis;
+    } else {
+        beyond = value > rule.limit;
+        inside = value <= rule.limit - rule.hysteresis;
     }
-}
 
-void SafetySystem::checkTurbidity() {
-    float turbidity = SensorController::readSensor("turbiditySensorSEN0554");
-    if (turbidity > MAX_TURBIDITY) {
-        logAlert("Turbidity high", LogLevel::WARNING);
+    if ((!state.active && beyond) || (state.active && inside)) {
+        if (state.count < 255) state.count++;
+    } else {
+        state.count = 0;
     }
-}
+    if (state.count < rule.persistence) return;
 
-void SafetySystem::checkElectronicTemperature() {
-    float temp = SensorController::readSensor("electronicTempSensor");
-    if (temp > MAX_ELECTRONIC_TEMP) {
-        logAlert("Electronic temperature critical", LogLevel::ERROR);
-        stopRequired = true;
-    } else if (temp > MAX_ELECTRONIC_TEMP - 10) {  // Warning at 5°C below the limit
-        logAlert("Electronic temperature high", LogLevel::WARNING);
+    state.count = 0;
+    state.active = !state.active;
+    if (state.active) {
+        logAlert(String(rule.message) + ": " + String(value), rule.level);
+    } else {
+        logAlert(String(rule.message) + " cleared: " + String(value), rule.level);
     }
 }
 
@@ -95,13 +139,15 @@ void SafetySystem::logAlert(const String& message, LogLevel level) {
 void SafetySystem::parseCommand(const String& command) {
     if (command.startsWith("warnings ")) {
         String value = command.substring(8);
+        value.trim();
         warningEnabled = (value == "true");
         logger->log(LogLevel::INFO, "Warnings set to " + String(warningEnabled ? "enabled" : "disabled"));
     } else if (command.startsWith("alarms ")) {
         String value = command.substring(6);
+        value.trim();
         alarmEnabled = (value == "true");
         logger->log(LogLevel::INFO, "Alarms set to " + String(alarmEnabled ? "enabled" : "disabled"));
     } else {
         logger->log(LogLevel::WARNING, "Unknown command: " + command);
     }
-}
\ No newline at end of file
+}
@@ -5,26 +5,70 @@
 #include <Arduino.h>
 #include "SensorController.h"
 #include "ActuatorController.h"
+#include "VolumeManager.h"
 #include <logger/Logger.h>
 
+// Value checked by a safety rule: one of the cached sensor samples, or the culture volume
+enum class SafetySource : uint8_t {
+    WATER_TEMP,
+    AIR_TEMP,
+    ELECTRONIC_TEMP,
+    PH,
+    OXYGEN,
+    AIR_FLOW,
+    TURBIDITY,
+    VOLUME,
+    COUNT
+};
+
+enum class SafetyCompare : uint8_t {
+    BELOW,
+    ABOVE
+};
+
+// A limit on one value. The rule becomes active after `persistence` consecutive samples beyond the
+// limit, and clears after as many samples back inside the limit by at least `hysteresis`.
+struct SafetyRule {
+    const char* message;
+    SafetySource source;
+    SafetyCompare compare;
+    float limit;
+    float hysteresis;
+    uint8_t persistence;
+    LogLevel level;         // WARNING, or ERROR for alarms
+    bool stopsSystem;       // The system must stop while the rule is active
+};
+
 class SafetySystem {
 public:
     SafetySystem(float totalVolume, float maxVolumePercent, float minVolume);
     void checkLimits();
     bool shouldStop() const { return stopRequired; }
     void setLogger(Logger* logger) { this->logger = logger; } //This allows the SafetySystem to use the same logger as the rest of this application, ensuring consistent logging.
+    void setVolumeManager(VolumeManager* volumeManager);  // The volume rules then follow its limits
     void parseCommand(const String& command);
+    // Minimum time between two evaluations (ms), 0 by default: the rules only evaluate new samples anyway
     void setCheckInterval(unsigned long interval) { checkInterval = interval; }
 
+    bool isRuleActive(uint8_t index) const { return index < ruleCount && ruleState[index].active; }
+    uint8_t getRuleCount() const { return ruleCount; }
+
 private:
-    void checkWaterTemperature();
-    void checkAirTemperature();
-    void checkElectronicTemperature();
-    void checkPH();
-    void checkDissolvedOxygen();
-    void checkVolume();
-    void checkTurbidity();
+    struct RuleState {
+        uint8_t count;      // Consecutive samples towards the opposite state
+        bool active;
+    };
 
+    static const uint8_t MAX_RULES = 16;
+    static const uint8_t SOURCE_COUNT = static_cast<uint8_t>(SafetySource::COUNT);
+    static const unsigned long VOLUME_SAMPLE_INTERVAL = 1000; // ms
+    // Inside the range VolumeManager clamps the volume to, so the volume rules can trip at its bounds
+    static constexpr float VOLUME_MARGIN = 0.01; // L
+
+    void addRule(const char* message, SafetySource source, SafetyCompare compare, float limit, float hysteresis,
+                 uint8_t persistence, LogLevel level, bool stopsSystem);
+    bool getSample(SafetySource source, float& value, unsigned long& time);
+    void evaluateRule(uint8_t index, float value);
     void logAlert(const String& message, LogLevel level);
 
     float totalVolume;
@@ -32,12 +76,21 @@ private:
     float minVolume;
     bool stopRequired;
     Logger* logger;
+    VolumeManager* volumeManager;
 
     bool alarmEnabled;
     bool warningEnabled;
     unsigned long lastCheckTime;
     unsigned long checkInterval;
 
+    SafetyRule rules[MAX_RULES];
+    RuleState ruleState[MAX_RULES];
+    uint8_t ruleCount;
+    uint8_t minVolumeRule;
+    uint8_t maxVolumeRule;
+    unsigned long lastSampleTime[SOURCE_COUNT];  // Time of the sample last evaluated, per source
+    unsigned long volumeSampleTime;
+
     // Safety thresholds
     static constexpr float MIN_WATER_TEMP = 15.0;
     static constexpr float MAX_WATER_TEMP = 45.0;
@@ -48,8 +101,8 @@ private:
     static constexpr float MIN_PH = 2.0;
     static constexpr float MAX_PH = 12.0;
     static constexpr float CRITICAL_PH = 10.0;
-    static constexpr float MIN_DO = 0.0;
+    static constexpr float MIN_DO = 2000.0;        // µg/L, as read by OxygenSensor (2 mg/L)
     static constexpr float MAX_TURBIDITY = 1000.0; // Example value, adjust as needed
 };
 
-#endif // SAFETY_SYSTEM_H
\ No newline at end of file
+#endif // SAFETY_SYSTEM_H
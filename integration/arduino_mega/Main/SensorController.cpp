@@ -1,4 +1,5 @@
 #include "SensorController.h"
+#include "ErrorHandler.h"
 
 // Static pointers, initialized to nullptr
 PT100Sensor* SensorController::waterTempSensor = nullptr;
@@ -9,6 +10,10 @@ OxygenSensor* SensorController::oxygenSensor = nullptr;
 AirFlowSensor* SensorController::airFlowSensor = nullptr;
 TurbiditySensorSEN0554* SensorController::turbiditySensorSEN0554 = nullptr;
 
+SensorSample SensorController::samples[SensorController::SENSOR_COUNT] = {};
+uint8_t SensorController::nextSample = 0;
+unsigned long SensorController::lastSampleTime = 0;
+
 // Initialize method
 void SensorController::initialize(PT100Sensor& waterTemp, DS18B20TemperatureSensor& airTemp, DS18B20TemperatureSensor& electronicTemp,
                                   PHSensor& ph,
@@ -36,16 +41,95 @@ void SensorController::beginAll() {
 }
 
 float SensorController::readSensor(const String& sensorName) {
-    SensorInterface* sensor = findSensorByName(sensorName);
-    if (sensor) {
-        float value = sensor->readValue();
-        //Logger::log(LogLevel::INFO, "Read sensor " + sensorName + ": " + String(value));
-        return value;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        SensorInterface* sensor = getSensor(static_cast<SensorId>(i));
+        if (sensor && sensorName == sensor->getName()) {
+            //Logger::log(LogLevel::INFO, "Read sensor " + sensorName + ": " + String(value));
+            return readAndCache(static_cast<SensorId>(i));
+        }
     }
     Logger::log(LogLevel::WARNING, "Sensor not found: " + sensorName);
     return 0.0f;
 }
 
+float SensorController::readAndCache(SensorId id) {
+    SensorInterface* sensor = getSensor(id);
+    if (!sensor) return 0.0f;
+    SensorSample& sample = samples[static_cast<uint8_t>(id)];
+    DS18B20TemperatureSensor* thermometer = getThermometer(id);
+    if (thermometer && !thermometer->isResultReady()) {
+        thermometer->startConversion();       // Never waited for: the last sample stands until it is done
+        return sample.time != 0 ? sample.value : NAN;
+    }
+    float value = sensor->readValue();
+    if (id == SensorId::AIR_FLOW && value < 0 && sample.time != 0) {
+        return sample.value;                  // Flow rate not updated yet, keep the last one
+    }
+    unsigned long now = millis();
+    if (!ErrorHandler::checkSample(id, value, now)) {
+        value = NAN;                          // Faulted channel, masked from the controllers
+    }
+    sample.value = value;
+    sample.time = now;
+    if (sample.time == 0) sample.time = 1;   // 0 means never read
+    return value;
+}
+
+void SensorController::sampleNextSensor() {
+    unsigned long now = millis();
+    if (now - lastSampleTime < SAMPLE_PERIOD / SENSOR_COUNT) return;
+    lastSampleTime = now;
+
+    // Skip the sensors read recently by someone else (PID loops, programs)
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        SensorId id = static_cast<SensorId>(nextSample);
+        nextSample = (nextSample + 1) % SENSOR_COUNT;
+        const SensorSample& sample = samples[static_cast<uint8_t>(id)];
+        if (sample.time == 0 || now - sample.time >= SAMPLE_PERIOD / 2) {
+            DS18B20TemperatureSensor* thermometer = getThermometer(id);
+            if (thermometer && !thermometer->isResultReady()) {
+                thermometer->startConversion();   // Read at its next turn
+                continue;
+            }
+            readAndCache(id);
+            return;
+        }
+    }
+}
+
+// Compared by age, so the result holds across the millis() rollover
+unsigned long SensorController::getLatestSampleTime() {
+    unsigned long now = millis();
+    unsigned long latest = 0;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        if (samples[i].time != 0 && (latest == 0 || now - samples[i].time < now - latest)) {
+            latest = samples[i].time;
+        }
+    }
+    return latest;
+}
+
+SensorInterface* SensorController::getSensor(SensorId id) {
+    switch (id) {
+        case SensorId::WATER_TEMP: return waterTempSensor;
+        case SensorId::AIR_TEMP: return airTempSensor;
+        case SensorId::ELECTRONIC_TEMP: return electronicTempSensor;
+        case SensorId::PH: return phSensor;
+        case SensorId::OXYGEN: return oxygenSensor;
+        case SensorId::AIR_FLOW: return airFlowSensor;
+        case SensorId::TURBIDITY: return turbiditySensorSEN0554;
+        default: return nullptr;
+    }
+}
+
+DS18B20TemperatureSensor* SensorController::getThermometer(SensorId id) {
+    switch (id) {
+        case SensorId::AIR_TEMP: return airTempSensor;
+        case SensorId::ELECTRONIC_TEMP: return electronicTempSensor;
+        default: return nullptr;
+    }
+}
+
 void SensorController::updateAllSensors() {
     readSensor(waterTempSensor->getName());
     readSensor(airTempSensor->getName());
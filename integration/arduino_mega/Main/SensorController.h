@@ -5,6 +5,24 @@
 #include <Arduino.h>
 #include <logger/Logger.h>
 
+// Sensor identifiers, used to index the cache of the latest samples
+enum class SensorId : uint8_t {
+    WATER_TEMP,
+    AIR_TEMP,
+    ELECTRONIC_TEMP,
+    PH,
+    OXYGEN,
+    AIR_FLOW,
+    TURBIDITY,
+    COUNT
+};
+
+// Latest reading of a sensor. Every read through readSensor() refreshes it, except while a DS18B20 converts.
+struct SensorSample {
+    float value;
+    unsigned long time;    // millis() of the reading, 0 if never read
+};
+
 class SensorController {
 public:
     static void initialize(PT100Sensor& waterTemp, DS18B20TemperatureSensor& airTemp, DS18B20TemperatureSensor& electronicTempSensor,
@@ -20,7 +38,26 @@ public:
     static SensorInterface* findSensorByName(const String& name);
     static void logSensorData();
 
+    // Reads at most one sensor per call, in turn, so that every sample is refreshed at least every
+    // SAMPLE_PERIOD without blocking the loop for a read of all sensors. A DS18B20 is read only once its
+    // conversion is over (it is then started again); until then its turn goes to the next sensor.
+    static void sampleNextSensor();
+    static const SensorSample& getSample(SensorId id) { return samples[static_cast<uint8_t>(id)]; }
+    // millis() of the newest cached sample, 0 if no sensor was read yet
+    static unsigned long getLatestSampleTime();
+    static SensorInterface* getSensor(SensorId id);
+
+    static const unsigned long SAMPLE_PERIOD = 2000; // ms
+
 private:
+    static const uint8_t SENSOR_COUNT = static_cast<uint8_t>(SensorId::COUNT);
+    static SensorSample samples[SENSOR_COUNT];
+    static uint8_t nextSample;
+    static unsigned long lastSampleTime;
+
+    static float readAndCache(SensorId id);
+    static DS18B20TemperatureSensor* getThermometer(SensorId id);
+
     static PT100Sensor* waterTempSensor;
     static DS18B20TemperatureSensor* airTempSensor;
     static DS18B20TemperatureSensor* electronicTempSensor;
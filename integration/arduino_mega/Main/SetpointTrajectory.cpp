@@ -0,0 +1,69 @@
+// SetpointTrajectory.cpp
+#include "SetpointTrajectory.h"
+
+SetpointTrajectory::SetpointTrajectory(TrajectoryProfile profile, float rateLimit)
+    : _profile(profile), _rateLimit(rateLimit), _phase(TrajectoryPhase::IDLE),
+      _from(0), _target(0), _setpoint(0), _startTime(0), _rampTime(0), _soakTime(0), _elapsed(0) {
+}
+
+void SetpointTrajectory::start(float from, float target, unsigned long now, unsigned long soakTime) {
+    _from = from;
+    _target = target;
+    _startTime = now;
+    _soakTime = soakTime;
+    _elapsed = 0;
+
+    float distance = fabs(target - from);
+    if (_profile == TrajectoryProfile::STEP || _rateLimit <= 0 || isnan(from) || distance == 0) {
+        _rampTime = 0;
+    } else {
+        float minutes = distance / _rateLimit;
+        if (_profile == TrajectoryProfile::S_CURVE) {
+            minutes *= 1.5;  // Peak slope of the smoothstep is 1.5x its average slope
+        }
+        _rampTime = (unsigned long)(minutes * 60000.0);
+    }
+    _setpoint = (_rampTime == 0) ? target : from;
+    _phase = TrajectoryPhase::RAMP;
+    update(now);
+}
+
+void SetpointTrajectory::hold(float value) {
+    _from = value;
+    _target = value;
+    _setpoint = value;
+    _phase = TrajectoryPhase::IDLE;
+}
+
+float SetpointTrajectory::update(unsigned long now) {
+    if (_phase == TrajectoryPhase::IDLE || _phase == TrajectoryPhase::DONE) {
+        return _setpoint;
+    }
+    _elapsed = now - _startTime;
+
+    if (_elapsed < _rampTime) {
+        float t = (float)_elapsed / _rampTime;
+        if (_profile == TrajectoryProfile::S_CURVE) {
+            t = t * t * (3 - 2 * t);
+        }
+        _setpoint = _from + (_target - _from) * t;
+        _phase = TrajectoryPhase::RAMP;
+    } else {
+        _setpoint = _target;
+        _phase = (_elapsed < _rampTime + _soakTime) ? TrajectoryPhase::SOAK : TrajectoryPhase::DONE;
+    }
+    return _setpoint;
+}
+
+uint8_t SetpointTrajectory::getProgress() const {
+    switch (_phase) {
+        case TrajectoryPhase::IDLE:
+        case TrajectoryPhase::DONE:
+            return 100;
+        default: {
+            unsigned long total = _rampTime + _soakTime;
+            if (total == 0) return 100;
+            return (uint8_t)min(100.0f, (float)_elapsed * 100.0f / total);
+        }
+    }
+}
@@ -0,0 +1,67 @@
+// SetpointTrajectory.h
+#ifndef SETPOINT_TRAJECTORY_H
+#define SETPOINT_TRAJECTORY_H
+
+#include <Arduino.h>
+
+enum class TrajectoryProfile : uint8_t {
+    STEP,      // Jump to the target (no rate limit)
+    LINEAR,    // Constant rate
+    S_CURVE    // Smooth start and end, peak rate at mid-ramp
+};
+
+enum class TrajectoryPhase : uint8_t {
+    IDLE,      // No trajectory, setpoint fixed
+    RAMP,      // Moving towards the target
+    SOAK,      // Holding the target for the soak time
+    DONE       // Target reached (and soaked)
+};
+
+// Setpoint generator of one control loop: moves the setpoint from a start value to a target
+// along a rate-limited ramp, then holds it for an optional soak time.
+// The ramp duration is chosen so that the setpoint never changes faster than the rate limit
+// (for S-curves, the peak rate at mid-ramp is 1.5x the average rate).
+class SetpointTrajectory {
+public:
+    SetpointTrajectory(TrajectoryProfile profile, float rateLimit);
+
+    // Starts a trajectory from 'from' to 'target', holding the target for soakTime (ms) once reached
+    void start(float from, float target, unsigned long now, unsigned long soakTime = 0);
+
+    // Sets the setpoint at once, without trajectory
+    void hold(float value);
+
+    // Returns the setpoint at time now (call once per control period)
+    float update(unsigned long now);
+
+    void setProfile(TrajectoryProfile profile) { _profile = profile; }
+    TrajectoryProfile getProfile() const { return _profile; }
+
+    // Maximum rate of change of the setpoint, in units per minute (0 = no limit)
+    void setRateLimit(float unitsPerMinute) { _rateLimit = unitsPerMinute; }
+    float getRateLimit() const { return _rateLimit; }
+
+    float getSetpoint() const { return _setpoint; }
+    float getTarget() const { return _target; }
+    TrajectoryPhase getPhase() const { return _phase; }
+    bool isRamping() const { return _phase == TrajectoryPhase::RAMP; }
+    // Ramping or soaking: the loop must regulate even within its hysteresis band
+    bool isActive() const { return _phase == TrajectoryPhase::RAMP || _phase == TrajectoryPhase::SOAK; }
+
+    // Progress of the ramp and soak, 0-100%
+    uint8_t getProgress() const;
+
+private:
+    TrajectoryProfile _profile;
+    float _rateLimit;
+    TrajectoryPhase _phase;
+    float _from;
+    float _target;
+    float _setpoint;
+    unsigned long _startTime;
+    unsigned long _rampTime;     // ms
+    unsigned long _soakTime;     // ms
+    unsigned long _elapsed;      // ms since start, at the last update
+};
+
+#endif // SETPOINT_TRAJECTORY_H
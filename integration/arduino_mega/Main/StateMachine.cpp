@@ -2,12 +2,23 @@
 #include "StateMachine.h"
 
 StateMachine::StateMachine(Logger& logger, PIDManager& pidManager, VolumeManager& volumeManager)
-    : currentState(ProgramState::IDLE),
-      currentProgram(nullptr),
+    : eventCount(0),
+      droppedEvents(0),
+      tripPending(false),
+      tripEnqueuedAt(0),
+      currentState(ProgramState::IDLE),
+      runningCount(0),
       logger(logger),
       pidManager(pidManager),
-      volumeManager(volumeManager)
+      volumeManager(volumeManager),
+      lastCheckpointTime(0),
+      checkpointWallTime(0),
+      downtimePending(false)
 {
+    for (uint8_t i = 0; i < ACTUATOR_COUNT; i++) {
+        actuatorOwners[i] = nullptr;
+    }
+    memset(eventStats, 0, sizeof(eventStats));
 }
 
 void StateMachine::addProgram(const String& name, ProgramBase* program) {
@@ -18,56 +29,298 @@ void StateMachine::addProgram(const String& name, ProgramBase* program) {
     }
 }
 
+// Updates every running program with access to its leased actuators only
 void StateMachine::update() {
-    if (currentProgram && currentState == ProgramState::RUNNING) {
-        currentProgram->update();
-        if (!currentProgram->isRunning()) {
+    processEvents();
+
+    bool completed = false;
+    for (uint8_t i = 0; i < runningCount; ) {
+        RunningProgram& entry = running[i];
+        ActuatorController::setAccessMask(entry.actuators);
+        entry.program->update();
+        ActuatorController::setAccessMask(ACTUATOR_MASK_ALL);
+        if (!entry.program->isRunning()) {
+            Logger::log(LogLevel::INFO, "Program completed and cleared: " + entry.program->getName());
+            removeRunning(i);
+            completed = true;
+        } else {
+            i++;
+        }
+    }
+    if (completed) {
+        if (runningCount == 0) {
             transitionToState(ProgramState::COMPLETED);
-            currentProgram = nullptr; 
-            Logger::log(LogLevel::INFO, "Program completed and cleared");
+        } else {
+            updateRunState();
         }
+        saveCheckpoint();
+    } else if (runningCount > 0 && millis() - lastCheckpointTime >= CHECKPOINT_INTERVAL) {
+        saveCheckpoint();
+    }
+    if (downtimePending && SystemClock::isSet()) {
+        reportDowntime();
     }
 }
 
 void StateMachine::startProgram(const String& programName, const String& command) {
-    ProgramBase** program = programs.find(programName);
-    if (program) {
-        //stopProgram();
-        currentProgram = *program;
-        currentProgram->start(command);
-        transitionToState(ProgramState::RUNNING);
-        logger.log(LogLevel::INFO, "Started program: " + programName);
-    } else {
+    ProgramBase** found = programs.find(programName);
+    if (!found) {
         logger.log(LogLevel::WARNING, "Program not found: " + programName);
+        return;
+    }
+    ProgramBase* program = *found;
+
+    // Restarting a running program: stop it first so that it releases its actuators
+    int8_t index = findRunning(program);
+    if (index >= 0) {
+        stopRunning(index);
+    }
+    if (runningCount >= MAX_RUNNING_PROGRAMS) {
+        logger.log(LogLevel::WARNING, "Cannot start " + programName + ": too many programs running");
+        return;
+    }
+    ActuatorMask actuators = program->getActuatorMask(command);
+    if (!acquireActuators(program, actuators)) {
+        return;
     }
-}
 
-// This method stops the currently running program if it matches the given program name
-void StateMachine::stopProgram(const String& programName) {   //TEST
-  // Check if there is a current program running and if its name matches the given program name
-    if (currentProgram && currentProgram->getName() == programName) {
-      // Stop the current program by calling its stop method
-        currentProgram->stop();
+    running[runningCount].program = program;
+    running[runningCount].actuators = actuators;
+    runningCount++;
+    ActuatorController::setAccessMask(actuators);
+    program->start(command);
+    ActuatorController::setAccessMask(ACTUATOR_MASK_ALL);
 
-        currentProgram = nullptr;
-        // Transition the state machine to the STOPPED state
-        transitionToState(ProgramState::STOPPED);
-        // Log the action of stopping the program
-        Logger::log(LogLevel::INFO, "Stopped program: " + programName);
+    if (!program->isRunning()) {
+        removeRunning(runningCount - 1);
+        logger.log(LogLevel::WARNING, "Program did not start: " + programName);
+        return;
     }
+    updateRunState();
+    saveCheckpoint();
+    logger.log(LogLevel::INFO, "Started program: " + programName);
 }
 
+// This method stops the running program with the given name, the other programs keep running
+void StateMachine::stopProgram(const String& programName) {
+    for (uint8_t i = 0; i < runningCount; i++) {
+        if (running[i].program->getName().equalsIgnoreCase(programName)) {
+            String name = running[i].program->getName();
+            stopRunning(i);
+            saveCheckpoint();
+            if (runningCount == 0) {
+                transitionToState(ProgramState::STOPPED);
+            } else {
+                updateRunState();
+            }
+            Logger::log(LogLevel::INFO, "Stopped program: " + name);
+            return;
+        }
+    }
+    Logger::log(LogLevel::WARNING, "Program not running: " + programName);
+}
 
 void StateMachine::stopAllPrograms() {
-    if (currentProgram) {
-        Logger::log(LogLevel::INFO, "Stopping current program: " + currentProgram->getName());
-        currentProgram->stop();
-        currentProgram = nullptr; 
-        transitionToState(ProgramState::STOPPED);
-        Logger::log(LogLevel::INFO, "All programs stopped");
-        //Logger::log(LogLevel::INFO, "Current state: " + programStateToString(getCurrentState()));
-        Logger::log(LogLevel::INFO, "Current state: " + String(static_cast<int>(getCurrentState())));
-        Logger::log(LogLevel::INFO, "Current program: None");  // Modifiez cette ligne
+    if (runningCount == 0) return;
+    while (runningCount > 0) {
+        Logger::log(LogLevel::INFO, "Stopping program: " + running[runningCount - 1].program->getName());
+        stopRunning(runningCount - 1);
+    }
+    clearCheckpoint();
+    transitionToState(ProgramState::STOPPED);
+    Logger::log(LogLevel::INFO, "All programs stopped");
+    Logger::log(LogLevel::INFO, "Current state: " + String(static_cast<int>(getCurrentState())));
+}
+
+void StateMachine::pauseProgram(const String& programName) {
+    bool found = false;
+    for (uint8_t i = 0; i < runningCount; i++) {
+        ProgramBase* program = running[i].program;
+        if (programName.length() > 0 && !program->getName().equalsIgnoreCase(programName)) continue;
+        found = true;
+        if (program->isPaused()) continue;
+        ActuatorController::setAccessMask(running[i].actuators);
+        program->pause();
+        ActuatorController::setAccessMask(ACTUATOR_MASK_ALL);
+    }
+    if (!found) {
+        Logger::log(LogLevel::WARNING, "Program not running: " + (programName.length() > 0 ? programName : String("any")));
+        return;
+    }
+    updateRunState();
+}
+
+void StateMachine::resumeProgram(const String& programName) {
+    bool found = false;
+    for (uint8_t i = 0; i < runningCount; i++) {
+        ProgramBase* program = running[i].program;
+        if (programName.length() > 0 && !program->getName().equalsIgnoreCase(programName)) continue;
+        found = true;
+        if (!program->isPaused()) continue;
+        ActuatorController::setAccessMask(running[i].actuators);
+        program->resume();
+        ActuatorController::setAccessMask(ACTUATOR_MASK_ALL);
+    }
+    if (!found) {
+        Logger::log(LogLevel::WARNING, "Program not running: " + (programName.length() > 0 ? programName : String("any")));
+        return;
+    }
+    updateRunState();
+}
+
+// PAUSED once every running program is paused, RUNNING as long as one of them is not
+void StateMachine::updateRunState() {
+    if (runningCount == 0) return;
+    for (uint8_t i = 0; i < runningCount; i++) {
+        if (!running[i].program->isPaused()) {
+            transitionToState(ProgramState::RUNNING);
+            return;
+        }
+    }
+    transitionToState(ProgramState::PAUSED);
+}
+
+// Queues an event and coalesces it with the pending events it makes pointless:
+// - a stop of all programs discards every pending event,
+// - an event on a program discards the pending events on the same program it supersedes
+//   (a newer start replaces an older one, pause and resume replace each other, a stop replaces all).
+bool StateMachine::postEvent(ProgramEvent event, const String& programName, const String& command) {
+    if (event == ProgramEvent::SAFETY_TRIP) {
+        if (tripPending) {
+            eventStats[static_cast<uint8_t>(ProgramEvent::SAFETY_TRIP)].coalesced++;
+        } else {
+            tripPending = true;
+            tripReason = command;
+            tripEnqueuedAt = micros();
+        }
+        return true;
+    }
+    if (event >= ProgramEvent::COUNT) return false;
+
+    for (uint8_t i = 0; i < eventCount; ) {
+        QueuedEvent& pending = eventQueue[i];
+        bool sameTarget = pending.program.equalsIgnoreCase(programName);
+        bool stopAll = (event == ProgramEvent::STOP && programName.length() == 0);
+        if (stopAll || (sameTarget && supersedes(event, pending.type))) {
+            eventStats[static_cast<uint8_t>(pending.type)].coalesced++;
+            removeEvent(i);
+        } else {
+            i++;
+        }
+    }
+    if (eventCount >= EVENT_QUEUE_SIZE) {
+        droppedEvents++;
+        Logger::log(LogLevel::WARNING, String("Event queue full, dropped: ") + getEventName(event) + " " + programName);
+        return false;
+    }
+    QueuedEvent& queued = eventQueue[eventCount++];
+    queued.type = event;
+    queued.program = programName;
+    queued.command = command;
+    queued.enqueuedAt = micros();
+    return true;
+}
+
+bool StateMachine::supersedes(ProgramEvent later, ProgramEvent earlier) {
+    switch (later) {
+        case ProgramEvent::START:
+            return earlier == ProgramEvent::START;
+        case ProgramEvent::PAUSE:
+        case ProgramEvent::RESUME:
+            return earlier == ProgramEvent::PAUSE || earlier == ProgramEvent::RESUME;
+        case ProgramEvent::STOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void StateMachine::removeEvent(uint8_t index) {
+    for (uint8_t i = index; i + 1 < eventCount; i++) {
+        eventQueue[i] = eventQueue[i + 1];
+    }
+    eventCount--;
+    eventQueue[eventCount].program = "";
+    eventQueue[eventCount].command = "";
+}
+
+// Applies the queued events, once per tick: a pending safety trip first, then the rest in arrival order
+void StateMachine::processEvents() {
+    if (tripPending) {
+        tripPending = false;
+        for (uint8_t i = 0; i < eventCount; i++) {
+            eventStats[static_cast<uint8_t>(eventQueue[i].type)].coalesced++;
+        }
+        while (eventCount > 0) removeEvent(eventCount - 1);
+        applyEvent(ProgramEvent::SAFETY_TRIP, "", tripReason);
+        recordLatency(ProgramEvent::SAFETY_TRIP, tripEnqueuedAt);
+        tripReason = "";
+        return;
+    }
+    for (uint8_t i = 0; i < eventCount; i++) {
+        applyEvent(eventQueue[i].type, eventQueue[i].program, eventQueue[i].command);
+        recordLatency(eventQueue[i].type, eventQueue[i].enqueuedAt);
+    }
+    while (eventCount > 0) removeEvent(eventCount - 1);
+}
+
+void StateMachine::applyEvent(ProgramEvent type, const String& programName, const String& command) {
+    switch (type) {
+        case ProgramEvent::START:
+            startProgram(programName, command);
+            break;
+        case ProgramEvent::PAUSE:
+            pauseProgram(programName);
+            break;
+        case ProgramEvent::RESUME:
+            resumeProgram(programName);
+            break;
+        case ProgramEvent::STOP:
+            if (programName.length() > 0) {
+                stopProgram(programName);
+            } else {
+                stopAllPrograms();
+            }
+            break;
+        case ProgramEvent::SAFETY_TRIP:
+            Logger::log(LogLevel::ERROR, "Safety trip: " + command);
+            stopAllPrograms();
+            pidManager.stop();
+            ActuatorController::stopAllActuators();
+            transitionToState(ProgramState::ERROR);
+            break;
+        default:
+            break;
+    }
+}
+
+void StateMachine::recordLatency(ProgramEvent type, unsigned long enqueuedAt) {
+    unsigned long latency = micros() - enqueuedAt;
+    EventStats& stats = eventStats[static_cast<uint8_t>(type)];
+    stats.count++;
+    stats.lastLatency = latency;
+    if (latency > stats.maxLatency) stats.maxLatency = latency;
+    Logger::log(LogLevel::DEBUG, String("Event ") + getEventName(type) + " applied after " + String(latency) + " us");
+}
+
+void StateMachine::logEventStats() const {
+    for (uint8_t i = 0; i < static_cast<uint8_t>(ProgramEvent::COUNT); i++) {
+        const EventStats& stats = eventStats[i];
+        Logger::log(LogLevel::INFO, String(getEventName(static_cast<ProgramEvent>(i))) + ": applied " + String(stats.count) +
+                    ", coalesced " + String(stats.coalesced) + ", latency last " + String(stats.lastLatency) +
+                    " us, max " + String(stats.maxLatency) + " us");
+    }
+    Logger::log(LogLevel::INFO, "Events pending " + String(eventCount) + ", dropped " + String(droppedEvents));
+}
+
+const char* StateMachine::getEventName(ProgramEvent event) {
+    switch (event) {
+        case ProgramEvent::START: return "start";
+        case ProgramEvent::PAUSE: return "pause";
+        case ProgramEvent::RESUME: return "resume";
+        case ProgramEvent::STOP: return "stop";
+        case ProgramEvent::SAFETY_TRIP: return "safety_trip";
+        default: return "unknown";
     }
 }
 
@@ -76,7 +329,170 @@ ProgramState StateMachine::getCurrentState() const {
 }
 
 String StateMachine::getCurrentProgram() const {
-    return currentProgram ? currentProgram->getName() : "None";
+    if (runningCount == 0) return "None";
+    String names = running[0].program->getName();
+    for (uint8_t i = 1; i < runningCount; i++) {
+        names += "+" + running[i].program->getName();
+    }
+    return names;
+}
+
+bool StateMachine::isProgramRunning(const String& programName) const {
+    for (uint8_t i = 0; i < runningCount; i++) {
+        if (running[i].program->getName() == programName) return true;
+    }
+    return false;
+}
+
+int8_t StateMachine::findRunning(const ProgramBase* program) const {
+    for (uint8_t i = 0; i < runningCount; i++) {
+        if (running[i].program == program) return i;
+    }
+    return -1;
+}
+
+// Leases the actuators to the program. Owners of lower priority are preempted (stopped);
+// if an owner has the same or a higher priority, nothing is changed and the start is refused.
+bool StateMachine::acquireActuators(ProgramBase* program, ActuatorMask actuators) {
+    ActuatorMask conflicts = ACTUATOR_MASK_NONE;
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        ProgramBase* owner = actuatorOwners[id];
+        if ((actuators & actuatorBit(static_cast<ActuatorId>(id))) && owner && owner != program &&
+            owner->getPriority() >= program->getPriority()) {
+            conflicts |= actuatorBit(static_cast<ActuatorId>(id));
+            Logger::log(LogLevel::WARNING, String(ActuatorController::getActuatorName(static_cast<ActuatorId>(id))) +
+                        " is owned by " + owner->getName());
+        }
+    }
+    if (conflicts != ACTUATOR_MASK_NONE) {
+        Logger::log(LogLevel::WARNING, "Cannot start " + program->getName() + ": actuator conflict");
+        return false;
+    }
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        ProgramBase* owner = actuatorOwners[id];
+        if ((actuators & actuatorBit(static_cast<ActuatorId>(id))) && owner && owner != program) {
+            Logger::log(LogLevel::WARNING, "Preempting " + owner->getName() + " for " + program->getName());
+            stopRunning(findRunning(owner));
+        }
+    }
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        if (actuators & actuatorBit(static_cast<ActuatorId>(id))) {
+            actuatorOwners[id] = program;
+        }
+    }
+    return true;
+}
+
+void StateMachine::releaseActuators(const ProgramBase* program) {
+    for (uint8_t id = 0; id < ACTUATOR_COUNT; id++) {
+        if (actuatorOwners[id] == program) {
+            actuatorOwners[id] = nullptr;
+        }
+    }
+}
+
+// Stops a running program with access to its own actuators only, and releases them
+void StateMachine::stopRunning(uint8_t index) {
+    if (index >= runningCount) return;
+    ActuatorController::setAccessMask(running[index].actuators);
+    running[index].program->stop();
+    ActuatorController::setAccessMask(ACTUATOR_MASK_ALL);
+    removeRunning(index);
+}
+
+void StateMachine::removeRunning(uint8_t index) {
+    releaseActuators(running[index].program);
+    for (uint8_t i = index; i + 1 < runningCount; i++) {
+        running[i] = running[i + 1];
+    }
+    runningCount--;
+}
+
+bool StateMachine::resumeFromCheckpoint() {
+    ProgramCheckpoint::Info info;
+    uint8_t payload[ProgramCheckpoint::MAX_PAYLOAD];
+    uint8_t length;
+    if (!ProgramCheckpoint::load(info, payload, length)) {
+        return false;
+    }
+    String programName(info.program);
+    ProgramBase** program = programs.find(programName);
+    if (!program || runningCount >= MAX_RUNNING_PROGRAMS) {
+        Logger::log(LogLevel::WARNING, "Cannot resume checkpointed program: " + programName);
+        clearCheckpoint();
+        return false;
+    }
+    ActuatorMask actuators = (*program)->getActuatorMask("");
+    if (!acquireActuators(*program, actuators)) {
+        clearCheckpoint();
+        return false;
+    }
+    CheckpointReader reader(payload, length);
+    ActuatorController::setAccessMask(actuators);
+    bool restored = (*program)->restoreCheckpoint(reader);
+    ActuatorController::setAccessMask(ACTUATOR_MASK_ALL);
+    if (!restored) {
+        Logger::log(LogLevel::WARNING, "Cannot resume checkpointed program: " + programName);
+        releaseActuators(*program);
+        clearCheckpoint();
+        return false;
+    }
+    running[runningCount].program = *program;
+    running[runningCount].actuators = actuators;
+    runningCount++;
+    transitionToState(ProgramState::RUNNING);
+    lastCheckpointTime = millis();
+    Logger::log(LogLevel::INFO, "Resumed program after reset: " + programName);
+
+    // The downtime can only be computed from wall-clock time, known once the clock is set
+    checkpointWallTime = info.wallTime;
+    downtimePending = true;
+    if (checkpointWallTime == 0) {
+        Logger::log(LogLevel::WARNING, "Downtime unknown: clock was not set at the last checkpoint");
+        downtimePending = false;
+    }
+    return true;
+}
+
+// Saves the state of the first running program supporting checkpoints, or removes a stale checkpoint
+void StateMachine::saveCheckpoint() {
+    lastCheckpointTime = millis();
+    uint8_t payload[ProgramCheckpoint::MAX_PAYLOAD];
+    for (uint8_t i = 0; i < runningCount; i++) {
+        ProgramBase* program = running[i].program;
+        CheckpointWriter writer(payload, sizeof(payload));
+        if (!program->isRunning() || !program->saveCheckpoint(writer)) {
+            continue;
+        }
+        // Not cleared on a failure: the last checkpoint that was written is the best one left
+        if (writer.length() == 0) {
+            Logger::log(LogLevel::ERROR, "Checkpoint of " + program->getName() + " exceeds " +
+                        String(ProgramCheckpoint::MAX_PAYLOAD) + " bytes, not written");
+        } else if (!ProgramCheckpoint::save(program->getName(), payload, writer.length())) {
+            Logger::log(LogLevel::ERROR, "Checkpoint of " + program->getName() + " not written");
+        }
+        return;
+    }
+    clearCheckpoint();
+}
+
+void StateMachine::clearCheckpoint() {
+    if (ProgramCheckpoint::exists()) {
+        ProgramCheckpoint::clear();
+    }
+}
+
+// Reports the time between the last checkpoint before the reset and the boot
+void StateMachine::reportDowntime() {
+    downtimePending = false;
+    uint32_t bootTime = SystemClock::bootTime();
+    if (bootTime < checkpointWallTime) {
+        Logger::log(LogLevel::WARNING, "Downtime unknown: clock is behind the last checkpoint");
+        return;
+    }
+    uint32_t downtime = bootTime - checkpointWallTime;
+    Logger::log(LogLevel::WARNING, "Program downtime gap: " + String(downtime) + " s (up to " +
+                String(CHECKPOINT_INTERVAL / 1000) + " s of it before the reset)");
 }
 
 void StateMachine::transitionToState(ProgramState newState) {
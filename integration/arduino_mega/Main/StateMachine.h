@@ -8,6 +8,8 @@
 #include "PIDManager.h"
 #include "VolumeManager.h"
 #include "SimpleMap.h"
+#include "ProgramCheckpoint.h"
+#include "SystemClock.h"
 
 enum class ProgramState {
     IDLE,
@@ -18,6 +20,17 @@ enum class ProgramState {
     ERROR
 };
 
+// Events queued for the state machine. They are applied at the next update(), in this order:
+// a safety trip first (it discards everything else), then the other events in arrival order.
+enum class ProgramEvent : uint8_t {
+    START,
+    PAUSE,
+    RESUME,
+    STOP,
+    SAFETY_TRIP,
+    COUNT
+};
+
 class StateMachine {
 public:
     StateMachine(Logger& logger, PIDManager& pidManager, VolumeManager& volumeManager);
@@ -27,18 +40,88 @@ public:
     void stopProgram(const String& programName);
     void stopAllPrograms();
     ProgramState getCurrentState() const;
-    String getCurrentProgram() const;
+    String getCurrentProgram() const;       // Names of the running programs, joined with '+'
+    bool isProgramRunning(const String& programName) const;
+    uint8_t getRunningProgramCount() const { return runningCount; }
+
+    // Pauses/resumes one running program, or all of them if the name is empty
+    void pauseProgram(const String& programName);
+    void resumeProgram(const String& programName);
+
+    // Queues an event, applied at the next update(). An empty program name targets all programs
+    // (PAUSE, RESUME, STOP); the command is the start command, or the reason of a safety trip.
+    // Returns false if the queue is full (a safety trip is always accepted).
+    bool postEvent(ProgramEvent event, const String& programName = "", const String& command = "");
+    void logEventStats() const;
+
+    // Restarts the program checkpointed before a reset, if any (call once at boot)
+    bool resumeFromCheckpoint();
 
 private:
     static const int MAX_PROGRAMS = 10;
+    static const uint8_t MAX_RUNNING_PROGRAMS = 4;
+    static const uint8_t ACTUATOR_COUNT = static_cast<uint8_t>(ActuatorId::COUNT);
+
+    struct RunningProgram {
+        ProgramBase* program;
+        ActuatorMask actuators;    // Actuators leased to the program
+    };
+
+    static const uint8_t EVENT_QUEUE_SIZE = 8;
+
+    struct QueuedEvent {
+        ProgramEvent type;
+        String program;
+        String command;
+        unsigned long enqueuedAt;  // micros()
+    };
+
+    struct EventStats {
+        uint16_t count;            // Events applied
+        uint16_t coalesced;        // Events superseded by a later event before being applied
+        unsigned long lastLatency; // Enqueue to effect, in microseconds
+        unsigned long maxLatency;
+    };
+
+    QueuedEvent eventQueue[EVENT_QUEUE_SIZE];
+    uint8_t eventCount;
+    uint16_t droppedEvents;
+    bool tripPending;               // Safety trips are latched outside the queue so they are never dropped
+    String tripReason;
+    unsigned long tripEnqueuedAt;
+    EventStats eventStats[static_cast<uint8_t>(ProgramEvent::COUNT)];
+
     SimpleMap<String, ProgramBase*, MAX_PROGRAMS> programs;
     ProgramState currentState;
-    ProgramBase* currentProgram;
+    RunningProgram running[MAX_RUNNING_PROGRAMS];
+    uint8_t runningCount;
+    ProgramBase* actuatorOwners[ACTUATOR_COUNT];  // Lease table: owner of each actuator, nullptr if free
     Logger& logger;
     PIDManager& pidManager;
     VolumeManager& volumeManager;
 
+    unsigned long lastCheckpointTime;
+    uint32_t checkpointWallTime;   // Unix time of the checkpoint resumed at boot (0 if unknown)
+    bool downtimePending;          // Downtime of the resumed program not reported yet
+
+    static const unsigned long CHECKPOINT_INTERVAL = 60000; // ms
+
     void transitionToState(ProgramState newState);
+    void updateRunState();
+    void processEvents();
+    void applyEvent(ProgramEvent type, const String& programName, const String& command);
+    void recordLatency(ProgramEvent type, unsigned long enqueuedAt);
+    void removeEvent(uint8_t index);
+    static bool supersedes(ProgramEvent later, ProgramEvent earlier);
+    static const char* getEventName(ProgramEvent event);
+    int8_t findRunning(const ProgramBase* program) const;
+    bool acquireActuators(ProgramBase* program, ActuatorMask actuators);
+    void releaseActuators(const ProgramBase* program);
+    void stopRunning(uint8_t index);
+    void removeRunning(uint8_t index);
+    void saveCheckpoint();
+    void clearCheckpoint();
+    void reportDowntime();
 };
 
 #endif // STATE_MACHINE_H
\ No newline at end of file
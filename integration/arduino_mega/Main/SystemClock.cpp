@@ -0,0 +1,86 @@
+// SystemClock.cpp
+#include "SystemClock.h"
+#include <logger/Logger.h>
+
+bool SystemClock::synchronized = false;
+uint32_t SystemClock::referenceUnixTime = 0;
+uint16_t SystemClock::referenceMilliseconds = 0;
+unsigned long SystemClock::referenceMillis = 0;
+bool SystemClock::referencePrecise = false;
+float SystemClock::rateError = 0;
+long SystemClock::lastCorrection = 0;
+uint16_t SystemClock::lastUncertainty = 0;
+uint16_t SystemClock::synchronizations = 0;
+
+void SystemClock::setUnixTime(uint32_t unixTime) {
+    referenceUnixTime = unixTime;
+    referenceMilliseconds = 0;
+    referenceMillis = millis();
+    referencePrecise = false;
+    synchronized = true;
+}
+
+void SystemClock::synchronize(uint32_t unixTime, uint16_t milliseconds, unsigned long atMillis, uint16_t uncertainty) {
+    if (synchronized) {
+        // Difference between the time received and the time extrapolated until now
+        uint32_t predictedTime;
+        uint16_t predictedMilliseconds;
+        timeAt(atMillis, predictedTime, predictedMilliseconds);
+        int64_t correction = (int64_t)(int32_t)(unixTime - predictedTime) * 1000 + milliseconds - predictedMilliseconds;
+        lastCorrection = (long)constrain(correction, -2000000000LL, 2000000000LL);
+
+        // Over a long enough interval between two precise points, the correction is a rate error
+        unsigned long interval = atMillis - referenceMillis;
+        if (referencePrecise && uncertainty <= MAX_RATE_UNCERTAINTY && interval >= MIN_RATE_INTERVAL) {
+            rateError += 0.5f * lastCorrection * 1e6f / interval;   // Half of it, against the noise of the link
+            rateError = constrain(rateError, -MAX_RATE_ERROR, MAX_RATE_ERROR);
+        }
+    }
+    referenceUnixTime = unixTime;
+    referenceMilliseconds = milliseconds;
+    referenceMillis = atMillis;
+    referencePrecise = uncertainty <= MAX_RATE_UNCERTAINTY;
+    lastUncertainty = uncertainty;
+    synchronized = true;
+    synchronizations++;
+}
+
+uint32_t SystemClock::now() {
+    uint32_t unixTime;
+    uint16_t milliseconds;
+    return timeAt(millis(), unixTime, milliseconds) ? unixTime : 0;
+}
+
+bool SystemClock::timeAt(unsigned long atMillis, uint32_t& unixTime, uint16_t& milliseconds) {
+    if (!synchronized) return false;
+
+    // Usually after the reference; a sample taken just before a synchronization is up to a day before it
+    int64_t elapsed = (int64_t)(atMillis - referenceMillis);
+    if (referenceMillis - atMillis < 86400000UL) elapsed = -(int64_t)(referenceMillis - atMillis);
+    int64_t total = referenceMilliseconds + elapsed + (int64_t)((float)elapsed * rateError * 1e-6f);
+
+    int64_t seconds = total >= 0 ? total / 1000 : -((999 - total) / 1000);
+    unixTime = referenceUnixTime + (int32_t)seconds;
+    milliseconds = (uint16_t)(total - seconds * 1000);
+    return true;
+}
+
+uint32_t SystemClock::bootTime() {
+    if (!synchronized) return 0;
+    return now() - millis() / 1000;
+}
+
+void SystemClock::logStatus() {
+    if (!synchronized) {
+        Logger::log(LogLevel::INFO, "Clock not set");
+        return;
+    }
+    uint32_t unixTime;
+    uint16_t milliseconds;
+    timeAt(millis(), unixTime, milliseconds);
+    char fraction[5];
+    snprintf(fraction, sizeof(fraction), ".%03u", milliseconds);
+    Logger::log(LogLevel::INFO, "Clock: " + String(unixTime) + fraction + ", rate error " + String(rateError, 1) +
+                " ppm, last correction " + String(lastCorrection) + " ms (+- " + String(lastUncertainty) + " ms), " +
+                String(synchronizations) + " synchronizations" + (referencePrecise ? "" : ", set by hand"));
+}
@@ -0,0 +1,51 @@
+// SystemClock.h
+#ifndef SYSTEM_CLOCK_H
+#define SYSTEM_CLOCK_H
+
+#include <Arduino.h>
+
+// Wall clock of the Mega, which has no RTC: the Unix time is set from outside and then extrapolated
+// with millis(). Until it is set, the time is unknown (0).
+//
+// The ESP32 synchronizes it every few minutes (clock_probe / clock_set): it measures the round trip
+// of a probe over the serial link and sends the Unix time, to the millisecond, at which the Mega
+// received it. Between two such points the resonator of the Mega drifts (up to 0.5 %), so the
+// clock also estimates its rate error from the successive corrections and applies it to millis().
+// set_time sets the clock by hand, to the second, without touching the rate estimate.
+class SystemClock {
+public:
+    static void setUnixTime(uint32_t unixTime);
+
+    // Unix time (seconds and milliseconds) at millis() == atMillis, known within +- uncertainty ms
+    static void synchronize(uint32_t unixTime, uint16_t milliseconds, unsigned long atMillis, uint16_t uncertainty);
+
+    static bool isSet() { return synchronized; }
+
+    // Current Unix time in seconds, 0 if the clock was never set
+    static uint32_t now();
+
+    // Unix time of a past or current millis() value, with its milliseconds; false if the clock was never set
+    static bool timeAt(unsigned long atMillis, uint32_t& unixTime, uint16_t& milliseconds);
+
+    // Unix time at which the board booted, 0 if the clock was never set
+    static uint32_t bootTime();
+
+    static void logStatus();
+
+private:
+    static const uint16_t MAX_RATE_UNCERTAINTY = 50;          // ms, worse synchronizations do not update the rate
+    static const unsigned long MIN_RATE_INTERVAL = 60000;     // ms between the points of a rate estimate
+    static const long MAX_RATE_ERROR = 10000;                 // ppm
+
+    static bool synchronized;
+    static uint32_t referenceUnixTime;
+    static uint16_t referenceMilliseconds;
+    static unsigned long referenceMillis;
+    static bool referencePrecise;       // Reference from a synchronization good enough to estimate the rate
+    static float rateError;             // ppm, millis() runs slow if positive
+    static long lastCorrection;         // ms, step applied by the last synchronization
+    static uint16_t lastUncertainty;
+    static uint16_t synchronizations;
+};
+
+#endif // SYSTEM_CLOCK_H
@@ -295,6 +295,24 @@ void TestsProgram::parseCommand(const String& command) {
     }
 }
 
+ActuatorMask TestsProgram::getActuatorMask(const String& command) const {
+    String cmd = command;
+    cmd.toLowerCase();
+    if (cmd == "test sensors") {
+        return ACTUATOR_MASK_NONE;
+    } else if (cmd.startsWith("test pid ")) {
+        String pidType = cmd.substring(9, 13);
+        ActuatorMask loop = (pidType == "temp") ? actuatorBit(ActuatorId::HEATING_PLATE)
+                          : (pidType == "ph") ? actuatorBit(ActuatorId::BASE_PUMP)
+                          : actuatorBit(ActuatorId::AIR_PUMP);
+        return loop | actuatorBit(ActuatorId::STIRRING_MOTOR);
+    } else if (cmd.startsWith("test ")) {
+        int firstSpace = cmd.indexOf(' ', 5);
+        return ActuatorController::getActuatorMask(command.substring(5, firstSpace));
+    }
+    return ACTUATOR_MASK_ALL;
+}
+
 void TestsProgram::stopPIDTest() {
     switch (_currentTestType) {
         case TestType::PID_TEMPERATURE:
@@ -29,6 +29,8 @@ public:
     bool isPaused() const override { return _isPaused; }
     String getName() const override { return "Tests"; }
     void parseCommand(const String& command) override;
+    ActuatorMask getActuatorMask(const String& command) const override;
+    uint8_t getPriority() const override { return PRIORITY_LOW; }
 
 private:
     TestType _currentTestType;
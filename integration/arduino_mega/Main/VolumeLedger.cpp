@@ -0,0 +1,123 @@
+// VolumeLedger.cpp
+#include "VolumeLedger.h"
+#include <util/crc16.h>
+
+VolumeLedger::VolumeLedger() : _epoch(0), _snapshotSlot(0), _head(0) {
+    memset(&_state, 0, sizeof(_state));
+}
+
+bool VolumeLedger::restore(State& state) {
+    Snapshot snapshots[2];
+    bool valid[2] = { readSnapshot(0, snapshots[0]), readSnapshot(1, snapshots[1]) };
+    if (!valid[0] && !valid[1]) {
+        // Start the next ledger above any epoch left in the journal, so stale entries never replay
+        for (uint8_t i = 0; i < EEPROM_LEDGER_JOURNAL_ENTRIES; i++) {
+            Entry entry;
+            EEPROM.get(EEPROM_LEDGER_JOURNAL_ADDR + i * sizeof(Entry), entry);
+            if (entry.crc == entryCRC(entry) && entry.epoch > _epoch) {
+                _epoch = entry.epoch;
+            }
+        }
+        return false;
+    }
+
+    // Newest snapshot, the epoch being compared with wrap-around
+    uint8_t slot = valid[0] ? 0 : 1;
+    if (valid[0] && valid[1] && static_cast<int16_t>(snapshots[1].epoch - snapshots[0].epoch) > 0) {
+        slot = 1;
+    }
+    _snapshotSlot = slot;
+    _epoch = snapshots[slot].epoch;
+    _state = snapshots[slot].state;
+
+    // Replay the journal entries of this epoch
+    _head = 0;
+    while (_head < EEPROM_LEDGER_JOURNAL_ENTRIES) {
+        Entry entry;
+        EEPROM.get(EEPROM_LEDGER_JOURNAL_ADDR + _head * sizeof(Entry), entry);
+        if (entry.epoch != _epoch || entry.crc != entryCRC(entry)) {
+            break;
+        }
+        apply(entry.type, entry.value);
+        _head++;
+    }
+
+    state = _state;
+    return true;
+}
+
+void VolumeLedger::reset(const State& state) {
+    _state = state;
+    compact();
+}
+
+void VolumeLedger::appendChange(VolumeSource source, float volume) {
+    append(static_cast<uint8_t>(source), volume);
+}
+
+void VolumeLedger::appendVolume(float volume) {
+    append(ENTRY_VOLUME, volume);
+}
+
+// Writes the current state as the snapshot of a new epoch, in the slot not holding the current one
+void VolumeLedger::compact() {
+    _epoch++;
+    _snapshotSlot ^= 1;
+    writeSnapshot(_snapshotSlot);
+    _head = 0;
+}
+
+void VolumeLedger::append(uint8_t type, float value) {
+    if (_head >= EEPROM_LEDGER_JOURNAL_ENTRIES) {
+        compact();
+    }
+    apply(type, value);
+    Entry entry = { _epoch, type, 0, value };
+    entry.crc = entryCRC(entry);
+    EEPROM.put(EEPROM_LEDGER_JOURNAL_ADDR + _head * sizeof(Entry), entry);
+    _head++;
+}
+
+void VolumeLedger::apply(uint8_t type, float value) {
+    if (type == ENTRY_VOLUME) {
+        _state.volume = value;
+    } else if (type < static_cast<uint8_t>(VolumeSource::COUNT)) {
+        _state.totals[type] += value;
+    }
+}
+
+void VolumeLedger::writeSnapshot(uint8_t slot) {
+    Snapshot snapshot;
+    snapshot.magic = MAGIC;
+    snapshot.epoch = _epoch;
+    snapshot.state = _state;
+    snapshot.crc = snapshotCRC(snapshot);
+    EEPROM.put(EEPROM_LEDGER_SNAPSHOT_ADDR + slot * EEPROM_LEDGER_SNAPSHOT_SIZE, snapshot);
+}
+
+bool VolumeLedger::readSnapshot(uint8_t slot, Snapshot& snapshot) {
+    EEPROM.get(EEPROM_LEDGER_SNAPSHOT_ADDR + slot * EEPROM_LEDGER_SNAPSHOT_SIZE, snapshot);
+    return snapshot.magic == MAGIC && snapshot.crc == snapshotCRC(snapshot);
+}
+
+// CRC-16/MODBUS over the snapshot, CRC field excluded
+uint16_t VolumeLedger::snapshotCRC(const Snapshot& snapshot) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&snapshot);
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i = 0; i < offsetof(Snapshot, crc); i++) {
+        crc = _crc16_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+// CRC-8 over the entry, CRC field excluded
+uint8_t VolumeLedger::entryCRC(const Entry& entry) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&entry);
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < sizeof(Entry); i++) {
+        if (i != offsetof(Entry, crc)) {
+            crc = _crc8_ccitt_update(crc, bytes[i]);
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,83 @@
+// VolumeLedger.h
+#ifndef VOLUME_LEDGER_H
+#define VOLUME_LEDGER_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "EepromLayout.h"
+
+// Sources of volume changes tracked by the VolumeManager
+enum class VolumeSource : uint8_t {
+    NAOH,
+    NUTRIENT,
+    MICROALGAE,
+    REMOVED,
+    COUNT
+};
+
+// Append-only EEPROM journal of the culture volume, surviving resets and brown-outs.
+//
+// The ledger is a snapshot (volume and per-source totals) followed by journal entries
+// (per-source deltas and absolute volumes). Every entry carries the epoch of its snapshot
+// and a CRC, so replay stops at the first stale or torn entry. When the journal is full it
+// is compacted: the current state is written as a new snapshot (next epoch) in the other
+// snapshot slot, which invalidates all previous entries at once without erasing them.
+class VolumeLedger {
+public:
+    struct State {
+        float volume;                                          // Current culture volume (L)
+        float totals[static_cast<uint8_t>(VolumeSource::COUNT)]; // Volume per source since reset (L)
+    };
+
+    VolumeLedger();
+
+    // Replays the snapshot and journal; returns false if the ledger holds no valid snapshot
+    bool restore(State& state);
+
+    // Starts a new ledger from the given state (e.g. when the initial volume is set)
+    void reset(const State& state);
+
+    // Appends a change of the given source, or the current absolute volume
+    void appendChange(VolumeSource source, float volume);
+    void appendVolume(float volume);
+
+    void compact();
+
+    const State& getState() const { return _state; }
+    uint8_t getJournalLength() const { return _head; }
+
+private:
+    static const uint16_t MAGIC = 0x5E1F;
+    static const uint8_t ENTRY_VOLUME = 0x10; // Entry type for absolute volumes, source types are 0..COUNT-1
+
+    struct Snapshot {
+        uint16_t magic;
+        uint16_t epoch;
+        State state;
+        uint16_t crc;
+    };
+
+    struct Entry {
+        uint16_t epoch;
+        uint8_t type;
+        uint8_t crc;
+        float value;
+    };
+
+    static_assert(sizeof(Snapshot) <= EEPROM_LEDGER_SNAPSHOT_SIZE, "Ledger snapshot does not fit in its slot");
+    static_assert(sizeof(Entry) == 8, "Ledger entries must be 8 bytes");
+
+    State _state;
+    uint16_t _epoch;
+    uint8_t _snapshotSlot;
+    uint8_t _head;         // Index of the next journal entry
+
+    void append(uint8_t type, float value);
+    void apply(uint8_t type, float value);
+    void writeSnapshot(uint8_t slot);
+    bool readSnapshot(uint8_t slot, Snapshot& snapshot);
+    static uint16_t snapshotCRC(const Snapshot& snapshot);
+    static uint8_t entryCRC(const Entry& entry);
+};
+
+#endif // VOLUME_LEDGER_H
@@ -2,35 +2,90 @@
 
 VolumeManager::VolumeManager(float totalVolume, float maxVolumePercent, float minVolume)
     : totalVolume(totalVolume), maxVolumePercent(maxVolumePercent), minVolume(minVolume),
-      currentVolume(0), addedNaOH(0), addedNutrient(0), addedMicroalgae(0), removedVolume(0) {}
+      currentVolume(0), lastUpdateTime(0), lastLedgerFlushTime(0) {
+    for (uint8_t i = 0; i < SOURCE_COUNT; i++) {
+        pendingChanges[i] = 0;
+        unjournaledChanges[i] = 0;
+    }
+}
+
+// Restores the volume and per-source totals from the EEPROM ledger (call once at boot)
+bool VolumeManager::restore() {
+    unsigned long start = micros();
+    VolumeLedger::State state;
+    if (!ledger.restore(state)) {
+        Logger::log(LogLevel::INFO, "No volume ledger in EEPROM");
+        return false;
+    }
+    currentVolume = state.volume;
+    unsigned long elapsed = micros() - start;
+    Logger::log(LogLevel::INFO, "Volume restored: " + String(currentVolume) + " L (" + String(ledger.getJournalLength()) +
+        " journal entries, " + String(elapsed / 1000.0) + " ms)");
+    for (uint8_t i = 0; i < SOURCE_COUNT; i++) {
+        Logger::log(LogLevel::INFO, "  " + String(getSourceName(static_cast<VolumeSource>(i))) + ": " + String(state.totals[i], 4) + " L");
+    }
+    return true;
+}
+
+// Called from the main loop: pulls the pump volumes and keeps the ledger up to date
+void VolumeManager::update() {
+    unsigned long currentTime = millis();
+    if (currentTime - lastUpdateTime >= UPDATE_INTERVAL) {
+        lastUpdateTime = currentTime;
+        updateVolume();
+    }
+    // The heater interlock requires liquid in the vessel
+    ActuatorController::setInterlockCondition(INTERLOCK_VOLUME_ABOVE_MIN, currentVolume > minVolume);
+}
 
 void VolumeManager::updateVolume() {
     updateVolumeFromActuators();
-    float volumeChange = addedNaOH + addedNutrient + addedMicroalgae - removedVolume;
+    float volumeChange = pendingChanges[static_cast<uint8_t>(VolumeSource::NAOH)]
+                       + pendingChanges[static_cast<uint8_t>(VolumeSource::NUTRIENT)]
+                       + pendingChanges[static_cast<uint8_t>(VolumeSource::MICROALGAE)]
+                       - pendingChanges[static_cast<uint8_t>(VolumeSource::REMOVED)];
     currentVolume += volumeChange;
     currentVolume = max(minVolume, min(currentVolume, totalVolume * maxVolumePercent));
 
-    addedNaOH = 0;
-    addedNutrient = 0;
-    addedMicroalgae = 0;
-    removedVolume = 0;
+    for (uint8_t i = 0; i < SOURCE_COUNT; i++) {
+        unjournaledChanges[i] += pendingChanges[i];
+        pendingChanges[i] = 0;
+    }
+    journalChanges(false);
 
-    Logger::log(LogLevel::INFO, "Current volume updated: " + String(currentVolume) + " L");
+    Logger::log(LogLevel::DEBUG, "Current volume updated: " + String(currentVolume) + " L");
 }
 
 void VolumeManager::manuallyAdjustVolume(float volume, const String& source) {
-    recordVolumeChange(volume, source);
+    VolumeSource volumeSource;
+    if (!parseSource(source, volumeSource)) {
+        Logger::log(LogLevel::WARNING, "Unknown volume source: " + source);
+        return;
+    }
+    recordVolumeChange(volume, volumeSource);
     updateVolume();
+    journalChanges(true);
     Logger::log(LogLevel::INFO, "Volume manually adjusted: " + String(volume) + " L from " + source);
 }
 
 void VolumeManager::setInitialVolume(float volume) {
     if (volume > 0 && volume <= totalVolume * maxVolumePercent) {
         currentVolume = volume;
-        addedNaOH = 0;
-        addedNutrient = 0;
-        addedMicroalgae = 0;
-        removedVolume = 0;
+        for (uint8_t i = 0; i < SOURCE_COUNT; i++) {
+            pendingChanges[i] = 0;
+            unjournaledChanges[i] = 0;
+        }
+        // Discard what the pumps accounted before the new initial volume
+        ActuatorController::consumeVolumeAdded("nutrientPump");
+        ActuatorController::consumeVolumeAdded("basePump");
+        ActuatorController::consumeVolumeRemoved("drainPump");
+        ActuatorController::consumeVolumeRemoved("samplePump");
+
+        VolumeLedger::State state;
+        memset(&state, 0, sizeof(state));
+        state.volume = volume;
+        ledger.reset(state);
+        lastLedgerFlushTime = millis();
         Logger::log(LogLevel::INFO, "Initial volume set to: " + String(volume) + " L");
     } else {
     Logger::log(LogLevel::WARNING, "Invalid initial volume: " + String(volume) + " L. Must be between " + 
@@ -46,27 +101,75 @@ float VolumeManager::getMaxSafeAddition() const {
     return getAvailableVolume() * SAFE_ADDITION_PERCENT;
 }
 
-void VolumeManager::recordVolumeChange(float volume, const String& source) {
-    if (source == "NaOH") addedNaOH += volume;
-    else if (source == "Nutrient") addedNutrient += volume;
-    else if (source == "Microalgae") addedMicroalgae += volume;
-    else if (source == "Removed") removedVolume += volume;
+void VolumeManager::recordVolumeChange(float volume, VolumeSource source) {
+    if (source < VolumeSource::COUNT) {
+        pendingChanges[static_cast<uint8_t>(source)] += volume;
+    }
 }
 
+// The pumps integrate their volume (ml) over their actual ON time; read and reset it in one step
 void VolumeManager::updateVolumeFromActuators() {
-    float nutrientPumpVolume = ActuatorController::getVolumeAdded("nutrientPump");
-    float basePumpVolume = ActuatorController::getVolumeAdded("basePump");
-    float drainPumpVolume = ActuatorController::getVolumeRemoved("drainPump");
+    recordVolumeChange(ActuatorController::consumeVolumeAdded("nutrientPump") / 1000.0f, VolumeSource::NUTRIENT);
+    recordVolumeChange(ActuatorController::consumeVolumeAdded("basePump") / 1000.0f, VolumeSource::NAOH);
+    recordVolumeChange(ActuatorController::consumeVolumeRemoved("drainPump") / 1000.0f, VolumeSource::REMOVED);
+    recordVolumeChange(ActuatorController::consumeVolumeRemoved("samplePump") / 1000.0f, VolumeSource::REMOVED);
+}
 
-    addedNutrient += nutrientPumpVolume;
-    addedNaOH += basePumpVolume;
-    removedVolume += drainPumpVolume;
+// Writes the pending changes to the ledger now (e.g. before a planned shutdown)
+void VolumeManager::flushLedger() {
+    updateVolume();
+    journalChanges(true);
+}
 
-    ActuatorController::resetVolumeAdded("nutrientPump");
-    ActuatorController::resetVolumeAdded("basePump");
-    ActuatorController::resetVolumeRemoved("drainPump");
+float VolumeManager::getSourceTotal(VolumeSource source) const {
+    if (source >= VolumeSource::COUNT) return 0.0f;
+    uint8_t index = static_cast<uint8_t>(source);
+    return ledger.getState().totals[index] + unjournaledChanges[index] + pendingChanges[index];
 }
 
 bool VolumeManager::isSafeToAddVolume(float volume) const {
     return (currentVolume + volume) <= (totalVolume * maxVolumePercent);
 }
+
+bool VolumeManager::parseSource(const String& name, VolumeSource& source) {
+    for (uint8_t i = 0; i < SOURCE_COUNT; i++) {
+        if (name == getSourceName(static_cast<VolumeSource>(i))) {
+            source = static_cast<VolumeSource>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* VolumeManager::getSourceName(VolumeSource source) {
+    switch (source) {
+        case VolumeSource::NAOH: return "NaOH";
+        case VolumeSource::NUTRIENT: return "Nutrient";
+        case VolumeSource::MICROALGAE: return "Microalgae";
+        case VolumeSource::REMOVED: return "Removed";
+        default: return "Unknown";
+    }
+}
+
+// Appends the accumulated changes to the EEPROM ledger once they are large or old enough.
+// Batching keeps EEPROM wear low; at most LEDGER_FLUSH_INTERVAL of pump volume is lost on power failure.
+void VolumeManager::journalChanges(bool force) {
+    float magnitude = 0;
+    for (uint8_t i = 0; i < SOURCE_COUNT; i++) {
+        magnitude += fabs(unjournaledChanges[i]);
+    }
+    if (magnitude == 0) return;
+
+    unsigned long currentTime = millis();
+    if (!force && magnitude < LEDGER_FLUSH_THRESHOLD && currentTime - lastLedgerFlushTime < LEDGER_FLUSH_INTERVAL) {
+        return;
+    }
+    for (uint8_t i = 0; i < SOURCE_COUNT; i++) {
+        if (unjournaledChanges[i] != 0) {
+            ledger.appendChange(static_cast<VolumeSource>(i), unjournaledChanges[i]);
+            unjournaledChanges[i] = 0;
+        }
+    }
+    ledger.appendVolume(currentVolume);
+    lastLedgerFlushTime = currentTime;
+}
@@ -2,6 +2,7 @@
 #define VOLUME_MANAGER_H
 
 #include "ActuatorController.h"
+#include "VolumeLedger.h"
 #include <logger/Logger.h>
 #include <Arduino.h>
 
@@ -9,19 +10,23 @@ class VolumeManager {
 public:
     VolumeManager(float totalVolume, float maxVolumePercent, float minVolume);
 
+    bool restore();
+    void update();
     void updateVolume();
     void manuallyAdjustVolume(float volume, const String& source);
     float getCurrentVolume() const { return currentVolume; }
     void setInitialVolume(float volume);
     float getAvailableVolume() const;
     float getMaxSafeAddition() const;
-    void recordVolumeChange(float volume, const String& source);
+    void recordVolumeChange(float volume, VolumeSource source);
     void updateVolumeFromActuators();
+    void flushLedger();
 
-    float getAddedNaOH() const { return addedNaOH; }
-    float getAddedNutrient() const { return addedNutrient; }
-    float getAddedMicroalgae() const { return addedMicroalgae; }
-    float getRemovedVolume() const { return removedVolume; }
+    static bool parseSource(const String& name, VolumeSource& source);
+    static const char* getSourceName(VolumeSource source);
+
+    // Volume per source since the initial volume was set (L), restored after a reset
+    float getSourceTotal(VolumeSource source) const;
     
     float getTotalVolume() const { return totalVolume; }
     float getMinVolume() const { return minVolume; }
@@ -29,17 +34,26 @@ public:
     bool isSafeToAddVolume(float volume) const;
 
 private:
+    static const uint8_t SOURCE_COUNT = static_cast<uint8_t>(VolumeSource::COUNT);
+
     float totalVolume;
     float maxVolumePercent;
     float minVolume;
     float currentVolume;
-    float addedNaOH;
-    float addedNutrient;
-    float addedMicroalgae;
-    float removedVolume;
+    float pendingChanges[SOURCE_COUNT];  // Changes not yet applied to currentVolume (L)
+    float unjournaledChanges[SOURCE_COUNT]; // Changes applied but not yet written to the ledger (L)
+    unsigned long lastUpdateTime;
+    unsigned long lastLedgerFlushTime;
+    VolumeLedger ledger;
 
     const float MAX_VOLUME_PERCENT = 0.95; // 95% of total volume
     const float SAFE_ADDITION_PERCENT = 0.05; // 5% of available volume
+
+    static const unsigned long UPDATE_INTERVAL = 1000;         // Volume update from the pumps (ms)
+    static const unsigned long LEDGER_FLUSH_INTERVAL = 60000;  // Max time a change stays out of the ledger (ms)
+    static constexpr float LEDGER_FLUSH_THRESHOLD = 0.005;     // Change written to the ledger at once (L)
+
+    void journalChanges(bool force);
 };
 
-#endif // VOLUME_MANAGER_H
\ No newline at end of file
+#endif // VOLUME_MANAGER_H
@@ -0,0 +1,224 @@
+// Watchdog.cpp
+#include "Watchdog.h"
+#include "SystemClock.h"
+#include <avr/wdt.h>
+#include <util/crc16.h>
+
+volatile unsigned long Watchdog::lastBeat[Watchdog::HEARTBEAT_COUNT] = {};
+unsigned long Watchdog::deadline[Watchdog::HEARTBEAT_COUNT] = {5000, 5000, 5000, 65000};
+uint8_t Watchdog::requiredMask = (1 << Watchdog::HEARTBEAT_COUNT) - 1;
+bool Watchdog::enabled = false;
+bool Watchdog::starving = false;
+void (*Watchdog::safeStateHook)() = nullptr;
+ResetCause Watchdog::resetCause = ResetCause::UNKNOWN;
+Watchdog::ResetRecord Watchdog::lastRecord;
+
+#ifdef WDT_vect
+// MCUSR must be read and cleared before anything else: after a watchdog reset the watchdog stays
+// enabled with its shortest timeout. Some bootloaders clear MCUSR themselves, hence the EEPROM record.
+static uint8_t resetFlags __attribute__((section(".noinit")));
+
+void captureResetFlags() __attribute__((naked, used, section(".init3")));
+void captureResetFlags() {
+    resetFlags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+}
+
+ISR(WDT_vect) {
+    Watchdog::onTimeout();
+}
+#else
+static uint8_t resetFlags = 0;
+#endif
+
+void Watchdog::begin() {
+    wdt_disable();
+    ResetRecord record;
+    bool valid = loadRecord(record);
+    if (!valid) {
+        memset(&record, 0, sizeof(record));
+    }
+
+    if (valid && record.pending) {
+        resetCause = static_cast<ResetCause>(record.cause);
+    } else if (resetFlags & _BV(WDRF)) {
+        // Watchdog reset without a record: the interrupt could not run
+        resetCause = ResetCause::WATCHDOG;
+        record.lateHeartbeats = 0;
+        record.uptime = 0;
+        record.wallTime = 0;
+        record.watchdogResets++;
+    } else {
+        if (resetFlags & _BV(BORF)) {
+            resetCause = ResetCause::BROWN_OUT;
+        } else if (resetFlags & _BV(EXTRF)) {
+            resetCause = ResetCause::EXTERNAL;
+        } else if (resetFlags & _BV(PORF)) {
+            resetCause = ResetCause::POWER_ON;
+        } else {
+            resetCause = ResetCause::UNKNOWN;
+        }
+        record.lateHeartbeats = 0;
+        record.uptime = 0;
+        record.wallTime = 0;
+    }
+    record.cause = static_cast<uint8_t>(resetCause);
+    record.pending = 0;
+    saveRecord(record);
+    lastRecord = record;
+
+    if (resetCause == ResetCause::WATCHDOG || resetCause == ResetCause::HEARTBEAT) {
+        Logger::log(LogLevel::ERROR, String("Reset by watchdog (") + getCauseName(resetCause) + ") after " +
+                    String(record.uptime / 1000) + " s" +
+                    (record.lateHeartbeats ? ", late heartbeats: " + heartbeatList(record.lateHeartbeats) : String("")) +
+                    ", watchdog resets: " + String(record.watchdogResets));
+    } else {
+        Logger::log(LogLevel::INFO, String("Reset cause: ") + getCauseName(resetCause));
+    }
+}
+
+void Watchdog::enable(void (*hook)()) {
+    safeStateHook = hook;
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < HEARTBEAT_COUNT; i++) {
+        lastBeat[i] = now;
+    }
+    starving = false;
+    enabled = true;
+#ifdef WDT_vect
+    wdt_enable(WDTO_8S);
+    WDTCSR |= _BV(WDIE);   // Interrupt first, reset at the next timeout
+#endif
+    Logger::log(LogLevel::INFO, "Watchdog enabled");
+}
+
+void Watchdog::beat(Heartbeat heartbeat) {
+    if (heartbeat >= Heartbeat::COUNT) return;
+    lastBeat[static_cast<uint8_t>(heartbeat)] = millis();
+}
+
+void Watchdog::setDeadline(Heartbeat heartbeat, unsigned long deadlineMs) {
+    if (heartbeat >= Heartbeat::COUNT) return;
+    deadline[static_cast<uint8_t>(heartbeat)] = deadlineMs;
+}
+
+void Watchdog::setRequired(Heartbeat heartbeat, bool required) {
+    if (heartbeat >= Heartbeat::COUNT) return;
+    uint8_t bit = 1 << static_cast<uint8_t>(heartbeat);
+    if (required) {
+        requiredMask |= bit;
+    } else {
+        requiredMask &= ~bit;
+    }
+}
+
+uint8_t Watchdog::getLateHeartbeats() {
+    unsigned long now = millis();
+    uint8_t late = 0;
+    for (uint8_t i = 0; i < HEARTBEAT_COUNT; i++) {
+        if ((requiredMask & (1 << i)) && now - lastBeat[i] > deadline[i]) {
+            late |= 1 << i;
+        }
+    }
+    return late;
+}
+
+void Watchdog::update() {
+    if (!enabled) return;
+    uint8_t late = getLateHeartbeats();
+    if (late == 0) {
+        wdt_reset();
+        if (starving) {
+            starving = false;
+            Logger::log(LogLevel::INFO, "Heartbeats back on time, watchdog fed again");
+        }
+    } else if (!starving) {
+        // Stop feeding: the board resets unless the heartbeats come back before the timeout
+        starving = true;
+        Logger::log(LogLevel::ERROR, "Watchdog not fed, late heartbeats: " + heartbeatList(late));
+    }
+}
+
+// Runs with interrupts disabled: no logging, no I2C, only pin and EEPROM writes
+void Watchdog::onTimeout() {
+    if (safeStateHook) {
+        safeStateHook();
+    }
+    uint8_t late = getLateHeartbeats();
+    ResetRecord record = lastRecord;
+    record.cause = static_cast<uint8_t>(late ? ResetCause::HEARTBEAT : ResetCause::WATCHDOG);
+    record.lateHeartbeats = late;
+    record.pending = 1;
+    record.uptime = millis();
+    record.wallTime = SystemClock::now();
+    record.watchdogResets++;
+    saveRecord(record);
+#ifdef WDT_vect
+    wdt_enable(WDTO_15MS);
+    for (;;) {}
+#endif
+}
+
+void Watchdog::logStatus() {
+    unsigned long now = millis();
+    Logger::log(LogLevel::INFO, String("Watchdog ") + (enabled ? "enabled" : "disabled") +
+                ", last reset: " + getCauseName(resetCause) + ", watchdog resets: " + String(lastRecord.watchdogResets));
+    for (uint8_t i = 0; i < HEARTBEAT_COUNT; i++) {
+        Logger::log(LogLevel::INFO, String("  ") + getHeartbeatName(static_cast<Heartbeat>(i)) + ": " +
+                    String(now - lastBeat[i]) + " ms ago, deadline " + String(deadline[i]) + " ms" +
+                    ((requiredMask & (1 << i)) ? "" : " (not required)"));
+    }
+}
+
+bool Watchdog::loadRecord(ResetRecord& record) {
+    EEPROM.get(EEPROM_RESET_CAUSE_ADDR, record);
+    return record.magic == MAGIC && record.crc == computeCRC(record);
+}
+
+void Watchdog::saveRecord(ResetRecord& record) {
+    record.magic = MAGIC;
+    record.crc = computeCRC(record);
+    EEPROM.put(EEPROM_RESET_CAUSE_ADDR, record);
+}
+
+uint8_t Watchdog::computeCRC(const ResetRecord& record) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < offsetof(ResetRecord, crc); i++) {
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    }
+    return crc;
+}
+
+String Watchdog::heartbeatList(uint8_t mask) {
+    String list;
+    for (uint8_t i = 0; i < HEARTBEAT_COUNT; i++) {
+        if (mask & (1 << i)) {
+            if (list.length() > 0) list += ", ";
+            list += getHeartbeatName(static_cast<Heartbeat>(i));
+        }
+    }
+    return list;
+}
+
+const char* Watchdog::getHeartbeatName(Heartbeat heartbeat) {
+    switch (heartbeat) {
+        case Heartbeat::LINK: return "link";
+        case Heartbeat::CONTROL: return "control";
+        case Heartbeat::SAFETY: return "safety";
+        case Heartbeat::LOGGING: return "logging";
+        default: return "unknown";
+    }
+}
+
+const char* Watchdog::getCauseName(ResetCause cause) {
+    switch (cause) {
+        case ResetCause::POWER_ON: return "power-on";
+        case ResetCause::EXTERNAL: return "external";
+        case ResetCause::BROWN_OUT: return "brown-out";
+        case ResetCause::WATCHDOG: return "watchdog";
+        case ResetCause::HEARTBEAT: return "heartbeat";
+        default: return "unknown";
+    }
+}
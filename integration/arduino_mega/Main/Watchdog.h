@@ -0,0 +1,87 @@
+// Watchdog.h
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "EepromLayout.h"
+#include <logger/Logger.h>
+
+// Subsystems supervised by the watchdog. Each one beats once per loop (logging once per logging interval).
+enum class Heartbeat : uint8_t {
+    LINK,       // Serial / ESP32 commands polled
+    CONTROL,    // State machine, PID loops and volume updated
+    SAFETY,     // Safety limits checked
+    LOGGING,    // Data logged
+    COUNT
+};
+
+enum class ResetCause : uint8_t {
+    UNKNOWN,
+    POWER_ON,
+    EXTERNAL,    // Reset button or upload
+    BROWN_OUT,
+    WATCHDOG,    // The loop hung (all heartbeats were on time when it stopped)
+    HEARTBEAT    // The watchdog was not fed because heartbeats were late
+};
+
+// AVR hardware watchdog supervising the main loop. The watchdog runs in interrupt-and-reset mode:
+// when it is not fed in time, the interrupt first drives the actuators to a safe state (all off)
+// and records the cause in EEPROM, then the board resets. The record is reported at the next boot.
+// The watchdog is only fed while every required heartbeat arrived within its deadline.
+class Watchdog {
+public:
+    // Reads and reports the cause of the last reset; call first in setup()
+    static void begin();
+
+    // Starts the watchdog (call at the end of setup()). The hook must be interrupt-safe.
+    static void enable(void (*safeStateHook)());
+
+    static void beat(Heartbeat heartbeat);
+    static void setDeadline(Heartbeat heartbeat, unsigned long deadlineMs);
+    static void setRequired(Heartbeat heartbeat, bool required);
+
+    // Feeds the watchdog if all required heartbeats are on time (call once per loop)
+    static void update();
+
+    static ResetCause getResetCause() { return resetCause; }
+    static uint8_t getLateHeartbeats();
+    static void logStatus();
+
+    static const char* getHeartbeatName(Heartbeat heartbeat);
+    static const char* getCauseName(ResetCause cause);
+
+    // Called by the watchdog interrupt: safe state, then the cause is persisted before the reset
+    static void onTimeout();
+
+private:
+    struct ResetRecord {
+        uint16_t magic;
+        uint8_t cause;            // ResetCause
+        uint8_t lateHeartbeats;   // Bit per Heartbeat, for HEARTBEAT resets
+        uint8_t pending;          // Written by the interrupt, not yet reported
+        uint32_t uptime;          // Uptime before the reset (ms), 0 if unknown
+        uint32_t wallTime;        // Unix time of the reset, 0 if unknown
+        uint16_t watchdogResets;  // Watchdog resets since the EEPROM was erased
+        uint8_t crc;
+    };
+
+    static const uint16_t MAGIC = 0xD06F;
+    static const uint8_t HEARTBEAT_COUNT = static_cast<uint8_t>(Heartbeat::COUNT);
+
+    static volatile unsigned long lastBeat[HEARTBEAT_COUNT];
+    static unsigned long deadline[HEARTBEAT_COUNT];
+    static uint8_t requiredMask;
+    static bool enabled;
+    static bool starving;            // Feeding stopped, logged once
+    static void (*safeStateHook)();
+    static ResetCause resetCause;
+    static ResetRecord lastRecord;
+
+    static bool loadRecord(ResetRecord& record);
+    static void saveRecord(ResetRecord& record);
+    static uint8_t computeCRC(const ResetRecord& record);
+    static String heartbeatList(uint8_t mask);
+};
+
+#endif // WATCHDOG_H
@@ -30,6 +30,13 @@ public:
      */
     virtual bool isOn() const = 0;
 
+    /*
+     * Pure virtual function to cut the power of the actuator at once.
+     * Only the output pins are written (no I2C, logging or delay), so it is safe to call
+     * from an interrupt service routine, e.g. the watchdog safe-state hook before a reset.
+     */
+    virtual void forceOff() = 0;
+
     /*
      * Virtual function to get the name of the actuator.
      * @return: Constant character pointer to the name of the actuator.
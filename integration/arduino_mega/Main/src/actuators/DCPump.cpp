@@ -9,7 +9,8 @@
 
 // Constructor for DCPump
 DCPump::DCPump(int pwmPin, int relayPin, int minPWM, const char* name)
-    : _pwmPin(pwmPin), _relayPin(relayPin), _minPWM(minPWM), status(false), _name(name), volumeRemoved(0) {
+    : _pwmPin(pwmPin), _relayPin(relayPin), _minPWM(minPWM), status(false), _name(name), volumeRemoved(0),
+      _flowAtMinSpeed(0), _flowAtMaxSpeed(0), _currentFlowRate(0), _lastUpdate(0) {
     pinMode(_pwmPin, OUTPUT); // Set PWM pin as output
     pinMode(_relayPin, OUTPUT); // Set relay pin as output
 }
@@ -24,25 +25,76 @@ void DCPump::begin() {
 
 // Method to control the pump
 void DCPump::control(bool state, int value) {
+    accumulateVolume(); // Account for the volume pumped at the previous speed
     if (state && value >= _minPWM && value <= 100) {
         int pwmValue = map(value, _minPWM, 100, 26, 255); // Map speed percentage to PWM value
         analogWrite(_pwmPin, pwmValue); // Set the PWM value
         digitalWrite(_relayPin, HIGH); // Turn on the relay
         status = true; // Set the status to on
+        _currentFlowRate = speedToFlowRate(value);
         Logger::log(LogLevel::INFO, String(_name) + " is ON, Speed set to: " + String(value));
-
-        // Calculate volume removed
-        float flowRate = value * 0.1;  // Example: 0.1 ml/min per unit of value
-        float duration = 1.0 / 60.0;  // 1 second in minutes
-        volumeRemoved += flowRate * duration;
     } else {
         analogWrite(_pwmPin, 0); // Set PWM value to 0
         digitalWrite(_relayPin, LOW); // Turn off the relay
         status = false; // Set the status to off
+        _currentFlowRate = 0;
         Logger::log(LogLevel::INFO, String(_name) + " is OFF");
     }
 }
 
+// Sets the two-point flow calibration (linear between the minimum speed and 100%)
+void DCPump::setFlowCalibration(float flowAtMinSpeed, float flowAtMaxSpeed) {
+    if (flowAtMinSpeed >= 0 && flowAtMaxSpeed >= flowAtMinSpeed) {
+        accumulateVolume();
+        _flowAtMinSpeed = flowAtMinSpeed;
+        _flowAtMaxSpeed = flowAtMaxSpeed;
+    } else {
+        Logger::log(LogLevel::WARNING, String(_name) + " - Invalid flow calibration: " + String(flowAtMinSpeed) + " - " + String(flowAtMaxSpeed));
+    }
+}
+
+// Volume removed including the volume pumped since the last speed change
+float DCPump::getVolumeRemoved() const {
+    return volumeRemoved + pendingVolume(millis());
+}
+
+void DCPump::resetVolumeRemoved() {
+    accumulateVolume();
+    volumeRemoved = 0;
+}
+
+float DCPump::consumeVolumeRemoved() {
+    accumulateVolume();
+    float volume = volumeRemoved;
+    volumeRemoved = 0;
+    return volume;
+}
+
+// Flow rate in ml/min for a speed percentage, from the calibration curve
+float DCPump::speedToFlowRate(int value) const {
+    if (value <= _minPWM) return _flowAtMinSpeed;
+    return _flowAtMinSpeed + (_flowAtMaxSpeed - _flowAtMinSpeed) * (value - _minPWM) / (100.0f - _minPWM);
+}
+
+// Integrates the flow rate over the ON time elapsed since the last update
+void DCPump::accumulateVolume() {
+    unsigned long now = millis();
+    volumeRemoved += pendingVolume(now);
+    _lastUpdate = now;
+}
+
+float DCPump::pendingVolume(unsigned long now) const {
+    if (!status) return 0.0f;
+    return _currentFlowRate * ((now - _lastUpdate) / 60000.0f);
+}
+
+// Pins only: the volume accounting is lost, the board is about to reset
+void DCPump::forceOff() {
+    analogWrite(_pwmPin, 0);
+    digitalWrite(_relayPin, LOW);
+    status = false;
+}
+
 // Method to check if the pump is on
 bool DCPump::isOn() const {
     return status;
@@ -42,6 +42,11 @@ public:
      */
     void control(bool state, int value) override;
 
+    /*
+     * Method to cut the power at once, safe from an interrupt (see ActuatorInterface::forceOff).
+     */
+    void forceOff() override;
+
     /*
      * Method to check if the pump is on.
      * @return Boolean indicating if the pump is on.
@@ -56,14 +61,32 @@ public:
 
     /*
      * Method to get the volume of liquid removed by the pump.
+     * The volume is integrated from the calibrated flow curve over the actual ON time, up to now.
      * @return The volume removed in milliliters.
      */
-    float getVolumeRemoved() const { return volumeRemoved; }
+    float getVolumeRemoved() const;
 
     /*
      * Method to reset the volume removed counter.
      */
-    void resetVolumeRemoved() { volumeRemoved = 0; }
+    void resetVolumeRemoved();
+
+    /*
+     * Method to read and reset the volume removed counter in one step, so no volume is lost between the two.
+     * @return The volume removed in milliliters since the last reset.
+     */
+    float consumeVolumeRemoved();
+
+    /*
+     * Method to set the flow calibration of the pump (linear between the minimum speed and 100%).
+     * An uncalibrated pump (0, 0), such as the air pump, does not account any liquid volume.
+     * @param flowAtMinSpeed: Measured flow rate in ml/min at the minimum speed.
+     * @param flowAtMaxSpeed: Measured flow rate in ml/min at 100% speed.
+     */
+    void setFlowCalibration(float flowAtMinSpeed, float flowAtMaxSpeed);
+    float getFlowAtMinSpeed() const { return _flowAtMinSpeed; }
+    float getFlowAtMaxSpeed() const { return _flowAtMaxSpeed; }
+    bool isCalibrated() const { return _flowAtMaxSpeed > 0; }
 
 private:
     int _pwmPin;    // PWM pin
@@ -71,7 +94,15 @@ private:
     int _minPWM;    // Minimum PWM value
     const char* _name;
     bool status; // Track the state of the pump
-    float volumeRemoved; // Track the volume removed by the pump
+    float volumeRemoved; // Track the volume removed by the pump (ml)
+    float _flowAtMinSpeed; // Calibrated flow rate at the minimum speed (ml/min)
+    float _flowAtMaxSpeed; // Calibrated flow rate at 100% speed (ml/min)
+    float _currentFlowRate; // Flow rate applied since _lastUpdate (ml/min), 0 when off
+    unsigned long _lastUpdate; // Time up to which volumeRemoved has been integrated
+
+    float speedToFlowRate(int value) const;
+    void accumulateVolume();
+    float pendingVolume(unsigned long now) const;
 };
 
 #endif
\ No newline at end of file
@@ -76,13 +76,21 @@ void HeatingPlate::setCycleTime(unsigned long newCycleTime) {
 
 #include "HeatingPlate.h"
 
-HeatingPlate::HeatingPlate(int relayPin, bool isPWMCapable, const char* name)
-    : _relayPin(relayPin), _name(name), _status(false), _isPWMCapable(isPWMCapable) {
+HeatingPlate* HeatingPlate::instance = nullptr; // Instance ticked by the timer interrupt
+
+HeatingPlate::HeatingPlate(int relayPin, bool isPWMCapable, float ratedPower, const char* name)
+    : _relayPin(relayPin), _name(name), _enabled(false), _isPWMCapable(isPWMCapable), _ratedPower(ratedPower),
+      _cycle(relayPin, DEFAULT_CYCLE_TIME, MIN_RELAY_ON_TIME, MIN_RELAY_OFF_TIME) {
     pinMode(_relayPin, OUTPUT);
 }
 
 void HeatingPlate::begin() {
     digitalWrite(_relayPin, LOW);
+    if (!_isPWMCapable) {
+        _cycle.begin();
+        instance = this;
+        startCycleTimer();
+    }
     Logger::log(LogLevel::INFO, String(_name) + " initialized");
 }
 
@@ -98,35 +106,90 @@ void HeatingPlate::control(bool state, int value) {
     }
 }
 
+// Stops the timer ticking the time-proportioning driver first, otherwise it would switch the relay on again
+void HeatingPlate::forceOff() {
+#ifdef TIMER5_COMPA_vect
+    if (!_isPWMCapable) {
+        TIMSK5 &= ~_BV(OCIE5A);
+    }
+#endif
+    digitalWrite(_relayPin, LOW);
+    _enabled = false;
+}
+
 bool HeatingPlate::isOn() const {
-    return _status;
+    return _enabled;
+}
+
+bool HeatingPlate::isRelayOn() const {
+    return _isPWMCapable ? _enabled : _cycle.isRelayOn();
+}
+
+float HeatingPlate::getDeliveredEnergy() const {
+    return _ratedPower * (getOnTime() / 3600000.0f);
+}
+
+unsigned long HeatingPlate::getOnTime() const {
+    return _isPWMCapable ? 0 : _cycle.getOnTime();
+}
+
+void HeatingPlate::resetDeliveredEnergy() {
+    _cycle.resetOnTime();
+}
+
+void HeatingPlate::setCycleTime(unsigned long cycleTime) {
+    _cycle.setWindow(cycleTime);
 }
 
 void HeatingPlate::controlPWM(int value) {
     int pwmValue = map(value, 0, 100, 0, 255);
     analogWrite(_relayPin, pwmValue);
-    _status = (pwmValue > 0);
-    Logger::log(LogLevel::INFO, String(_name) + (_status ? " is ON with power: " + String(value) + "%" : " is OFF"));
+    _enabled = (pwmValue > 0);
+    Logger::log(LogLevel::INFO, String(_name) + (_enabled ? " is ON with power: " + String(value) + "%" : " is OFF"));
 }
 
 void HeatingPlate::controlOnOff(bool state) {
-    digitalWrite(_relayPin, state ? HIGH : LOW);
-    _status = state;
-    Logger::log(LogLevel::INFO, String(_name) + (_status ? " is ON" : " is OFF"));
+    if (_isPWMCapable) {
+        digitalWrite(_relayPin, state ? HIGH : LOW);
+    } else if (state) {
+        _cycle.setOutput(100);
+    } else {
+        _cycle.stop();
+    }
+    _enabled = state;
+    Logger::log(LogLevel::INFO, String(_name) + (_enabled ? " is ON" : " is OFF. Delivered energy: " + String(getDeliveredEnergy()) + " Wh"));
 }
 
+// The relay itself is switched by the time-proportioning driver, ticked from the timer interrupt: the plate
+// stays enabled through the OFF part of the windows
 void HeatingPlate::controlWithCycle(int percentage) {
-    _dutyCycle = percentage / 100.0;
-    unsigned long now = millis();
-    if (now - _lastCycleStart >= _cycleTime) {
-        _lastCycleStart = now;
-    }
-    if (now - _lastCycleStart < _cycleTime * _dutyCycle) {
-        digitalWrite(_relayPin, HIGH);
-        _status = true;
-    } else {
-        digitalWrite(_relayPin, LOW);
-        _status = false;
+    _cycle.setOutput(percentage);
+    _enabled = (percentage > 0);
+    Logger::log(LogLevel::INFO, String(_name) + " Duty Cycle: " + String(percentage) + "%");
+}
+
+// Timer5 (unused by the sketch: its PWM pins 44-46 are free) runs in CTC mode at CYCLE_TICK_HZ
+void HeatingPlate::startCycleTimer() {
+#ifdef TIMER5_COMPA_vect
+    noInterrupts();
+    TCCR5A = 0;
+    TCCR5B = _BV(WGM52) | _BV(CS51) | _BV(CS50);              // CTC, prescaler 64
+    TCNT5 = 0;
+    OCR5A = (F_CPU / 64 / CYCLE_TICK_HZ) - 1;
+    TIMSK5 |= _BV(OCIE5A);
+    interrupts();
+#endif
+}
+
+// Interrupt service routine driving the relay windows
+void HeatingPlate::onCycleTimer() {
+    if (instance) {
+        instance->_cycle.tick(millis());
     }
-    Logger::log(LogLevel::INFO, String(_name) + " Duty Cycle: " + String(_dutyCycle * 100) + "%");
-}
\ No newline at end of file
+}
+
+#ifdef TIMER5_COMPA_vect
+ISR(TIMER5_COMPA_vect) {
+    HeatingPlate::onCycleTimer();
+}
+#endif
@@ -2,12 +2,16 @@
  * HeatingPlate.h
  * This file defines a class for controlling a heating plate.
  * The class supports both on/off control and PWM control for future hardware.
+ * In relay mode, the power percentage is produced by a time-proportioning driver
+ * (TimeProportioningOutput) ticked every 10 ms from the Timer5 compare interrupt,
+ * so the duty cycle no longer depends on how often control() is called.
  */
 
 #ifndef HEATINGPLATE_H
 #define HEATINGPLATE_H
 
 #include "ActuatorInterface.h"
+#include "TimeProportioningOutput.h"
 #include <logger/Logger.h>
 #include <Arduino.h>
 
@@ -18,10 +22,11 @@ public:
     /*
      * Constructor for HeatingPlate.
      * @param controlPin: The pin connected to the relay or PWM pin for the heating plate.
-     * 
+     * @param isPWMCapable: True if the hardware accepts a PWM signal, false for a relay.
+     * @param ratedPower: Nominal power of the heating plate in watts (used for energy reporting).
      * @param name: Identifier for the heating plate (for debugging purposes).
      */
-     HeatingPlate(int relayPin, bool isPWMCapable, const char* name);
+     HeatingPlate(int relayPin, bool isPWMCapable, float ratedPower, const char* name);
 
     /*
      * Method to initialize the heating plate.
@@ -37,17 +42,54 @@ public:
     void control(bool state, int value = 0) override;
 
     /*
-     * Method to check if the heating plate is on.
-     * @return Boolean indicating if the heating plate is on.
+     * Method to cut the power at once, safe from an interrupt (see ActuatorInterface::forceOff).
+     */
+    void forceOff() override;
+
+    /*
+     * Method to check if the heating plate is enabled (a power above 0% is requested).
+     * In relay mode the relay is switched on and off within each window while enabled, see isRelayOn().
+     * @return Boolean indicating if the heating plate is enabled.
      */
     bool isOn() const override;
 
+    /*
+     * Method to check if the heating plate is drawing power right now.
+     * @return Boolean indicating the instantaneous relay state (the PWM state when PWM capable).
+     */
+    bool isRelayOn() const;
+
     /*
      * Method to get the name of the heating plate.
      * @return The name of the heating plate.
      */
     const char* getName() const override { return _name; }
 
+    /*
+     * Method to get the energy delivered by the heating plate (relay mode).
+     * @return The delivered energy in watt-hours since the last reset.
+     */
+    float getDeliveredEnergy() const;
+
+    /*
+     * Method to get the accumulated relay ON time (relay mode).
+     * @return The ON time in milliseconds since the last reset.
+     */
+    unsigned long getOnTime() const;
+
+    void resetDeliveredEnergy();
+
+    /*
+     * Method to change the length of the time-proportioning window.
+     * @param cycleTime: Window length in milliseconds.
+     */
+    void setCycleTime(unsigned long cycleTime);
+
+    /*
+     * Timer interrupt handler ticking the time-proportioning driver.
+     */
+    static void onCycleTimer();
+
 private:
 /*
     int _controlPin;   // Relay or PWM pin
@@ -70,16 +112,22 @@ private:
     */
     int _relayPin;
     const char* _name;
-    bool _status;
+    bool _enabled;     // Power requested, the relay may be in the OFF part of its window
     bool _isPWMCapable;
-    
-    unsigned long _cycleTime = 10000;
-    unsigned long _lastCycleStart = 0;
-    double _dutyCycle = 0;
-    
+    float _ratedPower;
+
+    static const unsigned long DEFAULT_CYCLE_TIME = 10000; // 10 seconds per cycle
+    static const unsigned long MIN_RELAY_ON_TIME = 1000;   // Shortest ON pulse accepted by the relay
+    static const unsigned long MIN_RELAY_OFF_TIME = 1000;  // Shortest OFF gap accepted by the relay
+    static const unsigned int CYCLE_TICK_HZ = 100;         // Tick rate of the time-proportioning driver
+
+    TimeProportioningOutput _cycle;
+    static HeatingPlate* instance; // Static instance for the interrupt handler
+
     void controlPWM(int value);
     void controlOnOff(bool state);
     void controlWithCycle(int percentage);
+    void startCycleTimer();
 };
 
 #endif
\ No newline at end of file
@@ -33,6 +33,11 @@ void LEDGrowLight::control(bool state, int value) {
     }
 }
 
+void LEDGrowLight::forceOff() {
+    digitalWrite(_relayPin, LOW);
+    status = false;
+}
+
 // Method to check if the LED grow light is on
 bool LEDGrowLight::isOn() const {
     return status;
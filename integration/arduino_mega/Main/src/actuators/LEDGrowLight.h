@@ -39,6 +39,11 @@ public:
      */
     void control(bool state, int value = 0) override;
 
+    /*
+     * Method to cut the power at once, safe from an interrupt (see ActuatorInterface::forceOff).
+     */
+    void forceOff() override;
+
     /*
      * Method to check if the LED grow light is on.
      * @return Boolean indicating if the LED grow light is on.
@@ -8,7 +8,8 @@
 
 // Constructor for PeristalticPump
 PeristalticPump::PeristalticPump(uint8_t dacAddress, int relayPin, float minFlowRate, float maxFlowRate, const char* name)
-    : _dacAddress(dacAddress), _relayPin(relayPin), _minFlowRate(minFlowRate), _maxFlowRate(maxFlowRate), _name(name), status(false), volumeAdded(0) {
+    : _dacAddress(dacAddress), _relayPin(relayPin), _minFlowRate(minFlowRate), _maxFlowRate(maxFlowRate), _name(name), status(false), volumeAdded(0),
+      _currentFlowRate(0), _lastUpdate(0) {
 }
 
 // Initializes the peristaltic pump by setting up the relay pin and the DAC
@@ -21,28 +22,74 @@ void PeristalticPump::begin() {
 
 // Controls the pump's state and flow rate
 void PeristalticPump::control(bool state, int value) {
+    accumulateVolume(); // Account for the volume pumped at the previous flow rate
     if (state && value > _minFlowRate) {
         float flowRate = constrain(value, _minFlowRate, _maxFlowRate);
         uint16_t dacValue = flowRateToDAC(flowRate);
         _dac.setVoltage(dacValue, false);
         digitalWrite(_relayPin, HIGH);
         status = true;
-        float duration = 1.0 / 60.0;
-        volumeAdded += flowRate * duration;
+        _currentFlowRate = flowRate;
         Logger::log(LogLevel::INFO, String(_name) + " is ON with flow rate: " + String(flowRate) + " ml/min");
     } else {
         _dac.setVoltage(0, false);
         digitalWrite(_relayPin, LOW);
         status = false;
+        _currentFlowRate = 0;
         Logger::log(LogLevel::INFO, String(_name) + " is OFF");
     }
 }
 
+// Volume added including the volume pumped since the last flow rate change
+float PeristalticPump::getVolumeAdded() const {
+    return volumeAdded + pendingVolume(millis());
+}
+
+void PeristalticPump::resetVolumeAdded() {
+    accumulateVolume();
+    volumeAdded = 0;
+}
+
+float PeristalticPump::consumeVolumeAdded() {
+    accumulateVolume();
+    float volume = volumeAdded;
+    volumeAdded = 0;
+    return volume;
+}
+
+// Integrates the flow rate over the ON time elapsed since the last update
+void PeristalticPump::accumulateVolume() {
+    unsigned long now = millis();
+    volumeAdded += pendingVolume(now);
+    _lastUpdate = now;
+}
+
+float PeristalticPump::pendingVolume(unsigned long now) const {
+    if (!status) return 0.0f;
+    return _currentFlowRate * ((now - _lastUpdate) / 60000.0f);
+}
+
+// The relay cuts the pump power: the DAC (I2C) is left untouched, the bus may be the one that hangs
+void PeristalticPump::forceOff() {
+    digitalWrite(_relayPin, LOW);
+    status = false;
+}
+
 // Method to check if the pump is on
 bool PeristalticPump::isOn() const {
     return status;
 }
 
+// Sets the calibrated flow range (ignored if not a valid range)
+void PeristalticPump::setFlowRange(float minFlowRate, float maxFlowRate) {
+    if (minFlowRate >= 0 && maxFlowRate > minFlowRate) {
+        _minFlowRate = minFlowRate;
+        _maxFlowRate = maxFlowRate;
+    } else {
+        Logger::log(LogLevel::WARNING, String(_name) + " - Invalid flow range: " + String(minFlowRate) + " - " + String(maxFlowRate));
+    }
+}
+
 // Converts flow rate in ml/min to DAC value
 uint16_t PeristalticPump::flowRateToDAC(float flowRate) {
     float proportion = flowRate / _maxFlowRate;       // Calculate proportion of max flow rate
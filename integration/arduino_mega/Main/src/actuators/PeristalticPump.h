@@ -43,6 +43,11 @@ public:
      */
     void control(bool state, int value) override;
 
+    /*
+     * Method to cut the power at once, safe from an interrupt (see ActuatorInterface::forceOff).
+     */
+    void forceOff() override;
+
     /*
      * Method to check if the pump is on.
      * @return Boolean indicating if the pump is on.
@@ -51,12 +56,34 @@ public:
 
     const char* getName() const override { return _name; }
 
-    float getVolumeAdded() const { return volumeAdded; }
-    void resetVolumeAdded() { volumeAdded = 0; }
+    /*
+     * Method to get the volume added by the pump.
+     * The volume is integrated from the flow rate over the actual ON time, up to now.
+     * @return The volume added in milliliters since the last reset.
+     */
+    float getVolumeAdded() const;
+
+    /*
+     * Method to reset the volume added counter.
+     */
+    void resetVolumeAdded();
+
+    /*
+     * Method to read and reset the volume added counter in one step, so no volume is lost between the two.
+     * @return The volume added in milliliters since the last reset.
+     */
+    float consumeVolumeAdded();
 
     float getMaxFlowRate() const { return _maxFlowRate; }
     float getMinFlowRate() const { return _minFlowRate; }
 
+    /*
+     * Sets the calibrated flow range of the pump.
+     * @param minFlowRate: Minimum flow rate in ml/min.
+     * @param maxFlowRate: Flow rate in ml/min at full DAC scale.
+     */
+    void setFlowRange(float minFlowRate, float maxFlowRate);
+
 
 private:
     uint8_t _dacAddress;    // I2C address of the DAC
@@ -66,7 +93,12 @@ private:
     const char* _name;
     Adafruit_MCP4725 _dac;  // DAC instance
     bool status;            // Track the state of the pump
-    float volumeAdded;      // Track the volume added by the pump
+    float volumeAdded;      // Track the volume added by the pump (ml)
+    float _currentFlowRate; // Flow rate applied since _lastUpdate (ml/min), 0 when off
+    unsigned long _lastUpdate; // Time up to which volumeAdded has been integrated
+
+    void accumulateVolume();
+    float pendingVolume(unsigned long now) const;
     
     /*
      * Converts flow rate in ml/min to DAC value.
@@ -39,6 +39,12 @@ void StirringMotor::control(bool state, int value) {
     }
 }
 
+void StirringMotor::forceOff() {
+    analogWrite(_pwmPin, 0);
+    digitalWrite(_relayPin, LOW);
+    status = false;
+}
+
 // Method to check if the motor is on
 bool StirringMotor::isOn() const {
     return status;
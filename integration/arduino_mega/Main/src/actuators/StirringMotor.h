@@ -40,6 +40,11 @@ public:
      */
     void control(bool state, int value) override;
 
+    /*
+     * Method to cut the power at once, safe from an interrupt (see ActuatorInterface::forceOff).
+     */
+    void forceOff() override;
+
     /*
      * Method to check if the motor is on.
      * @return Boolean indicating if the motor is on.
@@ -0,0 +1,99 @@
+/*
+ * TimeProportioningOutput.cpp
+ * This file provides the implementation of the TimeProportioningOutput class defined in TimeProportioningOutput.h.
+ */
+
+#include "TimeProportioningOutput.h"
+
+TimeProportioningOutput::TimeProportioningOutput(int pin, unsigned long windowMs, unsigned long minOnMs, unsigned long minOffMs)
+    : _pin(pin), _windowMs(windowMs), _minOnMs(minOnMs), _minOffMs(minOffMs),
+      _percent(0), _relayOn(false), _windowActive(false), _windowStart(0), _onTimeMs(0),
+      _carryMs(0), _relayOnSince(0), _totalOnMs(0) {
+}
+
+void TimeProportioningOutput::begin() {
+    pinMode(_pin, OUTPUT);
+    digitalWrite(_pin, LOW);
+    _relayOn = false;
+    _windowActive = false;
+}
+
+void TimeProportioningOutput::setOutput(float percent) {
+    _percent = constrain(percent, 0.0f, 100.0f);
+}
+
+void TimeProportioningOutput::tick(unsigned long now) {
+    if (!_windowActive || now - _windowStart >= _windowMs) {
+        startWindow(now);
+    }
+    setRelay(now - _windowStart < _onTimeMs, now);
+}
+
+void TimeProportioningOutput::stop() {
+    noInterrupts();
+    _percent = 0;
+    _carryMs = 0;
+    _onTimeMs = 0;
+    _windowActive = false;
+    setRelay(false, millis());
+    interrupts();
+}
+
+unsigned long TimeProportioningOutput::getOnTime() const {
+    noInterrupts();
+    unsigned long total = _totalOnMs;
+    if (_relayOn) {
+        total += millis() - _relayOnSince;
+    }
+    interrupts();
+    return total;
+}
+
+void TimeProportioningOutput::resetOnTime() {
+    noInterrupts();
+    _totalOnMs = 0;
+    _relayOnSince = millis();
+    interrupts();
+}
+
+void TimeProportioningOutput::setWindow(unsigned long windowMs) {
+    noInterrupts();
+    _windowMs = windowMs;
+    _windowActive = false;
+    interrupts();
+}
+
+// Plans the ON time of a new window from the requested power plus the carried-over time
+void TimeProportioningOutput::startWindow(unsigned long now) {
+    _windowStart = now;
+    _windowActive = true;
+
+    long window = (long)_windowMs;
+    long desired = (long)(_percent * _windowMs / 100.0f) + _carryMs;
+    desired = constrain(desired, 0L, window);
+
+    long planned;
+    if (_percent <= 0) {
+        planned = 0;
+    } else if (desired < (long)_minOnMs) {
+        planned = 0;               // Pulse too short for the relay: keep it for a later window
+    } else if (window - desired < (long)_minOffMs) {
+        planned = window;          // Gap too short for the relay: stay ON the whole window
+    } else {
+        planned = desired;
+    }
+
+    _carryMs = (_percent <= 0) ? 0 : desired - planned;
+    _onTimeMs = (unsigned long)planned;
+}
+
+void TimeProportioningOutput::setRelay(bool on, unsigned long now) {
+    if (on == _relayOn) return;
+    if (on) {
+        _relayOnSince = now;
+    } else {
+        _totalOnMs += now - _relayOnSince;
+    }
+    digitalWrite(_pin, on ? HIGH : LOW);
+    _relayOn = on;
+}
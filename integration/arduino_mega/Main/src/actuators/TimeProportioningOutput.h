@@ -0,0 +1,101 @@
+/*
+ * TimeProportioningOutput.h
+ * This file defines a time-proportioning driver for relay outputs.
+ * A power percentage is turned into an on/off window of fixed length: the relay is ON for
+ * (percentage * window) milliseconds at the start of each window and OFF for the rest.
+ *
+ * The driver is designed to be ticked in the background (from a timer interrupt or a scheduler)
+ * so that the windows are produced accurately, independently of how often the controller
+ * updates the requested percentage.
+ *
+ * Relay protection:
+ * - ON pulses shorter than the minimum ON time are skipped.
+ * - OFF gaps shorter than the minimum OFF time are filled (relay stays ON for the whole window).
+ * The skipped/extra time is carried over to the next windows, so the average power is preserved.
+ */
+
+#ifndef TIMEPROPORTIONINGOUTPUT_H
+#define TIMEPROPORTIONINGOUTPUT_H
+
+#include <Arduino.h>
+
+class TimeProportioningOutput {
+public:
+    /*
+     * Constructor for TimeProportioningOutput.
+     * @param pin: The pin connected to the relay.
+     * @param windowMs: Length of one time-proportioning window in milliseconds.
+     * @param minOnMs: Minimum time the relay may stay ON (in milliseconds).
+     * @param minOffMs: Minimum time the relay may stay OFF (in milliseconds).
+     */
+    TimeProportioningOutput(int pin, unsigned long windowMs, unsigned long minOnMs, unsigned long minOffMs);
+
+    /*
+     * Configures the relay pin and forces the output OFF.
+     */
+    void begin();
+
+    /*
+     * Sets the requested output power.
+     * The new value is applied at the start of the next window.
+     * @param percent: Output power in percent (0-100).
+     */
+    void setOutput(float percent);
+
+    /*
+     * Method to get the requested output power.
+     * @return The requested output power in percent.
+     */
+    float getOutput() const { return _percent; }
+
+    /*
+     * Advances the driver. Must be called periodically (every few milliseconds).
+     * Safe to call from an interrupt service routine.
+     * @param now: Current time in milliseconds (millis()).
+     */
+    void tick(unsigned long now);
+
+    /*
+     * Turns the relay OFF immediately and clears the requested output and carried time.
+     */
+    void stop();
+
+    /*
+     * Method to check if the relay is currently energised.
+     * @return Boolean indicating the instantaneous relay state.
+     */
+    bool isRelayOn() const { return _relayOn; }
+
+    /*
+     * Method to get the accumulated relay ON time.
+     * @return Total ON time in milliseconds since the last reset.
+     */
+    unsigned long getOnTime() const;
+
+    /*
+     * Method to reset the accumulated relay ON time.
+     */
+    void resetOnTime();
+
+    void setWindow(unsigned long windowMs);
+
+private:
+    int _pin;
+    unsigned long _windowMs;
+    unsigned long _minOnMs;
+    unsigned long _minOffMs;
+
+    volatile float _percent;              // Requested output power (0-100%)
+    volatile bool _relayOn;               // Instantaneous relay state
+    volatile bool _windowActive;          // False until the first window is started
+    volatile unsigned long _windowStart;  // Start of the current window
+    volatile unsigned long _onTimeMs;     // ON time planned for the current window
+    volatile long _carryMs;               // ON time carried over because of min ON/OFF constraints
+    volatile unsigned long _relayOnSince; // Time at which the relay was last switched ON
+    volatile unsigned long _totalOnMs;    // Accumulated ON time of completed pulses
+
+    void startWindow(unsigned long now);
+    void setRelay(bool on, unsigned long now);
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * HostLogStorage.cpp
+ * This file provides the implementation of the HostLogStorage class defined in HostLogStorage.h.
+ */
+
+#ifndef ARDUINO
+
+#include "HostLogStorage.h"
+#include <stdio.h>
+
+HostLogStorage::HostLogStorage(const char* directory) : _directory(directory) {}
+
+bool HostLogStorage::begin() {
+    char path[FULL_PATH_LENGTH];
+    fullPath(".", path);
+    FILE* dir = fopen(path, "r");
+    if (!dir) return false;
+    fclose(dir);
+    return true;
+}
+
+uint32_t HostLogStorage::size(const char* path) {
+    char buffer[FULL_PATH_LENGTH];
+    fullPath(path, buffer);
+    FILE* file = fopen(buffer, "rb");
+    if (!file) return 0;
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fclose(file);
+    return fileSize < 0 ? 0 : (uint32_t)fileSize;
+}
+
+bool HostLogStorage::read(const char* path, uint32_t offset, uint8_t* data, uint16_t length) {
+    char buffer[FULL_PATH_LENGTH];
+    fullPath(path, buffer);
+    FILE* file = fopen(buffer, "rb");
+    if (!file) return false;
+    bool ok = fseek(file, offset, SEEK_SET) == 0 && fread(data, 1, length, file) == length;
+    fclose(file);
+    return ok;
+}
+
+bool HostLogStorage::append(const char* path, const uint8_t* data, uint16_t length) {
+    char buffer[FULL_PATH_LENGTH];
+    fullPath(path, buffer);
+    FILE* file = fopen(buffer, "ab");
+    if (!file) return false;
+    bool ok = fwrite(data, 1, length, file) == length;
+    return fclose(file) == 0 && ok;
+}
+
+bool HostLogStorage::remove(const char* path) {
+    char buffer[FULL_PATH_LENGTH];
+    fullPath(path, buffer);
+    return ::remove(buffer) == 0;
+}
+
+void HostLogStorage::fullPath(const char* path, char* buffer) {
+    snprintf(buffer, FULL_PATH_LENGTH, "%s/%s", _directory, path);
+}
+
+#endif // ARDUINO
@@ -0,0 +1,39 @@
+/*
+ * HostLogStorage.h
+ * This file defines a LogStorage backend on the filesystem of a host computer (stdio), so the
+ * data recorder can be exercised without the SD card. It is not compiled for the Arduino.
+ */
+
+#ifndef HOSTLOGSTORAGE_H
+#define HOSTLOGSTORAGE_H
+
+#ifndef ARDUINO
+
+#include <Arduino.h>
+#include "LogStorage.h"
+
+class HostLogStorage : public LogStorage {
+public:
+    /*
+     * Constructor for HostLogStorage.
+     * @param directory: Existing directory holding the files (without trailing slash).
+     */
+    HostLogStorage(const char* directory);
+
+    bool begin() override;
+    uint32_t size(const char* path) override;
+    bool read(const char* path, uint32_t offset, uint8_t* data, uint16_t length) override;
+    bool append(const char* path, const uint8_t* data, uint16_t length) override;
+    bool remove(const char* path) override;
+
+private:
+    static const uint16_t FULL_PATH_LENGTH = 256;
+
+    const char* _directory;
+
+    void fullPath(const char* path, char* buffer);
+};
+
+#endif // ARDUINO
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * LogStorage.h
+ * This file defines an abstract interface for the file storage used by the data recorder.
+ * The recorder only needs append-only files addressed by name, so the same code runs on the
+ * SD card (SdLogStorage) and on a host filesystem (HostLogStorage) without the card.
+ */
+
+#ifndef LOGSTORAGE_H
+#define LOGSTORAGE_H
+
+#include <Arduino.h>
+
+class LogStorage {
+public:
+    /*
+     * Pure virtual function to initialize the storage (mount the card).
+     * @return: True if the storage can be used.
+     */
+    virtual bool begin() = 0;
+
+    /*
+     * Method to get the size of a file.
+     * @param path: Name of the file (8.3 format on the SD card).
+     * @return: Size in bytes, 0 if the file does not exist.
+     */
+    virtual uint32_t size(const char* path) = 0;
+
+    /*
+     * Reads bytes from a file.
+     * @param path: Name of the file.
+     * @param offset: Position of the first byte to read.
+     * @param data: Destination buffer.
+     * @param length: Number of bytes to read.
+     * @return: True if all the bytes were read.
+     */
+    virtual bool read(const char* path, uint32_t offset, uint8_t* data, uint16_t length) = 0;
+
+    /*
+     * Appends bytes at the end of a file (created if needed) and commits them to the medium.
+     * @param path: Name of the file.
+     * @param data: Bytes to append.
+     * @param length: Number of bytes to append.
+     * @return: True if all the bytes were written.
+     */
+    virtual bool append(const char* path, const uint8_t* data, uint16_t length) = 0;
+
+    /*
+     * Deletes a file.
+     * @param path: Name of the file.
+     * @return: True if the file was deleted.
+     */
+    virtual bool remove(const char* path) = 0;
+
+    /*
+     * Virtual destructor to ensure proper cleanup of derived classes.
+     */
+    virtual ~LogStorage() {}
+};
+
+#endif
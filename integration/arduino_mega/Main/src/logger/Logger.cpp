@@ -21,7 +21,8 @@ void Logger::log(LogLevel level, const String& message) {
 static void Logger::logData(const String& currentProgram, 
                      const String& programStatus,
                      float wTemp, float aTemp, float eTemp, float pH, float turb, float oxy, float aflow,
-                     bool apStat, bool dpStat, bool spStat, bool npStat, bool bpStat, bool smStat, bool hpStat, bool lgStat) {
+                     bool apStat, bool dpStat, bool spStat, bool npStat, bool bpStat, bool smStat, bool hpStat, bool lgStat,
+                     uint8_t sensorFaults, uint32_t seq, uint32_t unixTime, uint16_t milliseconds) {
 
     // Debug logs for sensor values
     log(LogLevel::DEBUG, "Water Temp: " + String(wTemp));
@@ -58,6 +59,18 @@ static void Logger::logData(const String& currentProgram,
     doc["oxygen"] = oxy;
     doc["airFlow"] = aflow;
 
+    // Bit per SensorId set while the sensor is faulted (its value is then null)
+    doc["sensorFaults"] = sensorFaults;
+
+    // Sequence number of the record on the SD card, to detect and backfill gaps (0 = not recorded)
+    if (seq != 0) doc["seq"] = seq;
+
+    // Unix time of the acquisition, to the millisecond (0 = clock not synchronized yet)
+    if (unixTime != 0) {
+        doc["t"] = unixTime;
+        doc["ms"] = milliseconds;
+    }
+
     // Serialize JSON document to string
     String output;
     serializeJson(doc, output);
@@ -146,7 +159,8 @@ void Logger::logStartupParameters(const String& programType, int rateOrSpeed, in
     Serial.println(output);
 }
 
-void Logger::logPIDData(const String& pidType, float setpoint, float input, float output) {
+void Logger::logPIDData(const String& pidType, float setpoint, float input, float output,
+    float target, uint8_t progress) {
     StaticJsonDocument<128> doc;
     
     doc["ev"] = "pid";
@@ -154,6 +168,8 @@ void Logger::logPIDData(const String& pidType, float setpoint, float input, floa
     doc["set"] = setpoint;
     doc["in"] = input;
     doc["out"] = output;
+    doc["tgt"] = target;      // Final setpoint of the trajectory
+    doc["prog"] = progress;   // Trajectory progress (%)
     
     String jsonOutput;
     serializeJson(doc, jsonOutput);
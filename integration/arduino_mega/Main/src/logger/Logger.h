@@ -14,15 +14,17 @@ enum class LogLevel {
 class Logger {
 public:
     static void log(LogLevel level, const String& message);
-    static void Logger::logData(const String& currentProgram, 
+    static void logData(const String& currentProgram, 
                      const String& programStatus,
                      float wTemp, float aTemp, float eTemp, float pH, float turb, float oxy, float aflow,
-                     bool apStat, bool dpStat, bool spStat, bool npStat, bool bpStat, bool smStat, bool hpStat, bool lgStat);
+                     bool apStat, bool dpStat, bool spStat, bool npStat, bool bpStat, bool smStat, bool hpStat, bool lgStat,
+                     uint8_t sensorFaults, uint32_t seq, uint32_t unixTime, uint16_t milliseconds);
     // static void logData(const String& currentProgram, const String& programStatus);
     static void logStartupParameters(const String& programType, int rateOrSpeed, int duration,
         float tempSetpoint, float phSetpoint, float doSetpoint, float nutrientConc,
         float baseConc, const String& experimentName, const String& comment);
-    static void logPIDData(const String& pidType, float setpoint, float input, float output);
+    static void logPIDData(const String& pidType, float setpoint, float input, float output,
+        float target, uint8_t progress);
     static void setLogLevel(LogLevel level);
     // static void logSensorData();
     // static void logActuatorData();
@@ -0,0 +1,57 @@
+/*
+ * SdLogStorage.cpp
+ * This file provides the implementation of the SdLogStorage class defined in SdLogStorage.h.
+ */
+
+#include "SdLogStorage.h"
+
+SdLogStorage::SdLogStorage(uint8_t csPin) : _csPin(csPin) {
+    _appendPath[0] = '\0';
+}
+
+bool SdLogStorage::begin() {
+    return SD.begin(_csPin);
+}
+
+uint32_t SdLogStorage::size(const char* path) {
+    if (_appendFile && strcmp(path, _appendPath) == 0) {
+        return _appendFile.size();
+    }
+    File file = SD.open(path, FILE_READ);
+    if (!file) return 0;
+    uint32_t fileSize = file.size();
+    file.close();
+    return fileSize;
+}
+
+bool SdLogStorage::read(const char* path, uint32_t offset, uint8_t* data, uint16_t length) {
+    File file = SD.open(path, FILE_READ);
+    if (!file) return false;
+    bool ok = file.seek(offset) && file.read(data, length) == length;
+    file.close();
+    return ok;
+}
+
+bool SdLogStorage::append(const char* path, const uint8_t* data, uint16_t length) {
+    if (!_appendFile || strcmp(path, _appendPath) != 0) {
+        if (_appendFile) _appendFile.close();
+        _appendFile = SD.open(path, FILE_WRITE);   // FILE_WRITE appends at the end of the file
+        if (!_appendFile) {
+            _appendPath[0] = '\0';
+            return false;
+        }
+        strncpy(_appendPath, path, PATH_LENGTH - 1);
+        _appendPath[PATH_LENGTH - 1] = '\0';
+    }
+    size_t written = _appendFile.write(data, length);
+    _appendFile.flush();
+    return written == length;
+}
+
+bool SdLogStorage::remove(const char* path) {
+    if (_appendFile && strcmp(path, _appendPath) == 0) {
+        _appendFile.close();
+        _appendPath[0] = '\0';
+    }
+    return SD.remove(path);
+}
@@ -0,0 +1,37 @@
+/*
+ * SdLogStorage.h
+ * This file defines the SD card backend of LogStorage, using the Arduino SD library.
+ * The card is on the hardware SPI bus (MISO 50, MOSI 51, SCK 52 on the Mega) with its own chip select.
+ * The file being appended stays open between appends, so the directory is not searched on every write.
+ */
+
+#ifndef SDLOGSTORAGE_H
+#define SDLOGSTORAGE_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include "LogStorage.h"
+
+class SdLogStorage : public LogStorage {
+public:
+    /*
+     * Constructor for SdLogStorage.
+     * @param csPin: Chip select pin of the SD card.
+     */
+    SdLogStorage(uint8_t csPin);
+
+    bool begin() override;
+    uint32_t size(const char* path) override;
+    bool read(const char* path, uint32_t offset, uint8_t* data, uint16_t length) override;
+    bool append(const char* path, const uint8_t* data, uint16_t length) override;
+    bool remove(const char* path) override;
+
+private:
+    static const uint8_t PATH_LENGTH = 13;   // 8.3 name and terminator
+
+    uint8_t _csPin;
+    File _appendFile;
+    char _appendPath[PATH_LENGTH];
+};
+
+#endif
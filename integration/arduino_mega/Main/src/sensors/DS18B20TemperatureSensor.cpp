@@ -7,50 +7,81 @@
 #include "DS18B20TemperatureSensor.h"
 
 // Constructor for DS18B20TemperatureSensor
-DS18B20TemperatureSensor::DS18B20TemperatureSensor(int pin, const char* name) : _ds(pin), _pin(pin), _name(name) {}
+DS18B20TemperatureSensor::DS18B20TemperatureSensor(int pin, const char* name)
+    : _ds(pin), _pin(pin), _name(name), _hasAddress(false), _state(State::IDLE), _conversionStart(0), _lastValue(-1000) {}
 
 // Method to initialize the temperature sensor
 void DS18B20TemperatureSensor::begin() {
-    // Nothing specific to initialize for DS18B20 in this implementation
+    // The first conversion runs while the other sensors are initialized
+    startConversion();
     Logger::log(LogLevel::INFO, String(_name) + " initialized");
 }
 
-// Method to read the temperature from the sensor
-float DS18B20TemperatureSensor::readValue() {
-    byte data[12];
-    byte addr[8];
-
-    if (!_ds.search(addr)) {
+// Searches the sensor on the bus, once: the conversions are then addressed to it
+bool DS18B20TemperatureSensor::findAddress() {
+    if (_hasAddress) return true;
+    if (!_ds.search(_addr)) {
         _ds.reset_search();
-        return -1000; // Return an error value if no sensor found
+        return false; // No sensor found
     }
+    _ds.reset_search();
 
-    if (OneWire::crc8(addr, 7) != addr[7]) {
+    if (OneWire::crc8(_addr, 7) != _addr[7]) {
         Serial.println("CRC is not valid!");
-        return -1000; // Return an error value if CRC check fails
+        return false;
     }
 
-    if (addr[0] != 0x10 && addr[0] != 0x28) {
+    if (_addr[0] != 0x10 && _addr[0] != 0x28) {
         Serial.print("Device is not recognized");
-        return -1000; // Return an error value if the device is not recognized
+        return false;
     }
+    _hasAddress = true;
+    return true;
+}
 
+void DS18B20TemperatureSensor::startConversion() {
+    if (_state == State::CONVERTING) return;
+    if (!findAddress()) {
+        _state = State::FAILED;
+        return;
+    }
     _ds.reset();
-    _ds.select(addr);
-    _ds.write(0x44, 1); // Start temperature conversion
+    _ds.select(_addr);
+    _ds.write(0x44, 1); // Start temperature conversion, the result is read CONVERSION_TIME later
+    _conversionStart = millis();
+    _state = State::CONVERTING;
+}
+
+bool DS18B20TemperatureSensor::isResultReady() const {
+    return _state == State::FAILED || (_state == State::CONVERTING && millis() - _conversionStart >= CONVERSION_TIME);
+}
 
-    delay(1000); // Wait for conversion to complete
+float DS18B20TemperatureSensor::readScratchpad() {
+    byte data[9];
 
     _ds.reset();
-    _ds.select(addr);
+    _ds.select(_addr);
     _ds.write(0xBE); // Read Scratchpad
 
     for (int i = 0; i < 9; i++) {
         data[i] = _ds.read();
     }
 
-    _ds.reset_search();
+    if (OneWire::crc8(data, 8) != data[8]) {
+        _hasAddress = false; // Unplugged or replaced: search it again
+        return -1000;
+    }
 
     int16_t rawTemperature = (data[1] << 8) | data[0];
     return rawTemperature / 16.0; // Convert raw temperature to Celsius
 }
+
+// Method to read the temperature from the sensor
+float DS18B20TemperatureSensor::readValue() {
+    if (isResultReady()) {
+        _lastValue = (_state == State::FAILED) ? -1000 : readScratchpad(); // Error value if no sensor was found
+        _state = State::IDLE;
+    }
+    startConversion();
+    return _lastValue;
+}
@@ -41,16 +41,40 @@ public:
     void begin();
 
     /*
-     * Method to read the temperature from the sensor.
-     * @return: The temperature in degrees Celsius.
+     * Method to read the temperature from the sensor, without waiting for a conversion.
+     * Reads the result of the conversion if it is ready and starts the next one.
+     * @return: The temperature of the last completed conversion in degrees Celsius, -1000 on error.
      */
     float readValue();
     const char* getName() const override { return _name; }
 
+    /*
+     * Method to start a temperature conversion, if none is running.
+     * The result can be read CONVERSION_TIME ms later (12-bit resolution).
+     */
+    void startConversion();
+
+    /*
+     * Method to check if readValue() has a new result: the conversion is over, or it could not be started.
+     */
+    bool isResultReady() const;
+
+    static const unsigned long CONVERSION_TIME = 750; // ms
+
 private:
+    enum class State : uint8_t { IDLE, CONVERTING, FAILED };
+
     OneWire _ds; // OneWire object for communication with DS18B20
     int _pin;    // Digital pin connected to the DS18B20
     const char* _name;
+    byte _addr[8];           // ROM address of the sensor, searched once
+    bool _hasAddress;
+    State _state;
+    unsigned long _conversionStart;
+    float _lastValue;        // Result of the last completed conversion
+
+    bool findAddress();
+    float readScratchpad();
 };
 
 #endif
@@ -0,0 +1,163 @@
+"""
+EEPROM image tool for the Arduino Mega bioreactor controller.
+
+Reads and writes the controller parameter store (ParameterStore.h / EepromLayout.h)
+in a raw 4096-byte EEPROM image, as read/written by avrdude:
+
+    avrdude -p m2560 -c wiring -P /dev/ttyACM0 -b 115200 -U eeprom:r:eeprom.bin:r
+    avrdude -p m2560 -c wiring -P /dev/ttyACM0 -b 115200 -U eeprom:w:eeprom.bin:r
+
+Usage:
+    python eeprom_tool.py show eeprom.bin
+    python eeprom_tool.py set eeprom.bin tempKp=2.5 tempKi=4 minStirringSpeed=500
+    python eeprom_tool.py blank eeprom.bin
+
+"set" works like the firmware: it starts from the current parameters and writes a new
+record (sequence + 1) to the next slot, so the previous record is kept.
+"""
+
+import argparse
+import struct
+import sys
+
+EEPROM_SIZE = 4096
+
+# Must match EepromLayout.h
+PARAMS_ADDR = 0x040
+PARAMS_SLOT_COUNT = 4
+PARAMS_SLOT_SIZE = 96
+
+# Must match ParameterStore.h
+PARAMS_MAGIC = 0xB10C
+PARAMS_VERSION = 2
+HEADER_FORMAT = "<HBBI"  # magic, version, size, sequence
+PARAMS_FIELDS = [
+    ("tempKp", "f"), ("tempKi", "f"), ("tempKd", "f"),
+    ("phKp", "f"), ("phKi", "f"), ("phKd", "f"),
+    ("doKp", "f"), ("doKi", "f"), ("doKd", "f"),
+    ("tempHysteresis", "f"), ("phHysteresis", "f"), ("doHysteresis", "f"),
+    ("nutrientPumpMinFlow", "f"), ("nutrientPumpMaxFlow", "f"),
+    ("basePumpMinFlow", "f"), ("basePumpMaxFlow", "f"),
+    ("drainPumpMinFlow", "f"), ("drainPumpMaxFlow", "f"),
+    ("samplePumpMinFlow", "f"), ("samplePumpMaxFlow", "f"),
+    ("minStirringSpeed", "h"), ("maxStirringSpeed", "h"),
+]
+PARAMS_FORMAT = "<" + "".join(fmt for _, fmt in PARAMS_FIELDS)
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+PARAMS_SIZE = struct.calcsize(PARAMS_FORMAT)
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/MODBUS, same as avr-libc _crc16_update() starting from 0xFFFF."""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def load_image(path):
+    with open(path, "rb") as f:
+        image = bytearray(f.read())
+    if len(image) < EEPROM_SIZE:
+        image.extend(b"\xff" * (EEPROM_SIZE - len(image)))
+    return image
+
+
+def save_image(path, image):
+    with open(path, "wb") as f:
+        f.write(image)
+
+
+def read_slot(image, slot):
+    """Returns (sequence, params dict) for a valid slot, None otherwise."""
+    address = PARAMS_ADDR + slot * PARAMS_SLOT_SIZE
+    magic, version, size, sequence = struct.unpack_from(HEADER_FORMAT, image, address)
+    if magic != PARAMS_MAGIC or version != PARAMS_VERSION or size != PARAMS_SIZE:
+        return None
+    length = HEADER_SIZE + PARAMS_SIZE
+    (stored_crc,) = struct.unpack_from("<H", image, address + length)
+    if stored_crc != crc16(image[address:address + length]):
+        return None
+    values = struct.unpack_from(PARAMS_FORMAT, image, address + HEADER_SIZE)
+    return sequence, dict(zip((name for name, _ in PARAMS_FIELDS), values))
+
+
+def latest_slot(image):
+    latest = None
+    for slot in range(PARAMS_SLOT_COUNT):
+        record = read_slot(image, slot)
+        if record and (latest is None or record[0] > latest[1]):
+            latest = (slot, record[0], record[1])
+    return latest
+
+
+def write_params(image, params):
+    latest = latest_slot(image)
+    slot = 0 if latest is None else (latest[0] + 1) % PARAMS_SLOT_COUNT
+    sequence = 1 if latest is None else latest[1] + 1
+    address = PARAMS_ADDR + slot * PARAMS_SLOT_SIZE
+    record = struct.pack(HEADER_FORMAT, PARAMS_MAGIC, PARAMS_VERSION, PARAMS_SIZE, sequence)
+    record += struct.pack(PARAMS_FORMAT, *(params[name] for name, _ in PARAMS_FIELDS))
+    record += struct.pack("<H", crc16(record))
+    image[address:address + len(record)] = record
+    return slot, sequence
+
+
+def cmd_show(args):
+    image = load_image(args.image)
+    for slot in range(PARAMS_SLOT_COUNT):
+        record = read_slot(image, slot)
+        print(f"slot {slot}: " + (f"valid, seq {record[0]}" if record else "empty/invalid"))
+    latest = latest_slot(image)
+    if latest is None:
+        print("No valid parameters (the controller boots with its defaults)")
+        return 1
+    print(f"Current parameters (slot {latest[0]}, seq {latest[1]}):")
+    for name, value in latest[2].items():
+        print(f"  {name} = {value:g}")
+    return 0
+
+
+def cmd_set(args):
+    image = load_image(args.image)
+    latest = latest_slot(image)
+    params = dict(latest[2]) if latest else {name: 0 for name, _ in PARAMS_FIELDS}
+    types = dict(PARAMS_FIELDS)
+    for assignment in args.assignments:
+        name, _, value = assignment.partition("=")
+        if name not in types:
+            print(f"Unknown parameter: {name}", file=sys.stderr)
+            return 1
+        params[name] = int(value) if types[name] == "h" else float(value)
+    slot, sequence = write_params(image, params)
+    save_image(args.image, image)
+    print(f"Parameters written to slot {slot} (seq {sequence})")
+    return 0
+
+
+def cmd_blank(args):
+    save_image(args.image, bytearray(b"\xff" * EEPROM_SIZE))
+    print(f"Blank EEPROM image written to {args.image}")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Bioreactor EEPROM image tool")
+    sub = parser.add_subparsers(dest="command", required=True)
+    show = sub.add_parser("show", help="Show the stored controller parameters")
+    show.add_argument("image")
+    show.set_defaults(func=cmd_show)
+    setp = sub.add_parser("set", help="Write new controller parameters (name=value ...)")
+    setp.add_argument("image")
+    setp.add_argument("assignments", nargs="+")
+    setp.set_defaults(func=cmd_set)
+    blank = sub.add_parser("blank", help="Create an erased EEPROM image")
+    blank.add_argument("image")
+    blank.set_defaults(func=cmd_blank)
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
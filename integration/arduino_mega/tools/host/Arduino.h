@@ -0,0 +1,72 @@
+/*
+ * Arduino.h (host)
+ * Minimal stand-in for the Arduino core, so that the host tools of this directory can build modules of the
+ * sketch on a computer: String, Serial (stdout, or captured lines) and millis() on a clock set by the tool.
+ * Only what those modules use is provided.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+class String {
+public:
+  String(const char* text = "") : _text(text ? text : "") {}
+  String(char c) : _text(1, c) {}
+  String(unsigned char value) : _text(std::to_string(value)) {}
+  String(int value) : _text(std::to_string(value)) {}
+  String(unsigned int value) : _text(std::to_string(value)) {}
+  String(long value) : _text(std::to_string(value)) {}
+  String(unsigned long value) : _text(std::to_string(value)) {}
+  String(double value, unsigned char decimals = 2) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    _text = buffer;
+  }
+  String(float value, unsigned char decimals = 2) : String(static_cast<double>(value), decimals) {}
+
+  const char* c_str() const { return _text.c_str(); }
+  unsigned int length() const { return _text.size(); }
+
+  String& operator+=(const String& other) { _text += other._text; return *this; }
+  String& operator+=(const char* other) { _text += other; return *this; }
+  String& operator+=(char c) { _text += c; return *this; }
+  bool operator==(const String& other) const { return _text == other._text; }
+  bool operator==(const char* other) const { return _text == other; }
+
+  friend String operator+(const String& a, const String& b) { String sum(a); return sum += b; }
+  friend String operator+(const String& a, const char* b) { String sum(a); return sum += b; }
+  friend String operator+(const char* a, const String& b) { String sum(a); return sum += b; }
+
+private:
+  std::string _text;
+};
+
+// Serial port: prints to stdout, or keeps the lines for the tool to check
+class HostSerial {
+public:
+  bool capture = false;
+  std::vector<std::string> lines;
+
+  void print(const String& text) { fputs(text.c_str(), stdout); }
+  void println(const String& line) {
+    if (capture) lines.push_back(line.c_str()); else puts(line.c_str());
+  }
+};
+
+inline HostSerial Serial;
+
+// Clock of millis(), advanced by the tool
+inline unsigned long hostMillis = 0;
+inline unsigned long millis() { return hostMillis; }
+inline void delay(unsigned long ms) { hostMillis += ms; }
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * util/crc16.h (host)
+ * The CRC update of avr-libc used by the sketch, for the host tools.
+ */
+
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// CRC-16 (polynomial 0xA001, reflected), as _crc16_update of avr-libc
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+  }
+  return crc;
+}
+
+#endif
@@ -0,0 +1,344 @@
+"""
+Recipe compiler and simulator for the Arduino Mega bioreactor controller.
+
+Compiles a text recipe into the bytecode run by RecipeProgram (RecipeBytecode.h), checks it,
+simulates its timeline and prints the serial commands that upload it to the EEPROM.
+
+Recipe syntax (one instruction per line, '#' starts a comment, durations take s/m/h/d suffixes):
+
+    phase 1                       # MARK: log the start of a phase
+    set temperature 30            # SET: PID setpoint or actuator value
+    ramp temperature 37 2h        # RAMP: linear ramp from the current value
+    hold 30m                      # HOLD: wait
+    wait ph < 6.8 timeout 1h      # WAIT: wait for a sensor condition (timeout optional)
+    loop 3                        # LOOP: repeat the body 3 times (loop 0 = forever)
+        set nutrient 20
+        hold 10m
+        off nutrient              # OFF: stop a PID loop or actuator
+        hold 50m
+    end loop
+    end                           # END (added if missing)
+
+Targets: temperature, ph, do, stirring, air, light, nutrient.
+Sensors: temperature, ph, do, turbidity, volume.
+
+Usage:
+    python recipe_compiler.py compile growth.recipe -o growth.bin
+    python recipe_compiler.py upload growth.recipe > upload.txt     # commands to send over serial
+    python recipe_compiler.py simulate growth.recipe --sensor turbidity=2.5
+"""
+
+import argparse
+import struct
+import sys
+
+# Must match RecipeBytecode.h
+OP_END, OP_SET, OP_RAMP, OP_HOLD, OP_WAIT, OP_LOOP, OP_ENDLOOP, OP_OFF, OP_MARK = range(9)
+TARGETS = ["temperature", "ph", "do", "stirring", "air", "light", "nutrient"]
+SENSORS = ["temperature", "ph", "do", "turbidity", "volume"]
+COMPARES = {"<": 0, ">": 1}
+
+# Must match RecipeStore.h / RecipeProgram.h / CommandHandler.h
+CAPACITY = 1024 - 8
+MAX_LOOP_DEPTH = 4
+CHUNK_SIZE = 32
+
+# Accepted ranges of the targets (same units as the firmware)
+TARGET_RANGES = {
+    "temperature": (5.0, 45.0),     # degC
+    "ph": (0.0, 14.0),
+    "do": (0.0, 100.0),            # %
+    "stirring": (0.0, 1000.0),      # RPM
+    "air": (0.0, 100.0),            # %
+    "light": (0.0, 100.0),          # %
+    "nutrient": (0.0, 105.0),       # ml/min
+}
+
+UNITS = {"s": 1, "m": 60, "h": 3600, "d": 86400}
+MAX_DURATION = 4294967  # s, RECIPE_MAX_DURATION of RecipeBytecode.h (the firmware times in 32-bit milliseconds)
+
+
+class RecipeError(Exception):
+    pass
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/MODBUS, same as _crc16_update() in avr-libc."""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def parse_duration(text, line):
+    unit = text[-1] if text[-1] in UNITS else "s"
+    number = text[:-1] if text[-1] in UNITS else text
+    try:
+        seconds = float(number) * UNITS[unit]
+    except ValueError:
+        raise RecipeError("line %d: invalid duration '%s'" % (line, text))
+    if seconds < 0 or seconds > MAX_DURATION:
+        raise RecipeError("line %d: duration out of range '%s' (0 to %d s)" % (line, text, MAX_DURATION))
+    return int(round(seconds))
+
+
+def parse_value(text, line):
+    try:
+        return float(text)
+    except ValueError:
+        raise RecipeError("line %d: invalid number '%s'" % (line, text))
+
+
+def lookup(names, name, kind, line):
+    if name.lower() not in names:
+        raise RecipeError("line %d: unknown %s '%s' (expected one of: %s)" % (line, kind, name, ", ".join(names)))
+    return names.index(name.lower())
+
+
+def check_range(target, value, line):
+    low, high = TARGET_RANGES[TARGETS[target]]
+    if not low <= value <= high:
+        raise RecipeError("line %d: %s %g out of range [%g, %g]" % (line, TARGETS[target], value, low, high))
+
+
+def parse(source):
+    """Parses the recipe text into a list of (line, instruction tuple)."""
+    program = []
+    for number, raw in enumerate(source.splitlines(), 1):
+        words = raw.split("#", 1)[0].split()
+        if not words:
+            continue
+        keyword = words[0].lower()
+        args = words[1:]
+        if keyword == "set" and len(args) == 2:
+            target = lookup(TARGETS, args[0], "target", number)
+            value = parse_value(args[1], number)
+            check_range(target, value, number)
+            program.append((number, (OP_SET, target, value)))
+        elif keyword == "ramp" and len(args) == 3:
+            target = lookup(TARGETS, args[0], "target", number)
+            value = parse_value(args[1], number)
+            check_range(target, value, number)
+            program.append((number, (OP_RAMP, target, value, parse_duration(args[2], number))))
+        elif keyword == "hold" and len(args) == 1:
+            program.append((number, (OP_HOLD, parse_duration(args[0], number))))
+        elif keyword == "wait" and len(args) in (3, 5):
+            sensor = lookup(SENSORS, args[0], "sensor", number)
+            if args[1] not in COMPARES:
+                raise RecipeError("line %d: comparison must be '<' or '>'" % number)
+            timeout = 0
+            if len(args) == 5:
+                if args[3].lower() != "timeout":
+                    raise RecipeError("line %d: expected 'timeout <duration>'" % number)
+                timeout = parse_duration(args[4], number)
+            program.append((number, (OP_WAIT, sensor, COMPARES[args[1]], parse_value(args[2], number), timeout)))
+        elif keyword == "loop" and len(args) == 1:
+            count = int(parse_value(args[0], number))
+            if not 0 <= count <= 255:
+                raise RecipeError("line %d: loop count must be 0-255" % number)
+            program.append((number, (OP_LOOP, count)))
+        elif keyword == "end" and args and args[0].lower() == "loop":
+            program.append((number, (OP_ENDLOOP,)))
+        elif keyword == "off" and len(args) == 1:
+            program.append((number, (OP_OFF, lookup(TARGETS, args[0], "target", number))))
+        elif keyword == "phase" and len(args) == 1:
+            phase = int(parse_value(args[0], number))
+            if not 0 <= phase <= 255:
+                raise RecipeError("line %d: phase must be 0-255" % number)
+            program.append((number, (OP_MARK, phase)))
+        elif keyword == "end" and not args:
+            program.append((number, (OP_END,)))
+        else:
+            raise RecipeError("line %d: cannot parse '%s'" % (number, raw.strip()))
+    if not program or program[-1][1][0] != OP_END:
+        program.append((0, (OP_END,)))
+    return program
+
+
+def check(program):
+    """Static checks mirroring RecipeProgram::validate(), plus warnings for suspicious recipes."""
+    warnings = []
+    depth = 0
+    loop_stack = []
+    assigned = set()
+    for index, (line, ins) in enumerate(program):
+        op = ins[0]
+        if op == OP_LOOP:
+            depth += 1
+            if depth > MAX_LOOP_DEPTH:
+                raise RecipeError("line %d: loops nested deeper than %d" % (line, MAX_LOOP_DEPTH))
+            loop_stack.append((index, ins[1]))
+        elif op == OP_ENDLOOP:
+            if depth == 0:
+                raise RecipeError("line %d: 'end loop' without 'loop'" % line)
+            depth -= 1
+            start, count = loop_stack.pop()
+            blocking = any(p[1][0] in (OP_HOLD, OP_RAMP, OP_WAIT) for p in program[start:index])
+            if count == 0 and not blocking:
+                raise RecipeError("line %d: endless loop without hold/ramp/wait" % program[start][0])
+        elif op in (OP_SET, OP_RAMP):
+            if op == OP_RAMP and ins[1] not in assigned:
+                warnings.append("line %d: ramp of %s starts from 0 (not set before)" % (line, TARGETS[ins[1]]))
+            assigned.add(ins[1])
+        elif op == OP_WAIT and ins[4] == 0:
+            warnings.append("line %d: wait without timeout may block the recipe forever" % line)
+        elif op == OP_END:
+            if depth != 0:
+                raise RecipeError("unterminated loop")
+            break
+    return warnings
+
+
+def encode(program):
+    code = bytearray()
+    for _, ins in program:
+        op = ins[0]
+        if op in (OP_END, OP_ENDLOOP):
+            code += struct.pack("<B", op)
+        elif op in (OP_LOOP, OP_OFF, OP_MARK):
+            code += struct.pack("<BB", op, ins[1])
+        elif op == OP_SET:
+            code += struct.pack("<BBf", op, ins[1], ins[2])
+        elif op == OP_RAMP:
+            code += struct.pack("<BBfI", op, ins[1], ins[2], ins[3])
+        elif op == OP_HOLD:
+            code += struct.pack("<BI", op, ins[1])
+        elif op == OP_WAIT:
+            code += struct.pack("<BBBfI", op, ins[1], ins[2], ins[3], ins[4])
+    if len(code) > CAPACITY:
+        raise RecipeError("recipe is %d bytes, the EEPROM holds %d" % (len(code), CAPACITY))
+    return bytes(code)
+
+
+def compile_file(path):
+    with open(path) as f:
+        program = parse(f.read())
+    warnings = check(program)
+    for warning in warnings:
+        print("warning: " + warning, file=sys.stderr)
+    return program, encode(program)
+
+
+def upload_commands(code):
+    commands = ["recipe_begin"]
+    for offset in range(0, len(code), CHUNK_SIZE):
+        commands.append("recipe_write %d %s" % (offset, code[offset:offset + CHUNK_SIZE].hex()))
+    commands.append("recipe_commit %d %04x" % (len(code), crc16(code)))
+    return commands
+
+
+def format_time(seconds):
+    return "%3dd %02d:%02d:%02d" % (seconds // 86400, seconds // 3600 % 24, seconds // 60 % 60, seconds % 60)
+
+
+def simulate(program, sensors, max_steps=100000):
+    """Runs the recipe with an ideal plant: temperature/pH/DO follow their setpoints,
+    other sensors keep the values given with --sensor. Returns the total duration (s)."""
+    values = [None] * len(TARGETS)
+    time = 0
+    loops = []
+    pc = 0
+    steps = 0
+    while steps < max_steps:
+        steps += 1
+        line, ins = program[pc]
+        op = ins[0]
+        prefix = "%s  line %3d  " % (format_time(time), line)
+        if op == OP_END:
+            print(prefix + "end")
+            return time
+        if op == OP_SET:
+            values[ins[1]] = ins[2]
+            print(prefix + "set %s = %g" % (TARGETS[ins[1]], ins[2]))
+        elif op == OP_RAMP:
+            print(prefix + "ramp %s %g -> %g over %ds" % (TARGETS[ins[1]], values[ins[1]] or 0.0, ins[2], ins[3]))
+            values[ins[1]] = ins[2]
+            time += ins[3]
+        elif op == OP_HOLD:
+            print(prefix + "hold %ds" % ins[1])
+            time += ins[1]
+        elif op == OP_WAIT:
+            name = SENSORS[ins[1]]
+            reading = sensors.get(name)
+            if reading is None and name in TARGETS:
+                reading = values[TARGETS.index(name)]
+            reached = reading is not None and (reading < ins[3] if ins[2] == 0 else reading > ins[3])
+            condition = "%s %s %g" % (name, "<" if ins[2] == 0 else ">", ins[3])
+            if reached:
+                print(prefix + "wait %s: met (%g)" % (condition, reading))
+            elif ins[4]:
+                print(prefix + "wait %s: timeout after %ds" % (condition, ins[4]))
+                time += ins[4]
+            else:
+                raise RecipeError("line %d: wait %s never met in simulation (reading %s)" % (line, condition, reading))
+        elif op == OP_LOOP:
+            loops.append([pc + 1, ins[1]])
+        elif op == OP_ENDLOOP:
+            frame = loops[-1]
+            if frame[1] == 0:
+                raise RecipeError("endless loop, simulation stopped at %s" % format_time(time))
+            frame[1] -= 1
+            if frame[1] > 0:
+                pc = frame[0]
+                continue
+            loops.pop()
+        elif op == OP_OFF:
+            values[ins[1]] = None
+            print(prefix + "off %s" % TARGETS[ins[1]])
+        elif op == OP_MARK:
+            print(prefix + "phase %d" % ins[1])
+        pc += 1
+    raise RecipeError("simulation exceeded %d steps" % max_steps)
+
+
+def cmd_compile(args):
+    _, code = compile_file(args.recipe)
+    output = args.output or args.recipe.rsplit(".", 1)[0] + ".bin"
+    with open(output, "wb") as f:
+        f.write(code)
+    print("%s: %d bytes, CRC %04x" % (output, len(code), crc16(code)))
+
+
+def cmd_upload(args):
+    _, code = compile_file(args.recipe)
+    for command in upload_commands(code):
+        print(command)
+
+
+def cmd_simulate(args):
+    program, code = compile_file(args.recipe)
+    sensors = {}
+    for item in args.sensor:
+        name, _, value = item.partition("=")
+        lookup(SENSORS, name, "sensor", 0)
+        sensors[name.lower()] = float(value)
+    total = simulate(program, sensors)
+    print("Recipe: %d bytes, duration %s" % (len(code), format_time(total).strip()))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Bioreactor recipe compiler and simulator")
+    sub = parser.add_subparsers(dest="command", required=True)
+    compile_parser = sub.add_parser("compile", help="Compile a recipe to bytecode")
+    compile_parser.add_argument("recipe")
+    compile_parser.add_argument("-o", "--output", help="Output file (default: <recipe>.bin)")
+    compile_parser.set_defaults(func=cmd_compile)
+    upload = sub.add_parser("upload", help="Print the serial commands uploading a recipe")
+    upload.add_argument("recipe")
+    upload.set_defaults(func=cmd_upload)
+    sim = sub.add_parser("simulate", help="Check a recipe and print its timeline")
+    sim.add_argument("recipe")
+    sim.add_argument("--sensor", action="append", default=[], metavar="NAME=VALUE",
+                     help="Sensor reading used by wait conditions (temperature/pH/DO default to their setpoint)")
+    sim.set_defaults(func=cmd_simulate)
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except RecipeError as e:
+        print("error: %s" % e, file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,301 @@
+/*
+ * Host run of the SD card data recorder of the Mega (DataRecorder on HostLogStorage).
+ *
+ * Records --small segments of a few records under alternating labels, then --records records under one label
+ * (rotated at MAX_SEGMENT_RECORDS), so the oldest segment files are deleted beyond MAX_SEGMENTS. It then checks:
+ *   - rotation: the files of the oldest segments are gone, the others are kept;
+ *   - backfill: every record of a kept segment is streamed once, in order, with its values and label;
+ *   - index reload: after a reset (begin() again) the records written before it are found again, the records
+ *     still in RAM at the reset are lost, and the numbering continues above all of them;
+ *   - lost sector: when a full sector cannot be written, its records are lost but the next ones are found.
+ *
+ *   g++ -O2 -std=gnu++17 -Ihost -I../Main -I../Main/src recorder_check.cpp ../Main/DataRecorder.cpp \
+ *       ../Main/src/logger/HostLogStorage.cpp -o recorder_check
+ *   mkdir -p /tmp/recorder && ./recorder_check --dir /tmp/recorder
+ *
+ * host/ stands in for the Arduino core. The directory must not hold a recording already (delete its *.BIN).
+ */
+
+#include <Arduino.h>
+#include "DataRecorder.h"
+#include "SystemClock.h"
+#include <logger/HostLogStorage.h>
+#include <logger/LogStorage.h>
+#include <logger/Logger.h>
+#include <map>
+#include <string>
+#include <vector>
+
+static const uint32_t START_TIME = 1760000000;
+static const unsigned long RECORD_PERIOD = 30000;   // ms between two records, as the logging interval
+static const uint8_t UNSYNCED_RECORDS = 5;          // Records still in RAM at the second reset
+static const uint8_t RECORDS_PER_SECTOR = 512 / sizeof(DataRecord);
+
+static const char* const VALUE_KEYS[] = {"waterTemp", "airTemp", "elecTemp", "pH", "oxygen", "airFlow", "turbidity"};
+static const char* const ACTUATOR_KEYS[] = {"airP", "drainP", "sampleP", "nutrientP", "baseP", "stirringM", "heatingP", "led"};
+static const float VALUE_SCALES[] = {100, 100, 100, 100, 1, 100, 1};
+
+// The recorder logs through Logger and dates its segments with SystemClock: only the warnings are shown
+void Logger::log(LogLevel level, const String& message) {
+  if (level >= LogLevel::WARNING) printf("  [log] %s\n", message.c_str());
+}
+
+uint32_t SystemClock::now() { return START_TIME + millis() / 1000; }
+
+// Sample of a record, derived from its sequence number
+struct Sample {
+  float values[RECORDED_SENSOR_COUNT];
+  uint8_t actuators;
+  uint8_t sensorFaults;
+  uint8_t state;
+};
+
+static Sample sampleOf(uint32_t seq) {
+  Sample sample;
+  sample.values[0] = 25.0 + (seq % 1000) * 0.01;
+  sample.values[1] = 21.5 + (seq % 7) * 0.25;
+  sample.values[2] = 38.0 + (seq % 11) * 0.5;
+  sample.values[3] = 7.0 - (seq % 90) * 0.01;
+  sample.values[4] = seq % 13 == 0 ? NAN : 6000 + seq % 2000;   // µg/L, masked from time to time
+  sample.values[5] = (seq % 400) * 0.01;
+  sample.values[6] = 500 + seq % 300;
+  sample.actuators = seq & 0xFF;
+  sample.sensorFaults = seq % 13 == 0 ? 0x10 : 0;
+  sample.state = seq % 6;
+  return sample;
+}
+
+// Host storage whose segment file appends can be made to fail, as when the card is pulled out
+class FlakyStorage : public LogStorage {
+public:
+  explicit FlakyStorage(const char* directory) : _host(directory) {}
+
+  bool failSegments = false;
+
+  bool begin() override { return _host.begin(); }
+  uint32_t size(const char* path) override { return _host.size(path); }
+  bool read(const char* path, uint32_t offset, uint8_t* data, uint16_t length) override {
+    return _host.read(path, offset, data, length);
+  }
+  bool append(const char* path, const uint8_t* data, uint16_t length) override {
+    return !(failSegments && strncmp(path, "LOG", 3) == 0) && _host.append(path, data, length);
+  }
+  bool remove(const char* path) override { return _host.remove(path); }
+
+private:
+  HostLogStorage _host;
+};
+
+// Records written, with the label of their segment, its number (counted as the recorder does) and their time
+struct Written {
+  std::string label;
+  uint32_t segment;
+  uint32_t time;
+};
+
+static std::map<uint32_t, Written> written;
+static uint32_t segmentCount = 0;
+static uint32_t segmentRecords = 0;
+static std::string segmentLabel;
+static uint32_t failures = 0;
+
+static void fail(const std::string& message) {
+  if (failures++ < 20) printf("  %s\n", message.c_str());
+}
+
+static uint32_t recordOne(const std::string& label, unsigned long period = RECORD_PERIOD) {
+  if (segmentCount == 0 || label != segmentLabel || segmentRecords >= DataRecorder::MAX_SEGMENT_RECORDS) {
+    segmentCount++;
+    segmentRecords = 0;
+    segmentLabel = label;
+  }
+  hostMillis += period;
+  uint32_t seq = DataRecorder::getLastSeq() + 1;
+  Sample sample = sampleOf(seq);
+  uint32_t recorded = DataRecorder::record(label.c_str(), sample.state, sample.values, sample.actuators,
+                                           sample.sensorFaults);
+  if (recorded != seq) fail("Record " + std::to_string(seq) + " stored as " + std::to_string(recorded));
+  written[recorded] = {label.substr(0, 17), segmentCount, SystemClock::now()};
+  segmentRecords++;
+  return recorded;
+}
+
+// The recorder forgets its segment at a reset: the next record opens a new one
+static void reset(LogStorage& storage) {
+  if (!DataRecorder::begin(storage)) fail("Recorder not restarted");
+  segmentLabel = "";
+}
+
+static bool findValue(const std::string& line, const char* key, std::string& value) {
+  std::string pattern = std::string("\"") + key + "\":";
+  size_t start = line.find(pattern);
+  if (start == std::string::npos) return false;
+  start += pattern.size();
+  size_t end = line[start] == '"' ? line.find('"', start + 1) + 1 : line.find_first_of(",}", start);
+  value = line.substr(start, end - start);
+  return true;
+}
+
+static uint32_t numberOf(const std::string& line, const char* key) {
+  std::string value;
+  return findValue(line, key, value) ? strtoul(value.c_str(), nullptr, 10) : 0;
+}
+
+// Backfills [from, to] and returns the records streamed, checked against what was recorded
+static std::vector<uint32_t> backfill(uint32_t from, uint32_t to) {
+  std::vector<uint32_t> streamed;
+  Serial.lines.clear();
+  Serial.capture = true;
+  if (!DataRecorder::requestBackfill(from, to)) fail("Backfill of " + std::to_string(from) + " refused");
+  bool ended = false;
+  for (uint32_t calls = 0; !ended && calls <= (to - from) + 1; calls++) {
+    DataRecorder::update();
+    for (const std::string& line : Serial.lines) {
+      if (line.find("\"ev\":\"backfill_end\"") != std::string::npos) {
+        ended = true;
+        if (numberOf(line, "sent") != streamed.size()) fail("backfill_end does not count the records: " + line);
+        continue;
+      }
+      uint32_t seq = numberOf(line, "seq");
+      streamed.push_back(seq);
+      auto record = written.find(seq);
+      if (record == written.end()) {
+        fail("Record never written streamed: " + line);
+        continue;
+      }
+      Sample sample = sampleOf(seq);
+      std::string value;
+      bool matches = findValue(line, "program", value) && value == "\"" + record->second.label + "\"";
+      matches = matches && findValue(line, "status", value) && value == "\"" + std::to_string(sample.state) + "\"";
+      matches = matches && numberOf(line, "t") == record->second.time &&
+                numberOf(line, "sensorFaults") == sample.sensorFaults;
+      for (uint8_t i = 0; i < RECORDED_ACTUATOR_COUNT; i++) {
+        matches = matches && numberOf(line, ACTUATOR_KEYS[i]) == ((sample.actuators >> i) & 1u);
+      }
+      for (uint8_t i = 0; i < RECORDED_SENSOR_COUNT; i++) {
+        if (!findValue(line, VALUE_KEYS[i], value)) {
+          matches = false;
+        } else if (isnan(sample.values[i])) {
+          matches = matches && value == "null";
+        } else {
+          matches = matches && fabs(strtod(value.c_str(), nullptr) - sample.values[i]) <= 0.5 / VALUE_SCALES[i] + 1e-4;
+        }
+      }
+      if (!matches) fail("Record " + std::to_string(seq) + " streamed wrong: " + line);
+    }
+    Serial.lines.clear();
+  }
+  Serial.capture = false;
+  if (!ended) fail("No backfill_end");
+  return streamed;
+}
+
+// Oldest segment whose file is kept by the rotation
+static uint32_t firstKeptSegment() {
+  return segmentCount > DataRecorder::MAX_SEGMENTS ? segmentCount - DataRecorder::MAX_SEGMENTS + 1 : 1;
+}
+
+// The records of [from, to] that must be streamed: those of the kept segments, less the lost ones
+static std::vector<uint32_t> expected(uint32_t from, uint32_t to, const std::vector<uint32_t>& lost) {
+  uint32_t firstKept = firstKeptSegment();
+  std::vector<uint32_t> records;
+  for (auto& record : written) {
+    if (record.first < from || record.first > to || record.second.segment < firstKept) continue;
+    bool isLost = false;
+    for (uint32_t seq : lost) isLost = isLost || seq == record.first;
+    if (!isLost) records.push_back(record.first);
+  }
+  return records;
+}
+
+static void compare(const char* step, const std::vector<uint32_t>& streamed, const std::vector<uint32_t>& wanted) {
+  if (streamed != wanted) {
+    fail(std::string(step) + ": " + std::to_string(streamed.size()) + " records streamed instead of " +
+         std::to_string(wanted.size()));
+  }
+  printf("%s: %zu records streamed\n", step, streamed.size());
+}
+
+int main(int argc, char** argv) {
+  const char* directory = nullptr;
+  uint32_t recordCount = 40000;
+  uint32_t smallSegments = 205;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+      directory = argv[++i];
+    } else if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+      recordCount = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--small") == 0 && i + 1 < argc) {
+      smallSegments = strtoul(argv[++i], nullptr, 10);
+    } else {
+      directory = nullptr;
+      break;
+    }
+  }
+  if (directory == nullptr || recordCount == 0) {
+    printf("Usage: recorder_check --dir <directory> [--records 40000] [--small 205]\n");
+    return 1;
+  }
+
+  FlakyStorage storage(directory);
+  if (!DataRecorder::begin(storage)) {
+    printf("%s: not a directory\n", directory);
+    return 1;
+  }
+  if (DataRecorder::getLastSeq() != 0) {
+    printf("%s already holds records up to %u, start from an empty directory\n", directory, DataRecorder::getLastSeq());
+    return 1;
+  }
+
+  // Rotation: short segments under alternating labels, then long ones under one label
+  for (uint32_t i = 0; i < smallSegments; i++) {
+    for (uint8_t j = 0; j < 3; j++) recordOne(i % 2 ? "Mix" : "Drain");
+  }
+  for (uint32_t i = 0; i < recordCount; i++) recordOne("Fermentation+Recipe+Drain");
+  uint32_t firstKept = firstKeptSegment();
+  for (uint32_t number = 1; number <= segmentCount; number++) {
+    char path[16];
+    snprintf(path, sizeof(path), "LOG%05u.BIN", number);
+    if ((storage.size(path) > 0) != (number >= firstKept)) {
+      fail(std::string(path) + (number >= firstKept ? " deleted" : " kept") + " after rotation");
+    }
+  }
+  printf("Rotation: %u records in %u segments, the oldest %u deleted\n", DataRecorder::getLastSeq(), segmentCount,
+         firstKept - 1);
+
+  uint32_t last = DataRecorder::getLastSeq();
+  std::vector<uint32_t> lost;
+  std::vector<uint32_t> before = backfill(1, last);
+  compare("Backfill", before, expected(1, last, lost));
+
+  // Reset with the buffer synchronized: nothing is lost, and the numbering skips a sector of records
+  hostMillis += DataRecorder::SYNC_INTERVAL;
+  recordOne("Fermentation+Recipe+Drain");
+  last = DataRecorder::getLastSeq();
+  reset(storage);
+  if (DataRecorder::getLastSeq() <= last) fail("Numbering restarted below record " + std::to_string(last));
+  compare("Index reload", backfill(1, last), expected(1, last, lost));
+
+  // Reset with records in RAM only (a new segment, within SYNC_INTERVAL): they are lost, and never numbered again
+  for (uint8_t i = 0; i < UNSYNCED_RECORDS; i++) lost.push_back(recordOne("Fermentation", 1000));
+  last = DataRecorder::getLastSeq();
+  reset(storage);
+  uint32_t next = recordOne("Fermentation");
+  if (next <= last) fail("Record " + std::to_string(next) + " reuses a number lost at the reset");
+  compare("Reset with unsynced records", backfill(1, next), expected(1, next, lost));
+
+  // A full sector that cannot be written (a new segment, within SYNC_INTERVAL): its records are lost, and the
+  // recorder continues in a new segment, where the next records are found again
+  lost.push_back(recordOne("Sampling", 1000));
+  storage.failSegments = true;
+  for (uint8_t i = 1; i < RECORDS_PER_SECTOR; i++) lost.push_back(recordOne("Sampling", 1000));
+  storage.failSegments = false;
+  segmentCount++;
+  segmentRecords = 0;
+  for (uint8_t i = 0; i < 2 * RECORDS_PER_SECTOR + 3; i++) recordOne("Sampling", 1000);
+  last = DataRecorder::getLastSeq();
+  compare("Lost sector", backfill(1, last), expected(1, last, lost));
+
+  printf("%s\n", failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
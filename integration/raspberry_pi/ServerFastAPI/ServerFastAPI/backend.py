@@ -8,9 +8,15 @@ import pandas as pd
 from typing import List
 import json
 import asyncio
+import base64
 import logging
 from logging.handlers import RotatingFileHandler
 
+try:
+    from .telemetry_block import decode_block
+except ImportError:
+    from telemetry_block import decode_block
+
 # Configuration du logging
 log_formatter = logging.Formatter('%(asctime)s - %(name)s - %(levelname)s - %(message)s')
 log_file = '/Raspberry/Bioreactor/ServerFastAPI/backend.log'
@@ -31,6 +37,7 @@ app = FastAPI()
 # Define the directory and file path
 data_dir = "/Raspberry/Bioreactor/ServerFastAPI/data"
 filename = os.path.join(data_dir, "data.csv")
+camera_filename = os.path.join(data_dir, "camera.csv")
 
 # Ensure the data directory exists
 os.makedirs(data_dir, exist_ok=True)
@@ -74,53 +81,56 @@ class SensorData(BaseModel):
     })
     timestamp: str = Field(..., example="2023-05-06T12:00:00Z")
 
-@app.post("/sensor_data")
-async def receive_data(data: SensorData):
-    logger.info("Received sensor data")
+REQUIRED_SENSOR_FIELDS = [
+    "event", "programType", "rateOrSpeed", "duration",
+    "tempSetpoint", "phSetpoint", "doSetpoint", "nutrientConc", "baseConc", 
+    "experimentName", "comment", "currentProgram", "programStatus",
+    "airPumpStatus", "drainPumpStatus", "nutrientPumpStatus", "basePumpStatus",
+    "stirringMotorStatus", "heatingPlateStatus", "ledGrowLightStatus",
+    "waterTemp", "airTemp", "ph", "turbidity", "oxygen", "airFlow"
+]
+
+def sensor_data_row(data: SensorData, backend_time: str):
+    """Check the fields of a sensor record and return its CSV row"""
+    sensor_data = data.sensor_value
+    # Ensure all required fields are present
+    for field in REQUIRED_SENSOR_FIELDS:
+        if field not in sensor_data:
+            logger.error(f"Missing field in sensor data: {field}")
+            raise HTTPException(status_code=400, detail=f"Missing field: {field}")
+
+    return [
+        backend_time, data.timestamp,
+        sensor_data.get("event", ""),
+        sensor_data.get("programType", ""), sensor_data.get("rateOrSpeed", 0),
+        sensor_data.get("duration", 0), sensor_data.get("tempSetpoint", 0.0), 
+        sensor_data.get("phSetpoint", 0.0), sensor_data.get("doSetpoint", 0.0),
+        sensor_data.get("nutrientConc", 0.0), sensor_data.get("baseConc", 0.0),
+        sensor_data.get("experimentName", ""), sensor_data.get("comment", ""),
+        sensor_data.get("currentProgram", ""), sensor_data.get("programStatus", ""),
+        sensor_data.get("airPumpStatus", 0), sensor_data.get("drainPumpStatus", 0), 
+        sensor_data.get("nutrientPumpStatus", 0), sensor_data.get("basePumpStatus", 0),
+        sensor_data.get("stirringMotorStatus", 0), sensor_data.get("heatingPlateStatus", 0), 
+        sensor_data.get("ledGrowLightStatus", 0), sensor_data.get("waterTemp", 0.0), 
+        sensor_data.get("airTemp", 0.0), sensor_data.get("ph", 0.0), 
+        sensor_data.get("turbidity", 0.0), sensor_data.get("oxygen", 0.0), 
+        sensor_data.get("airFlow", 0.0)
+    ]
+
+def save_sensor_data(records: List[SensorData]):
+    """Append sensor records to the CSV file, all of them or none"""
     ensure_csv_header()  # Ensure the header is present
 
     backend_time = datetime.now().strftime("%Y-%m-%d %H:%M:%S")
 
     try:
-        sensor_data = data.sensor_value
-        # Ensure all required fields are present
-        required_fields = [
-            "event", "programType", "rateOrSpeed", "duration",
-            "tempSetpoint", "phSetpoint", "doSetpoint", "nutrientConc", "baseConc", 
-            "experimentName", "comment", "currentProgram", "programStatus",
-            "airPumpStatus", "drainPumpStatus", "nutrientPumpStatus", "basePumpStatus",
-            "stirringMotorStatus", "heatingPlateStatus", "ledGrowLightStatus",
-            "waterTemp", "airTemp", "ph", "turbidity", "oxygen", "airFlow"
-        ]
-        
-        for field in required_fields:
-            if field not in sensor_data:
-                logger.error(f"Missing field in sensor data: {field}")
-                raise HTTPException(status_code=400, detail=f"Missing field: {field}")
-
+        rows = [sensor_data_row(record, backend_time) for record in records]
         with open(filename, 'a', newline='') as file:
             writer = csv.writer(file)
-            writer.writerow([
-                backend_time, data.timestamp,
-                sensor_data.get("event", ""),
-                sensor_data.get("programType", ""), sensor_data.get("rateOrSpeed", 0),
-                sensor_data.get("duration", 0), sensor_data.get("tempSetpoint", 0.0), 
-                sensor_data.get("phSetpoint", 0.0), sensor_data.get("doSetpoint", 0.0),
-                sensor_data.get("nutrientConc", 0.0), sensor_data.get("baseConc", 0.0),
-                sensor_data.get("experimentName", ""), sensor_data.get("comment", ""),
-                sensor_data.get("currentProgram", ""), sensor_data.get("programStatus", ""),
-                sensor_data.get("airPumpStatus", 0), sensor_data.get("drainPumpStatus", 0), 
-                sensor_data.get("nutrientPumpStatus", 0), sensor_data.get("basePumpStatus", 0),
-                sensor_data.get("stirringMotorStatus", 0), sensor_data.get("heatingPlateStatus", 0), 
-                sensor_data.get("ledGrowLightStatus", 0), sensor_data.get("waterTemp", 0.0), 
-                sensor_data.get("airTemp", 0.0), sensor_data.get("ph", 0.0), 
-                sensor_data.get("turbidity", 0.0), sensor_data.get("oxygen", 0.0), 
-                sensor_data.get("airFlow", 0.0)
-            ])
-
-        logger.info("Sensor data successfully saved")
-        return {"status": "success", "message": "Data received"}
+            writer.writerows(rows)
 
+    except HTTPException:
+        raise
     except ValidationError as e:
         logger.error(f"Validation error: {str(e)}")
         raise HTTPException(status_code=422, detail=str(e))
@@ -128,6 +138,21 @@ async def receive_data(data: SensorData):
         logger.error(f"Error processing data: {str(e)}")
         raise HTTPException(status_code=400, detail=f"Error processing data: {e}")
 
+@app.post("/sensor_data")
+async def receive_data(data: SensorData):
+    logger.info("Received sensor data")
+    save_sensor_data([data])
+    logger.info("Sensor data successfully saved")
+    return {"status": "success", "message": "Data received"}
+
+# Batches sent by the ESP32 from its store-and-forward queue (records received during an outage come in late)
+@app.post("/sensor_data/batch")
+async def receive_data_batch(data: List[SensorData]):
+    logger.info(f"Received a batch of {len(data)} sensor records")
+    save_sensor_data(data)
+    logger.info("Sensor data successfully saved")
+    return {"status": "success", "message": "Data received", "count": len(data)}
+
 @app.get("/sensor_data")
 async def get_sensor_data():
     logger.info("Fetching sensor data")
@@ -143,6 +168,52 @@ async def get_sensor_data():
         logger.error(f"Error fetching sensor data: {str(e)}")
         raise HTTPException(status_code=500, detail=str(e))
 
+# Channels measured by the ESP32-CAM (culture_density.h), stored apart from the records of the Mega
+CAMERA_FIELDS = ["pixels", "luminance", "red", "green", "blue", "greenRatio", "opticalDensity"]
+
+class CameraData(BaseModel):
+    channel: str = Field(..., example="culture_density")
+    timestamp: str = Field("", example="2023-05-06T12:00:00Z")
+    values: dict = Field(..., example={
+        "roi": {"x": 250, "y": 250, "w": 500, "h": 500}, "pixels": 19200, "luminance": 98.78,
+        "red": 61.2, "green": 131.5, "blue": 74.3, "greenRatio": 0.4927, "opticalDensity": 0.3682,
+        "histogram": [0] * 32
+    })
+
+@app.post("/camera_data")
+async def receive_camera_data(data: CameraData):
+    logger.info(f"Received camera data on channel {data.channel}")
+    file_exists = os.path.isfile(camera_filename)
+    roi = data.values.get("roi", {})
+    histogram = data.values.get("histogram", [])
+    try:
+        with open(camera_filename, 'a', newline='') as file:
+            writer = csv.writer(file)
+            if not file_exists:
+                writer.writerow(["Backend_Time", "Camera_Time", "channel", "roi"] + CAMERA_FIELDS + ["histogram"])
+            writer.writerow(
+                [datetime.now().strftime("%Y-%m-%d %H:%M:%S"), data.timestamp, data.channel,
+                 " ".join(str(roi.get(key, "")) for key in ("x", "y", "w", "h"))]
+                + [data.values.get(field, "") for field in CAMERA_FIELDS]
+                + [" ".join(str(count) for count in histogram)]
+            )
+    except Exception as e:
+        logger.error(f"Error saving camera data: {str(e)}")
+        raise HTTPException(status_code=400, detail=f"Error saving camera data: {e}")
+    return {"status": "success", "message": "Data received"}
+
+@app.get("/camera_data")
+async def get_camera_data():
+    logger.info("Fetching camera data")
+    try:
+        if not os.path.isfile(camera_filename):
+            return []
+        with open(camera_filename, 'r') as file:
+            return list(csv.DictReader(file))
+    except Exception as e:
+        logger.error(f"Error fetching camera data: {str(e)}")
+        raise HTTPException(status_code=500, detail=str(e))
+
 class MixCommand(BaseModel):
     speed: int
 
@@ -163,6 +234,31 @@ class FermentationCommand(BaseModel):
 esp32_connection = None
 frontend_connection = None
 
+def receive_telemetry_batch(message: str) -> str:
+    """Save a {"type":"telemetry","id":n,"records":[...]} message and return its ack (or nack)
+
+    The records can also come as a compressed block, {"type":"telemetry","id":n,"block":"<base64>"}
+    (see telemetry_block.py).
+    """
+    batch_id = None
+    try:
+        batch = json.loads(message)
+        batch_id = batch["id"]
+        if "block" in batch:
+            raw_records = decode_block(base64.b64decode(batch["block"]))
+        else:
+            raw_records = batch["records"]
+        records = [SensorData(**record) for record in raw_records]
+        save_sensor_data(records)
+        logger.info(f"Received telemetry batch {batch_id} over WebSocket: {len(records)} records")
+        return json.dumps({"type": "ack", "id": batch_id, "count": len(records)})
+    except HTTPException as e:
+        error = e.detail
+    except Exception as e:
+        error = str(e)
+    logger.error(f"Telemetry batch {batch_id} refused: {error}")
+    return json.dumps({"type": "nack", "id": batch_id, "error": error})
+
 @app.websocket("/ws")
 async def websocket_endpoint(websocket: WebSocket):
     await websocket.accept()
@@ -180,6 +276,12 @@ async def websocket_endpoint(websocket: WebSocket):
     try:
         while True:
             data = await websocket.receive_text()
+
+            # Telemetry batches of the ESP32 are saved and acknowledged, so it can remove them from its queue
+            if websocket == esp32_connection and data.startswith('{"type":"telemetry"'):
+                await websocket.send_text(receive_telemetry_batch(data))
+                continue
+
             logger.info(f"Received WebSocket message: {data}")
             
             if websocket == esp32_connection:
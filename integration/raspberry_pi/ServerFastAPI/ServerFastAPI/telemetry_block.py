@@ -0,0 +1,189 @@
+"""
+Reference decoder of the compressed telemetry blocks of the ESP32 bridge (TelemetryBlock.h).
+
+A block holds the records of a batch, with the timestamps stored as deltas of deltas and the numeric
+fields as the XOR of their float32 value with the previous one (Gorilla time-series encoding).
+decode_block() returns the records as dictionaries in the format of POST /sensor_data. Version 2
+stores the timestamps in milliseconds, for the samples stamped by the clock of the Mega; version 1
+(seconds) is still read.
+
+Decode a dump of tools/block_bench.cpp (16-bit big-endian length before each block) to JSON lines:
+
+    python telemetry_block.py blocks.bin
+"""
+
+import json
+import math
+import struct
+import sys
+from datetime import datetime, timezone
+
+VERSIONS = (1, 2)
+
+TEXT_FIELDS = ["event", "programType", "experimentName", "comment", "currentProgram", "programStatus"]
+NUMERIC_FIELDS = [
+    "rateOrSpeed", "duration", "tempSetpoint", "phSetpoint", "doSetpoint", "nutrientConc", "baseConc",
+    "airPumpStatus", "drainPumpStatus", "nutrientPumpStatus", "basePumpStatus", "stirringMotorStatus",
+    "heatingPlateStatus", "ledGrowLightStatus", "waterTemp", "airTemp", "ph", "turbidity", "oxygen", "airFlow",
+]
+
+# Order of the keys in the records, as sent by the bridge without compression
+FIELD_ORDER = [
+    "event", "programType", "rateOrSpeed", "duration", "tempSetpoint", "phSetpoint", "doSetpoint",
+    "nutrientConc", "baseConc", "experimentName", "comment", "currentProgram", "programStatus",
+    "airPumpStatus", "drainPumpStatus", "nutrientPumpStatus", "basePumpStatus", "stirringMotorStatus",
+    "heatingPlateStatus", "ledGrowLightStatus", "waterTemp", "airTemp", "ph", "turbidity", "oxygen", "airFlow",
+]
+
+
+class BitReader:
+    def __init__(self, data, position=0):
+        self.data = data
+        self.position = position   # In bits
+
+    def read(self, count):
+        value = 0
+        for _ in range(count):
+            byte = self.data[self.position >> 3]
+            value = (value << 1) | ((byte >> (7 - (self.position & 7))) & 1)
+            self.position += 1
+        return value
+
+    def read_signed(self, count):
+        value = self.read(count)
+        return value - (1 << count) if value & (1 << (count - 1)) else value
+
+    def align(self):
+        self.position = (self.position + 7) // 8 * 8
+
+    def read_bytes(self, count):
+        start = self.position // 8
+        if start + count > len(self.data):
+            raise ValueError("truncated block")
+        self.position += count * 8
+        return self.data[start:start + count]
+
+
+def float32_value(bits):
+    """Shortest decimal of a float32, None for NaN (null)"""
+    value = struct.unpack("<f", struct.pack("<I", bits))[0]
+    if math.isnan(value):
+        return None
+    for precision in range(1, 10):
+        text = f"{value:.{precision}g}"
+        if struct.pack("<f", float(text)) == struct.pack("<I", bits):
+            break
+    number = float(text)
+    return int(number) if number.is_integer() and abs(number) < 2 ** 24 else number
+
+
+def format_timestamp(unix_time, milliseconds=None):
+    if unix_time == 0:
+        return ""
+    text = datetime.fromtimestamp(unix_time, timezone.utc).strftime("%Y-%m-%dT%H:%M:%S")
+    return text + ("Z" if milliseconds is None else f".{milliseconds:03d}Z")
+
+
+def read_delta_of_delta(reader, sizes):
+    """Delta of delta after its prefix ('0', '10', '110', '1110'), None for the '1111' escape"""
+    for size in sizes:
+        if reader.read(1) == 0:
+            return reader.read_signed(size) if size else 0
+    return None
+
+
+def decode_block(data):
+    """Records of a block, as {"sensor_value": {...}, "timestamp": "..."} dictionaries"""
+    if len(data) < 2 or data[0] not in VERSIONS:
+        raise ValueError(f"unknown telemetry block version {data[0] if data else None}")
+    version = data[0]
+    count = data[1]
+    reader = BitReader(data, 16)
+
+    time = 0
+    delta = 0
+    texts = [None] * len(TEXT_FIELDS)
+    values = [0] * len(NUMERIC_FIELDS)
+    windows = [None] * len(NUMERIC_FIELDS)
+    records = []
+
+    for index in range(count):
+        # Timestamp: delta of delta modulo 2^32
+        if version == 1:
+            has_milliseconds = False
+            if index == 0:
+                time = reader.read(32)
+            else:
+                delta_of_delta = read_delta_of_delta(reader, (0, 7, 9, 12))
+                if delta_of_delta is None:
+                    delta_of_delta = reader.read_signed(32)
+                delta = (delta + delta_of_delta) & 0xFFFFFFFF
+                time = (time + delta) & 0xFFFFFFFF
+            seconds, milliseconds = time, None
+        else:
+            has_milliseconds = reader.read(1) == 1
+            delta_of_delta = None if index == 0 else read_delta_of_delta(reader, (0, 7, 12, 17))
+            if delta_of_delta is None:
+                # Absolute time, the next delta is taken from 0
+                seconds = reader.read(32)
+                time = seconds * 1000 + reader.read(10)
+                delta = 0
+            else:
+                # In ms, or in seconds for the times without milliseconds
+                delta = (delta + delta_of_delta) & 0xFFFFFFFF
+                time += delta * (1 if has_milliseconds else 1000)
+            seconds, milliseconds = divmod(time, 1000)
+            if not has_milliseconds:
+                milliseconds = None
+
+        # Text fields, stored when they change
+        for field in range(len(TEXT_FIELDS)):
+            if reader.read(1):
+                reader.align()
+                length = reader.read(16)
+                texts[field] = json.loads(reader.read_bytes(length).decode())
+            elif index == 0:
+                raise ValueError("first record without its text fields")
+
+        # Numeric fields: XOR with the previous value
+        for field in range(len(NUMERIC_FIELDS)):
+            if reader.read(1) == 0:
+                continue
+            if reader.read(1) == 0:
+                if windows[field] is None:
+                    raise ValueError("XOR window used before it was set")
+                leading, trailing = windows[field]
+            else:
+                leading = reader.read(5)
+                meaningful = reader.read(5) + 1
+                trailing = 32 - leading - meaningful
+                windows[field] = (leading, trailing)
+            xor = reader.read(32 - leading - trailing) << trailing
+            values[field] ^= xor
+
+        sensor_value = dict(zip(TEXT_FIELDS, texts))
+        sensor_value.update(zip(NUMERIC_FIELDS, (float32_value(bits) for bits in values)))
+        records.append({
+            "sensor_value": {key: sensor_value[key] for key in FIELD_ORDER},
+            "timestamp": format_timestamp(seconds, milliseconds),
+        })
+    return records
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 1
+    with open(sys.argv[1], "rb") as file:
+        data = file.read()
+    position = 0
+    while position + 2 <= len(data):
+        length = struct.unpack(">H", data[position:position + 2])[0]
+        for record in decode_block(data[position + 2:position + 2 + length]):
+            print(json.dumps(record))
+        position += 2 + length
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())